@@ -0,0 +1,298 @@
+/*
+	audio_frontend_bench.c
+
+	Runs the audio front end (src/audio_frontend.h) on simulated ADC samples, the way the ADC DMA delivers them: round
+	robin over both inputs at 384kS/s, 12 bits, with a DC offset and white noise on top (-n, in LSB), AUDIO_BLOCK_SAMPLES
+	output samples at a time. It reports:
+	-SNR (everything that isn't the tone, DC excluded) for tones across the audio band, against the same ADC sampled
+	 directly at 48kHz, which is what the oversampling and filtering have to beat
+	-the frequency response from 20Hz to 22kHz, and how far tones above 24kHz come through (aliases included)
+	-what's left of the DC offset after the DC blocker has settled, and how long it takes
+	-the time per block on this machine, and an estimate of the RP2040 cycles per block from the instructions of
+	 every stage (Cortex-M0+, code and data in RAM, no bus contention), against the time there is at -c MHz
+	Tones are measured by projecting on sine and cosine over a whole number of periods, after 200ms for the filters
+	to settle.
+
+	Build: gcc -O2 -o audio_frontend_bench audio_frontend_bench.c -lm
+	Usage: ./audio_frontend_bench [options]
+	-n lsb        ADC noise, standard deviation (default 1.0)
+	-a dbfs       tone level (default -1)
+	-d lsb        DC offset from mid scale (default 100)
+	-g gain       gain, Q8 (default 256)
+	-c mhz        system clock (default 294)
+	-t blocks     blocks to time (default 20000)
+	-s seed       noise seed
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_util.h"
+#include "../src/audio_frontend.h"
+
+// Cycle estimates, per ADC sample of one channel for the CIC input side.
+// ldrh (2), lsl/lsr for the mask (2), sub (1), 4 adds, pointer add, plus the loop
+#define CYC_CIC_IN 11
+// Per CIC output: 4 combs of ldr/sub/str/mov with the state in memory (6 each), strh (2), loop (3)
+#define CYC_CIC_OUT 29
+// Per tap pair of the FIR: 2 ldrsh (4), add, ldrsh of the tap (2), mul, add; unrolled
+#define CYC_FIR_PAIR 9
+// Per FIR output: the center tap, the shift, the store and the loop
+#define CYC_FIR_OUT 14
+// Per output sample of the DC blocker and gain: 2 shifts, sub, add, mul, 2 compares for the saturation, strh, loop
+#define CYC_DC_OUT 20
+// Per block and channel: moving the FIR history (30 halfwords), the state and the calls
+#define CYC_CHANNEL_BLOCK 110
+
+#define SETTLE_SAMPLES (AUDIO_SAMPLE_RATE/5)
+#define MEASURE_SAMPLES (AUDIO_SAMPLE_RATE/2) // tones at even Hz fit a whole number of periods
+#define RAW_RATE (AUDIO_SAMPLE_RATE*AUDIO_OVERSAMPLE*2)
+
+struct tone_t
+{
+	double freq; // input
+	double level; // peak, in ADC LSB
+	double dc; // offset from mid scale, in ADC LSB
+	double noise;
+};
+
+static double noise_lsb = 1.0;
+static double tone_dbfs = -1;
+static double dc_lsb = 100;
+static int32_t gain = AUDIO_GAIN_UNITY;
+
+static double gaussian(void)
+{
+	double u = (rng()+1.0)/4294967297.0, v = rng()/4294967296.0;
+	return sqrt(-2*log(u))*cos(2*M_PI*v);
+}
+
+static uint16_t adc_sample(const struct tone_t *t, uint64_t n)
+{
+	// Input 1 comes one ADC sample after input 0
+	double v = AUDIO_ADC_MID+t->dc+t->level*sin(2*M_PI*t->freq*n/RAW_RATE);
+	if(t->noise>0)
+		v += t->noise*gaussian();
+	long q = lrint(v);
+	return q<0 ? 0 : q>4095 ? 4095 : q;
+}
+
+// Runs the front end on the tone and keeps SETTLE_SAMPLES+samples output samples of channel 0 (channel 1 too, if r)
+static void run(const struct tone_t *t, int samples, double *l, double *r, double *direct)
+{
+	static struct audio_frontend_t af;
+	uint16_t adc[AUDIO_ADC_BLOCK];
+	int16_t out[2*AUDIO_BLOCK_SAMPLES];
+	int total = SETTLE_SAMPLES+samples;
+	uint64_t n = 0;
+	audio_frontend_init(&af, gain);
+	for(int pos=0; pos<total; pos+=AUDIO_BLOCK_SAMPLES)
+	{
+		int count = total-pos<AUDIO_BLOCK_SAMPLES ? total-pos : AUDIO_BLOCK_SAMPLES;
+		for(int i=0; i<count*AUDIO_OVERSAMPLE*2; i++)
+			adc[i] = adc_sample(t, n++);
+		audio_frontend_process(&af, adc, out, count);
+		for(int i=0; i<count; i++)
+		{
+			l[pos+i] = out[2*i];
+			if(r)
+				r[pos+i] = out[2*i+1];
+			// Sampling input 0 straight at 48kHz, scaled like the output
+			if(direct)
+				direct[pos+i] = ((int)adc[i*AUDIO_OVERSAMPLE*2]-AUDIO_ADC_MID)*16.0*gain/AUDIO_GAIN_UNITY;
+		}
+	}
+}
+
+// Amplitude of freq in x (a whole number of periods), and the power of everything else but DC
+static double fit(const double *x, int count, double freq, double *rest)
+{
+	double s = 0, c = 0, m = 0;
+	for(int i=0; i<count; i++)
+	{
+		double w = 2*M_PI*freq*i/AUDIO_SAMPLE_RATE;
+		s += x[i]*sin(w);
+		c += x[i]*cos(w);
+		m += x[i];
+	}
+	s *= 2.0/count;
+	c *= 2.0/count;
+	m /= count;
+	double e = 0;
+	for(int i=0; i<count; i++)
+	{
+		double w = 2*M_PI*freq*i/AUDIO_SAMPLE_RATE;
+		double d = x[i]-m-s*sin(w)-c*cos(w);
+		e += d*d;
+	}
+	*rest = e/count;
+	return sqrt(s*s+c*c);
+}
+
+static double db(double x)
+{
+	return 20*log10(x>1e-12 ? x : 1e-12);
+}
+
+static void snr_table(double *l, double *r, double *direct)
+{
+	static const double freqs[] = {100, 1000, 5000, 10000, 15000, 19000};
+	double level = 2047*pow(10, tone_dbfs/20);
+	printf("SNR, %.1fdBFS tone, %.2f LSB noise, DC offset %.0f LSB:\n", tone_dbfs, noise_lsb, dc_lsb);
+	printf("%8s %10s %10s %10s %8s\n", "Hz", "left dB", "right dB", "48k dB", "gain");
+	for(unsigned f=0; f<sizeof(freqs)/sizeof(freqs[0]); f++)
+	{
+		struct tone_t t = {freqs[f], level, dc_lsb, noise_lsb};
+		double rest_l, rest_r, rest_d;
+		run(&t, MEASURE_SAMPLES, l, r, direct);
+		double a_l = fit(l+SETTLE_SAMPLES, MEASURE_SAMPLES, freqs[f], &rest_l);
+		double a_r = fit(r+SETTLE_SAMPLES, MEASURE_SAMPLES, freqs[f], &rest_r);
+		double a_d = fit(direct+SETTLE_SAMPLES, MEASURE_SAMPLES, freqs[f], &rest_d);
+		printf("%8.0f %10.1f %10.1f %10.1f %7.2fx\n", freqs[f], db(a_l/sqrt(2*rest_l)), db(a_r/sqrt(2*rest_r)),
+			db(a_d/sqrt(2*rest_d)), a_l/(level*16*gain/AUDIO_GAIN_UNITY));
+	}
+}
+
+static void response_table(double *l)
+{
+	static const double pass[] = {20, 50, 100, 1000, 5000, 10000, 15000, 18000, 20000, 21000, 22000};
+	static const double stop[] = {26000, 28000, 32000, 40000, 56000, 68000, 72000, 76000, 90000};
+	double level = 1024;
+	struct tone_t t = {0, level, 0, 0};
+	printf("\nResponse (no noise, -6dBFS):\n%8s %8s\n", "Hz", "dB");
+	for(unsigned f=0; f<sizeof(pass)/sizeof(pass[0]); f++)
+	{
+		double rest;
+		t.freq = pass[f];
+		run(&t, MEASURE_SAMPLES, l, NULL, NULL);
+		printf("%8.0f %8.2f\n", pass[f], db(fit(l+SETTLE_SAMPLES, MEASURE_SAMPLES, pass[f], &rest)/(level*16)));
+	}
+	printf("\nAbove 24kHz (everything that comes out, aliases included):\n%8s %8s\n", "Hz", "dB");
+	for(unsigned f=0; f<sizeof(stop)/sizeof(stop[0]); f++)
+	{
+		double power = 0;
+		t.freq = stop[f];
+		run(&t, MEASURE_SAMPLES, l, NULL, NULL);
+		for(int i=SETTLE_SAMPLES; i<SETTLE_SAMPLES+MEASURE_SAMPLES; i++)
+			power += l[i]*l[i];
+		printf("%8.0f %8.1f\n", stop[f], db(sqrt(2*power/MEASURE_SAMPLES)/(level*16)));
+	}
+}
+
+static void dc_table(double *l)
+{
+	static const double offsets[] = {-500, -100, 100, 500};
+	int total = AUDIO_SAMPLE_RATE;
+	printf("\nDC offset (no noise, no tone), after %dms:\n%8s %8s %8s %10s\n", SETTLE_SAMPLES*1000/AUDIO_SAMPLE_RATE,
+		"LSB in", "mean", "max", "settled ms");
+	for(unsigned o=0; o<sizeof(offsets)/sizeof(offsets[0]); o++)
+	{
+		struct tone_t t = {0, 0, offsets[o], 0};
+		double mean = 0, max = 0;
+		int settled = 0;
+		run(&t, total-SETTLE_SAMPLES, l, NULL, NULL);
+		for(int i=0; i<total; i++)
+		{
+			if(fabs(l[i])>=1)
+				settled = i+1;
+			if(i>=SETTLE_SAMPLES)
+			{
+				mean += l[i];
+				if(fabs(l[i])>max)
+					max = fabs(l[i]);
+			}
+		}
+		printf("%8.0f %8.2f %8.0f %10.1f\n", offsets[o], mean/(total-SETTLE_SAMPLES), max,
+			settled*1000.0/AUDIO_SAMPLE_RATE);
+	}
+}
+
+static void cycle_table(int blocks, double mhz)
+{
+	static struct audio_frontend_t af;
+	static uint16_t adc[AUDIO_ADC_BLOCK];
+	int16_t out[2*AUDIO_BLOCK_SAMPLES];
+	struct tone_t t = {1000, 1000, dc_lsb, noise_lsb};
+	for(int i=0; i<AUDIO_ADC_BLOCK; i++)
+		adc[i] = adc_sample(&t, i);
+	audio_frontend_init(&af, gain);
+	double start = now();
+	for(int b=0; b<blocks; b++)
+		audio_frontend_process(&af, adc, out, AUDIO_BLOCK_SAMPLES);
+	double host = (now()-start)/blocks;
+
+	int cic_in = AUDIO_BLOCK_SAMPLES*AUDIO_OVERSAMPLE, cic_out = AUDIO_BLOCK_SAMPLES*AUDIO_FIR_DECIMATE;
+	uint32_t cic = cic_in*CYC_CIC_IN+cic_out*CYC_CIC_OUT;
+	uint32_t fir = AUDIO_BLOCK_SAMPLES*(AUDIO_FIR_TAPS/2*CYC_FIR_PAIR+CYC_FIR_OUT);
+	uint32_t dc = AUDIO_BLOCK_SAMPLES*CYC_DC_OUT;
+	uint32_t total = 2*(cic+fir+dc+CYC_CHANNEL_BLOCK);
+	double block_time = (double)AUDIO_BLOCK_SAMPLES/AUDIO_SAMPLE_RATE;
+	printf("\nBlock of %d stereo samples (%.1fms):\n", AUDIO_BLOCK_SAMPLES, block_time*1000);
+	printf("Host: %.2fus per block\n", host*1e6);
+	printf("RP2040 estimate:\n%12s %8s %8s\n", "stage", "cycles", "share");
+	printf("%12s %8u %7.1f%%\n", "CIC", 2*cic, 100.0*2*cic/total);
+	printf("%12s %8u %7.1f%%\n", "FIR", 2*fir, 100.0*2*fir/total);
+	printf("%12s %8u %7.1f%%\n", "DC/gain", 2*dc, 100.0*2*dc/total);
+	printf("%12s %8u %7.1f%%\n", "overhead", 2*CYC_CHANNEL_BLOCK, 100.0*2*CYC_CHANNEL_BLOCK/total);
+	printf("%12s %8u\n", "total", total);
+	printf("%.0f cycles per stereo sample, %.1f%% of one core at %.0fMHz\n", (double)total/AUDIO_BLOCK_SAMPLES,
+		100.0*total/(block_time*mhz*1e6), mhz);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, blocks = 20000;
+	double mhz = 294;
+	while((opt = getopt(argc, argv, "n:a:d:g:c:t:s:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'n':
+			noise_lsb = atof(optarg);
+			break;
+		case 'a':
+			tone_dbfs = atof(optarg);
+			break;
+		case 'd':
+			dc_lsb = atof(optarg);
+			break;
+		case 'g':
+			gain = atoi(optarg);
+			break;
+		case 'c':
+			mhz = atof(optarg);
+			break;
+		case 't':
+			blocks = atoi(optarg);
+			break;
+		case 's':
+			rng_state = strtoul(optarg, NULL, 0) | 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n lsb] [-a dbfs] [-d lsb] [-g gain] [-c mhz] [-t blocks] [-s seed]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(gain<0 || gain>AUDIO_GAIN_MAX)
+	{
+		fprintf(stderr, "Gain has to be 0-%d\n", AUDIO_GAIN_MAX);
+		return 1;
+	}
+	int total = SETTLE_SAMPLES+AUDIO_SAMPLE_RATE;
+	double *l = malloc(total*sizeof(double)), *r = malloc(total*sizeof(double)), *direct = malloc(total*sizeof(double));
+	if(!l || !r || !direct)
+		return 1;
+	snr_table(l, r, direct);
+	response_table(l);
+	dc_table(l);
+	cycle_table(blocks, mhz);
+	free(l);
+	free(r);
+	free(direct);
+	return 0;
+}
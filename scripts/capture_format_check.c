@@ -0,0 +1,325 @@
+/*
+	capture_format_check.c
+
+	Compares the 2 capture formats for the 15-bit '541 board: lcd_capture (src/lcd_cap_15bpp_mux.pio, 2 pixels per word,
+	which the encoder has to separate into channels first) and lcd_capture_lut (src/lcd_cap_lut.pio, one LUT-ready byte
+	per channel, which goes straight into the lookup.)
+
+	Both programs run in pio_emu on random pixels from lcd_trace.c, with the 2 buffers modeled in the GPIO callback: the
+	data pins show the buffer whose OE is low, and nothing useful (all ones) for a settle time after either OE changes,
+	or while none or both are enabled. Every captured word is checked against the pixels that were sent, and every line is
+	then encoded both ways (tmds_encode_line() and tmds_encode_line_bytes()), which have to give the same TMDS words.
+
+	It reports, for each format:
+	-PIO: instructions and busy cycles per pixel, and the fewest system clocks per LCD dot it still captures correctly at
+	 (found by going down from -c until it doesn't)
+	-CPU: cycles per line for the encode, with the same estimates as encode_split_sim.c
+	-memory: words a line, and bytes for 2 framebuffers
+
+	Options: -c system clocks per dot (70 is 294MHz for the GBA's 4.19MHz), -l lines, -o OE settle time in cycles,
+	-s seed, -d path to src.
+
+	Build: gcc -O2 -o capture_format_check capture_format_check.c lcd_trace.c pio_emu.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./capture_format_check [-c 70] [-l 8] [-o 5] [-s seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "pio_emu.h"
+#include "lcd_trace.h"
+#include "tmds_util.h"
+#define RNG_SEED 12345
+#include "host_util.h"
+#include "../src/tmds_channel_encode.h"
+
+#define WIDTH TMDS_LINE_PIXELS
+#define MAX_LINES 160
+#define FB_HEIGHT 160
+// The trace puts the 15-bit pixel on pins that don't exist on the RP2040, and the '541 model moves it to GP2-GP9.
+#define PIXEL_PINS 16
+#define DATA_BASE 2
+#define OE_PINS 3u // OE1 is GP0, OE2 is GP1
+
+// Same estimates as encode_split_sim.c, per pixel and channel, and per group of 16.
+#define CYC_SEPARATE 7
+#define CYC_LOOKUP 8
+#define CYC_PACK 4
+#define CYC_GROUP (30+6)
+// LUT bytes: the ldrb of the capture buffer goes straight to GetTMDSDisparity, without the lsl
+#define CYC_LOOKUP_BYTES 7
+
+enum format_t
+{
+	FORMAT_PAIRS,
+	FORMAT_BYTES
+};
+
+struct format_info_t
+{
+	const char *file, *program, *name;
+	bool shift_right;
+	int line_words;
+	int cycles_per_pixel; // CPU, per channel
+};
+
+static const struct format_info_t formats[2] =
+{
+	{"lcd_cap_15bpp_mux.pio", "lcd_capture", "2 pixels per word", false, TMDS_FB_LINE_WORDS,
+		CYC_SEPARATE+CYC_LOOKUP+CYC_PACK},
+	{"lcd_cap_lut.pio", "lcd_capture_lut", "LUT bytes", true, TMDS_FB_LINE_BYTES_LUT/4, CYC_LOOKUP_BYTES+CYC_PACK},
+};
+
+struct mux_t
+{
+	struct lcd_trace_t trace;
+	uint32_t last_oe;
+	uint64_t oe_changed;
+	int settle;
+	uint64_t contention; // cycles with both buffers enabled
+};
+
+static uint16_t pixels[MAX_LINES][WIDTH];
+static int lines = 8;
+static int oe_settle = 5; // 14ns at 294MHz, rounded up
+
+static uint16_t pixel_at(void *ctx, int frame, int line, int x)
+{
+	(void)ctx;
+	return (frame==0 && line<lines) ? pixels[line][x] : 0;
+}
+
+// The 2 74AHC541 buffers between the LCD and GP2-GP9
+static uint32_t mux_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs)
+{
+	struct mux_t *m = (struct mux_t *)ctx;
+	uint32_t level = lcd_trace_gpio(&m->trace, cycle, outputs, pindirs);
+	uint32_t pixel = (level>>PIXEL_PINS)&0x7fff;
+	level &= ~(0x7fffu<<PIXEL_PINS);
+
+	uint32_t oe = outputs&OE_PINS;
+	if(oe!=m->last_oe)
+	{
+		m->last_oe = oe;
+		m->oe_changed = cycle;
+	}
+	uint32_t bus = 0xff;
+	if(oe==0)
+		m->contention++;
+	else if(cycle-m->oe_changed>=(uint64_t)m->settle)
+	{
+		if(oe==2)
+			bus = pixel&0xff;
+		else if(oe==1)
+			bus = pixel>>8;
+	}
+	return level|(bus<<DATA_BASE);
+}
+
+struct format_result_t
+{
+	bool ok;
+	uint32_t words;
+	uint64_t contention;
+	double instr_per_pixel, busy_per_pixel;
+	uint32_t first_bad;
+};
+
+// What the words of a format should be for the pixels that were sent
+static void expected_line(enum format_t format, int line, uint32_t *out)
+{
+	if(format==FORMAT_PAIRS)
+	{
+		for(int i=0; i<WIDTH; i+=2)
+			out[i>>1] = ((uint32_t)pixels[line][i]<<16)|pixels[line][i+1];
+		return;
+	}
+	uint32_t fb_line[TMDS_FB_LINE_WORDS];
+	expected_line(FORMAT_PAIRS, line, fb_line);
+	tmds_pixels_to_bytes(fb_line, (uint8_t *)out, WIDTH);
+}
+
+static void capture(const struct pio_program_t *prog, const struct format_info_t *f, enum format_t format,
+	int cycles_per_dot, uint32_t *words, struct format_result_t *res)
+{
+	static struct mux_t mux;
+	struct lcd_timing_t timing;
+	lcd_timing_gba(&timing);
+	memset(res, 0, sizeof(struct format_result_t));
+	lcd_trace_init(&mux.trace, &timing, cycles_per_dot, 0, 0, 1);
+	mux.trace.data_base = PIXEL_PINS;
+	mux.trace.data_bits = 15;
+	mux.trace.pixel = pixel_at;
+	mux.last_oe = OE_PINS;
+	mux.oe_changed = 0;
+	mux.settle = oe_settle;
+	mux.contention = 0;
+
+	struct pio_emu_t emu;
+	pio_emu_init(&emu);
+	emu.read_gpio = mux_gpio;
+	emu.ctx = &mux;
+	emu.pins = OE_PINS;
+	int offset = pio_emu_load(&emu, prog, -1);
+	struct pio_sm_config_t cfg;
+	pio_sm_default_config(&cfg);
+	cfg.in_base = DATA_BASE;
+	cfg.set_base = 0;
+	cfg.set_count = 2;
+	cfg.in_shift_right = f->shift_right;
+	cfg.out_shift_right = true;
+	cfg.autopush = true;
+	cfg.push_threshold = 32;
+	pio_sm_start(&emu, 0, prog, offset, 0, &cfg);
+
+	// Runs into the hblank of the last line, to see that nothing else comes out
+	uint32_t max_words = (uint32_t)(lines*f->line_words);
+	uint64_t end = ((uint64_t)(lines-1)*timing.dots_per_line+timing.width+8)*(uint64_t)cycles_per_dot;
+	while(emu.cycle<end)
+	{
+		pio_emu_step(&emu);
+		uint32_t w;
+		while(pio_sm_get(&emu, 0, &w))
+		{
+			if(res->words<max_words)
+				words[res->words] = w;
+			res->words++;
+		}
+	}
+	lcd_trace_free(&mux.trace);
+
+	struct pio_sm_t *s = &emu.sm[0];
+	double captured = (double)lines*WIDTH;
+	res->instr_per_pixel = (double)s->exec_count/captured;
+	res->busy_per_pixel = (double)(s->exec_count+s->delay_cycles)/captured;
+	res->contention = mux.contention;
+	res->ok = res->words==max_words && !mux.contention;
+	res->first_bad = res->words;
+	for(int l=0; l<lines && res->ok; l++)
+	{
+		uint32_t expect[TMDS_FB_LINE_BYTES_LUT/4];
+		expected_line(format, l, expect);
+		for(int i=0; i<f->line_words; i++)
+		{
+			if(words[l*f->line_words+i]!=expect[i])
+			{
+				res->ok = false;
+				res->first_bad = (uint32_t)(l*f->line_words+i);
+				break;
+			}
+		}
+	}
+}
+
+// Encodes every line from both captures, and checks that the TMDS words are the same.
+static bool encode_check(const uint32_t *tmds_lut, const uint32_t *pairs, const uint32_t *bytes)
+{
+	static uint32_t lane_a[3][TMDS_LINE_WORDS], lane_b[3][TMDS_LINE_WORDS];
+	uint32_t *a[3] = {lane_a[0], lane_a[1], lane_a[2]};
+	uint32_t *b[3] = {lane_b[0], lane_b[1], lane_b[2]};
+	uint8_t values[TMDS_LINE_PIXELS];
+	for(int l=0; l<lines; l++)
+	{
+		tmds_encode_line(tmds_lut, pairs+l*TMDS_FB_LINE_WORDS, a, values);
+		tmds_encode_line_bytes(tmds_lut, (const uint8_t *)(bytes+l*(TMDS_FB_LINE_BYTES_LUT/4)), b);
+		if(memcmp(lane_a, lane_b, sizeof(lane_a)))
+		{
+			printf("Line %d encodes differently from the 2 formats\n", l);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int cpu_line_cycles(const struct format_info_t *f)
+{
+	return 3*(WIDTH*f->cycles_per_pixel+(WIDTH/TMDS_PACK_GROUP)*CYC_GROUP);
+}
+
+int main(int argc, char **argv)
+{
+	const char *src_dir = "../src";
+	int cycles_per_dot = 70;
+	int opt;
+	while((opt = getopt(argc, argv, "c:l:o:s:d:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'c': cycles_per_dot = atoi(optarg)&~1; break;
+			case 'l': lines = atoi(optarg); break;
+			case 'o': oe_settle = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "See the top of capture_format_check.c for the options.\n");
+				return 1;
+		}
+	}
+	if(lines<1 || lines>MAX_LINES || cycles_per_dot<4)
+	{
+		fprintf(stderr, "1 to %d lines, at least 4 cycles per dot\n", MAX_LINES);
+		return 1;
+	}
+	for(int l=0; l<lines; l++)
+	{
+		for(int x=0; x<WIDTH; x++)
+			pixels[l][x] = (uint16_t)(rng()&0x7fff);
+	}
+
+	static struct pio_program_t programs[2][PIO_MAX_PROGRAMS];
+	static uint32_t words[2][MAX_LINES*(TMDS_FB_LINE_BYTES_LUT/4)];
+	uint32_t *tmds_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(tmds_lut);
+
+	printf("%d lines of random pixels, %d cycles per dot, OE settles in %d cycles\n\n", lines, cycles_per_dot, oe_settle);
+	printf("%-18s %8s %8s %10s %9s %11s %12s\n", "format", "instr/px", "busy/px", "min clk/dot", "CPU/line",
+		"words/line", "2 frames");
+	bool ok = true;
+	for(int f=0; f<2; f++)
+	{
+		const struct format_info_t *info = &formats[f];
+		const struct pio_program_t *prog = pio_load_program(src_dir, info->file, info->program, NULL, 0, programs[f]);
+		if(!prog)
+		{
+			ok = false;
+			continue;
+		}
+		struct format_result_t res;
+		capture(prog, info, (enum format_t)f, cycles_per_dot, words[f], &res);
+		if(!res.ok)
+		{
+			printf("%-18s FAIL: %u of %d words, first wrong one %u, %llu cycles with both buffers on\n",
+				info->name, res.words, lines*info->line_words, res.first_bad, (unsigned long long)res.contention);
+			ok = false;
+			continue;
+		}
+		int min_dot = cycles_per_dot;
+		static uint32_t scratch[MAX_LINES*(TMDS_FB_LINE_BYTES_LUT/4)];
+		for(int c=cycles_per_dot-2; c>=4; c-=2)
+		{
+			struct format_result_t r;
+			capture(prog, info, (enum format_t)f, c, scratch, &r);
+			if(!r.ok)
+				break;
+			min_dot = c;
+		}
+		printf("%-18s %8.1f %8.1f %10d %9d %11d %10.1fKB\n", info->name, res.instr_per_pixel, res.busy_per_pixel,
+			min_dot, cpu_line_cycles(info), info->line_words, 2.0*info->line_words*4*FB_HEIGHT/1024.0);
+	}
+	if(ok)
+	{
+		ok = encode_check(tmds_lut, words[FORMAT_PAIRS], words[FORMAT_BYTES]);
+		if(ok)
+			printf("\nBoth formats encode to the same TMDS words\n");
+		int saved = cpu_line_cycles(&formats[FORMAT_PAIRS])-cpu_line_cycles(&formats[FORMAT_BYTES]);
+		printf("LUT bytes save %d CPU cycles a line (%.0f%%), for %.1fKB more SRAM\n", saved,
+			100.0*saved/cpu_line_cycles(&formats[FORMAT_PAIRS]),
+			2.0*(formats[FORMAT_BYTES].line_words-formats[FORMAT_PAIRS].line_words)*4*FB_HEIGHT/1024.0);
+	}
+	free(tmds_lut);
+	printf("\n%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
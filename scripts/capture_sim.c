@@ -0,0 +1,410 @@
+/*
+	capture_sim.c
+
+	Runs the LCD capture through power-on, resets and link cable glitches, and checks that the encoder only ever shows
+	whole frames. src/lcd_cap_9bpp.pio and src/vsync.pio (V on GP11) run in pio_emu on signals from lcd_trace.c, channels
+	8 and 9 are modeled the way capture_manager.c sets them up, and src/capture_manager.h decides where every frame goes.
+	The encoder side reads one framebuffer line every 3 output lines at the 720x480 frame rate, and every line it reads is
+	checked against the pattern the trace sent: all lines of a shown frame have to come from the same LCD frame, and that
+	frame has to be one the LCD sent all of.
+
+	Scenarios (-t, all of them by default):
+	-power: the LCD comes up partway through a frame, after a while without signals
+	-reset: the console is reset 3 times, partway through a frame, and comes back at a random line
+	-link: a link cable is pulled out: bursts of spurious and lost pixel clocks, then a brown-out reset
+	-drift: no glitches, but the output runs at 60.5Hz so the two frame rates go through every phase; this is the one
+	        that makes the capture go into the buffer the encoder holds, or into the sink
+
+	Options: -b buffers (2 or 3), -f LCD frames per scenario, -c emulator cycles per dot, -r output frame rate,
+	-l safe lines, -i vsync IRQ latency in cycles, -s seed, -v (print every vsync), -d path to src.
+
+	Build: gcc -O2 -o capture_sim capture_sim.c lcd_trace.c pio_emu.c
+	Usage: ./capture_sim [-t power|reset|link|drift] [-b 2] [-f 40] [-v]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "pio_emu.h"
+#include "lcd_trace.h"
+#include "host_util.h"
+#include "../src/capture_manager.h"
+
+#define CAPTURE_SM 0
+#define VSYNC_SM 1
+#define VSYNC_PIN 11
+#define OUT_LINES 539
+#define OUT_FRAME_HZ (29400000.0/(912.0*539.0))
+#define MAX_EVENTS 64
+#define MAX_FRAMES 1000
+
+struct scenario_t
+{
+	const char *name;
+	int off_dots, start_line;
+	double out_hz;
+	struct lcd_event_t events[MAX_EVENTS];
+	int event_count;
+};
+
+struct sim_t
+{
+	struct pio_emu_t emu;
+	struct lcd_trace_t trace;
+	struct capture_manager_t mgr;
+	uint32_t *buffers[CAPTURE_MAX_BUFFERS];
+	bool filled[CAPTURE_MAX_BUFFERS];
+	const struct pio_program_t *capture_prog;
+	int capture_offset;
+	struct pio_sm_config_t capture_cfg;
+	// Channel 8 and 9
+	uint32_t dma_words, sink;
+	uint64_t irq_at;
+	bool irq_pending;
+	// Encoder
+	double line_cycles, next_line;
+	int out_line;
+	int held;
+	int first_id;
+	bool mixed, garbage;
+	// Results
+	uint32_t shown, blank, whole, mixed_frames, garbage_frames, dirty_frames;
+	uint32_t torn; // the manager's count, for the frames that were checked
+	bool shown_id[MAX_FRAMES];
+};
+
+static struct pio_program_t programs[2][PIO_MAX_PROGRAMS];
+static int buffers = 2;
+static int lcd_frames = 40;
+static int cycles_per_dot = 8;
+static int safe_lines = CAPTURE_SAFE_LINES;
+static int irq_latency = 200;
+static double out_hz = OUT_FRAME_HZ;
+static bool verbose;
+
+static int rng_range(int lo, int hi)
+{
+	return lo+(int)(rng()%(uint32_t)(hi-lo+1));
+}
+
+static void add_event(struct scenario_t *sc, enum lcd_event_kind_t kind, int frame, int line, int x, int dots, int restart)
+{
+	if(sc->event_count>=MAX_EVENTS)
+		return;
+	struct lcd_event_t *ev = &sc->events[sc->event_count++];
+	ev->kind = kind;
+	ev->frame = frame;
+	ev->line = line;
+	ev->x = x;
+	ev->dots = dots;
+	ev->restart_line = restart;
+}
+
+// Events have to be in order, at positions the LCD gets to. Frames after an OFF event start at its restart line,
+// so nothing goes into the frame right after one.
+static void build_scenario(struct scenario_t *sc, const char *name, const struct lcd_timing_t *tm)
+{
+	int frame_dots = tm->dots_per_line*tm->lines_per_frame;
+	memset(sc, 0, sizeof(struct scenario_t));
+	sc->name = name;
+	sc->out_hz = out_hz;
+	sc->start_line = 0;
+	if(!strcmp(name, "power"))
+	{
+		sc->off_dots = rng_range(frame_dots/4, 2*frame_dots);
+		sc->start_line = rng_range(1, tm->lines_per_frame-1);
+		// Switched off and on again halfway through
+		int f = lcd_frames/2;
+		add_event(sc, LCD_EVENT_OFF, f, rng_range(0, tm->height-1), rng_range(0, tm->dots_per_line-1),
+			rng_range(frame_dots, 3*frame_dots), rng_range(0, tm->lines_per_frame-1));
+	}
+	else if(!strcmp(name, "reset"))
+	{
+		for(int i=1; i<=3; i++)
+		{
+			int f = i*lcd_frames/4;
+			add_event(sc, LCD_EVENT_OFF, f, rng_range(0, tm->lines_per_frame-1), rng_range(0, tm->dots_per_line-1),
+				rng_range(tm->dots_per_line, frame_dots/2), rng_range(0, tm->lines_per_frame-1));
+		}
+	}
+	else if(!strcmp(name, "link"))
+	{
+		// A few frames of contact bounce, with spurious and lost clocks on some of the lines
+		int f = lcd_frames/4;
+		for(int frame=f; frame<f+3; frame++)
+		{
+			int line = rng_range(0, 20);
+			while(line<tm->height)
+			{
+				bool extra = rng()&1;
+				add_event(sc, extra ? LCD_EVENT_EXTRA_CLOCKS : LCD_EVENT_LOST_CLOCKS, frame, line,
+					rng_range(0, tm->width-1), extra ? rng_range(1, 40) : rng_range(1, 400), 0);
+				line += rng_range(10, 60);
+			}
+		}
+		// and the console browning out a bit later
+		add_event(sc, LCD_EVENT_OFF, lcd_frames/2, rng_range(0, tm->height-1), rng_range(0, tm->dots_per_line-1),
+			rng_range(frame_dots/8, frame_dots), rng_range(0, tm->lines_per_frame-1));
+	}
+	else if(!strcmp(name, "drift"))
+		sc->out_hz = 60.5;
+}
+
+static bool load_programs(struct sim_t *sim, const char *src_dir)
+{
+	struct pio_define_t define = {"V", VSYNC_PIN};
+	const struct pio_program_t *capture = pio_load_program(src_dir, "lcd_cap_9bpp.pio", "lcd_cap_9bpp", NULL, 0,
+		programs[0]);
+	const struct pio_program_t *vsync = pio_load_program(src_dir, "vsync.pio", "vsync_interruptor", &define, 1,
+		programs[1]);
+	if(!capture || !vsync)
+		return false;
+
+	pio_emu_init(&sim->emu);
+	sim->capture_prog = capture;
+	sim->capture_offset = pio_emu_load(&sim->emu, capture, -1);
+	int vsync_offset = pio_emu_load(&sim->emu, vsync, -1);
+	if(sim->capture_offset<0 || vsync_offset<0)
+	{
+		fprintf(stderr, "Programs don't fit\n");
+		return false;
+	}
+	pio_sm_default_config(&sim->capture_cfg);
+	sim->capture_cfg.in_base = 0;
+	sim->capture_cfg.in_shift_right = false;
+	sim->capture_cfg.push_threshold = 32;
+	pio_sm_start(&sim->emu, CAPTURE_SM, capture, sim->capture_offset, 0, &sim->capture_cfg);
+	struct pio_sm_config_t cfg;
+	pio_sm_default_config(&cfg);
+	pio_sm_start(&sim->emu, VSYNC_SM, vsync, vsync_offset, 0, &cfg);
+	return true;
+}
+
+// capture_vsync_irq() in capture_manager.c
+static void vsync_irq(struct sim_t *sim)
+{
+	uint32_t words = sim->dma_words;
+	pio_sm_start(&sim->emu, CAPTURE_SM, sim->capture_prog, sim->capture_offset, 0, &sim->capture_cfg);
+	int old = sim->mgr.target;
+	int target = capture_vsync(&sim->mgr, words);
+	if(sim->mgr.last_result==CAPTURE_COMPLETE)
+		sim->filled[old] = true;
+	sim->dma_words = 0;
+	if(verbose)
+	{
+		static const char *results[] = {"complete", "short", "long", "dropped"};
+		printf("  vsync %4u: %5u words, %-8s -> %s%c  (encoder %s line %d)\n", sim->mgr.vsyncs, words,
+			results[sim->mgr.last_result], target==CAPTURE_SINK ? "sink" : "buffer ", target==CAPTURE_SINK ? ' ' : '0'+target,
+			sim->mgr.held>=0 ? "at" : "between frames,", sim->mgr.encoder_line);
+	}
+}
+
+static void check_line(struct sim_t *sim, int line)
+{
+	const uint32_t *words = sim->mgr.buffer[sim->held]+line*CAPTURE_LINE_WORDS;
+	// Every 10-bit value is a pattern pixel of some frame, so pixels from another frame (including a line that was
+	// half rewritten when it was read, or pixels out of place) show up as a different frame number. Bits outside
+	// the pixels can only be set by something that isn't lcd_capture.
+	for(int x=0; x<CAPTURE_WIDTH; x++)
+	{
+		if(lcd_trace_pattern_check(pair_pixel(words, x), line, x, &sim->first_id, &sim->mixed)<0)
+			sim->garbage = true;
+	}
+}
+
+static void encoder_line(struct sim_t *sim)
+{
+	int l = sim->out_line;
+	if(!l)
+	{
+		sim->held = capture_display_begin(&sim->mgr);
+		sim->first_id = -1;
+		sim->mixed = sim->garbage = false;
+	}
+	if(l%3==0 && l/3<CAPTURE_HEIGHT)
+	{
+		// capture_frame_line() in capture_manager.c, like vga_output.c and the split encoder's frame_line
+		capture_display_line(&sim->mgr, l/3, sim->dma_words);
+		if(sim->filled[sim->held])
+			check_line(sim, l/3);
+	}
+	if(l==3*(CAPTURE_HEIGHT-1)+1)
+	{
+		capture_display_end(&sim->mgr);
+		sim->shown++;
+		if(sim->filled[sim->held])
+			sim->torn += sim->mgr.torn_frame;
+		if(!sim->filled[sim->held])
+			sim->blank++;
+		else if(sim->garbage)
+			sim->garbage_frames++;
+		else if(sim->mixed)
+			sim->mixed_frames++;
+		else if(!lcd_trace_frame_clean(&sim->trace, sim->first_id))
+			sim->dirty_frames++;
+		else
+		{
+			sim->whole++;
+			sim->shown_id[sim->first_id] = true;
+		}
+	}
+	sim->out_line = (l+1)%OUT_LINES;
+}
+
+static bool run(const struct scenario_t *sc, const char *src_dir)
+{
+	struct lcd_timing_t timing;
+	struct sim_t *sim = (struct sim_t *)calloc(1, sizeof(struct sim_t));
+	lcd_timing_gba(&timing);
+	printf("%s:\n", sc->name);
+	bool ok = lcd_trace_init(&sim->trace, &timing, cycles_per_dot, sc->off_dots, sc->start_line, MAX_FRAMES);
+	sim->trace.events = sc->events;
+	sim->trace.event_count = sc->event_count;
+	for(int i=0; i<buffers; i++)
+		sim->buffers[i] = (uint32_t *)calloc(CAPTURE_DMA_WORDS, sizeof(uint32_t));
+	capture_init(&sim->mgr, sim->buffers, buffers);
+	sim->mgr.safe_lines = safe_lines;
+	if(!ok || !load_programs(sim, src_dir))
+		ok = false;
+	sim->emu.read_gpio = lcd_trace_gpio;
+	sim->emu.ctx = &sim->trace;
+
+	double emu_hz = timing.dot_hz*sim->trace.cycles_per_dot;
+	sim->line_cycles = emu_hz/sc->out_hz/OUT_LINES;
+	// The encoder starts at a random point of its frame
+	sim->out_line = rng_range(0, OUT_LINES-1);
+	sim->next_line = sim->line_cycles;
+	sim->held = -1;
+	while(ok && sim->trace.frame<lcd_frames)
+	{
+		pio_emu_step(&sim->emu);
+		uint64_t cycle = sim->emu.cycle;
+		uint32_t word;
+		if(sim->dma_words<CAPTURE_DMA_WORDS && pio_sm_get(&sim->emu, CAPTURE_SM, &word))
+		{
+			if(sim->mgr.target==CAPTURE_SINK)
+				sim->sink = word;
+			else
+				sim->mgr.buffer[sim->mgr.target][sim->dma_words] = word;
+			sim->dma_words++;
+		}
+		if(pio_sm_get(&sim->emu, VSYNC_SM, &word))
+		{
+			sim->irq_pending = true;
+			sim->irq_at = cycle+(uint64_t)irq_latency;
+		}
+		if(sim->irq_pending && cycle>=sim->irq_at)
+		{
+			sim->irq_pending = false;
+			vsync_irq(sim);
+		}
+		while((double)cycle>=sim->next_line)
+		{
+			encoder_line(sim);
+			sim->next_line += sim->line_cycles;
+		}
+	}
+
+	const struct capture_manager_t *m = &sim->mgr;
+	int clean = 0, clean_shown = 0;
+	for(int f=0; f<lcd_frames && f<MAX_FRAMES; f++)
+	{
+		if(lcd_trace_frame_clean(&sim->trace, f))
+		{
+			clean++;
+			clean_shown += sim->shown_id[f];
+		}
+	}
+	printf("  LCD: %d frames, %d with all lines, %llu spurious and %llu lost pixel clocks\n", lcd_frames, clean,
+		(unsigned long long)sim->trace.extra_clocks, (unsigned long long)sim->trace.lost_clocks);
+	printf("  Capture: %u vsyncs, %u complete, %u short, %u long, %u dropped into the sink, %u skipped, %u into the held buffer\n",
+		m->vsyncs, m->complete, m->short_frames, m->long_frames, m->dropped, m->skipped, m->shared);
+	printf("  Encoder: %u frames, %u before the first capture, %u whole (%u repeated), %u torn by the manager's count\n",
+		sim->shown, sim->blank, sim->whole, m->repeated, sim->torn);
+	printf("  Checked: %u mixed, %u with bad lines, %u from a frame the LCD didn't finish; %d of %d whole LCD frames shown\n",
+		sim->mixed_frames, sim->garbage_frames, sim->dirty_frames, clean_shown, clean);
+	if(sim->mixed_frames!=sim->torn)
+		printf("  The manager counted %u torn frames, the check found %u\n", sim->torn, sim->mixed_frames);
+	if(ok && (sim->mixed_frames || sim->garbage_frames || sim->dirty_frames || sim->torn))
+	{
+		printf("  FAIL: a frame that wasn't whole got shown\n");
+		ok = false;
+	}
+	else if(ok)
+		printf("  OK\n");
+
+	lcd_trace_free(&sim->trace);
+	for(int i=0; i<buffers; i++)
+		free(sim->buffers[i]);
+	free(sim);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *src_dir = "../src";
+	const char *only = NULL;
+	static const char *names[] = {"power", "reset", "link", "drift"};
+	int opt;
+	while((opt = getopt(argc, argv, "t:b:f:c:r:l:i:s:vd:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 't': only = optarg; break;
+			case 'b': buffers = atoi(optarg); break;
+			case 'f': lcd_frames = atoi(optarg); break;
+			case 'c': cycles_per_dot = atoi(optarg); break;
+			case 'r': out_hz = atof(optarg); break;
+			case 'l': safe_lines = atoi(optarg); break;
+			case 'i': irq_latency = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+			case 'v': verbose = true; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "See the top of capture_sim.c for the options.\n");
+				return 1;
+		}
+	}
+	if(buffers<2 || buffers>CAPTURE_MAX_BUFFERS)
+	{
+		fprintf(stderr, "2 or %d buffers\n", CAPTURE_MAX_BUFFERS);
+		return 1;
+	}
+	if(lcd_frames<8)
+		lcd_frames = 8;
+	if(lcd_frames>MAX_FRAMES-8)
+		lcd_frames = MAX_FRAMES-8;
+	if(cycles_per_dot<8)
+	{
+		// lcd_cap_9bpp needs 4 cycles with the pixel clock low to get the first pixel of a pair in.
+		fprintf(stderr, "At least 8 cycles per dot\n");
+		return 1;
+	}
+	if(out_hz<OUT_FRAME_HZ-0.5)
+		printf("Note: the safe line count assumes the encoder reads at least as fast as at %.2fHz\n", OUT_FRAME_HZ);
+
+	struct lcd_timing_t timing;
+	lcd_timing_gba(&timing);
+	printf("%d buffers of %d words, %d LCD frames per scenario, safe from encoder line %d\n\n", buffers,
+		CAPTURE_DMA_WORDS, lcd_frames, safe_lines);
+	bool ok = true;
+	bool any = false;
+	for(int i=0; i<4; i++)
+	{
+		if(only && strcmp(only, names[i]))
+			continue;
+		struct scenario_t sc;
+		build_scenario(&sc, names[i], &timing);
+		ok = run(&sc, src_dir) && ok;
+		any = true;
+	}
+	if(!any)
+	{
+		fprintf(stderr, "No scenario %s\n", only);
+		return 1;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+#	check_golden.sh
+#
+#	Regression check of everything tmds_util.c writes. It builds tmds_util, tmds_decode and tmds_reference_check with
+#	AddressSanitizer and UndefinedBehaviorSanitizer (any report stops it), runs "./tmds_util", "./tmds_util -i" and
+#	"./tmds_util -3" in a scratch folder, and compares the SHA-256 of every file with golden/tmds_util.sha256, so a missing, extra or changed
+#	file fails. Then tmds_decode checks the round trip and tmds_reference_check every symbol against the reference
+#	encoder.
+#
+#	After a change that is meant to change the output (and passes tmds_reference_check), -u writes the new hashes;
+#	commit them with the change.
+#
+#	Usage: ./check_golden.sh [-u]    (CC picks the compiler, gcc by default)
+
+set -e
+cd "$(dirname "$0")"
+scripts=$(pwd)
+golden="$scripts/golden/tmds_util.sha256"
+cc=${CC:-gcc}
+sanitize="-g -O1 -fno-omit-frame-pointer -fsanitize=address,undefined -fno-sanitize-recover=all"
+export ASAN_OPTIONS=detect_leaks=1:abort_on_error=0
+export UBSAN_OPTIONS=print_stacktrace=1
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+$cc $sanitize -Wall -o "$work/tmds_util" tmds_util.c -lm
+$cc $sanitize -Wall -o "$work/tmds_decode" tmds_decode.c tmds_util.c -DTMDS_UTIL_NO_MAIN -lm
+$cc $sanitize -Wall -o "$work/tmds_reference_check" tmds_reference_check.c
+
+mkdir "$work/out"
+cd "$work/out"
+"$work/tmds_util" > /dev/null
+"$work/tmds_util" -i > /dev/null
+"$work/tmds_util" -3 > /dev/null
+sha256sum *.bin > "$work/tmds_util.sha256"
+
+if [ "$1" = "-u" ]; then
+	cp "$work/tmds_util.sha256" "$golden"
+	echo "Wrote $(wc -l < "$golden") hashes to golden/tmds_util.sha256"
+elif ! diff "$golden" "$work/tmds_util.sha256"; then
+	echo "Output differs from golden/tmds_util.sha256 (< golden, > now)"
+	exit 1
+else
+	echo "$(wc -l < "$golden") files match golden/tmds_util.sha256"
+fi
+
+"$work/tmds_decode"
+"$work/tmds_reference_check"
@@ -0,0 +1,317 @@
+/*
+	clock_planner.c
+
+	Picks the lowest system clock (and core voltage) that can run a given video mode and feature set.
+
+	The system clock has to be exactly 10x the pixel clock (TMDS bit rate), and it has to come out of the
+	RP2040 system PLL: 12MHz XOSC, reference divider 1, feedback divider 16-320, VCO 750-1600MHz,
+	and 2 post dividers from 1-7.
+	Since the cycle budget per input line is 10 * repeat*Htotal no matter what the clock is, the only way to go lower
+	is a smaller Htotal/Vtotal. So this searches the blanking of the modeline (keeping the sync pulse and porches at
+	least as long as asked for) together with the PLL settings, and keeps only what:
+	-has a refresh rate within the tolerance of the target (the Gameboy's ~59.73Hz by default)
+	-fits the cycle budget of the enabled features, plus a safety margin
+
+	The refresh target is what sets the clock, so the features are only a pass/fail check: as long as they fit the
+	budget of the smallest modeline, they don't change the result. With the estimates, every combination fits the
+	standard 720x480p blanking (25740 cycles), even on one core, so -f only makes a difference with a smaller -m or a
+	measured -b that doesn't fit; then Htotal, and with it the clock, goes up. The output says which case it is.
+
+	The per-feature costs are estimates from encode_split_sim; when there are real numbers from the scanline
+	profiler (worst slack from profile_decode), pass the measured encode cycles with -b.
+
+	Output: a config header with the PLL settings, core voltage, final modeline and PIO delays.
+
+	Build: gcc -O2 -o clock_planner clock_planner.c -lm
+	Usage: ./clock_planner [options]
+	-m "Hactive Hfront Hsync Hback Vactive Vfront Vsync Vback"   minimum modeline (default: standard 720x480p)
+	-r repeat            lines each input line is repeated for (default 3)
+	-f feature,...       audio, colorcor, dmg, split
+	-R refresh           target refresh rate in Hz (default 59.7275)
+	-t tolerance         allowed refresh error in Hz (default 0.5)
+	-b cycles            measured encode cycles per input line (replaces the estimate)
+	-M margin            safety margin in percent (default 10)
+	-o file              output header (default clock_config.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "host_util.h"
+
+#define XOSC_KHZ 12000
+#define VCO_MIN_KHZ 750000
+#define VCO_MAX_KHZ 1600000
+#define FBDIV_MIN 16
+#define FBDIV_MAX 320
+
+// How much longer than asked for the blanking periods are allowed to get.
+#define H_EXTRA_MAX 256
+#define V_EXTRA_MAX 64
+
+#define LINE_PIXELS 240
+
+// Encode cost estimates per input line (cycles), from encode_split_sim's worst case at 5% stalls.
+#define COST_ENCODE_ONE_CORE 15750
+#define COST_ENCODE_SPLIT 8100
+// Audio: grabbing samples and building/encoding 1 audio packet every few lines, averaged per line.
+#define COST_AUDIO 2200
+// Color correction: one more table lookup (ldrh + add) per pixel per channel.
+#define COST_COLORCOR (LINE_PIXELS*3*4)
+// DMG: 2bpp pixels go straight to the LUT without separating the channels, so roughly 40% less work.
+#define DMG_PERCENT 60
+
+// The '541 buffers need 14ns to switch; lcd_capture waits this long after toggling OE.
+#define LCD_OE_SETTLE_NS 14
+
+struct modeline_t
+{
+	int h_active, h_front, h_pulse, h_back;
+	int v_active, v_front, v_pulse, v_back;
+};
+
+struct pll_t
+{
+	uint32_t vco_khz;
+	int fbdiv, postdiv1, postdiv2;
+};
+
+struct plan_t
+{
+	uint32_t sys_khz;
+	struct pll_t pll;
+	struct modeline_t mode;
+	int h_total, v_total;
+	double refresh;
+	uint32_t budget;
+	const char *vreg;
+	double vreg_volts;
+};
+
+// Core voltage needed for a system clock. 1.10V is the default; 1.15V is what 294MHz needed on my boards,
+// the rest is extrapolated with some headroom.
+static const struct
+{
+	uint32_t max_khz;
+	const char *name;
+	double volts;
+} vreg_table[] =
+{
+	{250000, "VREG_VOLTAGE_1_10", 1.10},
+	{300000, "VREG_VOLTAGE_1_15", 1.15},
+	{340000, "VREG_VOLTAGE_1_20", 1.20},
+	{380000, "VREG_VOLTAGE_1_25", 1.25},
+	{420000, "VREG_VOLTAGE_1_30", 1.30}
+};
+
+// Finds PLL settings for an exact system clock, preferring the lowest VCO (less power) and postdiv1 >= postdiv2,
+// like check_sys_clock_khz() does.
+static bool find_pll(uint32_t sys_khz, struct pll_t *pll)
+{
+	for(int fbdiv=FBDIV_MIN; fbdiv<=FBDIV_MAX; fbdiv++)
+	{
+		uint32_t vco = XOSC_KHZ*fbdiv;
+		if(vco<VCO_MIN_KHZ || vco>VCO_MAX_KHZ)
+			continue;
+		for(int pd1=7; pd1>=1; pd1--)
+		{
+			for(int pd2=pd1; pd2>=1; pd2--)
+			{
+				if(vco==sys_khz*(uint32_t)(pd1*pd2))
+				{
+					pll->vco_khz = vco;
+					pll->fbdiv = fbdiv;
+					pll->postdiv1 = pd1;
+					pll->postdiv2 = pd2;
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static bool parse_features(char *list, bool *audio, bool *colorcor, bool *dmg, bool *split)
+{
+	for(char *tok=strtok(list, ","); tok; tok=strtok(NULL, ","))
+	{
+		if(!strcmp(tok, "audio"))
+			*audio = true;
+		else if(!strcmp(tok, "colorcor"))
+			*colorcor = true;
+		else if(!strcmp(tok, "dmg"))
+			*dmg = true;
+		else if(!strcmp(tok, "split"))
+			*split = true;
+		else
+		{
+			fprintf(stderr, "Unknown feature: %s\n", tok);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void write_header(const char *name, struct plan_t *plan, int repeat, uint32_t needed, const char *features)
+{
+	FILE *out = header_open(name, "clock_config.h", "clock_planner.c");
+	if(!out)
+		return;
+	int oe_delay = (int)ceil((double)LCD_OE_SETTLE_NS*(double)plan->sys_khz/1000000.0);
+	fprintf(out, "\tFeatures: %s, line repeat %d\n", features[0] ? features : "none", repeat);
+	fprintf(out, "\tCycle budget per input line: %u, needed (with margin): %u\n", plan->budget, needed);
+	header_guard(out, "clock_config.h");
+	fprintf(out, "#define SYS_CLOCK_KHZ %u\n", plan->sys_khz);
+	fprintf(out, "#define PLL_SYS_VCO_HZ %uu\n", plan->pll.vco_khz*1000u);
+	fprintf(out, "#define PLL_SYS_POSTDIV1 %d\n", plan->pll.postdiv1);
+	fprintf(out, "#define PLL_SYS_POSTDIV2 %d\n", plan->pll.postdiv2);
+	fprintf(out, "#define SYS_VREG_VOLTAGE %s\n\n", plan->vreg);
+	fprintf(out, "#define PIXEL_CLOCK_KHZ %u\n", plan->sys_khz/10);
+	fprintf(out, "#define MODE_H_ACTIVE %d\n#define MODE_H_FRONT %d\n#define MODE_H_PULSE %d\n#define MODE_H_BACK %d\n#define MODE_H_TOTAL %d\n",
+		plan->mode.h_active, plan->mode.h_front, plan->mode.h_pulse, plan->mode.h_back, plan->h_total);
+	fprintf(out, "#define MODE_V_ACTIVE %d\n#define MODE_V_FRONT %d\n#define MODE_V_PULSE %d\n#define MODE_V_BACK %d\n#define MODE_V_TOTAL %d\n",
+		plan->mode.v_active, plan->mode.v_front, plan->mode.v_pulse, plan->mode.v_back, plan->v_total);
+	fprintf(out, "// %.4fHz\n#define MODE_REFRESH_MILLIHZ %d\n\n", plan->refresh, (int)lround(plan->refresh*1000.0));
+	fprintf(out, "// TMDS output runs at 1 bit per system clock.\n#define TMDS_PIO_CLKDIV_INT 1\n#define TMDS_PIO_CLKDIV_FRAC 0\n");
+	fprintf(out, "// LCD capture runs at the system clock; OE settle delay for the '541s in cycles (%dns).\n", LCD_OE_SETTLE_NS);
+	fprintf(out, "#define LCD_CAP_PIO_CLKDIV_INT 1\n#define LCD_OE_DELAY_CYCLES %d\n\n", oe_delay);
+	header_close(out);
+}
+
+int main(int argc, char **argv)
+{
+	// The standard 720x480p timings are the shortest blanking a TV should accept; tmds_util.h's custom mode
+	// is one of the results this can come up with.
+	struct modeline_t base = {H_ACTIVE, 16, 62, 60, V_ACTIVE, 9, 6, 30};
+	int repeat = 3;
+	double target = 59.7275, tolerance = 0.5;
+	int measured = 0, margin = 10;
+	bool audio = false, colorcor = false, dmg = false, split = false;
+	char features[128] = "";
+	const char *out_name = "clock_config.h";
+	int opt;
+	while((opt = getopt(argc, argv, "m:r:f:R:t:b:M:o:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'm':
+				if(sscanf(optarg, "%d %d %d %d %d %d %d %d", &base.h_active, &base.h_front, &base.h_pulse, &base.h_back,
+					&base.v_active, &base.v_front, &base.v_pulse, &base.v_back)!=8)
+				{
+					fprintf(stderr, "The modeline needs 8 numbers.\n");
+					return 1;
+				}
+				break;
+			case 'r': repeat = atoi(optarg); break;
+			case 'f':
+				snprintf(features, sizeof(features), "%s", optarg);
+				if(!parse_features(optarg, &audio, &colorcor, &dmg, &split))
+					return 1;
+				break;
+			case 'R': target = atof(optarg); break;
+			case 't': tolerance = atof(optarg); break;
+			case 'b': measured = atoi(optarg); break;
+			case 'M': margin = atoi(optarg); break;
+			case 'o': out_name = optarg; break;
+			default:
+				fprintf(stderr, "See the top of clock_planner.c for the options.\n");
+				return 1;
+		}
+	}
+
+	uint32_t needed = measured ? (uint32_t)measured : (split ? COST_ENCODE_SPLIT : COST_ENCODE_ONE_CORE);
+	if(dmg && !measured)
+		needed = needed*DMG_PERCENT/100;
+	if(colorcor)
+		needed += split ? COST_COLORCOR/2 : COST_COLORCOR;
+	if(audio)
+		needed += COST_AUDIO;
+	needed = needed*(100+margin)/100;
+
+	struct plan_t best;
+	bool found = false;
+	best.sys_khz = 0;
+	for(int hx=0; hx<=H_EXTRA_MAX; hx++)
+	{
+		int h_total = base.h_active+base.h_front+base.h_pulse+base.h_back+hx;
+		uint32_t budget = 10u*(uint32_t)(repeat*h_total);
+		if(budget<needed)
+			continue;
+		for(int vx=0; vx<=V_EXTRA_MAX; vx++)
+		{
+			int v_total = base.v_active+base.v_front+base.v_pulse+base.v_back+vx;
+			// Lowest and highest system clocks (in kHz) that land within the refresh tolerance
+			double per_khz = (double)h_total*(double)v_total*10.0/1000.0;
+			uint32_t lo = (uint32_t)ceil((target-tolerance)*per_khz);
+			uint32_t hi = (uint32_t)floor((target+tolerance)*per_khz);
+			for(uint32_t sys_khz=lo; sys_khz<=hi; sys_khz++)
+			{
+				// Pixel clock has to be a whole number of kHz too, or the TMDS clock isn't exactly 1/10th.
+				if(sys_khz%10)
+					continue;
+				if(found && sys_khz>=best.sys_khz)
+					break;
+				struct pll_t pll;
+				if(!find_pll(sys_khz, &pll))
+					continue;
+				found = true;
+				best.sys_khz = sys_khz;
+				best.pll = pll;
+				best.mode = base;
+				// Extra blanking goes to the back porches; the hsync position doesn't matter to the encoder.
+				best.mode.h_back += hx;
+				best.mode.v_back += vx;
+				best.h_total = h_total;
+				best.v_total = v_total;
+				best.refresh = (double)sys_khz*100.0/((double)h_total*(double)v_total);
+				best.budget = budget;
+				break;
+			}
+		}
+	}
+	if(!found)
+	{
+		fprintf(stderr, "No system clock fits: %u cycles per line needed, and no PLL setting lands within %.3fHz of %.4fHz.\n",
+			needed, tolerance, target);
+		return 1;
+	}
+	best.vreg = NULL;
+	for(size_t i=0; i<sizeof(vreg_table)/sizeof(vreg_table[0]); i++)
+	{
+		if(best.sys_khz<=vreg_table[i].max_khz)
+		{
+			best.vreg = vreg_table[i].name;
+			best.vreg_volts = vreg_table[i].volts;
+			break;
+		}
+	}
+	if(!best.vreg)
+	{
+		fprintf(stderr, "%ukHz is above anything in the voltage table.\n", best.sys_khz);
+		return 1;
+	}
+
+	printf("Cycles needed per input line: %u (%d%% margin)\n", needed, margin);
+	printf("System clock: %ukHz (VCO %ukHz / %d / %d), pixel clock %ukHz\n", best.sys_khz, best.pll.vco_khz,
+		best.pll.postdiv1, best.pll.postdiv2, best.sys_khz/10);
+	printf("Modeline: %d %d %d %d (%d), %d %d %d %d (%d), %.4fHz\n", best.mode.h_active, best.mode.h_front, best.mode.h_pulse,
+		best.mode.h_back, best.h_total, best.mode.v_active, best.mode.v_front, best.mode.v_pulse, best.mode.v_back,
+		best.v_total, best.refresh);
+	printf("Budget: %u cycles per input line, %u spare\n", best.budget, best.budget-needed);
+	int base_h_total = base.h_active+base.h_front+base.h_pulse+base.h_back;
+	if(needed<=10u*(uint32_t)(repeat*base_h_total))
+		printf("The features fit the smallest modeline, so the refresh target alone sets the clock\n");
+	else
+		printf("The features need %d more pixels of hblank than the smallest modeline, which raises the clock\n",
+			best.h_total-base_h_total);
+	printf("Core voltage: %.2fV (%s)\n", best.vreg_volts, best.vreg);
+	write_header(out_name, &best, repeat, needed, features);
+	printf("Wrote %s\n", out_name);
+
+	return 0;
+}
@@ -0,0 +1,869 @@
+/*
+	e2e_sim.c
+
+	The whole path from the GBA's LCD to the TV, on the host: a reference image goes in as LCD signals and comes back out
+	of the HDMI pins as a decoded image, which has to be the image scaled 3x, exactly.
+
+	Everything runs on one clock, the 294MHz system clock (70 per LCD dot, 1 per TMDS bit), so an LCD frame and an output
+	frame are both 4915680 cycles, like on the board:
+	-LCD: lcd_trace.c plays the image as GBA signals, scrolled by -s pixels every frame so every frame is different
+	-capture: lcd_capture (src/lcd_cap_15bpp_mux.pio) behind the '541 model of capture_format_check.c and
+	 vsync_interruptor (src/vsync.pio) run in pio_emu, with channel 8, channel 9 and the vsync IRQ modeled like in
+	 capture_sim.c, and src/capture_manager.h deciding where every frame goes
+	-encode: split_encode_core0()/core1() (src/tmds_encode_split.h) take the frames from the capture manager. Their time
+	 comes from the cycle model of encode_split_sim.c (with its random bus stalls), and what they write only lands in the
+	 line buffer when the core is done with it, so a line that isn't ready when the DMA gets to it shows up as wrong
+	 pixels, not just as a number
+	-DMA: per lane and line, the blanking words (fill_blank_line() from tmds_util.c with 2 null packets, packed) and then
+	 the line buffer, or the control symbols of a vblank line; DMA_RELOAD_CYCLES between the 2 blocks, and
+	 DMA_RESTART_CYCLES for the IRQ to start the next line. Every line of lane 0, vblank included, runs the line IRQ of
+	 src/blank_spans.h (blank_spans_next() and blank_spans_line_sent()), whose line_done releases a line buffer every 3
+	 active lines with split_encode_line_sent(), like split_encode_line_done() in tmds_encode_split.c
+	-serialize: src/tmds_output.pio, 3 state machines on GP14-19 with joined TX FIFOs, in pio_emu
+	-decode: the P pin of every lane is cut back into symbols; the blanking and vblank symbols have to be exactly what
+	 was generated, and the active ones are decoded into a 720x480 image per output frame
+	Every output frame has to be either all border (before the first capture) or exactly one LCD frame scaled 3x, with
+	the LCD frames in order. With -s 0 all LCD frames look the same, so it can only tell that the latest one is shown.
+
+	It reports, per stage, what it has to do and how close to its limit it is: PIO load and FIFO levels, encode cycles
+	per line against the time to the DMA (slack), DMA FIFO levels, serializer stalls, and the frames shown with their
+	latency from the end of the LCD frame to the start of the output frame. -e scales the encode cycles, to see how much
+	slower the encoder can get before lines are late.
+
+	Options: -f output frames, -s scroll per LCD frame, -l LCD line at the start, -e encode cycles in percent of the model,
+	-p bus stall probability, -r DMA restart cycles, -i reference image (240x160 binary PPM, a test pattern otherwise),
+	-o decoded last frame (PPM), -d path to src.
+
+	Build: gcc -O2 -o e2e_sim e2e_sim.c lcd_trace.c pio_emu.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./e2e_sim [-f 5] [-s 1] [-e 100] [-i frame.ppm] [-o out.ppm]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "pio_emu.h"
+#include "lcd_trace.h"
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#define RNG_SEED 12345
+#include "host_util.h"
+#include "../src/capture_manager.h"
+#include "../src/tmds_encode_split.h"
+#include "../src/blank_spans.h"
+
+#define LANES 3
+#define CAPTURE_SM 0
+#define VSYNC_SM 1
+#define VSYNC_PIN 11
+#define HDMI_PIN_BASE 14
+// 294MHz for the GBA's 4.19MHz
+#define CYCLES_PER_DOT 70
+#define SYS_HZ (4194304.0*CYCLES_PER_DOT)
+// Same '541 model as capture_format_check.c
+#define PIXEL_PINS 16
+#define DATA_BASE 2
+#define OE_PINS 3u
+#define OE_SETTLE 5
+#define VSYNC_IRQ_LATENCY 200
+
+#define BLANK_SYMBOLS (H_TOTAL-H_ACTIVE)
+#define BLANK_WORDS ((BLANK_SYMBOLS*10)/32)
+#define FRAME_SYMBOLS (H_TOTAL*V_TOTAL)
+#define ISLANDS 2
+#define VARIANTS 4
+#define LINE_LATENCY_BITS 64
+// Same DMA model as span_compiler.c
+#define DMA_RELOAD_CYCLES 12
+#define DMA_RESTART_CYCLES 120
+#define MAX_LCD_FRAMES 256
+
+// Same cycle model as encode_split_sim.c
+#define CYC_SEPARATE 7
+#define MEM_SEPARATE 2
+#define CYC_LOOKUP 8
+#define MEM_LOOKUP 2
+#define CYC_PACK 4
+#define CYC_STORE_GROUP 30
+#define MEM_STORE_GROUP 15
+#define CYC_GROUP 6
+#define CYC_IRQ 48
+
+struct lane_feed_t
+{
+	int line; // output line
+	int block; // 0 blanking, 1 active
+	int word;
+	uint64_t ready;
+};
+
+// One input line on its way through both cores
+struct encode_job_t
+{
+	bool active, encoded, done[2];
+	uint32_t line;
+	uint64_t start[2], finish[2];
+};
+
+struct sim_t
+{
+	struct pio_emu_t cap_emu, out_emu;
+	struct lcd_trace_t trace;
+	uint64_t level_cycle;
+	uint32_t level;
+	uint32_t last_oe;
+	uint64_t oe_changed;
+	const struct pio_program_t *capture_prog;
+	int capture_offset;
+	struct pio_sm_config_t capture_cfg;
+
+	// Capture: channels 8 and 9 and the vsync IRQ
+	struct capture_manager_t mgr;
+	uint32_t *buffers[CAPTURE_MAX_BUFFERS];
+	int last_captured;
+	uint64_t frame_done[MAX_LCD_FRAMES]; // cycle of the vsync that completed each LCD frame
+	uint32_t dma_words, sink;
+	uint64_t irq_at;
+	bool irq_pending;
+	int rx_max;
+
+	// Encoder
+	struct split_encode_t enc;
+	uint32_t staging[2][LANES][TMDS_LINE_WORDS]; // where the cores write
+	uint32_t live[2][LANES][TMDS_LINE_WORDS]; // what the DMA reads
+	const uint32_t *lut;
+	int held;
+	struct encode_job_t job;
+	uint32_t next_line;
+	uint64_t core_free[2], core_busy[2];
+	uint32_t core_max[2];
+	uint64_t finish[4]; // by input line&3
+	int64_t min_slack;
+	uint32_t late_lines, lines_encoded;
+
+	// DMA and serializer
+	struct lane_feed_t feed[LANES];
+	int out_frame;
+	struct blank_dma_t out_dma; // line IRQ state
+	bool output_started;
+	uint64_t output_start;
+	int tx_min;
+	uint32_t blank_words[VARIANTS][LANES][BLANK_WORDS];
+	uint32_t vblank_words[VARIANTS][LANES][TMDS_LINE_WORDS];
+	uint16_t blank_symbols[VARIANTS][LANES][BLANK_SYMBOLS];
+	uint16_t vblank_symbol[VARIANTS][LANES];
+
+	// Decoder
+	int latency;
+	uint8_t first_bits[LANES][LINE_LATENCY_BITS+8];
+	uint32_t sym_acc[LANES];
+	int sym_bits[LANES];
+	uint64_t sym_index[LANES];
+	uint8_t image[V_ACTIVE][H_ACTIVE][LANES];
+	uint64_t frame_start; // cycle the current output frame's first active symbol came out
+	bool frame_bad_symbols;
+	int decoded_frames, blank_frames, whole_frames, bad_frames, repeated, out_of_order, skipped;
+	int last_shown;
+	uint64_t sync_errors, not_video;
+	double latency_min, latency_max;
+};
+
+static struct sim_t *sim;
+static uint16_t ref[CAPTURE_HEIGHT][CAPTURE_WIDTH];
+static int frames = 5;
+static int scroll = 1;
+static int start_line = 180;
+static int encode_percent = 100;
+static double stall_prob = 0.05;
+static int restart_cycles = DMA_RESTART_CYCLES;
+
+// Gradients of the 3 channels and gray, color bars, and single pixel detail at the bottom
+static void test_pattern(void)
+{
+	static const uint16_t bars[8] = {0x7fff, 0x03ff, 0x7fe0, 0x03e0, 0x7c1f, 0x001f, 0x7c00, 0x0000};
+	for(int y=0; y<CAPTURE_HEIGHT; y++)
+	{
+		for(int x=0; x<CAPTURE_WIDTH; x++)
+		{
+			uint16_t v = (uint16_t)((x*32)/CAPTURE_WIDTH);
+			if(y<80)
+				ref[y][x] = (uint16_t)(y<60 ? v<<(5*(y/20)) : v|(v<<5)|(v<<10));
+			else if(y<120)
+				ref[y][x] = bars[(x*8)/CAPTURE_WIDTH];
+			else
+				ref[y][x] = (((x/8)+(y/8))&1) ? 0x7fff : (uint16_t)(((x^y)&1) ? (x*y)&0x7fff : 0);
+		}
+	}
+}
+
+static uint16_t lcd_pixel(int frame, int line, int x)
+{
+	return ref[line][(x+frame*scroll)%CAPTURE_WIDTH];
+}
+
+static uint16_t pixel_at(void *ctx, int frame, int line, int x)
+{
+	(void)ctx;
+	return lcd_pixel(frame, line, x);
+}
+
+// The 2 '541s in front of GP2-GP9 (see capture_format_check.c)
+static uint32_t capture_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs)
+{
+	(void)ctx;
+	(void)pindirs;
+	if(cycle!=sim->level_cycle)
+	{
+		sim->level_cycle = cycle;
+		sim->level = lcd_trace_gpio(&sim->trace, cycle, 0, 0);
+	}
+	uint32_t level = sim->level;
+	uint32_t pixel = (level>>PIXEL_PINS)&0x7fff;
+	level &= ~(0x7fffu<<PIXEL_PINS);
+	uint32_t oe = outputs&OE_PINS;
+	if(oe!=sim->last_oe)
+	{
+		sim->last_oe = oe;
+		sim->oe_changed = cycle;
+	}
+	uint32_t bus = 0xff;
+	if(oe && oe!=OE_PINS && cycle-sim->oe_changed>=OE_SETTLE)
+		bus = oe==2 ? pixel&0xff : pixel>>8;
+	return level|(bus<<DATA_BASE);
+}
+
+static bool load_programs(const char *src_dir)
+{
+	static struct pio_program_t programs[3][PIO_MAX_PROGRAMS];
+	struct pio_define_t define = {"V", VSYNC_PIN};
+	const struct pio_program_t *capture = pio_load_program(src_dir, "lcd_cap_15bpp_mux.pio", "lcd_capture", &define, 1,
+		programs[0]);
+	const struct pio_program_t *vsync = pio_load_program(src_dir, "vsync.pio", "vsync_interruptor", &define, 1,
+		programs[1]);
+	const struct pio_program_t *output = pio_load_program(src_dir, "tmds_output.pio", "tmds_output", &define, 1,
+		programs[2]);
+	if(!capture || !vsync || !output)
+		return false;
+
+	pio_emu_init(&sim->cap_emu);
+	sim->cap_emu.read_gpio = capture_gpio;
+	sim->cap_emu.pins = OE_PINS;
+	sim->capture_prog = capture;
+	sim->capture_offset = pio_emu_load(&sim->cap_emu, capture, -1);
+	int vsync_offset = pio_emu_load(&sim->cap_emu, vsync, -1);
+	pio_sm_default_config(&sim->capture_cfg);
+	sim->capture_cfg.in_base = DATA_BASE;
+	sim->capture_cfg.set_base = 0;
+	sim->capture_cfg.set_count = 2;
+	sim->capture_cfg.in_shift_right = false;
+	sim->capture_cfg.autopush = true;
+	sim->capture_cfg.push_threshold = 32;
+	pio_sm_start(&sim->cap_emu, CAPTURE_SM, capture, sim->capture_offset, 0, &sim->capture_cfg);
+	struct pio_sm_config_t cfg;
+	pio_sm_default_config(&cfg);
+	pio_sm_start(&sim->cap_emu, VSYNC_SM, vsync, vsync_offset, 0, &cfg);
+
+	pio_emu_init(&sim->out_emu);
+	int out_offset = pio_emu_load(&sim->out_emu, output, -1);
+	for(int lane=0; lane<LANES; lane++)
+	{
+		pio_sm_default_config(&cfg);
+		cfg.out_shift_right = true;
+		cfg.autopull = true;
+		cfg.pull_threshold = 32;
+		cfg.join_tx = true;
+		cfg.sideset_base = HDMI_PIN_BASE+2*lane;
+		pio_sm_start(&sim->out_emu, lane, output, out_offset, 0, &cfg);
+	}
+	printf("Capture PIO: lcd_capture %d + vsync_interruptor %d instructions, output PIO: tmds_output %d\n",
+		capture->length, vsync->length, output->length);
+	return true;
+}
+
+// Vsync edges happen at the start of the hsync pulse (same as span_compiler.c), line 0 being the first active line
+static int line_variant(int line)
+{
+	int pulse_start = V_ACTIVE+V_FRONT;
+	if(line==pulse_start)
+		return BLANK_VBLANK_EN;
+	if(line>pulse_start && line<pulse_start+V_PULSE)
+		return BLANK_VBLANK_SYN;
+	if(line==pulse_start+V_PULSE)
+		return BLANK_VBLANK_EX;
+	return BLANK_HBLANK;
+}
+
+// Blanking words of every variant, and the control symbols that fill the rest of a vblank line
+static void build_blanking(void)
+{
+	// vsync level after the start of the hsync pulse, as in fill_blank_line_packets()
+	const int vsync_after[VARIANTS] = {1, 0, 0, 1};
+	struct blank_timing_t timing = {H_FRONT, H_PULSE, H_BACK};
+	static uint16_t vblank[H_ACTIVE];
+	for(int v=0; v<VARIANTS; v++)
+	{
+		uint16_t *s = sim->blank_symbols[v][0];
+		fill_blank_line(s, sim->blank_symbols[v][1], sim->blank_symbols[v][2], &timing, v, ISLANDS);
+		for(int lane=0; lane<LANES; lane++)
+		{
+			pack_symbols(sim->blank_symbols[v][lane], sim->blank_words[v][lane], BLANK_SYMBOLS);
+			sim->vblank_symbol[v][lane] = lane==0 ? sync_ctl_states[(vsync_after[v]<<1)|1] : sync_ctl_states[0];
+			for(int i=0; i<H_ACTIVE; i++)
+				vblank[i] = sim->vblank_symbol[v][lane];
+			pack_symbols(vblank, sim->vblank_words[v][lane], H_ACTIVE);
+		}
+	}
+}
+
+// model_next_frame() in model_detect.c, for a GBA only
+static void next_frame(struct split_encode_t *enc, struct split_frame_t *frame)
+{
+	(void)enc;
+	if(sim->held>=0)
+		capture_display_end(&sim->mgr);
+	int b = capture_display_begin(&sim->mgr);
+	sim->held = b;
+	frame->tmds_lut = sim->lut;
+	frame->pixels = sim->mgr.buffer_format[b]==CAPTURE_FORMAT_NONE ? NULL : sim->mgr.buffer[b];
+	frame->line_words = TMDS_FB_LINE_WORDS;
+	frame->height = CAPTURE_HEIGHT;
+	frame->x_words = 0;
+	frame->y = 0;
+	frame->border = 0;
+}
+
+// model_frame_line() (capture_frame_line() in capture_manager.c), from core 0 before every line of the frame
+static void frame_line(struct split_encode_t *enc, int line)
+{
+	(void)enc;
+	capture_display_line(&sim->mgr, line, sim->dma_words);
+}
+
+static uint32_t stalls(int accesses)
+{
+	uint32_t threshold = (uint32_t)(stall_prob*4294967295.0);
+	uint32_t count = 0;
+	for(int i=0; i<accesses; i++)
+	{
+		if(rng()<threshold)
+			count++;
+	}
+	return count;
+}
+
+// Cycles to separate and encode count pixels of one channel, scaled by -e
+static uint64_t channel_cycles(int count)
+{
+	int groups = count/TMDS_PACK_GROUP;
+	uint64_t cycles = (uint64_t)count*(CYC_SEPARATE+CYC_LOOKUP+CYC_PACK)+(uint64_t)groups*(CYC_STORE_GROUP+CYC_GROUP);
+	cycles += stalls(count*(MEM_SEPARATE+MEM_LOOKUP)+groups*MEM_STORE_GROUP);
+	return cycles*(uint64_t)encode_percent/100;
+}
+
+// Starts the next input line on both cores once its line buffer is free (wait_line_buffer() in tmds_encode_split.c)
+static void encoder_step(uint64_t cycle)
+{
+	struct encode_job_t *job = &sim->job;
+	if(!job->active)
+	{
+		if(sim->enc.line_release+1<sim->next_line)
+			return;
+		job->active = true;
+		job->encoded = job->done[0] = job->done[1] = false;
+		job->line = sim->next_line;
+		for(int core=0; core<2; core++)
+			job->start[core] = cycle>sim->core_free[core] ? cycle : sim->core_free[core];
+		// Core 0: its part of channel 1, the handoff, then channel 0, plus the 3 DMA IRQs of a line
+		uint64_t handoff = job->start[0]+channel_cycles(SPLIT_CH1_PIXELS);
+		job->finish[0] = handoff+channel_cycles(TMDS_LINE_PIXELS)+SPLIT_LINE_REPEAT*CYC_IRQ;
+		// Core 1: channel 2, then the rest of channel 1 once the handoff is there
+		uint64_t ch2 = job->start[1]+channel_cycles(TMDS_LINE_PIXELS);
+		job->finish[1] = (ch2>handoff ? ch2 : handoff)+channel_cycles(TMDS_LINE_PIXELS-SPLIT_CH1_PIXELS);
+	}
+	if(!job->encoded && cycle>=job->start[0])
+	{
+		uint8_t values[TMDS_LINE_PIXELS];
+		split_encode_core0(&sim->enc, job->line, values, NULL);
+		split_encode_core1(&sim->enc, job->line, values, NULL);
+		job->encoded = true;
+	}
+	if(!job->encoded)
+		return;
+	int b = job->line&1;
+	for(int core=0; core<2; core++)
+	{
+		if(job->done[core] || cycle<job->finish[core])
+			continue;
+		// Only now is the core's part of the line in the line buffer
+		if(core==0)
+		{
+			memcpy(sim->live[b][0], sim->staging[b][0], sizeof(sim->live[b][0]));
+			memcpy(sim->live[b][1], sim->staging[b][1], SPLIT_CH1_WORDS*sizeof(uint32_t));
+		}
+		else
+		{
+			memcpy(sim->live[b][2], sim->staging[b][2], sizeof(sim->live[b][2]));
+			memcpy(sim->live[b][1]+SPLIT_CH1_WORDS, sim->staging[b][1]+SPLIT_CH1_WORDS,
+				(TMDS_LINE_WORDS-SPLIT_CH1_WORDS)*sizeof(uint32_t));
+		}
+		job->done[core] = true;
+		uint64_t busy = job->finish[core]-job->start[core];
+		sim->core_busy[core] += busy;
+		if(busy>sim->core_max[core])
+			sim->core_max[core] = (uint32_t)busy;
+		sim->core_free[core] = job->finish[core];
+	}
+	if(job->done[0] && job->done[1])
+	{
+		sim->finish[job->line&3] = job->finish[0]>job->finish[1] ? job->finish[0] : job->finish[1];
+		sim->enc.core_done[0] = sim->enc.core_done[1] = job->line+1;
+		sim->lines_encoded++;
+		sim->next_line++;
+		job->active = false;
+	}
+}
+
+// split_encode_line_done() in tmds_encode_split.c, from the line IRQ after an active line
+static void line_done(void)
+{
+	split_encode_line_sent(&sim->enc);
+}
+
+// The DMA model reads the blanking and line buffers itself, so there are no control blocks to build
+static void build_line(struct blank_dma_t *dma, int line, struct dma_ctrl_block_t *const blocks[3])
+{
+	(void)dma;
+	(void)line;
+	(void)blocks;
+}
+
+// DMA of one lane: puts the next word into the TX FIFO if there is one
+static void dma_step(int lane, uint64_t cycle)
+{
+	struct lane_feed_t *f = &sim->feed[lane];
+	if(cycle<f->ready || pio_sm_tx_level(&sim->out_emu, lane)>=pio_sm_fifo_depth(&sim->out_emu, lane, true))
+		return;
+	int variant = line_variant(f->line);
+	uint32_t word;
+	if(f->block==0)
+	{
+		word = sim->blank_words[variant][lane][f->word];
+		if(++f->word==BLANK_WORDS)
+		{
+			f->block = 1;
+			f->word = 0;
+			f->ready = cycle+DMA_RELOAD_CYCLES;
+		}
+		pio_sm_put(&sim->out_emu, lane, word);
+		return;
+	}
+	if(f->line<V_ACTIVE)
+	{
+		uint32_t line = (uint32_t)sim->out_frame*CAPTURE_HEIGHT+(uint32_t)f->line/SPLIT_LINE_REPEAT;
+		if(f->word==0 && f->line%SPLIT_LINE_REPEAT==0 && line>0)
+		{
+			// The first word of the first repeat is the deadline of the encode. Line 0 is what starts the output, so
+			// it has none.
+			int64_t slack = sim->lines_encoded>line ? (int64_t)cycle-(int64_t)sim->finish[line&3] : -1;
+			if(slack<0 && lane==0)
+				sim->late_lines++;
+			if(slack<sim->min_slack)
+				sim->min_slack = slack;
+		}
+		word = sim->live[line&1][lane][f->word];
+	}
+	else
+		word = sim->vblank_words[variant][lane][f->word];
+	pio_sm_put(&sim->out_emu, lane, word);
+	if(++f->word<TMDS_LINE_WORDS)
+		return;
+	// blank_spans_irq() in blank_spans.c, on every line
+	if(lane==0)
+		blank_spans_line_sent(&sim->out_dma, blank_spans_next(&sim->out_dma));
+	f->block = 0;
+	f->word = 0;
+	f->ready = cycle+(uint64_t)restart_cycles;
+	if(++f->line==V_TOTAL)
+	{
+		f->line = 0;
+		if(lane==LANES-1)
+			sim->out_frame++;
+	}
+}
+
+// The LCD frame an output frame shows, or -1
+static int match_frame(int first, int last)
+{
+	for(int k=last; k>=first; k--)
+	{
+		bool same = true;
+		for(int y=0; y<V_ACTIVE && same; y++)
+		{
+			for(int x=0; x<H_ACTIVE && same; x++)
+			{
+				uint16_t pixel = lcd_pixel(k, y/3, x/3);
+				for(int lane=0; lane<LANES && same; lane++)
+					same = sim->image[y][x][lane]==depth_convert((uint8_t)((pixel>>tmds_channel_shift(lane))&0x1f));
+			}
+		}
+		if(same)
+			return k;
+	}
+	return -1;
+}
+
+static void end_frame(void)
+{
+	bool blank = true;
+	for(int y=0; y<V_ACTIVE && blank; y++)
+	{
+		for(int x=0; x<H_ACTIVE && blank; x++)
+		{
+			for(int lane=0; lane<LANES; lane++)
+				blank &= sim->image[y][x][lane]==depth_convert(0);
+		}
+	}
+	int k = -1;
+	if(!blank)
+	{
+		// Only frames that were captured before this one started can be in it
+		int last = sim->last_captured;
+		while(last>=0 && sim->frame_done[last]>sim->frame_start)
+			last--;
+		k = match_frame(0, last);
+	}
+	const char *what;
+	if(blank && !sim->frame_bad_symbols)
+	{
+		sim->blank_frames++;
+		what = "border only (no frame yet)";
+	}
+	else if(k<0 || sim->frame_bad_symbols)
+	{
+		sim->bad_frames++;
+		what = "BAD";
+	}
+	else
+	{
+		sim->whole_frames++;
+		if(k==sim->last_shown)
+			sim->repeated++;
+		else if(k<sim->last_shown)
+			sim->out_of_order++;
+		else if(sim->last_shown>=0)
+			sim->skipped += k-sim->last_shown-1;
+		sim->last_shown = k;
+		double latency = (double)(sim->frame_start-sim->frame_done[k])*1000.0/SYS_HZ;
+		if(latency<sim->latency_min)
+			sim->latency_min = latency;
+		if(latency>sim->latency_max)
+			sim->latency_max = latency;
+		what = "LCD frame";
+	}
+	printf("Output frame %d: %s", sim->decoded_frames, what);
+	if(k>=0 && !blank)
+		printf(" %d, %.2fms after it was captured", k, (double)(sim->frame_start-sim->frame_done[k])*1000.0/SYS_HZ);
+	printf("\n");
+	sim->decoded_frames++;
+	sim->frame_bad_symbols = false;
+}
+
+// One symbol of a lane
+static void decode_symbol(int lane, uint16_t symbol, uint64_t cycle)
+{
+	uint64_t index = sim->sym_index[lane]++;
+	int line = (int)((index/H_TOTAL)%V_TOTAL);
+	int x = (int)(index%H_TOTAL);
+	int variant = line_variant(line);
+	if(x<BLANK_SYMBOLS || line>=V_ACTIVE)
+	{
+		uint16_t want = x<BLANK_SYMBOLS ? sim->blank_symbols[variant][lane][x] : sim->vblank_symbol[variant][lane];
+		if(symbol!=want)
+		{
+			if(sim->sync_errors++<8)
+				printf("  line %d symbol %d lane %d: %03x instead of %03x\n", line, x, lane, symbol, want);
+			sim->frame_bad_symbols = true;
+		}
+	}
+	else
+	{
+		int value = tmds_decode_video(symbol);
+		if(value<0)
+		{
+			sim->not_video++;
+			sim->frame_bad_symbols = true;
+			value = 0;
+		}
+		sim->image[line][x-BLANK_SYMBOLS][lane] = (uint8_t)value;
+		if(line==0 && x==BLANK_SYMBOLS && lane==0)
+			sim->frame_start = cycle;
+	}
+	if(lane==LANES-1 && line==V_TOTAL-1 && x==H_TOTAL-1)
+		end_frame();
+}
+
+// P pin of every lane, one bit per cycle; bit counts from the start of the output
+static void decode_bits(uint64_t bit_index, uint64_t cycle)
+{
+	for(int lane=0; lane<LANES; lane++)
+	{
+		int bit = (sim->out_emu.pins>>(HDMI_PIN_BASE+2*lane))&1;
+		if(sim->latency<0)
+		{
+			sim->first_bits[lane][bit_index] = (uint8_t)bit;
+			continue;
+		}
+		sim->sym_acc[lane] |= (uint32_t)bit<<sim->sym_bits[lane];
+		if(++sim->sym_bits[lane]==10)
+		{
+			decode_symbol(lane, (uint16_t)sim->sym_acc[lane], cycle);
+			sim->sym_acc[lane] = 0;
+			sim->sym_bits[lane] = 0;
+		}
+	}
+	if(sim->latency>=0 || bit_index<LINE_LATENCY_BITS+7)
+		return;
+	// The PC-as-LUT program is a cycle or so behind its input (serializer_check.c); find it on the first line.
+	uint8_t want[LINE_LATENCY_BITS];
+	for(int b=0; b<LINE_LATENCY_BITS; b++)
+		want[b] = (uint8_t)((sim->blank_symbols[BLANK_HBLANK][0][b/10]>>(b%10))&1);
+	for(int lat=0; lat<8 && sim->latency<0; lat++)
+	{
+		if(!memcmp(sim->first_bits[0]+lat, want, LINE_LATENCY_BITS))
+			sim->latency = lat;
+	}
+	if(sim->latency<0)
+		sim->latency = 0;
+	for(int lane=0; lane<LANES; lane++)
+	{
+		for(int c=sim->latency; c<=(int)bit_index; c++)
+		{
+			sim->sym_acc[lane] |= (uint32_t)sim->first_bits[lane][c]<<sim->sym_bits[lane];
+			if(++sim->sym_bits[lane]==10)
+			{
+				decode_symbol(lane, (uint16_t)sim->sym_acc[lane], cycle);
+				sim->sym_acc[lane] = 0;
+				sim->sym_bits[lane] = 0;
+			}
+		}
+	}
+}
+
+// capture_vsync_irq() in capture_manager.c
+static void vsync_irq(uint64_t cycle)
+{
+	int frame = sim->trace.frame;
+	capture_vsync(&sim->mgr, sim->dma_words);
+	if(sim->mgr.last_result==CAPTURE_COMPLETE && frame>=0 && frame<MAX_LCD_FRAMES)
+	{
+		sim->frame_done[frame] = cycle;
+		sim->last_captured = frame;
+	}
+	pio_sm_start(&sim->cap_emu, CAPTURE_SM, sim->capture_prog, sim->capture_offset, 0, &sim->capture_cfg);
+	sim->dma_words = 0;
+}
+
+// The decoded picture, lane 0 being blue
+static bool write_image(const char *name)
+{
+	static uint8_t rgb[V_ACTIVE][H_ACTIVE][3];
+	for(int y=0; y<V_ACTIVE; y++)
+	{
+		for(int x=0; x<H_ACTIVE; x++)
+		{
+			for(int c=0; c<3; c++)
+				rgb[y][x][c] = sim->image[y][x][2-c];
+		}
+	}
+	return write_ppm(name, &rgb[0][0][0], H_ACTIVE, V_ACTIVE);
+}
+
+int main(int argc, char **argv)
+{
+	const char *src_dir = "../src", *in_name = NULL, *out_name = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "f:s:l:e:p:r:i:o:d:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': frames = atoi(optarg); break;
+			case 's': scroll = atoi(optarg); break;
+			case 'l': start_line = atoi(optarg); break;
+			case 'e': encode_percent = atoi(optarg); break;
+			case 'p': stall_prob = atof(optarg); break;
+			case 'r': restart_cycles = atoi(optarg); break;
+			case 'i': in_name = optarg; break;
+			case 'o': out_name = optarg; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "See the top of e2e_sim.c for the options.\n");
+				return 1;
+		}
+	}
+	if(frames<1 || frames>MAX_LCD_FRAMES-2 || scroll<0 || start_line<0 || start_line>=228 || encode_percent<1 ||
+		restart_cycles<0)
+	{
+		fprintf(stderr, "1 to %d frames, scroll and restart cycles from 0, LCD line 0-227, encode at least 1%%\n",
+			MAX_LCD_FRAMES-2);
+		return 1;
+	}
+	if(in_name && !read_ppm(in_name, &ref[0][0], CAPTURE_WIDTH, CAPTURE_HEIGHT))
+		return 1;
+	if(!in_name)
+		test_pattern();
+
+	sim = (struct sim_t *)calloc(1, sizeof(struct sim_t));
+	if(!load_programs(src_dir))
+		return 1;
+	build_blanking();
+	uint32_t *lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(lut);
+	sim->lut = lut;
+
+	struct lcd_timing_t timing;
+	lcd_timing_gba(&timing);
+	lcd_trace_init(&sim->trace, &timing, CYCLES_PER_DOT, 0, start_line, MAX_LCD_FRAMES);
+	sim->trace.data_base = PIXEL_PINS;
+	sim->trace.data_bits = 15;
+	sim->trace.pixel = pixel_at;
+	sim->level_cycle = (uint64_t)-1;
+
+	for(int i=0; i<CAPTURE_MAX_BUFFERS; i++)
+		sim->buffers[i] = (uint32_t *)calloc(CAPTURE_DMA_WORDS, sizeof(uint32_t));
+	capture_init(&sim->mgr, sim->buffers, CAPTURE_MAX_BUFFERS);
+	struct split_encode_t *enc = &sim->enc;
+	for(int b=0; b<2; b++)
+	{
+		for(int lane=0; lane<LANES; lane++)
+			enc->line_buf[b][lane] = sim->staging[b][lane];
+	}
+	enc->lines = CAPTURE_HEIGHT;
+	enc->next_frame = next_frame;
+	enc->frame_line = frame_line;
+	enc->ch1_handoff = 0xffffu<<16;
+	// blank_spans_run(), with line 0 being sent and line 1 built
+	sim->out_dma.lines = V_TOTAL;
+	sim->out_dma.active_lines = V_ACTIVE;
+	sim->out_dma.build_line = build_line;
+	sim->out_dma.line_done = line_done;
+	sim->held = -1;
+	sim->min_slack = INT64_MAX;
+	sim->tx_min = PIO_FIFO_DEPTH*2;
+	sim->latency = -1;
+	sim->last_shown = -1;
+	sim->last_captured = -1;
+	sim->latency_min = 1e9;
+
+	printf("%d output frames, LCD starting at line %d, %d pixel scroll per frame, encode at %d%% of the model\n\n",
+		frames, start_line, scroll, encode_percent);
+	clock_t host_start = clock();
+	uint64_t cycle = 0;
+	for(; sim->decoded_frames<frames; cycle++)
+	{
+		encoder_step(cycle);
+		pio_emu_step(&sim->cap_emu);
+		// The output starts once the first line is encoded, so it never sends a line buffer nothing was written to
+		bool output = sim->lines_encoded>0;
+		if(output)
+		{
+			if(!sim->output_started)
+			{
+				sim->output_started = true;
+				sim->output_start = cycle;
+			}
+			for(int lane=0; lane<LANES; lane++)
+				dma_step(lane, cycle);
+			pio_emu_step(&sim->out_emu);
+		}
+
+		// Channel 8, and channel 9 with the vsync IRQ
+		uint32_t word;
+		int rx = pio_sm_rx_level(&sim->cap_emu, CAPTURE_SM);
+		if(rx>sim->rx_max)
+			sim->rx_max = rx;
+		if(sim->dma_words<CAPTURE_DMA_WORDS && pio_sm_get(&sim->cap_emu, CAPTURE_SM, &word))
+		{
+			if(sim->mgr.target==CAPTURE_SINK)
+				sim->sink = word;
+			else
+				sim->mgr.buffer[sim->mgr.target][sim->dma_words] = word;
+			sim->dma_words++;
+		}
+		if(pio_sm_get(&sim->cap_emu, VSYNC_SM, &word))
+		{
+			sim->irq_pending = true;
+			sim->irq_at = cycle+VSYNC_IRQ_LATENCY;
+		}
+		if(sim->irq_pending && cycle>=sim->irq_at)
+		{
+			sim->irq_pending = false;
+			vsync_irq(cycle);
+		}
+
+		if(!output)
+			continue;
+		if(cycle-sim->output_start>(uint64_t)H_TOTAL*10)
+		{
+			for(int lane=0; lane<LANES; lane++)
+			{
+				int level = pio_sm_tx_level(&sim->out_emu, lane);
+				if(level<sim->tx_min)
+					sim->tx_min = level;
+			}
+		}
+		decode_bits(cycle-sim->output_start, cycle);
+	}
+	double host_s = (double)(clock()-host_start)/CLOCKS_PER_SEC;
+
+	const struct pio_sm_t *cap = &sim->cap_emu.sm[CAPTURE_SM];
+	uint64_t underflow = 0, out_stalls = 0;
+	for(int lane=0; lane<LANES; lane++)
+	{
+		underflow += sim->out_emu.sm[lane].tx_underflow;
+		out_stalls += sim->out_emu.sm[lane].stall_cycles;
+	}
+	double seconds = (double)cycle/SYS_HZ;
+	uint32_t deadline = (SPLIT_LINE_REPEAT*H_TOTAL+BLANK_SYMBOLS)*10;
+	printf("\nStage        Throughput                          Load and slack\n");
+	printf("LCD          %5.2f Mpixel/s, %d frames               %d dots per line, %d lines, %d cycles per dot\n",
+		CAPTURE_WIDTH*CAPTURE_HEIGHT*59.73/1e6, sim->trace.frame, timing.dots_per_line, timing.lines_per_frame,
+		CYCLES_PER_DOT);
+	printf("Capture      %5.2f Mword/s into %d buffers           PIO busy %.1f%% of cycles, RX FIFO at most %d of %d; "
+		"%u complete, %u dropped, %u short, %u long, %u torn\n",
+		(double)CAPTURE_FRAME_WORDS*sim->mgr.complete/seconds/1e6, CAPTURE_MAX_BUFFERS,
+		100.0*(double)(cap->cycles-cap->stall_cycles)/(double)cap->cycles, sim->rx_max, PIO_FIFO_DEPTH, sim->mgr.complete,
+		sim->mgr.dropped, sim->mgr.short_frames, sim->mgr.long_frames, sim->mgr.torn);
+	printf("Encode       %5.0f lines/s, %u lines               core 0 %u, core 1 %u cycles at most (%.1f%%/%.1f%% busy); "
+		"deadline %u, least slack %lld cycles, %u late\n",
+		(double)sim->lines_encoded/seconds, sim->lines_encoded, sim->core_max[0], sim->core_max[1],
+		100.0*(double)sim->core_busy[0]/(double)cycle, 100.0*(double)sim->core_busy[1]/(double)cycle, deadline,
+		(long long)(sim->min_slack==INT64_MAX ? 0 : sim->min_slack), sim->late_lines);
+	printf("DMA          %5.1f Mword/s                        TX FIFO at least %d of %d words, %d cycle restart\n",
+		(double)LANES*H_TOTAL*10/32*V_TOTAL*sim->out_frame/seconds/1e6, sim->tx_min, 2*PIO_FIFO_DEPTH, restart_cycles);
+	printf("Serializer   %5.1f Mbit/s per lane                 %llu stall cycles (%llu on an empty FIFO), latency %d\n",
+		SYS_HZ/1e6, (unsigned long long)out_stalls, (unsigned long long)underflow, sim->latency);
+	printf("Decode       %d frames                            %d whole, %d border only, %d bad, %d repeated, %d LCD frames "
+		"skipped, %d out of order; %llu sync symbol errors, %llu not video\n",
+		sim->decoded_frames, sim->whole_frames, sim->blank_frames, sim->bad_frames, sim->repeated, sim->skipped,
+		sim->out_of_order, (unsigned long long)sim->sync_errors, (unsigned long long)sim->not_video);
+	if(sim->whole_frames)
+		printf("Latency      %.2f to %.2fms from the end of an LCD frame to the start of the output frame that shows it\n",
+			sim->latency_min, sim->latency_max);
+	printf("Host         %.1fs for %.3fs of board time (%.1fs per frame)\n", host_s, seconds, host_s/sim->decoded_frames);
+	if(out_name)
+		write_image(out_name);
+
+	bool ok = sim->whole_frames>0 && !sim->bad_frames && !sim->out_of_order && !sim->sync_errors && !sim->not_video &&
+		!underflow && !sim->late_lines;
+	printf("\n%s\n", ok ? "PASS" : "FAIL");
+
+	lcd_trace_free(&sim->trace);
+	for(int i=0; i<CAPTURE_MAX_BUFFERS; i++)
+		free(sim->buffers[i]);
+	free(lut);
+	free(sim);
+	return ok ? 0 : 1;
+}
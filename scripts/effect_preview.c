@@ -0,0 +1,168 @@
+/*
+	effect_preview.c
+
+	Renders what the screen shows with a line effect of src/line_effect.h: every line of a 240x160 frame is encoded
+	with the LUT of the effect, sent SPLIT_LINE_REPEAT times from where line_effect_source() says, and decoded back
+	from the TMDS symbols into a 720x480 PPM. Every decoded symbol is also checked against what it should be (the
+	pixel, the dimmed pixel on every third column for the grid, or the dark line), so it doubles as a round trip test
+	of grid_lut.bin and the dark lines.
+
+	It reports the extra SRAM of the effect, the LUT lookups per line (the same for every effect) and the average
+	brightness against no effect.
+
+	Options: -m none, scanlines or grid, -l grid brightness out of 256 (128), -d dark pixel (15-bit, 0), -t lanes with a
+	pull threshold of 30, -i 240x160 binary PPM to show instead of the test pattern, -o output PPM (effect_preview.ppm.)
+
+	Build: gcc -O2 -o effect_preview effect_preview.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./effect_preview [-m grid] [-l 128] [-d 0] [-t] [-i frame.ppm] [-o effect_preview.ppm]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#include "host_util.h"
+#include "../src/line_effect.h"
+
+#define WIDTH TMDS_LINE_PIXELS
+#define HEIGHT 160
+#define OUT_WIDTH (WIDTH*3)
+#define OUT_HEIGHT (HEIGHT*SPLIT_LINE_REPEAT)
+
+static const char *mode_names[LINE_EFFECT_MODES] = {"none", "scanlines", "grid"};
+
+static uint16_t frame[HEIGHT][WIDTH];
+static uint8_t out[OUT_HEIGHT][OUT_WIDTH][3];
+
+// Color bars on top, then gradients of red, green, blue and gray, then a checkerboard with single pixel detail
+static void test_pattern(void)
+{
+	static const uint16_t bars[8] = {0x7fff, 0x03ff, 0x7fe0, 0x03e0, 0x7c1f, 0x001f, 0x7c00, 0x0000};
+	for(int y=0; y<HEIGHT; y++)
+	{
+		for(int x=0; x<WIDTH; x++)
+		{
+			uint16_t v = (uint16_t)((x*32)/WIDTH);
+			if(y<40)
+				frame[y][x] = bars[(x*8)/WIDTH];
+			else if(y<100)
+				frame[y][x] = (uint16_t)(v<<(5*((y-40)/20)));
+			else if(y<120)
+				frame[y][x] = (uint16_t)(v|(v<<5)|(v<<10));
+			else
+				frame[y][x] = (((x/8)+(y/8))&1) ? 0x7fff : (((x+y)&1) ? 0x001f : 0x0000);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *in_name = NULL, *out_name = "effect_preview.ppm";
+	int mode = LINE_EFFECT_GRID, level = 128;
+	uint32_t dark = 0;
+	bool pull30 = false;
+	int opt;
+	while((opt = getopt(argc, argv, "m:l:d:ti:o:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'm':
+				for(mode=0; mode<LINE_EFFECT_MODES && strcmp(optarg, mode_names[mode]); mode++);
+				break;
+			case 'l': level = atoi(optarg); break;
+			case 'd': dark = (uint32_t)strtoul(optarg, NULL, 0)&0x7fff; break;
+			case 't': pull30 = true; break;
+			case 'i': in_name = optarg; break;
+			case 'o': out_name = optarg; break;
+			default:
+				fprintf(stderr, "See the top of effect_preview.c for the options.\n");
+				return 1;
+		}
+	}
+	if(mode>=LINE_EFFECT_MODES || level<0 || level>256)
+	{
+		fprintf(stderr, "Modes are none, scanlines and grid, and the level goes from 0 to 256\n");
+		return 1;
+	}
+	if(in_name && !read_ppm(in_name, &frame[0][0], WIDTH, HEIGHT))
+		return 1;
+	if(!in_name)
+		test_pattern();
+
+	uint32_t *lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	uint32_t *grid_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(lut);
+	create_tmds_lut_grid(grid_lut, level);
+	static struct line_effect_t effect;
+	int line_words = pull30 ? TMDS_LINE_PIXELS : TMDS_LINE_WORDS;
+	line_effect_init(&effect, mode, lut, grid_lut, dark, line_words);
+
+	static uint32_t buffers[3][TMDS_LINE_PIXELS];
+	uint32_t *line_buf[3] = {buffers[0], buffers[1], buffers[2]};
+	uint8_t values[WIDTH];
+	uint16_t symbols[OUT_WIDTH];
+	int errors = 0;
+	double sum = 0;
+	double sum_plain = 0;
+	for(int y=0; y<HEIGHT; y++)
+	{
+		const uint16_t *line = frame[y];
+		for(int ch=0; ch<3; ch++)
+		{
+			for(int x=0; x<WIDTH; x++)
+				values[x] = (uint8_t)((line[x]>>tmds_channel_shift(ch))&0x1f);
+			if(pull30)
+				tmds_encode_channel_30(effect.tmds_lut, values, line_buf[ch], WIDTH, TMDS_DISP_RESET);
+			else
+				tmds_encode_channel(effect.tmds_lut, values, line_buf[ch], WIDTH, TMDS_DISP_RESET);
+		}
+		for(int r=0; r<SPLIT_LINE_REPEAT; r++)
+		{
+			int row = y*SPLIT_LINE_REPEAT+r;
+			for(int ch=0; ch<3; ch++)
+			{
+				const uint32_t *src = line_effect_source(&effect, r, ch, line_buf);
+				if(pull30)
+				{
+					for(int s=0; s<OUT_WIDTH; s++)
+						symbols[s] = (uint16_t)((src[s/3]>>(10*(s%3)))&0x3ff);
+				}
+				else
+					unpack_single(src, symbols, OUT_WIDTH);
+				for(int s=0; s<OUT_WIDTH; s++)
+				{
+					int decoded = tmds_decode_video(symbols[s]);
+					uint8_t plain = depth_convert((uint8_t)((line[s/3]>>tmds_channel_shift(ch))&0x1f));
+					uint8_t want = plain;
+					if(effect.pattern[r]==LINE_EFFECT_DARK)
+						want = depth_convert((uint8_t)((dark>>tmds_channel_shift(ch))&0x1f));
+					else if(mode==LINE_EFFECT_GRID && s%3==2)
+						want = grid_dim(plain, level);
+					if(decoded!=want && errors++<8)
+						printf("line %d repeat %d lane %d symbol %d: %02x instead of %02x\n", y, r, ch, s, decoded, want);
+					// PPM is RGB, lane 0 is blue
+					out[row][s][2-ch] = (uint8_t)(decoded<0 ? 0 : decoded);
+					sum += out[row][s][2-ch];
+					sum_plain += plain;
+				}
+			}
+		}
+	}
+
+	if(!write_ppm(out_name, &out[0][0][0], OUT_WIDTH, OUT_HEIGHT))
+		return 1;
+
+	int sram = mode==LINE_EFFECT_NONE ? 0 : (int)sizeof(effect.dark_line[0][0])*3*line_words;
+	if(mode==LINE_EFFECT_GRID)
+		sram += TMDS_LUT_WORDS*(int)sizeof(uint32_t);
+	printf("Effect %s, %s lanes: %d bytes of SRAM, %d lookups per line, %.1f%% of the brightness, %s written\n",
+		mode_names[mode], pull30 ? "30-bit" : "32-bit", sram, 3*WIDTH, 100.0*sum/sum_plain, out_name);
+	free(lut);
+	free(grid_lut);
+	printf("%s\n", errors ? "FAIL" : "PASS");
+	return errors ? 1 : 0;
+}
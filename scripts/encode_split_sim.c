@@ -0,0 +1,229 @@
+/*
+	encode_split_sim.c
+
+	Host-side simulation of the split channel encode in src/tmds_encode_split.h.
+	It does 2 things:
+	-Runs the real encode loops (tmds_channel_encode.h) for both cores on random and gradient lines, and checks
+	 that the split output is bit-exact with a single core encoding all 3 channels.
+	-Runs a cycle model of both cores over a lot of lines to get the balance between them, and the worst-case
+	 finish time compared to the deadline (the point where DMA starts sending the line.)
+
+	The cycle costs are estimates for the Cortex-M0+ based on the macros in tmds_encode.S, not measurements.
+	Bus contention is modelled as a random 1 cycle stall on each memory access, and core 0 also takes the DMA
+	line completion IRQ (3 per input line, since every line is repeated 3 times.)
+
+	Deadline: an input line's buffer is released at the end of the active part of the line before the previous one,
+	and has to be ready when the previous line has been repeated 3 times, which is 3 whole lines plus one hblank:
+	(3*H_TOTAL + (H_TOTAL-H_ACTIVE)) pixel clocks, times the number of system clocks per pixel (10 for TMDS.)
+
+	Build: gcc -O2 -o encode_split_sim encode_split_sim.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./encode_split_sim [-n lines] [-p stall probability] [-c clocks per pixel] [-s seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#define RNG_SEED 12345
+#include "host_util.h"
+#include "../src/tmds_encode_split.h"
+
+// Cycle estimates per pixel of one channel.
+// Separation: ldr of a pixel pair (2), then lsr/and/strb (4) for each pixel, plus loop overhead.
+#define CYC_SEPARATE 7
+#define MEM_SEPARATE 2 // memory accesses per pixel for the above
+// Lookup: ldrb (2), lsl (1), then GetTMDSDisparity (orr, add, ldmia of 2 words = 5)
+#define CYC_LOOKUP 8
+#define MEM_LOOKUP 2
+// Packing: PackTMDS is 4 cycles, and 15 stores (2 cycles each) per 16 pixels
+#define CYC_PACK 4
+#define CYC_STORE_GROUP 30
+#define MEM_STORE_GROUP 15
+// Loop overhead per group of 16 pixels
+#define CYC_GROUP 6
+// DMA completion IRQ on core 0: entry, handler and exit
+#define CYC_IRQ 48
+// Polling the handoff word on core 1 (ldr + cmp + branch)
+#define CYC_POLL 5
+
+struct core_time_t
+{
+	uint64_t total;
+	uint32_t max;
+	uint32_t min;
+};
+
+static double stall_prob = 0.05;
+
+// Number of stall cycles for a given number of memory accesses.
+static uint32_t stalls(int accesses)
+{
+	uint32_t threshold = (uint32_t)(stall_prob*4294967295.0);
+	uint32_t count = 0;
+	for(int i=0; i<accesses; i++)
+	{
+		if(rng()<threshold)
+			count++;
+	}
+	return count;
+}
+
+// Cycles to separate and encode count pixels of one channel.
+static uint32_t channel_cycles(int count)
+{
+	int groups = count/TMDS_PACK_GROUP;
+	uint32_t cycles = count*(CYC_SEPARATE+CYC_LOOKUP+CYC_PACK)+groups*(CYC_STORE_GROUP+CYC_GROUP);
+	cycles += stalls(count*(MEM_SEPARATE+MEM_LOOKUP)+groups*MEM_STORE_GROUP);
+	return cycles;
+}
+
+static void core_time_add(struct core_time_t *t, uint32_t cycles)
+{
+	t->total += cycles;
+	if(cycles>t->max)
+		t->max = cycles;
+	if(cycles<t->min)
+		t->min = cycles;
+}
+
+static void fill_test_line(uint32_t *fb_line, int kind)
+{
+	for(int i=0; i<TMDS_FB_LINE_WORDS; i++)
+	{
+		uint32_t p0, p1;
+		if(kind==0)
+		{
+			p0 = rng()&0x7fff;
+			p1 = rng()&0x7fff;
+		}
+		else
+		{
+			// Gradient on all 3 channels, so every color and most disparities get used
+			uint32_t c0 = ((i*2)>>3)&0x1f, c1 = ((i*2+1)>>3)&0x1f;
+			p0 = c0|((31-c0)<<5)|(((c0*7)&0x1f)<<10);
+			p1 = c1|((31-c1)<<5)|(((c1*7)&0x1f)<<10);
+		}
+		fb_line[i] = (p0<<16)|p1;
+	}
+}
+
+// Checks the split encode against the single core encode.
+static int check_bit_exact(const uint32_t *tmds_lut, int lines)
+{
+	uint32_t *fb = (uint32_t *)malloc(lines*TMDS_FB_LINE_WORDS*sizeof(uint32_t));
+	uint32_t *ref = (uint32_t *)malloc(3*TMDS_LINE_WORDS*sizeof(uint32_t));
+	uint32_t *out = (uint32_t *)malloc(6*TMDS_LINE_WORDS*sizeof(uint32_t));
+	uint8_t values[TMDS_LINE_PIXELS];
+	uint32_t *ref_lane[3] = {ref, ref+TMDS_LINE_WORDS, ref+2*TMDS_LINE_WORDS};
+	struct split_encode_t enc;
+	int errors = 0;
+
+	memset(&enc, 0, sizeof(enc));
+	enc.tmds_lut = tmds_lut;
+	enc.framebuffer = fb;
+	enc.lines = lines;
+	enc.ch1_handoff = 0xffffu<<16;
+	for(int b=0; b<2; b++)
+	{
+		for(int ch=0; ch<3; ch++)
+			enc.line_buf[b][ch] = out+(b*3+ch)*TMDS_LINE_WORDS;
+	}
+	for(int l=0; l<lines; l++)
+		fill_test_line(fb+l*TMDS_FB_LINE_WORDS, l&1);
+
+	for(int l=0; l<lines; l++)
+	{
+		// Core 0 has to publish the handoff before core 1 gets to it; on the host they just run one after the other.
+		split_encode_core0(&enc, l, values, NULL);
+		split_encode_core1(&enc, l, values, NULL);
+		enc.core_done[0] = enc.core_done[1] = (uint32_t)l+1;
+		tmds_encode_line(tmds_lut, fb+l*TMDS_FB_LINE_WORDS, ref_lane, values);
+		for(int ch=0; ch<3; ch++)
+		{
+			if(memcmp(ref_lane[ch], enc.line_buf[l&1][ch], TMDS_LINE_WORDS*sizeof(uint32_t))!=0)
+			{
+				printf("Line %d channel %d: split encode differs from single core encode!\n", l, ch);
+				errors++;
+			}
+		}
+	}
+	free(fb);
+	free(ref);
+	free(out);
+	return errors;
+}
+
+int main(int argc, char **argv)
+{
+	int lines = 100000;
+	int clocks_per_pixel = 10;
+	int opt;
+	while((opt = getopt(argc, argv, "n:p:c:s:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'n': lines = atoi(optarg); break;
+			case 'p': stall_prob = atof(optarg); break;
+			case 'c': clocks_per_pixel = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0)|1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-n lines] [-p stall probability] [-c clocks per pixel] [-s seed]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	uint32_t *tmds_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(tmds_lut);
+	int errors = check_bit_exact(tmds_lut, 160);
+	printf("Bit-exact check over 160 lines: %s\n", errors ? "FAILED" : "ok");
+	free(tmds_lut);
+
+	struct core_time_t c0 = {0, 0, 0xffffffff}, c1 = {0, 0, 0xffffffff}, single = {0, 0, 0xffffffff}, finish = {0, 0, 0xffffffff};
+	uint64_t wait_total = 0;
+	uint32_t wait_max = 0;
+	int rest = TMDS_LINE_PIXELS-SPLIT_CH1_PIXELS;
+	for(int l=0; l<lines; l++)
+	{
+		// Core 0: channel 1 up to the split, handoff, channel 0, plus the IRQs landing somewhere in between.
+		uint32_t handoff = channel_cycles(SPLIT_CH1_PIXELS);
+		uint32_t t0 = handoff+channel_cycles(TMDS_LINE_PIXELS)+SPLIT_LINE_REPEAT*CYC_IRQ;
+		// Core 1: channel 2, the separation for the rest of channel 1, wait, then encode the rest.
+		uint32_t sep = rest*CYC_SEPARATE+stalls(rest*MEM_SEPARATE);
+		uint32_t before = channel_cycles(TMDS_LINE_PIXELS)+sep;
+		uint32_t wait = 0;
+		if(before<handoff)
+			wait = ((handoff-before+CYC_POLL-1)/CYC_POLL)*CYC_POLL;
+		uint32_t t1 = before+wait+channel_cycles(rest)-sep;
+		core_time_add(&c0, t0);
+		core_time_add(&c1, t1);
+		core_time_add(&finish, t0>t1 ? t0 : t1);
+		wait_total += wait;
+		if(wait>wait_max)
+			wait_max = wait;
+		// The same line on one core.
+		core_time_add(&single, 3*channel_cycles(TMDS_LINE_PIXELS)+SPLIT_LINE_REPEAT*CYC_IRQ);
+	}
+
+	uint32_t deadline = (3*H_TOTAL+(H_TOTAL-H_ACTIVE))*clocks_per_pixel;
+	printf("\nSplit point: %d pixels of channel 1 on core 0\n", SPLIT_CH1_PIXELS);
+	printf("Lines simulated: %d, stall probability per access: %.3f\n", lines, stall_prob);
+	printf("Deadline: %u cycles per input line (%d clocks per pixel)\n\n", deadline, clocks_per_pixel);
+	printf("              mean      min      max\n");
+	printf("Core 0    %8.1f %8u %8u\n", (double)c0.total/lines, c0.min, c0.max);
+	printf("Core 1    %8.1f %8u %8u\n", (double)c1.total/lines, c1.min, c1.max);
+	printf("Split     %8.1f %8u %8u\n", (double)finish.total/lines, finish.min, finish.max);
+	printf("One core  %8.1f %8u %8u\n\n", (double)single.total/lines, single.min, single.max);
+	printf("Imbalance (core 0 - core 1, mean): %.1f cycles (%.1f%%)\n",
+		((double)c0.total-(double)c1.total)/lines, 100.0*((double)c0.total-(double)c1.total)/(double)c0.total);
+	printf("Core 1 handoff wait: mean %.1f, max %u cycles\n", (double)wait_total/lines, wait_max);
+	printf("Worst-case slack: split %d cycles, one core %d cycles\n", (int)deadline-(int)finish.max, (int)deadline-(int)single.max);
+	// Lowest clocks per pixel where the worst case still fits
+	int line_pixels = 3*H_TOTAL+(H_TOTAL-H_ACTIVE);
+	printf("Minimum clocks per pixel for the worst case: split %d, one core %d\n",
+		(int)((finish.max+line_pixels-1)/line_pixels), (int)((single.max+line_pixels-1)/line_pixels));
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/*
+	host_util.h
+
+	Small helpers the host tools share: the xorshift32 generator for test data, a monotonic clock for the benchmarks,
+	the pixels of packed pair words, binary PPM (P6) files in and out, and the start and end of the headers the
+	planners and compilers generate.
+	It's all static in here, so including it doesn't change the Build: line of a tool.
+
+	rng_state starts at RNG_SEED (1 unless the tool defines it before including this), and tools with a -s option
+	set it directly, ORed with 1: 0 is the one state xorshift never leaves.
+*/
+
+#ifndef HOST_UTIL_H
+#define HOST_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef RNG_SEED
+#define RNG_SEED 1
+#endif
+
+static uint32_t rng_state = RNG_SEED;
+
+static inline uint32_t rng(void)
+{
+	rng_state ^= rng_state<<13;
+	rng_state ^= rng_state>>17;
+	rng_state ^= rng_state<<5;
+	return rng_state;
+}
+
+static inline double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+// Pixel x of a line of pixel pairs, the first in the upper half of each word (the framebuffer and capture layout)
+static inline uint16_t pair_pixel(const uint32_t *words, int x)
+{
+	return (uint16_t)((x&1) ? words[x>>1] : words[x>>1]>>16);
+}
+
+// Reads a width x height binary PPM with 8-bit channels into RGB555 pixels (red in bits 0-4, like the GBA), one line
+// after the other. Prints what's wrong and returns false if it can't be read or has another size.
+static inline bool read_ppm(const char *name, uint16_t *pixels, int width, int height)
+{
+	FILE *f = fopen(name, "rb");
+	if(!f)
+	{
+		fprintf(stderr, "Can't open %s\n", name);
+		return false;
+	}
+	int w, h, max;
+	bool ok = fscanf(f, "P6 %d %d %d", &w, &h, &max)==3 && w==width && h==height && max==255 && fgetc(f)!=EOF;
+	for(int i=0; ok && i<width*height; i++)
+	{
+		uint8_t rgb[3];
+		ok = fread(rgb, 1, 3, f)==3;
+		pixels[i] = (uint16_t)((rgb[0]>>3)|((rgb[1]>>3)<<5)|((rgb[2]>>3)<<10));
+	}
+	fclose(f);
+	if(!ok)
+		fprintf(stderr, "%s isn't a %dx%d binary PPM\n", name, width, height);
+	return ok;
+}
+
+// Writes width x height pixels of 3 bytes (red, green, blue) as a binary PPM.
+static inline bool write_ppm(const char *name, const uint8_t *rgb, int width, int height)
+{
+	FILE *f = fopen(name, "wb");
+	if(!f)
+	{
+		fprintf(stderr, "Can't write %s\n", name);
+		return false;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	bool ok = fwrite(rgb, 3, (size_t)width*height, f)==(size_t)width*height;
+	fclose(f);
+	return ok;
+}
+
+// Opens a generated header at path and starts its top comment with the name it has in src (whatever path is) and the
+// tool. The tool adds its own lines to the comment and then calls header_guard(). NULL (after saying so) if it can't
+// be written.
+static inline FILE *header_open(const char *path, const char *name, const char *tool)
+{
+	FILE *out = fopen(path, "w");
+	if(!out)
+	{
+		fprintf(stderr, "Can't write %s\n", path);
+		return NULL;
+	}
+	fprintf(out, "/*\n\t%s\n\n\tGenerated by scripts/%s, don't edit by hand.\n", name, tool);
+	return out;
+}
+
+// Ends the top comment and opens the include guard, which is the name in capitals (clock_config.h: CLOCK_CONFIG_H)
+static inline void header_guard(FILE *out, const char *name)
+{
+	char guard[128];
+	int i;
+	for(i=0; name[i] && i<(int)sizeof(guard)-1; i++)
+	{
+		char c = name[i];
+		guard[i] = (char)((c>='a' && c<='z') ? c-32 : ((c>='A' && c<='Z') || (c>='0' && c<='9')) ? c : '_');
+	}
+	guard[i] = 0;
+	fprintf(out, "*/\n\n#ifndef %s\n#define %s\n\n", guard, guard);
+}
+
+// Closes the include guard and the file
+static inline void header_close(FILE *out)
+{
+	fprintf(out, "#endif\n");
+	fclose(out);
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*
+	lcd_trace.c
+
+	Synthetic LCD signal generator (see lcd_trace.h.) Not a tool on its own, it's built into the ones that need it.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "lcd_trace.h"
+
+// 37*inverse = 1 mod 1024
+#define PATTERN_MUL 37
+#define PATTERN_INV 941
+
+void lcd_timing_gba(struct lcd_timing_t *timing)
+{
+	timing->width = 240;
+	timing->height = 160;
+	timing->dots_per_line = 308;
+	timing->lines_per_frame = 228;
+	timing->vsync_line = 226;
+	timing->vsync_lines = 2;
+	timing->dot_hz = 4194304.0;
+}
+
+void lcd_timing_gb(struct lcd_timing_t *timing)
+{
+	timing->width = 160;
+	timing->height = 144;
+	timing->dots_per_line = 456;
+	timing->lines_per_frame = 154;
+	timing->vsync_line = 152;
+	timing->vsync_lines = 2;
+	timing->dot_hz = 4194304.0;
+}
+
+uint16_t lcd_trace_pattern(void *ctx, int frame, int line, int x)
+{
+	(void)ctx;
+	return (uint16_t)((frame*PATTERN_MUL+line*5+x*3)&0x3ff);
+}
+
+// Frame number (mod 1024) that a pattern pixel came from
+int lcd_trace_pattern_frame(uint16_t value, int line, int x)
+{
+	return (int)((((uint32_t)value-(uint32_t)(line*5+x*3))*PATTERN_INV)&0x3ff);
+}
+
+int lcd_trace_pattern_check(uint16_t value, int line, int x, int *frame, bool *mixed)
+{
+	if(value&0xfc00)
+		return -1;
+	int f = lcd_trace_pattern_frame(value, line, x);
+	if(*frame<0)
+		*frame = f;
+	else if(f!=*frame)
+		*mixed = true;
+	return f;
+}
+
+bool lcd_trace_init(struct lcd_trace_t *t, const struct lcd_timing_t *timing, int cycles_per_dot, int off_dots,
+	int start_line, int max_frames)
+{
+	memset(t, 0, sizeof(struct lcd_trace_t));
+	t->timing = *timing;
+	t->data_base = 0;
+	t->data_bits = 10;
+	t->hsync_pin = 10;
+	t->vsync_pin = 11;
+	t->pclk_pin = 12;
+	t->cycles_per_dot = cycles_per_dot<2 ? 2 : (cycles_per_dot&~1);
+	t->pixel = lcd_trace_pattern;
+	t->max_frames = max_frames;
+	t->clean = (uint8_t *)calloc(max_frames, 1);
+	if(!t->clean)
+		return false;
+	t->off = off_dots;
+	t->restart_line = start_line;
+	t->frame = -1;
+	if(!off_dots)
+	{
+		t->frame = 0;
+		t->line = start_line;
+		t->clean[0] = start_line==0;
+	}
+	t->dot = (uint64_t)-1;
+	return true;
+}
+
+void lcd_trace_free(struct lcd_trace_t *t)
+{
+	free(t->clean);
+	t->clean = NULL;
+}
+
+bool lcd_trace_frame_clean(const struct lcd_trace_t *t, int frame)
+{
+	return frame>=0 && frame<t->max_frames && t->clean[frame];
+}
+
+static void mark_dirty(struct lcd_trace_t *t)
+{
+	if(t->frame>=0 && t->frame<t->max_frames && t->line<t->timing.height)
+		t->clean[t->frame] = 0;
+}
+
+static void start_frame(struct lcd_trace_t *t, int line)
+{
+	t->frame++;
+	t->line = line;
+	t->x = 0;
+	if(t->frame<t->max_frames)
+		t->clean[t->frame] = line==0;
+}
+
+static uint32_t sync_levels(const struct lcd_trace_t *t, bool hsync_low)
+{
+	const struct lcd_timing_t *tm = &t->timing;
+	bool vsync = t->line>=tm->vsync_line && t->line<tm->vsync_line+tm->vsync_lines;
+	return (hsync_low ? 0 : 1u<<t->hsync_pin)|(vsync ? 1u<<t->vsync_pin : 0);
+}
+
+static uint32_t data_levels(const struct lcd_trace_t *t, uint16_t value)
+{
+	return ((uint32_t)value&((1u<<t->data_bits)-1))<<t->data_base;
+}
+
+// Works out the levels of the next dot.
+static void next_dot(struct lcd_trace_t *t)
+{
+	const struct lcd_timing_t *tm = &t->timing;
+	if(!t->off && !t->extra)
+	{
+		while(t->next_event<t->event_count)
+		{
+			const struct lcd_event_t *ev = &t->events[t->next_event];
+			// Skips events at positions a restart jumped over
+			int64_t ev_pos = ((int64_t)ev->frame*t->timing.lines_per_frame+ev->line)*t->timing.dots_per_line+ev->x;
+			int64_t pos = ((int64_t)t->frame*t->timing.lines_per_frame+t->line)*t->timing.dots_per_line+t->x;
+			if(ev_pos<pos)
+			{
+				t->next_event++;
+				continue;
+			}
+			if(ev_pos>pos)
+				break;
+			t->next_event++;
+			switch(ev->kind)
+			{
+				case LCD_EVENT_OFF:
+					// The frame that's cut off only counts if it's past its active lines.
+					mark_dirty(t);
+					t->off = ev->dots;
+					t->restart_line = ev->restart_line;
+					break;
+				case LCD_EVENT_EXTRA_CLOCKS:
+					mark_dirty(t);
+					t->extra = ev->dots;
+					break;
+				case LCD_EVENT_LOST_CLOCKS:
+					mark_dirty(t);
+					t->lost = ev->dots;
+					break;
+			}
+		}
+	}
+
+	if(t->off)
+	{
+		t->level = 0;
+		t->clocked = false;
+		if(!--t->off)
+			start_frame(t, t->restart_line);
+		return;
+	}
+	if(t->extra)
+	{
+		t->extra--;
+		t->extra_clocks++;
+		t->level = sync_levels(t, true)|data_levels(t, (uint16_t)(0x2aa^t->extra));
+		t->clocked = true;
+		return;
+	}
+
+	bool active = t->line<tm->height && t->x<tm->width;
+	t->level = sync_levels(t, active);
+	if(active)
+		t->level |= data_levels(t, t->pixel(t->pixel_ctx, t->frame, t->line, t->x));
+	t->clocked = !t->lost;
+	if(t->lost)
+	{
+		t->lost--;
+		t->lost_clocks++;
+	}
+	if(++t->x==tm->dots_per_line)
+	{
+		t->x = 0;
+		if(++t->line==tm->lines_per_frame)
+			start_frame(t, 0);
+	}
+}
+
+uint32_t lcd_trace_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs)
+{
+	struct lcd_trace_t *t = (struct lcd_trace_t *)ctx;
+	(void)outputs;
+	(void)pindirs;
+	uint64_t dot = cycle/(uint64_t)t->cycles_per_dot;
+	while(t->dot!=dot)
+	{
+		t->dot++;
+		next_dot(t);
+	}
+	bool high = (cycle%(uint64_t)t->cycles_per_dot)>=(uint64_t)(t->cycles_per_dot/2);
+	return t->level|((t->clocked && high) ? 1u<<t->pclk_pin : 0);
+}
@@ -0,0 +1,81 @@
+/*
+	lcd_trace.h
+
+	Synthetic Gameboy LCD signals for the host tools, as a read_gpio callback for pio_emu: data pins, hsync, vsync and
+	pixel clock, one dot at a time, with power-on, reset and glitch events thrown in.
+	Levels follow what the capture programs in src expect: data is valid for the whole dot, the pixel clock is low for
+	the first half of it, hsync is low while active pixels are clocked out, and vsync is high for vsync_lines lines.
+*/
+
+#ifndef LCD_TRACE_H
+#define LCD_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum lcd_event_kind_t
+{
+	LCD_EVENT_OFF, // no signals for dots dots (power off or reset), then the LCD starts again at restart_line
+	LCD_EVENT_EXTRA_CLOCKS, // dots spurious pixel clocks with hsync low, without the LCD going forward
+	LCD_EVENT_LOST_CLOCKS // the pixel clock stays low for dots dots while the LCD goes on
+};
+
+struct lcd_event_t
+{
+	enum lcd_event_kind_t kind;
+	int frame, line, x; // where it starts
+	int dots;
+	int restart_line;
+};
+
+struct lcd_timing_t
+{
+	int width, height; // active dots and lines
+	int dots_per_line, lines_per_frame;
+	int vsync_line, vsync_lines;
+	double dot_hz;
+};
+
+struct lcd_trace_t
+{
+	struct lcd_timing_t timing;
+	int data_base, data_bits, hsync_pin, vsync_pin, pclk_pin;
+	int cycles_per_dot; // emulator cycles, even
+	uint16_t (*pixel)(void *ctx, int frame, int line, int x);
+	void *pixel_ctx;
+	const struct lcd_event_t *events;
+	int event_count;
+	// Frames with all active lines sent without an event, up to max_frames
+	uint8_t *clean;
+	int max_frames;
+	// State
+	int next_event;
+	uint64_t dot;
+	int frame, line, x;
+	int off, extra, lost;
+	int restart_line;
+	uint32_t level; // pins other than the pixel clock for the current dot
+	bool clocked;
+	uint64_t extra_clocks, lost_clocks;
+};
+
+// GBA: 240x160 of 308x228 dots at 2^22Hz
+void lcd_timing_gba(struct lcd_timing_t *timing);
+// DMG and GBC: 160x144 of 456x154 dots at 2^22Hz
+void lcd_timing_gb(struct lcd_timing_t *timing);
+// Starts off for off_dots dots, then at start_line of frame 0. Pins: data from GP0, hsync GP10, vsync GP11, pixel
+// clock GP12 (lcd_cap_9bpp.pio) until changed.
+bool lcd_trace_init(struct lcd_trace_t *t, const struct lcd_timing_t *timing, int cycles_per_dot, int off_dots,
+	int start_line, int max_frames);
+void lcd_trace_free(struct lcd_trace_t *t);
+// pio_emu read_gpio callback, ctx is the trace. cycle has to go up.
+uint32_t lcd_trace_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs);
+bool lcd_trace_frame_clean(const struct lcd_trace_t *t, int frame);
+// Default pixel pattern: 10 bits that give the frame number back from any pixel (see lcd_trace_pattern_frame().)
+uint16_t lcd_trace_pattern(void *ctx, int frame, int line, int x);
+int lcd_trace_pattern_frame(uint16_t value, int line, int x);
+// Frame of a captured pattern pixel, -1 if it has bits set above the 10 of the pattern (so it wasn't captured.)
+// *frame is the frame of the picture so far, -1 before its first pixel; *mixed is set if this one is from another.
+int lcd_trace_pattern_check(uint16_t value, int line, int x, int *frame, bool *mixed);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+	line_cache_bench.c
+
+	Runs the line cache (src/line_cache.h) through the split encode over sequences of frames and reports how many
+	lines changed per frame, how many line encodes the cache saves, and what that costs in SRAM, for a range of entry
+	counts. Every line the encoder hands to DMA is checked against a plain encode of the same framebuffer line, so a
+	hit that returns the wrong line shows up.
+
+	Without -r it makes its own Gameboy-like sequences out of tiles, a text box and sprites:
+	-pause: nothing moves
+	-menu: a cursor moves every 20 frames and an arrow blinks
+	-text: a text box fills in one character every 2 frames
+	-walk: the background scrolls sideways 1 pixel a frame, with a few sprites walking around
+	-vscroll: the background scrolls up 1 pixel a frame, so every line changes but is the line below from the last frame
+	-r file runs a recording instead: 240x160 frames of 16-bit little-endian pixels (bits 0-4 red, 5-9 green,
+	10-14 blue), one after the other, like an emulator's raw frame dump.
+
+	Work saved counts the hash and the cache lookup against the encodes that were skipped, with the same cycle estimates
+	as encode_split_sim.c. SRAM is the cache entries plus their bookkeeping; the 2 line buffers are there anyway.
+
+	Build: gcc -O2 -o line_cache_bench line_cache_bench.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./line_cache_bench [-f frames per sequence] [-r recording] [-s seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "host_util.h"
+// Room for one entry per line, to see how far it goes
+#define LINE_CACHE_ENTRIES 160
+#include "../src/tmds_encode_split.h"
+
+#define WIDTH TMDS_LINE_PIXELS
+#define HEIGHT 160
+#define FRAME_WORDS (TMDS_FB_LINE_WORDS*HEIGHT)
+
+// Same estimates as encode_split_sim.c: 19 cycles per pixel and channel, 36 per group of 16, 3 channels
+#define CYC_LINE (3*(WIDTH*19+(WIDTH/TMDS_PACK_GROUP)*36))
+// Hash: 2 loads, 2 multiplies, xor/add/shift per word; lookup: key compare and stamp check per entry
+#define CYC_HASH_WORD 8
+#define CYC_LOOKUP_ENTRY 7
+
+#define TILES 64
+#define MAP_SIZE 32
+
+static const int entry_counts[] = {0, 4, 8, 16, 24, 32, 64, 160};
+#define ENTRY_COUNTS ((int)(sizeof(entry_counts)/sizeof(entry_counts[0])))
+
+// A tile-based screen, rendered into 15-bit pixels
+struct scene_t
+{
+	uint8_t tile[TILES][8][8]; // 2-bit color indexes
+	uint8_t map[MAP_SIZE][MAP_SIZE];
+	uint16_t palette[4], sprite_palette[4], text_palette[4];
+	int scroll_x, scroll_y;
+	bool text_box;
+	int text_chars;
+	int sprite_count;
+	int sprite_x[8], sprite_y[8], sprite_tile[8];
+};
+
+static uint16_t rgb(int r, int g, int b)
+{
+	return (uint16_t)((r&0x1f)|((g&0x1f)<<5)|((b&0x1f)<<10));
+}
+
+static void scene_init(struct scene_t *sc)
+{
+	memset(sc, 0, sizeof(struct scene_t));
+	// Tile 0 is plain, 1-15 are textures (bricks, grass), 16-63 are letters and objects
+	for(int t=1; t<TILES; t++)
+	{
+		for(int y=0; y<8; y++)
+		{
+			for(int x=0; x<8; x++)
+			{
+				uint8_t c;
+				if(t<8)
+					c = (uint8_t)(((x+t)%4==0 || y==7) ? 3 : ((x^y)&1)+1);
+				else if(t<16)
+					c = (uint8_t)((rng()%5==0) ? 2 : 1);
+				else
+					c = (uint8_t)((x>0 && x<7 && y>0 && y<7 && (rng()&1)) ? 3 : 0);
+				sc->tile[t][y][x] = c;
+			}
+		}
+	}
+	for(int y=0; y<MAP_SIZE; y++)
+	{
+		for(int x=0; x<MAP_SIZE; x++)
+		{
+			uint8_t t = 0;
+			if(y>=12)
+				t = (uint8_t)(8+rng()%8);
+			else if(y>=8)
+				t = (uint8_t)(1+(x+y)%7);
+			else if(y==3 && (x%9)<3)
+				t = (uint8_t)(16+x%9); // a few clouds
+			sc->map[y][x] = t;
+		}
+	}
+	sc->palette[0] = rgb(24, 28, 31);
+	sc->palette[1] = rgb(8, 20, 6);
+	sc->palette[2] = rgb(4, 12, 3);
+	sc->palette[3] = rgb(2, 4, 2);
+	sc->sprite_palette[0] = 0;
+	sc->sprite_palette[1] = rgb(31, 20, 12);
+	sc->sprite_palette[2] = rgb(20, 4, 4);
+	sc->sprite_palette[3] = rgb(4, 2, 2);
+	sc->text_palette[0] = rgb(31, 31, 31);
+	sc->text_palette[1] = rgb(31, 31, 31);
+	sc->text_palette[2] = rgb(12, 12, 12);
+	sc->text_palette[3] = rgb(0, 0, 0);
+}
+
+static uint16_t scene_pixel(const struct scene_t *sc, int x, int y)
+{
+	// Sprites on top
+	for(int s=0; s<sc->sprite_count; s++)
+	{
+		int dx = x-sc->sprite_x[s], dy = y-sc->sprite_y[s];
+		if(dx>=0 && dx<8 && dy>=0 && dy<8)
+		{
+			uint8_t c = sc->tile[sc->sprite_tile[s]][dy][dx];
+			if(c)
+				return sc->sprite_palette[c];
+		}
+	}
+	// Text box: lines 112-159, a border and 2 rows of 26 characters
+	if(sc->text_box && y>=112)
+	{
+		int bx = x-4, by = y-116;
+		if(x<4 || x>=WIDTH-4 || y<116 || y>=HEIGHT-4)
+			return sc->text_palette[3];
+		int row = by/12, col = bx/8;
+		int cy = by%12, cx = bx%8;
+		int index = row*28+col;
+		if(row<3 && col>=1 && col<=26 && cy>=2 && cy<10 && index<sc->text_chars)
+			return sc->text_palette[sc->tile[16+(index*7)%48][cy-2][cx]];
+		return sc->text_palette[0];
+	}
+	int mx = (x+sc->scroll_x)&(MAP_SIZE*8-1), my = (y+sc->scroll_y)&(MAP_SIZE*8-1);
+	return sc->palette[sc->tile[sc->map[my>>3][mx>>3]][my&7][mx&7]];
+}
+
+static void scene_render(const struct scene_t *sc, uint32_t *fb)
+{
+	for(int y=0; y<HEIGHT; y++)
+	{
+		for(int x=0; x<WIDTH; x+=2)
+			fb[y*TMDS_FB_LINE_WORDS+x/2] = ((uint32_t)scene_pixel(sc, x, y)<<16)|scene_pixel(sc, x+1, y);
+	}
+}
+
+// Frame f of a synthetic sequence
+static void sequence_frame(const char *name, struct scene_t *sc, int f, uint32_t *fb)
+{
+	if(!strcmp(name, "menu"))
+	{
+		sc->sprite_count = 2;
+		sc->sprite_x[0] = 40;
+		sc->sprite_y[0] = 40+24*((f/20)%4);
+		sc->sprite_tile[0] = 20;
+		// Blinking arrow
+		sc->sprite_x[1] = 200;
+		sc->sprite_y[1] = ((f/30)&1) ? 200 : 140;
+		sc->sprite_tile[1] = 21;
+	}
+	else if(!strcmp(name, "text"))
+	{
+		sc->text_box = true;
+		sc->text_chars = f/2;
+	}
+	else if(!strcmp(name, "walk"))
+	{
+		sc->scroll_x = f;
+		sc->sprite_count = 3;
+		sc->sprite_x[0] = 116;
+		sc->sprite_y[0] = 88+((f/8)&1);
+		sc->sprite_tile[0] = 22;
+		for(int s=1; s<3; s++)
+		{
+			sc->sprite_x[s] = (60*s+f*s)%WIDTH;
+			sc->sprite_y[s] = 80+8*s;
+			sc->sprite_tile[s] = 22+s;
+		}
+	}
+	else if(!strcmp(name, "vscroll"))
+		sc->scroll_y = f;
+	scene_render(sc, fb);
+}
+
+struct result_t
+{
+	uint64_t lines, dirty, hits, errors;
+	uint32_t frames, static_frames;
+};
+
+// Encodes every line of frames frames through the split encode with a cache of entries entries (0 for none.)
+static void run(const uint32_t *tmds_lut, const uint32_t *frames, int frame_count, int entries, struct result_t *res)
+{
+	static uint32_t buffers[(LINE_CACHE_ENTRIES+2)*3][TMDS_LINE_WORDS];
+	uint32_t ref[3][TMDS_LINE_WORDS];
+	uint32_t *ref_lane[3] = {ref[0], ref[1], ref[2]};
+	uint32_t *entry_lanes[LINE_CACHE_ENTRIES*3];
+	uint32_t *scratch[2][3];
+	uint8_t values[TMDS_LINE_PIXELS];
+	static struct line_cache_t cache;
+	struct split_encode_t enc;
+
+	memset(res, 0, sizeof(struct result_t));
+	memset(&enc, 0, sizeof(enc));
+	enc.tmds_lut = tmds_lut;
+	enc.lines = HEIGHT;
+	enc.ch1_handoff = 0xffffu<<16;
+	enc.cache_handoff = 0xffffu<<16;
+	for(int b=0; b<2; b++)
+	{
+		for(int n=0; n<3; n++)
+			scratch[b][n] = enc.line_buf[b][n] = buffers[b*3+n];
+	}
+	for(int i=0; i<entries*3; i++)
+		entry_lanes[i] = buffers[6+i];
+	if(entries)
+	{
+		line_cache_init(&cache, entry_lanes, entries, scratch, HEIGHT);
+		enc.cache = &cache;
+	}
+
+	uint32_t seq = 0;
+	for(int f=0; f<frame_count; f++)
+	{
+		enc.framebuffer = frames+(size_t)f*FRAME_WORDS;
+		for(int l=0; l<HEIGHT; l++, seq++)
+		{
+			// The line number only matters mod enc.lines, so the running count makes it go through the frame.
+			split_encode_core0(&enc, seq, values, NULL);
+			split_encode_core1(&enc, seq, values, NULL);
+			enc.core_done[0] = enc.core_done[1] = seq+1;
+			tmds_encode_line(tmds_lut, enc.framebuffer+l*TMDS_FB_LINE_WORDS, ref_lane, values);
+			for(int n=0; n<3; n++)
+			{
+				if(memcmp(ref[n], enc.line_buf[seq&1][n], sizeof(ref[n])))
+				{
+					res->errors++;
+					break;
+				}
+			}
+		}
+	}
+	res->lines = seq;
+	if(entries)
+	{
+		// The last frame only gets counted at the start of the next one
+		res->dirty = cache.dirty;
+		res->hits = cache.hits;
+		res->frames = cache.frames+1;
+		res->static_frames = cache.static_frames+(cache.frame_dirty ? 0 : 1);
+	}
+}
+
+static uint32_t cache_sram(int entries)
+{
+	if(!entries)
+		return 0;
+	return (uint32_t)(entries*(3*TMDS_LINE_WORDS*sizeof(uint32_t)+sizeof(struct line_cache_entry_t))
+		+HEIGHT*(sizeof(struct line_cache_key_t)+sizeof(int16_t))+64);
+}
+
+static bool report(const char *name, const uint32_t *tmds_lut, const uint32_t *frames, int frame_count)
+{
+	struct result_t res[ENTRY_COUNTS];
+	bool ok = true;
+	for(int i=0; i<ENTRY_COUNTS; i++)
+	{
+		run(tmds_lut, frames, frame_count, entry_counts[i], &res[i]);
+		if(res[i].errors)
+			ok = false;
+	}
+	// The dirty count doesn't depend on the cache size. All lines of the first frame count as changed.
+	const struct result_t *r = &res[1];
+	printf("%s: %d frames, %.1f of %d lines changed per frame on average, %u static frames\n", name, frame_count,
+		(double)(r->dirty-HEIGHT)/(r->frames-1), HEIGHT, r->static_frames);
+	printf("  entries      SRAM    hits   encoded   work saved   mismatches\n");
+	for(int i=0; i<ENTRY_COUNTS; i++)
+	{
+		const struct result_t *x = &res[i];
+		uint64_t encoded = x->lines-x->hits;
+		double plain = (double)x->lines*CYC_LINE;
+		double cost = (double)encoded*CYC_LINE;
+		if(entry_counts[i])
+			cost += (double)x->lines*(TMDS_FB_LINE_WORDS*CYC_HASH_WORD+entry_counts[i]*CYC_LOOKUP_ENTRY);
+		printf("  %7d %7.1fKB %6.1f%% %8.1f%% %11.1f%% %12llu\n", entry_counts[i], cache_sram(entry_counts[i])/1024.0,
+			100.0*x->hits/x->lines, 100.0*encoded/x->lines, 100.0*(1.0-cost/plain), (unsigned long long)x->errors);
+	}
+	printf("\n");
+	return ok;
+}
+
+static uint32_t *load_recording(const char *path, int *frame_count)
+{
+	FILE *file = fopen(path, "rb");
+	if(!file)
+	{
+		perror(path);
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	int count = (int)(size/(WIDTH*HEIGHT*2));
+	if(!count)
+	{
+		fprintf(stderr, "%s is smaller than one 240x160 frame\n", path);
+		fclose(file);
+		return NULL;
+	}
+	uint32_t *frames = (uint32_t *)malloc((size_t)count*FRAME_WORDS*sizeof(uint32_t));
+	uint8_t pixels[WIDTH*2];
+	for(int i=0; i<count*HEIGHT; i++)
+	{
+		if(fread(pixels, 1, sizeof(pixels), file)!=sizeof(pixels))
+			break;
+		for(int x=0; x<WIDTH; x+=2)
+		{
+			uint32_t p0 = (pixels[2*x]|(pixels[2*x+1]<<8))&0x7fff;
+			uint32_t p1 = (pixels[2*x+2]|(pixels[2*x+3]<<8))&0x7fff;
+			frames[(size_t)i*TMDS_FB_LINE_WORDS+x/2] = (p0<<16)|p1;
+		}
+	}
+	fclose(file);
+	*frame_count = count;
+	return frames;
+}
+
+int main(int argc, char **argv)
+{
+	int frame_count = 120;
+	const char *recording = NULL;
+	static const char *names[] = {"pause", "menu", "text", "walk", "vscroll"};
+	int opt;
+	while((opt = getopt(argc, argv, "f:r:s:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': frame_count = atoi(optarg); break;
+			case 'r': recording = optarg; break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0)|1; break;
+			default:
+				fprintf(stderr, "See the top of line_cache_bench.c for the options.\n");
+				return 1;
+		}
+	}
+	if(frame_count<2)
+		frame_count = 2;
+
+	uint32_t *tmds_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(tmds_lut);
+	printf("Encode of one line: about %d cycles, hash %d, lookup %d per entry\n\n", CYC_LINE,
+		TMDS_FB_LINE_WORDS*CYC_HASH_WORD, CYC_LOOKUP_ENTRY);
+
+	bool ok = true;
+	if(recording)
+	{
+		int count;
+		uint32_t *frames = load_recording(recording, &count);
+		if(!frames)
+			return 1;
+		ok = report(recording, tmds_lut, frames, count);
+		free(frames);
+	}
+	else
+	{
+		uint32_t *frames = (uint32_t *)malloc((size_t)frame_count*FRAME_WORDS*sizeof(uint32_t));
+		struct scene_t *scene = (struct scene_t *)malloc(sizeof(struct scene_t));
+		for(int s=0; s<(int)(sizeof(names)/sizeof(names[0])); s++)
+		{
+			uint32_t seed = rng_state;
+			scene_init(scene);
+			for(int f=0; f<frame_count; f++)
+				sequence_frame(names[s], scene, f, frames+(size_t)f*FRAME_WORDS);
+			ok = report(names[s], tmds_lut, frames, frame_count) && ok;
+			rng_state = seed*69069u+1;
+		}
+		free(scene);
+		free(frames);
+	}
+	if(!ok)
+		printf("Cached lines didn't match the plain encode!\n");
+	free(tmds_lut);
+	return ok ? 0 : 1;
+}
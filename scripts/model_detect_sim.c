@@ -0,0 +1,582 @@
+/*
+	model_detect_sim.c
+
+	Runs the model detection (src/model_detect.h) on one board that gets a GBA, then a GBC, then a DMG, then a GBA again,
+	with the LCD off for a while in between, and checks that it picks the right pipeline every time without the output
+	ever stopping.
+
+	lcd_capture (src/lcd_cap_15bpp_mux.pio), lcd_capture_dmg (src/lcd_cap_dmg.pio) and vsync_interruptor (src/vsync.pio,
+	V on GP11) are all loaded on one pio_emu like on the capture PIO, behind the same '541 model as capture_format_check.c,
+	and lcd_timing (src/lcd_timing.pio) runs on a second one. Channels 8, 9 and 10 and the vsync IRQ are modeled like in
+	capture_sim.c and model_detect.c: at every vsync the hook gets the line count and pixel clocks lcd_timing pushed, the
+	time since the last vsync and GP28, and a switch restarts the capture at the other program with the other format.
+	The GBA and GBC send the 10-bit pattern of lcd_trace.c, the DMG sends shade (frame+line+x)&3 on LD0 and LD1.
+
+	The encoder runs all the time at the output line rate: split_encode_core0()/core1() with model_next_frame() as it is
+	in model_detect.c, so every frame comes with the LUT and placement of its own format. Every line it encodes is checked:
+	-the frame has to be one frame from the model its format says, with the border where it should be
+	-every TMDS symbol has to decode to the 8-bit value the pixel should have with the LUT of that format (RGB555 expanded,
+	 or the DMG palette)
+	and the detection can never pick a model that isn't the one connected.
+
+	Options: -f LCD frames per console, -c emulator cycles per dot, -i vsync IRQ latency in cycles, -v (print every switch
+	and the frames around it), -d path to src.
+
+	Build: gcc -O2 -o model_detect_sim model_detect_sim.c lcd_trace.c pio_emu.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./model_detect_sim [-f 12] [-c 24] [-v]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "pio_emu.h"
+#include "lcd_trace.h"
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#include "host_util.h"
+#include "../src/model_detect.h"
+
+#define CAPTURE_SM 0
+#define VSYNC_SM 1
+#define TIMING_SM 3
+#define VSYNC_PIN 11
+#define OUT_LINES 539
+#define OUT_FRAME_HZ (29400000.0/(912.0*539.0))
+#define MAX_FRAMES 1024
+#define SEGMENTS 4
+// Same '541 model as capture_format_check.c
+#define PIXEL_PINS 16
+#define DATA_BASE 2
+#define OE_PINS 3u
+#define OE_SETTLE 5
+
+struct segment_t
+{
+	int model;
+	bool strap;
+	int base; // global number of the first frame
+	// Results
+	int switched_at, first_shown; // LCD frame of the segment, -1 if it didn't happen
+	uint32_t shown;
+};
+
+struct sim_t
+{
+	struct pio_emu_t cap_emu, timing_emu;
+	struct lcd_trace_t trace;
+	int seg;
+	uint64_t seg_start;
+	// GPIO levels of the current cycle, without the '541s
+	uint64_t level_cycle;
+	uint32_t level;
+	uint32_t last_oe;
+	uint64_t oe_changed;
+
+	struct capture_manager_t mgr;
+	struct model_detect_t detect;
+	uint32_t *buffers[CAPTURE_MAX_BUFFERS];
+	const struct pio_program_t *capture_prog[MODEL_CAPTURES];
+	int capture_offset[MODEL_CAPTURES];
+	struct pio_sm_config_t capture_cfg;
+	int program;
+	// Channels 8, 9 and 10
+	uint32_t dma_words, sink;
+	uint32_t timing_line, timing_lines;
+	uint64_t irq_at, last_vsync;
+	bool irq_pending;
+
+	// Encoder
+	struct split_encode_t enc;
+	uint32_t lane_mem[2][3][TMDS_LINE_WORDS];
+	const uint32_t *luts[MODEL_LUTS];
+	int held, slot_format[2];
+	uint32_t enc_line;
+	double line_cycles, next_line;
+	int out_line;
+	int frame_id;
+	bool mixed, garbage, wrong_border, wrong_model, wrong_tmds;
+	// Results
+	uint32_t out_frames, blank, whole, bad_frames, wrong_picks;
+	uint32_t tmds_checked;
+};
+
+static struct segment_t segments[SEGMENTS] =
+{
+	{LCD_MODEL_GBA, false, 0, -1, -1, 0},
+	{LCD_MODEL_GBC, false, 0, -1, -1, 0},
+	{LCD_MODEL_DMG, true, 0, -1, -1, 0},
+	// A GBA with the strap still high for the DMG: the size alone says it's a GBA
+	{LCD_MODEL_GBA, true, 0, -1, -1, 0},
+};
+static const uint32_t dmg_palette[4] = {0x9bbc0f, 0x8bac0f, 0x306230, 0x0f380f};
+static int seg_frames = 12;
+static int cycles_per_dot = 24;
+static int irq_latency = 200;
+static bool verbose;
+static int frame_model[MAX_FRAMES];
+static struct sim_t *sim;
+
+static uint16_t pixel_at(void *ctx, int frame, int line, int x)
+{
+	const struct segment_t *seg = (const struct segment_t *)ctx;
+	int id = (seg->base+frame)%MAX_FRAMES;
+	if(seg->model==LCD_MODEL_DMG)
+		return (uint16_t)((id+line+x)&3);
+	return lcd_trace_pattern(NULL, id, line, x);
+}
+
+static uint32_t lcd_level(uint64_t cycle)
+{
+	if(cycle!=sim->level_cycle)
+	{
+		sim->level_cycle = cycle;
+		sim->level = lcd_trace_gpio(&sim->trace, cycle-sim->seg_start, 0, 0);
+	}
+	return sim->level;
+}
+
+// lcd_timing only looks at the sync and clock pins
+static uint32_t timing_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs)
+{
+	(void)ctx;
+	(void)outputs;
+	(void)pindirs;
+	return lcd_level(cycle)&~(0x7fffu<<PIXEL_PINS);
+}
+
+// The 2 '541s in front of GP2-GP9 (see capture_format_check.c)
+static uint32_t capture_gpio(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs)
+{
+	(void)ctx;
+	(void)pindirs;
+	uint32_t level = lcd_level(cycle);
+	uint32_t pixel = (level>>PIXEL_PINS)&0x7fff;
+	level &= ~(0x7fffu<<PIXEL_PINS);
+	uint32_t oe = outputs&OE_PINS;
+	if(oe!=sim->last_oe)
+	{
+		sim->last_oe = oe;
+		sim->oe_changed = cycle;
+	}
+	uint32_t bus = 0xff;
+	if(oe && oe!=OE_PINS && cycle-sim->oe_changed>=OE_SETTLE)
+		bus = oe==2 ? pixel&0xff : pixel>>8;
+	return level|(bus<<DATA_BASE);
+}
+
+static void start_segment(int s)
+{
+	struct segment_t *seg = &segments[s];
+	struct lcd_timing_t timing;
+	if(seg->model==LCD_MODEL_GBA)
+		lcd_timing_gba(&timing);
+	else
+		lcd_timing_gb(&timing);
+	if(s>0)
+		lcd_trace_free(&sim->trace);
+	seg->base = s ? segments[s-1].base+seg_frames+1 : 0;
+	seg->switched_at = seg->first_shown = -1;
+	for(int f=0; f<seg_frames; f++)
+		frame_model[(seg->base+f)%MAX_FRAMES] = seg->model;
+	// Off for a bit more than a frame: the cartridge is swapped over to the next console
+	int off = timing.dots_per_line*timing.lines_per_frame*3/2;
+	lcd_trace_init(&sim->trace, &timing, cycles_per_dot, off, 0, seg_frames+1);
+	sim->trace.data_base = PIXEL_PINS;
+	sim->trace.data_bits = 15;
+	sim->trace.pixel = pixel_at;
+	sim->trace.pixel_ctx = seg;
+	sim->seg = s;
+	sim->seg_start = sim->cap_emu.cycle;
+	sim->level_cycle = (uint64_t)-1;
+}
+
+static bool load_programs(const char *src_dir)
+{
+	static struct pio_program_t programs[4][PIO_MAX_PROGRAMS];
+	static const char *files[4][2] =
+	{
+		{"lcd_cap_15bpp_mux.pio", "lcd_capture"},
+		{"lcd_cap_dmg.pio", "lcd_capture_dmg"},
+		{"vsync.pio", "vsync_interruptor"},
+		{"lcd_timing.pio", "lcd_timing"}
+	};
+	const struct pio_program_t *prog[4];
+	struct pio_define_t define = {"V", VSYNC_PIN};
+	for(int i=0; i<4; i++)
+	{
+		prog[i] = pio_load_program(src_dir, files[i][0], files[i][1], &define, 1, programs[i]);
+		if(!prog[i])
+			return false;
+	}
+
+	pio_emu_init(&sim->cap_emu);
+	sim->cap_emu.read_gpio = capture_gpio;
+	sim->cap_emu.pins = OE_PINS;
+	int used = 0;
+	for(int i=0; i<MODEL_CAPTURES; i++)
+	{
+		sim->capture_prog[i] = prog[i];
+		sim->capture_offset[i] = pio_emu_load(&sim->cap_emu, prog[i], -1);
+		used += prog[i]->length;
+	}
+	int vsync_offset = pio_emu_load(&sim->cap_emu, prog[2], -1);
+	used += prog[2]->length;
+	if(sim->capture_offset[0]<0 || sim->capture_offset[1]<0 || vsync_offset<0)
+	{
+		fprintf(stderr, "The capture programs don't fit in one PIO\n");
+		return false;
+	}
+	printf("Capture PIO: lcd_capture %d, lcd_capture_dmg %d, vsync_interruptor %d instructions (%d of 32)\n",
+		prog[0]->length, prog[1]->length, prog[2]->length, used);
+	pio_sm_default_config(&sim->capture_cfg);
+	sim->capture_cfg.in_base = DATA_BASE;
+	sim->capture_cfg.set_base = 0;
+	sim->capture_cfg.set_count = 2;
+	sim->capture_cfg.in_shift_right = false;
+	sim->capture_cfg.autopush = true;
+	sim->capture_cfg.push_threshold = 32;
+	sim->program = lcd_models[LCD_MODEL_GBA].capture;
+	pio_sm_start(&sim->cap_emu, CAPTURE_SM, prog[sim->program], sim->capture_offset[sim->program], 0, &sim->capture_cfg);
+	struct pio_sm_config_t cfg;
+	pio_sm_default_config(&cfg);
+	pio_sm_start(&sim->cap_emu, VSYNC_SM, prog[2], vsync_offset, 0, &cfg);
+
+	pio_emu_init(&sim->timing_emu);
+	sim->timing_emu.read_gpio = timing_gpio;
+	int timing_offset = pio_emu_load(&sim->timing_emu, prog[3], -1);
+	pio_sm_default_config(&cfg);
+	cfg.jmp_pin = 10;
+	pio_sm_start(&sim->timing_emu, TIMING_SM, prog[3], timing_offset, 0, &cfg);
+	return true;
+}
+
+// capture_vsync_irq() in capture_manager.c with model_vsync_hook() from model_detect.c
+static void vsync_irq(double emu_hz)
+{
+	uint64_t cycle = sim->cap_emu.cycle;
+	struct lcd_measure_t ms;
+	ms.lines = sim->timing_lines;
+	ms.line_pixels = sim->timing_line;
+	ms.frame_us = (uint32_t)((double)(cycle-sim->last_vsync)*1e6/emu_hz);
+	ms.strap = segments[sim->seg].strap;
+	sim->last_vsync = cycle;
+	sim->timing_lines = 0;
+	if(model_detect_vsync(&sim->detect, &sim->mgr, &ms))
+	{
+		struct segment_t *seg = &segments[sim->seg];
+		int model = sim->detect.model;
+		if(model!=seg->model)
+			sim->wrong_picks++;
+		else if(seg->switched_at<0)
+			seg->switched_at = sim->trace.frame;
+		sim->program = lcd_models[model].capture;
+		if(verbose)
+			printf("  LCD frame %d of the %s: switched to %s (%u pixel clocks, %u lines, %uus, GP28 %s)\n",
+				sim->trace.frame, lcd_models[seg->model].name, lcd_models[model].name, ms.line_pixels, ms.lines,
+				ms.frame_us, ms.strap ? "high" : "low");
+	}
+	capture_vsync(&sim->mgr, sim->dma_words);
+	pio_sm_start(&sim->cap_emu, CAPTURE_SM, sim->capture_prog[sim->program], sim->capture_offset[sim->program], 0,
+		&sim->capture_cfg);
+	sim->dma_words = 0;
+}
+
+// model_next_frame() in model_detect.c, without the spin lock
+static void next_frame(struct split_encode_t *enc, struct split_frame_t *frame)
+{
+	if(sim->held>=0)
+		capture_display_end(&sim->mgr);
+	int b = capture_display_begin(&sim->mgr);
+	sim->held = b;
+	int format = sim->mgr.buffer_format[b];
+	sim->slot_format[frame==&enc->frame[0] ? 0 : 1] = format;
+	model_frame(frame, format, sim->mgr.buffer[b], sim->luts);
+}
+
+// model_frame_line() in model_detect.c, without the spin lock
+static void frame_line(struct split_encode_t *enc, int line)
+{
+	(void)enc;
+	capture_display_line(&sim->mgr, line, sim->dma_words);
+}
+
+// 8-bit value a 5-bit channel value should come out as with the LUT of format
+static uint8_t expected_8b(int format, int channel, uint32_t value)
+{
+	uint8_t c;
+	if(format==LCD_MODEL_DMG)
+	{
+		int shade = channel==0 ? (int)value-0x1c : (channel==1 ? (int)(value>>3) : (int)value-0x04);
+		c = (uint8_t)(dmg_palette[shade&3]>>(8*channel));
+		if(c==0x00 || c==0xff)
+			c ^= 0x01;
+		return c;
+	}
+	return depth_convert((uint8_t)value);
+}
+
+static void check_line(uint32_t line, const uint32_t *fb_line, int format)
+{
+	const struct split_frame_t *f = &sim->enc.frame[(line/sim->enc.lines)&1];
+	int y = (int)(line%sim->enc.lines);
+	bool inside_y = format!=CAPTURE_FORMAT_NONE && y>=f->y && y<f->y+f->height;
+	for(int x=0; x<TMDS_LINE_PIXELS; x++)
+	{
+		uint32_t pixel = pair_pixel(fb_line, x)&0x7fff;
+		int fx = x-2*f->x_words;
+		if(!inside_y || fx<0 || fx>=2*f->line_words)
+		{
+			if(fb_line[x>>1]!=f->border)
+				sim->wrong_border = true;
+			continue;
+		}
+		int id;
+		if(format==LCD_MODEL_DMG)
+		{
+			int shade = (int)(pixel&3);
+			if(pixel!=(uint32_t)DMG_PIXEL(shade))
+			{
+				sim->garbage = true;
+				continue;
+			}
+			id = (shade-(y-f->y)-fx)&3;
+		}
+		else
+		{
+			if(pixel&0x7c00)
+			{
+				sim->garbage = true;
+				continue;
+			}
+			id = lcd_trace_pattern_frame((uint16_t)pixel, y-f->y, fx);
+			if(frame_model[id]!=format)
+				sim->wrong_model = true;
+		}
+		if(sim->frame_id<0)
+			sim->frame_id = id;
+		else if(id!=sim->frame_id)
+			sim->mixed = true;
+	}
+
+	// The TMDS words have to be the pixels through the LUT of the format
+	uint32_t **lane = sim->enc.line_buf[line&1];
+	for(int ch=0; ch<3; ch++)
+	{
+		uint16_t symbols[3*TMDS_LINE_PIXELS];
+		unpack_single(lane[ch], symbols, 3*TMDS_LINE_PIXELS);
+		for(int x=0; x<TMDS_LINE_PIXELS; x++)
+		{
+			uint32_t pixel = pair_pixel(fb_line, x)&0x7fff;
+			uint32_t value = (pixel>>tmds_channel_shift(ch))&0x1f;
+			int lut_format = format==LCD_MODEL_DMG ? LCD_MODEL_DMG : LCD_MODEL_GBA;
+			for(int r=0; r<3; r++)
+			{
+				if(tmds_decode_video(symbols[3*x+r])!=expected_8b(lut_format, ch, value))
+					sim->wrong_tmds = true;
+			}
+		}
+	}
+	sim->tmds_checked++;
+}
+
+static void end_frame(int format)
+{
+	sim->out_frames++;
+	bool bad = sim->garbage || sim->mixed || sim->wrong_border || sim->wrong_model || sim->wrong_tmds;
+	if(bad)
+	{
+		sim->bad_frames++;
+		printf("  Output frame %u (%s): %s%s%s%s%s\n", sim->out_frames, format<0 ? "none" : lcd_models[format].name,
+			sim->garbage ? "bad pixels " : "", sim->mixed ? "mixed frames " : "", sim->wrong_border ? "bad border " : "",
+			sim->wrong_model ? "from another model " : "", sim->wrong_tmds ? "wrong TMDS" : "");
+	}
+	else if(format==CAPTURE_FORMAT_NONE)
+		sim->blank++;
+	else
+	{
+		sim->whole++;
+		for(int s=0; s<SEGMENTS; s++)
+		{
+			struct segment_t *seg = &segments[s];
+			int rel = (sim->frame_id-seg->base)&(MAX_FRAMES-1);
+			// DMG frames only have their number mod 4: the newest frame of the DMG that's on with that number
+			if(format==LCD_MODEL_DMG)
+			{
+				if(s!=sim->seg)
+					continue;
+				rel = sim->trace.frame-((sim->trace.frame+seg->base-sim->frame_id)&3);
+			}
+			if(seg->model==format && rel>=0 && rel<seg_frames)
+			{
+				seg->shown++;
+				if(seg->first_shown<0)
+					seg->first_shown = rel;
+				break;
+			}
+		}
+	}
+	sim->frame_id = -1;
+	sim->garbage = sim->mixed = sim->wrong_border = sim->wrong_model = sim->wrong_tmds = false;
+}
+
+// One output line; every 3rd one of the first 480 encodes a framebuffer line
+static void encoder_line(void)
+{
+	int l = sim->out_line;
+	if(l%3==0 && l/3<CAPTURE_HEIGHT)
+	{
+		uint32_t line = sim->enc_line++;
+		uint8_t values[TMDS_LINE_PIXELS];
+		const uint32_t *lut;
+		split_encode_core0(&sim->enc, line, values, NULL);
+		split_encode_core1(&sim->enc, line, values, NULL);
+		sim->enc.core_done[0] = sim->enc.core_done[1] = line+1;
+		int format = sim->slot_format[(line/sim->enc.lines)&1];
+		check_line(line, split_frame_line(&sim->enc, line, 0, &lut), format);
+		if(line%sim->enc.lines==(uint32_t)sim->enc.lines-1)
+			end_frame(format);
+	}
+	sim->out_line = (l+1)%OUT_LINES;
+}
+
+int main(int argc, char **argv)
+{
+	const char *src_dir = "../src";
+	int opt;
+	while((opt = getopt(argc, argv, "f:c:i:vd:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': seg_frames = atoi(optarg); break;
+			case 'c': cycles_per_dot = atoi(optarg)&~1; break;
+			case 'i': irq_latency = atoi(optarg); break;
+			case 'v': verbose = true; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "See the top of model_detect_sim.c for the options.\n");
+				return 1;
+		}
+	}
+	if(seg_frames<MODEL_DETECT_FRAMES+4 || seg_frames>MAX_FRAMES/SEGMENTS-1)
+	{
+		fprintf(stderr, "%d to %d frames per console\n", MODEL_DETECT_FRAMES+4, MAX_FRAMES/SEGMENTS-1);
+		return 1;
+	}
+	if(cycles_per_dot<22)
+	{
+		// lcd_capture needs 22 with the '541s (capture_format_check)
+		fprintf(stderr, "At least 22 cycles per dot\n");
+		return 1;
+	}
+
+	sim = (struct sim_t *)calloc(1, sizeof(struct sim_t));
+	if(!load_programs(src_dir))
+		return 1;
+	uint32_t *rgb_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	uint32_t *dmg_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(rgb_lut);
+	create_tmds_lut_dmg(dmg_lut, dmg_palette);
+	sim->luts[MODEL_LUT_RGB555] = rgb_lut;
+	sim->luts[MODEL_LUT_DMG] = dmg_lut;
+
+	// 3 buffers, like the firmware with a GBA frame in each
+	for(int i=0; i<CAPTURE_MAX_BUFFERS; i++)
+		sim->buffers[i] = (uint32_t *)calloc(CAPTURE_DMA_WORDS, sizeof(uint32_t));
+	capture_init(&sim->mgr, sim->buffers, CAPTURE_MAX_BUFFERS);
+	model_detect_init(&sim->detect, LCD_MODEL_GBA);
+	model_capture_format(&sim->mgr, LCD_MODEL_GBA);
+
+	struct split_encode_t *enc = &sim->enc;
+	for(int b=0; b<2; b++)
+	{
+		for(int n=0; n<3; n++)
+			enc->line_buf[b][n] = sim->lane_mem[b][n];
+	}
+	enc->lines = CAPTURE_HEIGHT;
+	enc->next_frame = next_frame;
+	enc->frame_line = frame_line;
+	sim->held = -1;
+	sim->frame_id = -1;
+
+	double emu_hz = 4194304.0*cycles_per_dot;
+	sim->line_cycles = emu_hz/OUT_FRAME_HZ/OUT_LINES;
+	sim->next_line = sim->line_cycles;
+	start_segment(0);
+	printf("%d LCD frames per console, %d cycles per dot, %d frames to switch\n\n", seg_frames, cycles_per_dot,
+		MODEL_DETECT_FRAMES);
+	while(sim->seg<SEGMENTS)
+	{
+		pio_emu_step(&sim->cap_emu);
+		pio_emu_step(&sim->timing_emu);
+		uint64_t cycle = sim->cap_emu.cycle;
+		uint32_t word;
+		if(sim->dma_words<CAPTURE_DMA_WORDS && pio_sm_get(&sim->cap_emu, CAPTURE_SM, &word))
+		{
+			if(sim->mgr.target==CAPTURE_SINK)
+				sim->sink = word;
+			else
+				sim->mgr.buffer[sim->mgr.target][sim->dma_words] = word;
+			sim->dma_words++;
+		}
+		if(pio_sm_get(&sim->timing_emu, TIMING_SM, &word))
+		{
+			sim->timing_line = word;
+			sim->timing_lines++;
+		}
+		if(pio_sm_get(&sim->cap_emu, VSYNC_SM, &word))
+		{
+			sim->irq_pending = true;
+			sim->irq_at = cycle+(uint64_t)irq_latency;
+		}
+		if(sim->irq_pending && cycle>=sim->irq_at)
+		{
+			sim->irq_pending = false;
+			vsync_irq(emu_hz);
+		}
+		while((double)cycle>=sim->next_line)
+		{
+			encoder_line();
+			sim->next_line += sim->line_cycles;
+		}
+		if(sim->trace.frame>=seg_frames)
+		{
+			if(sim->seg+1<SEGMENTS)
+				start_segment(sim->seg+1);
+			else
+				sim->seg++;
+		}
+	}
+
+	bool ok = !sim->wrong_picks && !sim->bad_frames;
+	for(int s=0; s<SEGMENTS; s++)
+	{
+		const struct segment_t *seg = &segments[s];
+		char switched[32];
+		if(seg->switched_at>=0)
+			snprintf(switched, sizeof(switched), "LCD frame %d", seg->switched_at);
+		else
+			snprintf(switched, sizeof(switched), "%s", s==0 ? "(starts as GBA)" : "never");
+		printf("%s, GP28 %-4s switched at %-16s first frame shown: %2d, %u output frames of it\n",
+			lcd_models[seg->model].name, seg->strap ? "high" : "low", switched, seg->first_shown, seg->shown);
+		if((s>0 && seg->switched_at<0) || seg->first_shown<0)
+			ok = false;
+	}
+	printf("\nDetection: %u vsyncs, %u not a known model, %u switches, %u to the wrong model\n", sim->detect.frames,
+		sim->detect.unknown, sim->detect.switches, sim->wrong_picks);
+	printf("Capture: %u complete, %u rejected, %u short, %u long, %u dropped into the sink\n", sim->mgr.complete,
+		sim->mgr.rejected, sim->mgr.short_frames, sim->mgr.long_frames, sim->mgr.dropped);
+	printf("Output: %u frames without a gap, %u before the first capture, %u whole, %u bad; %u lines checked down to the TMDS symbols\n",
+		sim->out_frames, sim->blank, sim->whole, sim->bad_frames, sim->tmds_checked);
+	printf("\n%s\n", ok ? "PASS" : "FAIL");
+
+	lcd_trace_free(&sim->trace);
+	for(int i=0; i<CAPTURE_MAX_BUFFERS; i++)
+		free(sim->buffers[i]);
+	free(rgb_lut);
+	free(dmg_lut);
+	free(sim);
+	return ok ? 0 : 1;
+}
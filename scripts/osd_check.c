@@ -0,0 +1,289 @@
+/*
+	osd_check.c
+
+	Checks the on-screen display of src/osd.h: lines are encoded with a LUT, the OSD is drawn into them with
+	osd_patch_lane(), and the result is decoded back and checked symbol by symbol:
+	-outside the box, every symbol is the one of the line without the OSD
+	-inside the box, every pixel is the OSD's fg or bg, as the font and the text say (worked out here from osd_font,
+	 not from the patterns of osd_render()), except for the 2 fix-up pixels, which only have to be one color
+	-every symbol of the line is the one a DVI encoder sends for its byte at the running disparity (tmds_calc_disparity()
+	 of tmds_util.c). The line without the OSD is checked the same way, and the OSD can't add any.
+	That's for lines of random pixels, gradients and solid colors, with the RGB555, grid and Gameboy LUTs, boxes on the
+	left, in the middle, on the right and over the whole line, and lanes of both formats.
+
+	Then it reports the cycles per line the OSD takes on top of the encode, per lane and for the line, against
+	encoding the line again (estimates for the M0+, like encode_split_sim.c), and writes a preview of one frame.
+
+	Options: -t lanes with a pull threshold of 30 only, -o output PPM of the preview (osd_check.ppm.)
+
+	Build: gcc -O2 -o osd_check osd_check.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./osd_check [-t] [-o osd_check.ppm]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#include "host_util.h"
+#include "../src/osd.h"
+
+#define WIDTH TMDS_LINE_PIXELS
+#define HEIGHT 160
+#define SYMBOLS (WIDTH*3)
+#define OSD_Y 24
+
+// Same estimates as encode_split_sim.c for the encode: 19 cycles per pixel and channel, 36 per group of 16
+#define CYC_ENCODE_LANE (WIDTH*19+(WIDTH/TMDS_PACK_GROUP)*36)
+// SWAR popcount: load, 10 ALU ops and the sum per word, unrolled
+#define CYC_POP_WORD 14
+// Packed group: 4 pattern loads, 4 run addresses, 18 run loads and 15 stores
+#define CYC_RUN_GROUP 86
+// 30-bit lanes: pattern load, then a shift, and, load and store per pixel
+#define CYC_RUN_PIXEL 6
+// Disparities, 2 LUT entries and 2 pixel stores, and the call
+#define CYC_FIXUP 60
+
+enum { LINE_RANDOM, LINE_GRADIENT, LINE_SOLID, LINE_KINDS };
+static const char *kind_names[LINE_KINDS] = {"random", "gradient", "solid"};
+static const uint32_t dmg_palette[4] = {0x9bbc0f, 0x8bac0f, 0x306230, 0x0f380f};
+
+struct box_t
+{
+	int x_groups, groups, rows;
+};
+
+static const struct box_t boxes[] = {{0, 6, 4}, {4, 7, 3}, {9, 6, 2}, {0, 15, 4}, {14, 1, 1}};
+#define BOXES ((int)(sizeof(boxes)/sizeof(boxes[0])))
+
+static const char *menu[OSD_MAX_ROWS] = {"PALETTE: DMG GREEN", "COLOR CORRECTION ON", "SCALE 3X, GRID", "VOLUME 75%"};
+
+static uint16_t frame[HEIGHT][WIDTH];
+static uint8_t out[HEIGHT][WIDTH][3];
+
+static void make_frame(int kind)
+{
+	uint32_t solid = rng()&0x7fff;
+	for(int y=0; y<HEIGHT; y++)
+	{
+		for(int x=0; x<WIDTH; x++)
+		{
+			uint32_t v = (uint32_t)((x*32)/WIDTH);
+			if(kind==LINE_RANDOM)
+				frame[y][x] = (uint16_t)(rng()&0x7fff);
+			else if(kind==LINE_GRADIENT)
+				frame[y][x] = (uint16_t)((v<<(5*(y%3)))|((31-v)<<(5*((y+1)%3))));
+			else
+				frame[y][x] = (uint16_t)solid;
+		}
+	}
+}
+
+// 1 if the pixel of the box at rel pixels from its left edge is fg
+static int osd_expected(const struct osd_t *osd, int l, int rel)
+{
+	const char *text = osd->text[l/OSD_ROW_LINES];
+	int glyph_line = l%OSD_ROW_LINES-1, cols = osd_cols(osd);
+	if(rel<OSD_MARGIN || rel>=OSD_MARGIN+cols*OSD_CELL_PIXELS || glyph_line<0 || glyph_line>=OSD_FONT_HEIGHT)
+		return 0;
+	int c = (rel-OSD_MARGIN)/OSD_CELL_PIXELS;
+	if(c>=(int)strlen(text))
+		return 0;
+	return (osd_font_glyph(text[c])[glyph_line]>>(7-(rel-OSD_MARGIN)%OSD_CELL_PIXELS))&1;
+}
+
+static void lane_symbols(const uint32_t *lane, int line_words, uint16_t *symbols)
+{
+	if(line_words==TMDS_LINE_PIXELS)
+	{
+		for(int s=0; s<SYMBOLS; s++)
+			symbols[s] = (uint16_t)((lane[s/3]>>(10*(s%3)))&0x3ff);
+	}
+	else
+		unpack_single(lane, symbols, SYMBOLS);
+}
+
+// Symbols that aren't what a DVI encoder would send from the running disparity
+static int reference_violations(const uint16_t *symbols)
+{
+	struct tmds_pixel_t p;
+	int violations = 0;
+	p.disparity = 0;
+	for(int s=0; s<SYMBOLS; s++)
+	{
+		int decoded = tmds_decode_video(symbols[s]);
+		if(decoded<0)
+			return SYMBOLS;
+		p.color_data = (uint8_t)decoded;
+		p.tmds_data = 0;
+		int before = p.disparity;
+		tmds_calc_disparity(&p);
+		if(p.tmds_data!=symbols[s])
+			violations++;
+		// Go on from what was sent
+		int ones = __builtin_popcount(symbols[s]);
+		p.disparity = before+2*ones-10;
+	}
+	return violations;
+}
+
+struct result_t
+{
+	int lines, errors, added_violations, plain_violations;
+	uint32_t inexact;
+};
+
+static void check(const uint32_t *lut, int line_words, const struct box_t *box, int kind, struct osd_t *osd,
+	struct result_t *res, bool preview)
+{
+	static uint32_t plain[3][TMDS_LINE_PIXELS], patched[3][TMDS_LINE_PIXELS];
+	uint8_t values[WIDTH];
+	uint16_t plain_sym[SYMBOLS], patched_sym[SYMBOLS];
+	int first = box->x_groups*TMDS_PACK_GROUP, pixels = box->groups*TMDS_PACK_GROUP;
+
+	osd_set_box(osd, box->x_groups, box->groups, OSD_Y, box->rows);
+	osd_render(osd);
+	make_frame(kind);
+	for(int y=0; y<HEIGHT; y++)
+	{
+		int l = y-OSD_Y;
+		bool inside = l>=0 && l<box->rows*OSD_ROW_LINES;
+		for(int ch=0; ch<3; ch++)
+		{
+			for(int x=0; x<WIDTH; x++)
+				values[x] = (uint8_t)((frame[y][x]>>tmds_channel_shift(ch))&0x1f);
+			if(line_words==TMDS_LINE_PIXELS)
+				tmds_encode_channel_30(lut, values, plain[ch], WIDTH, TMDS_DISP_RESET);
+			else
+				tmds_encode_channel(lut, values, plain[ch], WIDTH, TMDS_DISP_RESET);
+			memcpy(patched[ch], plain[ch], sizeof(plain[ch]));
+			osd_patch_lane(osd, y, ch, patched[ch]);
+
+			lane_symbols(plain[ch], line_words, plain_sym);
+			lane_symbols(patched[ch], line_words, patched_sym);
+			for(int s=0; s<SYMBOLS; s++)
+			{
+				int x = s/3, rel = x-first;
+				int decoded = tmds_decode_video(patched_sym[s]);
+				bool ok;
+				if(!inside || rel<0 || rel>=pixels)
+					ok = patched_sym[s]==plain_sym[s];
+				else if(rel>=pixels-OSD_FIXUP_PIXELS)
+					ok = decoded>=0 && decoded==tmds_decode_video(patched_sym[x*3]);
+				else
+				{
+					uint32_t pix = osd_expected(osd, l, rel) ? osd->fg : osd->bg;
+					ok = decoded==depth_convert((uint8_t)osd_channel(pix, ch));
+				}
+				if(!ok && res->errors++<8)
+				{
+					printf("%s lanes, box %d+%d, %s line %d lane %d symbol %d: %03x, decodes to %d\n",
+						line_words==TMDS_LINE_PIXELS ? "30-bit" : "32-bit", box->x_groups, box->groups, kind_names[kind],
+						y, ch, s, patched_sym[s], decoded);
+				}
+				if(preview && s%3==1)
+					out[y][x][2-ch] = (uint8_t)(decoded<0 ? 0 : decoded);
+			}
+			int plain_violations = reference_violations(plain_sym);
+			int patched_violations = reference_violations(patched_sym);
+			res->plain_violations += plain_violations;
+			if(patched_violations>plain_violations)
+				res->added_violations += patched_violations-plain_violations;
+		}
+		res->lines++;
+	}
+}
+
+// Cycles per line of the box for one lane, from the estimates above
+static int osd_cycles(int line_words, int x_groups, int groups)
+{
+	int words = line_words==TMDS_LINE_WORDS ? TMDS_PACK_WORDS : TMDS_PACK_GROUP;
+	int runs = line_words==TMDS_LINE_WORDS ? groups*CYC_RUN_GROUP : groups*TMDS_PACK_GROUP*CYC_RUN_PIXEL;
+	return (x_groups+groups)*words*CYC_POP_WORD+runs+CYC_FIXUP;
+}
+
+int main(int argc, char **argv)
+{
+	const char *out_name = "osd_check.ppm";
+	bool only30 = false;
+	int opt;
+	while((opt = getopt(argc, argv, "to:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 't': only30 = true; break;
+			case 'o': out_name = optarg; break;
+			default:
+				fprintf(stderr, "See the top of osd_check.c for the options.\n");
+				return 1;
+		}
+	}
+
+	uint32_t *luts[3];
+	static const char *lut_names[3] = {"RGB555", "grid", "Gameboy"};
+	for(int i=0; i<3; i++)
+		luts[i] = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(luts[0]);
+	create_tmds_lut_grid(luts[1], 128);
+	create_tmds_lut_dmg(luts[2], dmg_palette);
+
+	static struct osd_t osd;
+	int total_errors = 0, total_added = 0;
+	for(int format=only30 ? 1 : 0; format<2; format++)
+	{
+		int line_words = format ? TMDS_LINE_PIXELS : TMDS_LINE_WORDS;
+		osd_init(&osd, luts[0], line_words);
+		// Gray 29 on gray 2, blue 29 on red 2 would do too: every channel on its own
+		if(!osd_set_colors(&osd, 29|(29<<5)|(29<<10), 2|(2<<5)|(2<<10)) || osd_set_colors(&osd, 28, 2))
+		{
+			printf("osd_set_colors() doesn't take what it should\n");
+			return 1;
+		}
+		osd.visible = true;
+		for(int r=0; r<OSD_MAX_ROWS; r++)
+			osd_print(&osd, r, menu[r]);
+		for(int lut=0; lut<3; lut++)
+		{
+			struct result_t res;
+			memset(&res, 0, sizeof(res));
+			memset(osd.inexact, 0, sizeof(osd.inexact));
+			for(int b=0; b<BOXES; b++)
+			{
+				for(int kind=0; kind<LINE_KINDS; kind++)
+					check(luts[lut], line_words, &boxes[b], kind, &osd, &res, format==(only30 ? 1 : 0) && !lut && b==1 && !kind);
+			}
+			res.inexact = osd.inexact[0]+osd.inexact[1]+osd.inexact[2];
+			printf("%s lanes, %s LUT: %d lines, %d wrong symbols, %d violations added (%d in the lines without OSD), "
+				"%u inexact fix-ups\n", format ? "30-bit" : "32-bit", lut_names[lut], res.lines, res.errors,
+				res.added_violations, res.plain_violations, res.inexact);
+			total_errors += res.errors;
+			// Lines from the RGB555 LUT have to stay exactly what a DVI encoder sends
+			total_added += res.added_violations+(lut==0 ? (int)res.inexact+res.plain_violations : 0);
+		}
+	}
+
+	printf("\nOSD cycles per line of the box (32-bit lanes / 30-bit lanes), against %d to encode a lane again:\n",
+		CYC_ENCODE_LANE);
+	for(int b=0; b<BOXES; b++)
+	{
+		int c32 = osd_cycles(TMDS_LINE_WORDS, boxes[b].x_groups, boxes[b].groups);
+		int c30 = osd_cycles(TMDS_LINE_PIXELS, boxes[b].x_groups, boxes[b].groups);
+		printf("  box at %3d, %3d pixels wide: %4d / %4d per lane, %5d / %5d per line (%.0f%% / %.0f%% of an encode)\n",
+			boxes[b].x_groups*TMDS_PACK_GROUP, boxes[b].groups*TMDS_PACK_GROUP, c32, c30, 3*c32, 3*c30,
+			100.0*c32/CYC_ENCODE_LANE, 100.0*c30/CYC_ENCODE_LANE);
+	}
+	printf("  0 for lines outside the box, and for line cache hits (the key has the OSD in it)\n");
+	printf("  SRAM: %d bytes for the OSD\n", (int)sizeof(struct osd_t));
+
+	if(!write_ppm(out_name, &out[0][0][0], WIDTH, HEIGHT))
+		return 1;
+	printf("Preview written to %s\n", out_name);
+
+	for(int i=0; i<3; i++)
+		free(luts[i]);
+	printf("%s\n", total_errors || total_added ? "FAIL" : "PASS");
+	return total_errors || total_added ? 1 : 0;
+}
@@ -0,0 +1,333 @@
+/*
+	packet_sched_sim.c
+
+	Runs the data island packet scheduler (src/packet_sched.h) over a number of frames, with audio coming in the way the
+	ADC DMA delivers it (a block of samples at a time), and reports:
+	-average demand against the number of slots (flagged if it doesn't fit)
+	-packets sent per frame of every kind, and how many slots are left for null packets
+	-audio FIFO occupancy over time (min/avg/max per interval), a histogram of it, and the latency at the worst point
+	-samples dropped, periodic packets that missed their slot, and lines where audio was still waiting after the last slot
+	 (out of slots.) Those are expected: a block of audio comes in at once and takes a few lines of slots to send. What
+	 can't happen is a run of them as long as the time between blocks, since then the FIFO never empties before the
+	 next block and only grows, so the longest run has to be shorter than that.
+
+	For the first frames (-c) it also checks every line's island words, the same ones the DMA would send:
+	-they match the symbols of fill_blank_line_packets() from tmds_util.c in 30-bit framing
+	-decoded back through TERC4 and the BCH ECC, every packet has valid ECC, the type the scheduler says it is, and
+	 the audio samples come out in order with none missing (the test signal is a counter)
+
+	-o writes a schedule for span_compiler.c (islands per line) that matches the slot counts.
+
+	Build: gcc -O2 -o packet_sched_sim packet_sched_sim.c tmds_decode.c tmds_util.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./packet_sched_sim [options]
+	-r rate       audio sample rate, 0 for none (default 48000)
+	-n samples    samples to wait for before sending an audio packet, 1-4 (default 4)
+	-a lines      lines between ACR packets (default 32)
+	-s slots      packets per active line (default 2)
+	-v slots      packets per vblank line (default 2)
+	-i frames     AVI/Audio InfoFrame every this many frames (default 1); -p frames for SPD (default 0, off)
+	-b samples    stereo samples per audio block (default 96, half of the ADC double buffer)
+	-d ppm        audio clock error against the pixel clock (default 0)
+	-f frames     frames to run (default 600)
+	-t frames     frames per line of the occupancy table (default 60)
+	-c frames     frames to check the island words of (default 2)
+	-o file       write a span_compiler schedule
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#include "../src/packet_sched.h"
+
+#define HIST_BINS 16
+
+static const char *kind_names[PKT_KINDS] = {"null", "ACR", "audio", "AVI", "Audio IF", "SPD"};
+static const uint8_t kind_types[PKT_KINDS] = {PACKET_NULL, PACKET_ACR, PACKET_AUDIO_SAMPLE, PACKET_INFOFRAME_AVI,
+	PACKET_INFOFRAME_AUDIO, PACKET_INFOFRAME_SPD};
+
+static uint32_t produced; // test signal: sample n is (n, ~n)
+// Samples that made it into the FIFO, in order, for the decoder to compare against
+static uint32_t accepted[PACKET_AUDIO_FIFO];
+static uint32_t accepted_head, accepted_tail;
+static unsigned long check_errors;
+
+static int blank_variant(int before, int after)
+{
+	if(before && after)
+		return BLANK_HBLANK;
+	if(before)
+		return BLANK_VBLANK_EN;
+	return after ? BLANK_VBLANK_EX : BLANK_VBLANK_SYN;
+}
+
+// Decodes one packet out of the symbols of the 3 lanes and checks it. Channel 0 bit 3 is only clear on the first
+// pixel of the island, so on pixel 0 of slot 0.
+static void check_packet(const uint16_t *sym[3], int kind, int line, int slot)
+{
+	uint8_t header[4] = {0}, sub[4][8];
+	memset(sub, 0, sizeof(sub));
+	for(int i=0; i<DATA_ISLAND_PIXELS; i++)
+	{
+		int n0 = tmds_decode_terc4(sym[0][i]), n1 = tmds_decode_terc4(sym[1][i]), n2 = tmds_decode_terc4(sym[2][i]);
+		if(n0<0 || n1<0 || n2<0 || ((n0>>3)&1)!=(i || slot ? 1 : 0))
+		{
+			if(check_errors++<10)
+				fprintf(stderr, "Line %d slot %d pixel %d: bad TERC4 or first pixel flag\n", line, slot, i);
+			return;
+		}
+		header[i>>3] |= (uint8_t)(((n0>>2)&1)<<(i&7));
+		for(int n=0; n<4; n++)
+		{
+			sub[n][(2*i)>>3] |= (uint8_t)(((n1>>n)&1)<<((2*i)&7));
+			sub[n][(2*i+1)>>3] |= (uint8_t)(((n2>>n)&1)<<((2*i+1)&7));
+		}
+	}
+	bool ok = data_island_ecc(header, 3)==header[3] && header[0]==kind_types[kind];
+	for(int n=0; n<4; n++)
+		ok = ok && data_island_ecc(sub[n], 7)==sub[n][7];
+	if(ok && kind==PKT_AUDIO)
+	{
+		for(int n=0; n<4; n++)
+		{
+			if(!((header[1]>>n)&1))
+				continue;
+			uint16_t left = (uint16_t)((sub[n][1]>>0)|(sub[n][2]<<8));
+			uint16_t right = (uint16_t)((sub[n][4])|(sub[n][5]<<8));
+			uint32_t expected = accepted[accepted_tail++%PACKET_AUDIO_FIFO];
+			if(left!=(uint16_t)expected || right!=(uint16_t)~expected)
+				ok = false;
+		}
+	}
+	if(!ok && check_errors++<10)
+		fprintf(stderr, "Line %d slot %d: %s packet doesn't decode\n", line, slot, kind_names[kind]);
+}
+
+static void check_line(const struct packet_sched_t *s, int line, const struct data_island_t **islands, const uint8_t *kinds, int count)
+{
+	const struct packet_sched_config_t *cfg = &s->cfg;
+	struct blank_timing_t timing = {cfg->h_front, cfg->h_pulse, cfg->h_total-H_ACTIVE-cfg->h_front-cfg->h_pulse};
+	int blank = cfg->h_total-H_ACTIVE;
+	uint16_t *ref[3], *sym[3];
+	struct data_island_t packets[PACKET_SCHED_MAX_SLOTS];
+	uint32_t words[PACKET_ISLAND_WORDS];
+	int before, after;
+	packet_sched_vsync(cfg, line, &before, &after);
+	for(int i=0; i<count; i++)
+		packets[i] = *islands[i];
+	for(int lane=0; lane<3; lane++)
+	{
+		ref[lane] = (uint16_t *)malloc(blank*sizeof(uint16_t));
+		sym[lane] = (uint16_t *)malloc((blank+3)*sizeof(uint16_t));
+	}
+	fill_blank_line_packets(ref[0], ref[1], ref[2], &timing, blank_variant(before, after), packets, count);
+	int first = cfg->h_front/3;
+	for(int lane=0; lane<3; lane++)
+	{
+		int n = packet_sched_frame_words(s, line, islands, count, lane, words);
+		for(int w=0; w<n; w++)
+		{
+			for(int k=0; k<3; k++)
+				sym[lane][3*(first+w)+k] = (uint16_t)((words[w]>>(10*k))&0x3ff);
+		}
+		for(int p=3*first; p<3*(first+n); p++)
+		{
+			if(sym[lane][p]!=ref[lane][p])
+			{
+				if(check_errors++<10)
+					fprintf(stderr, "Line %d lane %d symbol %d: %03x, fill_blank_line_packets has %03x\n", line, lane, p,
+						sym[lane][p], ref[lane][p]);
+				break;
+			}
+		}
+	}
+	for(int slot=0; slot<count; slot++)
+	{
+		const uint16_t *p[3];
+		for(int lane=0; lane<3; lane++)
+			p[lane] = sym[lane]+cfg->h_front+slot*DATA_ISLAND_PIXELS;
+		check_packet(p, kinds[slot], line, slot);
+	}
+	for(int lane=0; lane<3; lane++)
+	{
+		free(ref[lane]);
+		free(sym[lane]);
+	}
+}
+
+static bool write_schedule(const char *name, const struct packet_sched_config_t *cfg)
+{
+	FILE *out = fopen(name, "w");
+	if(!out)
+	{
+		fprintf(stderr, "Can't write %s\n", name);
+		return false;
+	}
+	fprintf(out, "# Written by packet_sched_sim.c: first last islands\n");
+	fprintf(out, "0 %d %d\n", cfg->v_active-1, cfg->slots_active);
+	fprintf(out, "%d %d %d\n", cfg->v_active, cfg->v_total-1, cfg->slots_vblank);
+	fclose(out);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	struct packet_sched_config_t cfg;
+	packet_sched_default_config(&cfg);
+	int block = 96, frames = 600, interval = 60, check_frames = 2;
+	double ppm = 0;
+	const char *schedule = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "r:n:a:s:v:i:p:b:d:f:t:c:o:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'r': cfg.sample_rate = (uint32_t)atoi(optarg); break;
+			case 'n': cfg.audio_packet_samples = atoi(optarg); break;
+			case 'a': cfg.acr_lines = atoi(optarg); break;
+			case 's': cfg.slots_active = atoi(optarg); break;
+			case 'v': cfg.slots_vblank = atoi(optarg); break;
+			case 'i': cfg.avi_frames = cfg.aif_frames = atoi(optarg); break;
+			case 'p': cfg.spd_frames = atoi(optarg); break;
+			case 'b': block = atoi(optarg); break;
+			case 'd': ppm = atof(optarg); break;
+			case 'f': frames = atoi(optarg); break;
+			case 't': interval = atoi(optarg); break;
+			case 'c': check_frames = atoi(optarg); break;
+			case 'o': schedule = optarg; break;
+			default:
+				fprintf(stderr, "See the top of packet_sched_sim.c for the options.\n");
+				return 1;
+		}
+	}
+	if(block<1 || block>PACKET_AUDIO_FIFO || cfg.acr_lines<1 || interval<1 || frames<1
+		|| cfg.slots_active<0 || cfg.slots_active>PACKET_SCHED_MAX_SLOTS || cfg.slots_vblank<0 || cfg.slots_vblank>PACKET_SCHED_MAX_SLOTS)
+	{
+		fprintf(stderr, "Audio blocks have to be 1-%d samples, and slots 0-%d per line\n", PACKET_AUDIO_FIFO, PACKET_SCHED_MAX_SLOTS);
+		return 1;
+	}
+
+	struct packet_sched_t *s = (struct packet_sched_t *)malloc(sizeof(struct packet_sched_t));
+	packet_sched_init(s, &cfg);
+	double line_time = (double)cfg.h_total/cfg.pixel_hz;
+	double demand;
+	int capacity;
+	bool fits = packet_sched_demand(&s->cfg, &demand, &capacity);
+	printf("Line rate %.1fHz, %.4f audio samples per line\n", 1.0/line_time, cfg.sample_rate*line_time);
+	if(cfg.sample_rate)
+	{
+		uint32_t n = audio_acr_n(cfg.sample_rate), cts = audio_acr_cts(cfg.pixel_hz, cfg.sample_rate, n);
+		printf("ACR: N %u, CTS %u (%s)\n", n, cts,
+			(uint64_t)cfg.pixel_hz*n==(uint64_t)cts*128*cfg.sample_rate ? "exact" : "rounded, the sink averages it out");
+	}
+	printf("Demand %.1f packets per frame, %d slots -> %s\n\n", demand, capacity, fits ? "fits" : "OVER CAPACITY");
+
+	int16_t *samples = (int16_t *)malloc(2*block*sizeof(int16_t));
+	double audio_acc = 0;
+	double rate = cfg.sample_rate*(1.0+ppm*1e-6);
+	uint32_t hist[HIST_BINS] = {0};
+	uint32_t level_max = 0, total_lines = 0;
+	uint64_t level_sum = 0;
+	uint32_t late_run = 0, late_run_max = 0;
+	uint32_t iv_min = UINT32_MAX, iv_max = 0;
+	uint64_t iv_sum = 0;
+	int iv_lines = 0;
+	int bin_size = PACKET_AUDIO_FIFO/HIST_BINS;
+
+	if(cfg.sample_rate)
+		printf("Audio FIFO occupancy (stereo samples), every %d frame%s:\n  frames      min    avg    max\n", interval, interval==1 ? "" : "s");
+	for(int frame=0; frame<frames; frame++)
+	{
+		for(int line=0; line<cfg.v_total; line++)
+		{
+			// The ADC DMA hands over a block at a time.
+			if(cfg.sample_rate)
+			{
+				audio_acc += rate*line_time;
+				while(audio_acc>=block)
+				{
+					for(int i=0; i<block; i++)
+					{
+						samples[2*i] = (int16_t)(produced+i);
+						samples[2*i+1] = (int16_t)~(produced+i);
+					}
+					int pushed = packet_sched_push_audio(s, samples, block);
+					for(int i=0; i<pushed; i++)
+						accepted[accepted_head++%PACKET_AUDIO_FIFO] = produced+i;
+					produced += block;
+					audio_acc -= block;
+				}
+			}
+			const struct data_island_t *islands[PACKET_SCHED_MAX_SLOTS];
+			uint8_t kinds[PACKET_SCHED_MAX_SLOTS];
+			uint32_t late = s->audio_late;
+			int count = packet_sched_line(s, line, islands, kinds);
+			late_run = s->audio_late!=late ? late_run+1 : 0;
+			if(late_run>late_run_max)
+				late_run_max = late_run;
+			if(frame<check_frames)
+				check_line(s, line, islands, kinds, count);
+
+			uint32_t level = packet_sched_audio_level(s);
+			hist[level/bin_size<HIST_BINS ? level/bin_size : HIST_BINS-1]++;
+			level_sum += level;
+			total_lines++;
+			if(level>level_max)
+				level_max = level;
+			iv_min = level<iv_min ? level : iv_min;
+			iv_max = level>iv_max ? level : iv_max;
+			iv_sum += level;
+			iv_lines++;
+		}
+		if(cfg.sample_rate && ((frame+1)%interval==0 || frame==frames-1))
+		{
+			printf("  %5d-%-5d %4u %6.1f %6u\n", frame+1-(iv_lines/cfg.v_total)+1, frame+1, iv_min, (double)iv_sum/iv_lines, iv_max);
+			iv_min = UINT32_MAX;
+			iv_max = 0;
+			iv_sum = 0;
+			iv_lines = 0;
+		}
+	}
+
+	printf("\nPackets per frame:\n");
+	for(int k=0; k<PKT_KINDS; k++)
+		printf("  %-9s %8.2f\n", kind_names[k], (double)s->sent[k]/frames);
+	if(cfg.sample_rate)
+	{
+		printf("\nOccupancy histogram (%d samples per bin):\n", bin_size);
+		for(int b=0; b<HIST_BINS; b++)
+		{
+			if(hist[b])
+				printf("  %3d-%-3d %6.2f%%\n", b*bin_size, (b+1)*bin_size-1, 100.0*hist[b]/total_lines);
+		}
+		uint32_t fifo = 1;
+		while(fifo<level_max+(uint32_t)block)
+			fifo <<= 1;
+		printf("Average %.1f, worst %u samples (%.2fms of latency); a FIFO of %u samples covers it with a block to spare\n",
+			(double)level_sum/total_lines, level_max, 1000.0*level_max/cfg.sample_rate, fifo);
+	}
+	printf("\nDropped samples: %u, missed periodic packets: %u\n", s->audio_dropped, s->missed);
+	// Lines between the audio blocks: a backlog that lasts that long never clears
+	double block_lines = cfg.sample_rate ? block/(rate*line_time) : 0;
+	bool backlog = cfg.sample_rate && late_run_max>=block_lines;
+	if(cfg.sample_rate)
+		printf("Lines that ran out of slots for audio: %u (%.1f%%), at most %u in a row against %.1f lines between "
+			"blocks: %s\n", s->audio_late, 100.0*s->audio_late/total_lines, late_run_max, block_lines,
+			backlog ? "the backlog never clears" : "every block is sent before the next one");
+	if(check_frames)
+		printf("Island check, first %d frame%s: %s\n", check_frames, check_frames==1 ? "" : "s", check_errors ? "FAIL" : "OK");
+
+	if(schedule && write_schedule(schedule, &s->cfg))
+		printf("Wrote %s\n", schedule);
+	bool over = !fits || s->audio_dropped || s->missed;
+	if(over)
+		printf("Demand exceeds what the slots can carry\n");
+	bool ok = !over && !backlog && !check_errors;
+	free(samples);
+	free(s);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+/*
+	pair_lut_bench.c
+
+	Compares the stateless pair encoder (tmds_encode_channel_pairs() with the LUT of create_tmds_lut_pairs()) with the
+	LUT encoder that carries the disparity (tmds_encode_channel() with create_tmds_lut()), on lines of random pixels,
+	gradients, solid colors and Gameboy-like tiles, in both lane formats. For every line and channel it checks:
+	-every symbol of the pair encode decodes to a value with the pixel's color in its top 5 bits, and how many aren't
+	 depth_convert()'s value (what the LUT encoder sends)
+	-the running disparity is 0 after every pair, and how far it goes in between, against the LUT encoder
+	-the groups of 16 pixels encoded one at a time in a random order, and the line split at SPLIT_CH1_PIXELS like the
+	 2 cores do it, give the same words as the whole line
+	Then it times both on the host, and estimates the cycles per lane on the M0+ with the numbers of encode_split_sim.c.
+
+	Build: gcc -O2 -o pair_lut_bench pair_lut_bench.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./pair_lut_bench [-l lines to time] [-s seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#include "host_util.h"
+#include "../src/tmds_encode_split.h"
+
+#define WIDTH TMDS_LINE_PIXELS
+#define LINES 160
+#define SYMBOLS (WIDTH*3)
+#define GROUPS (WIDTH/TMDS_PACK_GROUP)
+
+// encode_split_sim.c: separation 7, lookup 8 and packing 4 cycles per pixel, 30 cycles of stores and 6 of loop per
+// group of 16
+#define CYC_SEPARATE 7
+#define CYC_LOOKUP 8
+#define CYC_PACK 4
+#define CYC_STORE_GROUP 30
+#define CYC_GROUP 6
+// 30-bit lanes: a str per pixel instead of the packing
+#define CYC_STORE 2
+// Pair lookup straight from a framebuffer word: ldr (2), 2 shifts and 2 ANDs, orr, add, ldmia of 2 words (3)
+#define CYC_PAIR_LOOKUP 11
+// 30-bit lanes: stmia of the 2 words
+#define CYC_PAIR_STORE 3
+
+enum { LINE_RANDOM, LINE_GRADIENT, LINE_SOLID, LINE_TILES, LINE_KINDS };
+static const char *kind_names[LINE_KINDS] = {"random", "gradient", "solid", "tiles"};
+
+// Framebuffer lines, 2 pixels per word with the older one on top
+static uint32_t frame[LINE_KINDS][LINES][TMDS_FB_LINE_WORDS];
+
+static void make_frames(void)
+{
+	uint16_t tile[4] = {0x7fff, 0x56b5, 0x294a, 0x0000};
+	uint32_t solid = rng()&0x7fff;
+	for(int kind=0; kind<LINE_KINDS; kind++)
+	{
+		for(int y=0; y<LINES; y++)
+		{
+			uint16_t line[WIDTH];
+			for(int x=0; x<WIDTH; x++)
+			{
+				uint32_t v = (uint32_t)((x*32)/WIDTH);
+				if(kind==LINE_RANDOM)
+					line[x] = (uint16_t)(rng()&0x7fff);
+				else if(kind==LINE_GRADIENT)
+					line[x] = (uint16_t)((v<<(5*(y%3)))|((31-v)<<(5*((y+1)%3))));
+				else if(kind==LINE_SOLID)
+					line[x] = (uint16_t)solid;
+				else
+					line[x] = tile[((x/8)*7+(y/8)*3+((x^y)&4))&3];
+			}
+			for(int i=0; i<TMDS_FB_LINE_WORDS; i++)
+				frame[kind][y][i] = ((uint32_t)line[2*i]<<16)|line[2*i+1];
+		}
+	}
+}
+
+static void lane_symbols(const uint32_t *lane, bool pull30, uint16_t *symbols)
+{
+	if(pull30)
+	{
+		for(int s=0; s<SYMBOLS; s++)
+			symbols[s] = (uint16_t)((lane[s/3]>>(10*(s%3)))&0x3ff);
+	}
+	else
+		unpack_single(lane, symbols, SYMBOLS);
+}
+
+struct result_t
+{
+	int wrong, nudged, unbalanced, order;
+	int peak_pairs, peak_lut, end_lut;
+};
+
+static void check_line(const uint32_t *lut, const uint32_t *pair_lut, const uint32_t *fb_line, bool pull30,
+	struct result_t *res)
+{
+	static uint32_t with_lut[TMDS_LINE_PIXELS], pairs[TMDS_LINE_PIXELS], pieces[TMDS_LINE_PIXELS];
+	uint8_t values[WIDTH];
+	uint16_t lut_sym[SYMBOLS], pair_sym[SYMBOLS];
+	int words = pull30 ? TMDS_PACK_GROUP : TMDS_PACK_WORDS;
+	for(int ch=0; ch<3; ch++)
+	{
+		int shift = tmds_channel_shift(ch);
+		tmds_separate_channel(fb_line, values, 0, WIDTH, shift);
+		if(pull30)
+		{
+			tmds_encode_channel_30(lut, values, with_lut, WIDTH, TMDS_DISP_RESET);
+			tmds_encode_channel_pairs_30(pair_lut, fb_line, shift, pairs, WIDTH);
+		}
+		else
+		{
+			tmds_encode_channel(lut, values, with_lut, WIDTH, TMDS_DISP_RESET);
+			tmds_encode_channel_pairs(pair_lut, fb_line, shift, pairs, WIDTH);
+		}
+
+		// Groups one at a time in a random order, then the 2 halves of the split encode, second half first
+		int order[GROUPS];
+		for(int g=0; g<GROUPS; g++)
+			order[g] = g;
+		for(int g=GROUPS-1; g>0; g--)
+		{
+			int k = (int)(rng()%(uint32_t)(g+1)), t = order[g];
+			order[g] = order[k];
+			order[k] = t;
+		}
+		memset(pieces, 0, sizeof(pieces));
+		for(int g=0; g<GROUPS; g++)
+		{
+			int first = order[g]*TMDS_PACK_GROUP;
+			if(pull30)
+				tmds_encode_channel_pairs_30(pair_lut, fb_line+first/2, shift, pieces+first, TMDS_PACK_GROUP);
+			else
+				tmds_encode_channel_pairs(pair_lut, fb_line+first/2, shift, pieces+order[g]*words, TMDS_PACK_GROUP);
+		}
+		res->order += memcmp(pieces, pairs, sizeof(uint32_t)*(size_t)(GROUPS*words))!=0;
+		memset(pieces, 0, sizeof(pieces));
+		int rest = WIDTH-SPLIT_CH1_PIXELS;
+		if(pull30)
+		{
+			tmds_encode_channel_pairs_30(pair_lut, fb_line+SPLIT_CH1_PIXELS/2, shift, pieces+SPLIT_CH1_PIXELS, rest);
+			tmds_encode_channel_pairs_30(pair_lut, fb_line, shift, pieces, SPLIT_CH1_PIXELS);
+		}
+		else
+		{
+			tmds_encode_channel_pairs(pair_lut, fb_line+SPLIT_CH1_PIXELS/2, shift, pieces+SPLIT_CH1_WORDS, rest);
+			tmds_encode_channel_pairs(pair_lut, fb_line, shift, pieces, SPLIT_CH1_PIXELS);
+		}
+		res->order += memcmp(pieces, pairs, sizeof(uint32_t)*(size_t)(GROUPS*words))!=0;
+
+		lane_symbols(with_lut, pull30, lut_sym);
+		lane_symbols(pairs, pull30, pair_sym);
+		int d_lut = 0, d_pairs = 0;
+		for(int s=0; s<SYMBOLS; s++)
+		{
+			int color = values[s/3];
+			int decoded = tmds_decode_video(pair_sym[s]);
+			if(decoded<0 || decoded>>3!=color)
+				res->wrong++;
+			else if(decoded!=depth_convert((uint8_t)color))
+				res->nudged++;
+			d_lut += 2*__builtin_popcount(lut_sym[s])-10;
+			d_pairs += 2*__builtin_popcount(pair_sym[s])-10;
+			if(s%6==5 && d_pairs)
+				res->unbalanced++;
+			res->peak_lut = abs(d_lut)>res->peak_lut ? abs(d_lut) : res->peak_lut;
+			res->peak_pairs = abs(d_pairs)>res->peak_pairs ? abs(d_pairs) : res->peak_pairs;
+		}
+		res->end_lut = abs(d_lut)>res->end_lut ? abs(d_lut) : res->end_lut;
+	}
+}
+
+// Host time per line of 3 lanes, in ns
+static double time_lines(const uint32_t *lut, const uint32_t *pair_lut, bool pairs, bool pull30, int count)
+{
+	static uint32_t lanes[3][TMDS_LINE_PIXELS];
+	uint8_t values[WIDTH];
+	uint32_t sink = 0;
+	double start = now();
+	for(int n=0; n<count; n++)
+	{
+		const uint32_t *fb_line = frame[LINE_RANDOM][n%LINES];
+		for(int ch=0; ch<3; ch++)
+		{
+			int shift = tmds_channel_shift(ch);
+			if(pairs && pull30)
+				tmds_encode_channel_pairs_30(pair_lut, fb_line, shift, lanes[ch], WIDTH);
+			else if(pairs)
+				tmds_encode_channel_pairs(pair_lut, fb_line, shift, lanes[ch], WIDTH);
+			else
+			{
+				tmds_separate_channel(fb_line, values, 0, WIDTH, shift);
+				if(pull30)
+					tmds_encode_channel_30(lut, values, lanes[ch], WIDTH, TMDS_DISP_RESET);
+				else
+					tmds_encode_channel(lut, values, lanes[ch], WIDTH, TMDS_DISP_RESET);
+			}
+			sink += lanes[ch][n%WIDTH];
+		}
+	}
+	double elapsed = now()-start;
+	if(sink==0x12345678)
+		printf(" ");
+	return elapsed*1e9/count;
+}
+
+int main(int argc, char **argv)
+{
+	int timed = 200000;
+	int opt;
+	while((opt = getopt(argc, argv, "l:s:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'l': timed = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0)|1; break;
+			default:
+				fprintf(stderr, "See the top of pair_lut_bench.c for the options.\n");
+				return 1;
+		}
+	}
+	if(timed<1)
+		timed = 1;
+
+	uint32_t *lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	uint32_t *pair_lut = (uint32_t *)malloc(TMDS_PAIR_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(lut);
+	create_tmds_lut_pairs(pair_lut);
+	int nudged_entries, entry_peak;
+	int bad_entries = check_tmds_lut_pairs(pair_lut, &nudged_entries, &entry_peak);
+	printf("Pair LUT: %d bytes (LUT: %d), %d entries not DC balanced, %d with other 8-bit values\n\n",
+		TMDS_PAIR_LUT_WORDS*4, TMDS_LUT_WORDS*4, bad_entries, nudged_entries);
+	make_frames();
+
+	int failures = bad_entries;
+	printf("%-8s %-6s %6s %8s %10s %6s %11s %14s\n", "lines", "lanes", "wrong", "nudged", "unbalanced", "order",
+		"peak pairs", "peak/end LUT");
+	for(int format=0; format<2; format++)
+	{
+		for(int kind=0; kind<LINE_KINDS; kind++)
+		{
+			struct result_t res;
+			memset(&res, 0, sizeof(res));
+			for(int y=0; y<LINES; y++)
+				check_line(lut, pair_lut, frame[kind][y], format==1, &res);
+			printf("%-8s %-6s %6d %7.1f%% %10d %6d %11d %8d/%d\n", kind_names[kind], format ? "30-bit" : "32-bit",
+				res.wrong, 100.0*res.nudged/(LINES*3*SYMBOLS), res.unbalanced, res.order, res.peak_pairs, res.peak_lut,
+				res.end_lut);
+			failures += res.wrong+res.unbalanced+res.order;
+		}
+	}
+
+	// M0+ estimates for one lane of 240 pixels
+	int lut32 = WIDTH*(CYC_SEPARATE+CYC_LOOKUP+CYC_PACK)+GROUPS*(CYC_STORE_GROUP+CYC_GROUP);
+	int pairs32 = (WIDTH/2)*CYC_PAIR_LOOKUP+WIDTH*CYC_PACK+GROUPS*(CYC_STORE_GROUP+CYC_GROUP);
+	int lut30 = WIDTH*(CYC_SEPARATE+CYC_LOOKUP+CYC_STORE)+GROUPS*CYC_GROUP;
+	int pairs30 = (WIDTH/2)*(CYC_PAIR_LOOKUP+CYC_PAIR_STORE)+GROUPS*CYC_GROUP;
+	printf("\nM0+ cycles per lane (estimate): 32-bit lanes %d with the LUT, %d with pairs (%.0f%% less), 30-bit lanes %d "
+		"and %d (%.0f%% less)\n", lut32, pairs32, 100.0-100.0*pairs32/lut32, lut30, pairs30, 100.0-100.0*pairs30/lut30);
+
+	double t_lut32 = time_lines(lut, pair_lut, false, false, timed);
+	double t_pairs32 = time_lines(lut, pair_lut, true, false, timed);
+	double t_lut30 = time_lines(lut, pair_lut, false, true, timed);
+	double t_pairs30 = time_lines(lut, pair_lut, true, true, timed);
+	printf("Host, ns per line of 3 lanes: 32-bit lanes %.0f with the LUT, %.0f with pairs, 30-bit lanes %.0f and %.0f\n",
+		t_lut32, t_pairs32, t_lut30, t_pairs30);
+
+	free(lut);
+	free(pair_lut);
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,1168 @@
+/*
+	pio_emu.c
+
+	PIO assembler and emulator for the host tools (see pio_emu.h.)
+	Instruction encodings and behaviour follow the RP2040 datasheet, chapter 3.4.
+
+	Build: link it with whichever tool needs it, e.g. gcc -O2 -o serializer_check serializer_check.c pio_emu.c ...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "pio_emu.h"
+
+#define ASM_MAX_DEFINES 64
+#define ASM_LINE_LEN 256
+#define ASM_MAX_TOKENS 12
+
+enum
+{
+	OP_JMP = 0,
+	OP_WAIT = 1,
+	OP_IN = 2,
+	OP_OUT = 3,
+	OP_PUSH_PULL = 4,
+	OP_MOV = 5,
+	OP_IRQ = 6,
+	OP_SET = 7
+};
+
+struct asm_define_t
+{
+	char name[PIO_NAME_LEN];
+	int value;
+};
+
+struct asm_state_t
+{
+	const char *file_name;
+	const struct pio_define_t *ext;
+	int ext_count;
+	struct asm_define_t defines[ASM_MAX_DEFINES];
+	int define_count;
+	int global_defines; // defines before the first .program are visible to all of them
+	struct pio_program_t *programs;
+	int max_programs;
+	int count;
+	struct pio_program_t *cur;
+	// Instructions are kept as text until the end of the program, so jumps can go forward.
+	char text[PIO_INSTR_MEM][ASM_LINE_LEN];
+	bool wrap_target_set, wrap_set;
+	int line;
+};
+
+/* Assembler */
+
+static void asm_error(struct asm_state_t *as, const char *msg, const char *what)
+{
+	fprintf(stderr, "%s:%d: %s%s%s\n", as->file_name, as->line, msg, what ? ": " : "", what ? what : "");
+}
+
+static char *trim(char *s)
+{
+	while(isspace((unsigned char)*s))
+		s++;
+	char *end = s+strlen(s);
+	while(end>s && isspace((unsigned char)end[-1]))
+		*--end = 0;
+	return s;
+}
+
+static bool lookup_symbol(struct asm_state_t *as, const char *name, int *value)
+{
+	for(int i=as->define_count-1; i>=0; i--)
+	{
+		if(!strcmp(as->defines[i].name, name))
+		{
+			*value = as->defines[i].value;
+			return true;
+		}
+	}
+	if(as->cur)
+	{
+		for(int i=0; i<as->cur->label_count; i++)
+		{
+			if(!strcmp(as->cur->labels[i].name, name))
+			{
+				*value = as->cur->labels[i].offset;
+				return true;
+			}
+		}
+	}
+	for(int i=0; i<as->ext_count; i++)
+	{
+		if(!strcmp(as->ext[i].name, name))
+		{
+			*value = as->ext[i].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parse_term(struct asm_state_t *as, const char *s, int len, int *value)
+{
+	char buf[PIO_NAME_LEN];
+	if(len<=0 || len>=PIO_NAME_LEN)
+		return false;
+	memcpy(buf, s, len);
+	buf[len] = 0;
+	if(isdigit((unsigned char)buf[0]))
+	{
+		char *end;
+		if(buf[0]=='0' && (buf[1]=='b' || buf[1]=='B'))
+			*value = (int)strtol(buf+2, &end, 2);
+		else
+			*value = (int)strtol(buf, &end, 0);
+		return *end==0;
+	}
+	return lookup_symbol(as, buf, value);
+}
+
+// Values are numbers (decimal, 0x, 0b) or names, optionally added/subtracted: "line_end+1"
+static bool parse_value(struct asm_state_t *as, const char *tok, int *value)
+{
+	char buf[ASM_LINE_LEN];
+	snprintf(buf, sizeof(buf), "%s", tok);
+	char *s = trim(buf);
+	int len = (int)strlen(s);
+	if(len>=2 && s[0]=='(' && s[len-1]==')')
+	{
+		s[len-1] = 0;
+		s = trim(s+1);
+	}
+	int total = 0, sign = 1;
+	if(*s=='-')
+	{
+		sign = -1;
+		s++;
+	}
+	while(*s)
+	{
+		int n = 0;
+		while(s[n] && s[n]!='+' && s[n]!='-')
+			n++;
+		int v;
+		while(n>0 && isspace((unsigned char)s[n-1]))
+			n--;
+		if(!parse_term(as, s, n, &v))
+			return false;
+		total += sign*v;
+		s += n;
+		while(isspace((unsigned char)*s))
+			s++;
+		if(!*s)
+			break;
+		sign = *s=='-' ? -1 : 1;
+		s = trim(s+1);
+	}
+	*value = total;
+	return true;
+}
+
+static int tokenize(char *s, char **tokens)
+{
+	int count = 0;
+	char *p = strtok(s, " \t,");
+	while(p && count<ASM_MAX_TOKENS)
+	{
+		tokens[count++] = p;
+		p = strtok(NULL, " \t,");
+	}
+	return count;
+}
+
+static int bitcount_field(struct asm_state_t *as, const char *tok)
+{
+	int n;
+	if(!parse_value(as, tok, &n) || n<1 || n>32)
+	{
+		asm_error(as, "bad bit count", tok);
+		return -1;
+	}
+	return n&0x1f;
+}
+
+static int match(const char *tok, const char *const *names, int count)
+{
+	for(int i=0; i<count; i++)
+	{
+		if(names[i] && !strcasecmp(tok, names[i]))
+			return i;
+	}
+	return -1;
+}
+
+static const char *const in_sources[8] = {"pins", "x", "y", "null", NULL, NULL, "isr", "osr"};
+static const char *const out_dests[8] = {"pins", "x", "y", "null", "pindirs", "pc", "isr", "exec"};
+static const char *const mov_dests[8] = {"pins", "x", "y", NULL, "exec", "pc", "isr", "osr"};
+static const char *const mov_sources[8] = {"pins", "x", "y", "null", NULL, "status", "isr", "osr"};
+static const char *const set_dests[8] = {"pins", "x", "y", NULL, "pindirs", NULL, NULL, NULL};
+static const char *const jmp_conds[8] = {NULL, "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre"};
+
+// Encodes one instruction into 16 bits, or returns -1.
+static int encode_instr(struct asm_state_t *as, const char *src)
+{
+	struct pio_program_t *prog = as->cur;
+	char buf[ASM_LINE_LEN];
+	snprintf(buf, sizeof(buf), "%s", src);
+
+	// Delay: [n]
+	int delay = 0;
+	char *open = strchr(buf, '[');
+	if(open)
+	{
+		char *close = strchr(open, ']');
+		if(!close)
+		{
+			asm_error(as, "missing ]", NULL);
+			return -1;
+		}
+		*close = 0;
+		if(!parse_value(as, open+1, &delay))
+		{
+			asm_error(as, "bad delay", open+1);
+			return -1;
+		}
+		memmove(open, close+1, strlen(close+1)+1);
+	}
+
+	char *tok[ASM_MAX_TOKENS];
+	int n = tokenize(buf, tok);
+	int side = -1;
+	for(int i=0; i<n; i++)
+	{
+		if(!strcasecmp(tok[i], "side") || !strcasecmp(tok[i], "sideset") || !strcasecmp(tok[i], "side_set"))
+		{
+			if(i+1>=n || !parse_value(as, tok[i+1], &side))
+			{
+				asm_error(as, "bad side-set value", NULL);
+				return -1;
+			}
+			for(int j=i; j+2<=n; j++)
+				tok[j] = j+2<n ? tok[j+2] : NULL;
+			n -= 2;
+			break;
+		}
+	}
+	if(n<1)
+	{
+		asm_error(as, "empty instruction", NULL);
+		return -1;
+	}
+
+	int op = 0, args = 0;
+	const char *name = tok[0];
+	if(!strcasecmp(name, "nop"))
+	{
+		op = OP_MOV;
+		args = (2<<5)|(0<<3)|2; // mov y, y
+	}
+	else if(!strcasecmp(name, "jmp"))
+	{
+		op = OP_JMP;
+		int cond = 0, target;
+		const char *target_tok = tok[n-1];
+		if(n==3)
+		{
+			cond = match(tok[1], jmp_conds, 8);
+			if(cond<0)
+			{
+				asm_error(as, "bad jmp condition", tok[1]);
+				return -1;
+			}
+		}
+		else if(n!=2)
+		{
+			asm_error(as, "bad jmp", NULL);
+			return -1;
+		}
+		if(!parse_value(as, target_tok, &target) || target<0 || target>=PIO_INSTR_MEM)
+		{
+			asm_error(as, "bad jmp target", target_tok);
+			return -1;
+		}
+		args = (cond<<5)|target;
+	}
+	else if(!strcasecmp(name, "wait"))
+	{
+		op = OP_WAIT;
+		int i = 1, pol = 1, index;
+		// pioasm wants the polarity, but 'wait irq, line_end' in vga_output_9bpp.pio leaves it out.
+		if(i<n && isdigit((unsigned char)tok[i][0]))
+		{
+			pol = atoi(tok[i]);
+			i++;
+		}
+		if(i+1>=n)
+		{
+			asm_error(as, "bad wait", NULL);
+			return -1;
+		}
+		int source = match(tok[i], (const char *const[]){"gpio", "pin", "irq"}, 3);
+		if(source<0 || !parse_value(as, tok[i+1], &index) || index<0 || index>31)
+		{
+			asm_error(as, "bad wait source", tok[i]);
+			return -1;
+		}
+		if(source==2 && i+2<n && !strcasecmp(tok[i+2], "rel"))
+			index |= 0x10;
+		args = ((pol&1)<<7)|(source<<5)|index;
+	}
+	else if(!strcasecmp(name, "in") || !strcasecmp(name, "out"))
+	{
+		bool is_in = !strcasecmp(name, "in");
+		op = is_in ? OP_IN : OP_OUT;
+		if(n!=3)
+		{
+			asm_error(as, "expected source/destination and bit count", NULL);
+			return -1;
+		}
+		int where = match(tok[1], is_in ? in_sources : out_dests, 8);
+		int bits = bitcount_field(as, tok[2]);
+		if(where<0 || bits<0)
+		{
+			asm_error(as, "bad operand", tok[1]);
+			return -1;
+		}
+		args = (where<<5)|bits;
+	}
+	else if(!strcasecmp(name, "push") || !strcasecmp(name, "pull"))
+	{
+		op = OP_PUSH_PULL;
+		bool is_pull = !strcasecmp(name, "pull");
+		int if_flag = 0, block = 1;
+		for(int i=1; i<n; i++)
+		{
+			if(!strcasecmp(tok[i], is_pull ? "ifempty" : "iffull"))
+				if_flag = 1;
+			else if(!strcasecmp(tok[i], "block"))
+				block = 1;
+			else if(!strcasecmp(tok[i], "noblock"))
+				block = 0;
+			else
+			{
+				asm_error(as, "bad push/pull option", tok[i]);
+				return -1;
+			}
+		}
+		args = (is_pull<<7)|(if_flag<<6)|(block<<5);
+	}
+	else if(!strcasecmp(name, "mov"))
+	{
+		op = OP_MOV;
+		if(n!=3)
+		{
+			asm_error(as, "expected destination and source", NULL);
+			return -1;
+		}
+		const char *s = tok[2];
+		int mov_op = 0;
+		if(*s=='!' || *s=='~')
+		{
+			mov_op = 1;
+			s++;
+		}
+		else if(s[0]==':' && s[1]==':')
+		{
+			mov_op = 2;
+			s += 2;
+		}
+		int dest = match(tok[1], mov_dests, 8), source = match(s, mov_sources, 8);
+		if(dest<0 || source<0)
+		{
+			asm_error(as, "bad mov operand", dest<0 ? tok[1] : s);
+			return -1;
+		}
+		args = (dest<<5)|(mov_op<<3)|source;
+	}
+	else if(!strcasecmp(name, "irq"))
+	{
+		op = OP_IRQ;
+		int i = 1, clear = 0, wait = 0, index;
+		if(i<n && (!strcasecmp(tok[i], "set") || !strcasecmp(tok[i], "nowait")))
+			i++;
+		else if(i<n && !strcasecmp(tok[i], "wait"))
+		{
+			wait = 1;
+			i++;
+		}
+		else if(i<n && !strcasecmp(tok[i], "clear"))
+		{
+			clear = 1;
+			i++;
+		}
+		if(i>=n || !parse_value(as, tok[i], &index) || index<0 || index>7)
+		{
+			asm_error(as, "bad irq index", i<n ? tok[i] : NULL);
+			return -1;
+		}
+		if(i+1<n && !strcasecmp(tok[i+1], "rel"))
+			index |= 0x10;
+		args = (clear<<6)|(wait<<5)|index;
+	}
+	else if(!strcasecmp(name, "set"))
+	{
+		op = OP_SET;
+		int data;
+		int dest = n==3 ? match(tok[1], set_dests, 8) : -1;
+		if(dest<0 || !parse_value(as, tok[2], &data) || data<0 || data>31)
+		{
+			asm_error(as, "bad set", n>1 ? tok[1] : NULL);
+			return -1;
+		}
+		args = (dest<<5)|data;
+	}
+	else
+	{
+		asm_error(as, "unknown instruction", name);
+		return -1;
+	}
+
+	// Delay/side-set field
+	int side_total = prog->sideset_bits+(prog->sideset_opt ? 1 : 0);
+	int delay_bits = 5-side_total;
+	if(delay<0 || delay>=(1<<delay_bits))
+	{
+		asm_error(as, "delay too long for the side-set width", NULL);
+		return -1;
+	}
+	int field = delay;
+	if(side>=0)
+	{
+		if(!prog->sideset_bits || side>=(1<<prog->sideset_bits))
+		{
+			asm_error(as, "bad side-set", NULL);
+			return -1;
+		}
+		field |= side<<delay_bits;
+		if(prog->sideset_opt)
+			field |= 0x10;
+	}
+	return (op<<13)|(field<<8)|args;
+}
+
+static bool finish_program(struct asm_state_t *as)
+{
+	struct pio_program_t *prog = as->cur;
+	if(!prog)
+		return true;
+	int saved_line = as->line;
+	for(int i=0; i<prog->length; i++)
+	{
+		as->line = prog->source_line[i];
+		int instr = encode_instr(as, as->text[i]);
+		if(instr<0)
+			return false;
+		prog->instr[i] = (uint16_t)instr;
+	}
+	as->line = saved_line;
+	if(!as->wrap_target_set)
+		prog->wrap_target = 0;
+	if(!as->wrap_set)
+		prog->wrap = prog->length-1;
+	as->cur = NULL;
+	as->define_count = as->global_defines;
+	return true;
+}
+
+static bool add_define(struct asm_state_t *as, const char *name, int value)
+{
+	if(as->define_count>=ASM_MAX_DEFINES || strlen(name)>=PIO_NAME_LEN)
+	{
+		asm_error(as, "too many defines", name);
+		return false;
+	}
+	snprintf(as->defines[as->define_count].name, PIO_NAME_LEN, "%s", name);
+	as->defines[as->define_count++].value = value;
+	if(!as->cur)
+		as->global_defines = as->define_count;
+	return true;
+}
+
+static bool parse_directive(struct asm_state_t *as, char *line)
+{
+	char *tok[ASM_MAX_TOKENS];
+	int n = tokenize(line, tok);
+	struct pio_program_t *prog = as->cur;
+	if(!strcmp(tok[0], ".program"))
+	{
+		if(!finish_program(as))
+			return false;
+		if(n<2 || as->count>=as->max_programs)
+		{
+			asm_error(as, "bad .program (or too many programs)", NULL);
+			return false;
+		}
+		prog = as->cur = &as->programs[as->count++];
+		memset(prog, 0, sizeof(struct pio_program_t));
+		snprintf(prog->name, PIO_NAME_LEN, "%s", tok[1]);
+		prog->origin = -1;
+		as->wrap_target_set = false;
+		as->wrap_set = false;
+		return true;
+	}
+	if(!strcmp(tok[0], ".define"))
+	{
+		int i = 1, value;
+		if(i<n && !strcasecmp(tok[i], "public"))
+			i++;
+		if(i+1>=n || !parse_value(as, tok[i+1], &value))
+		{
+			asm_error(as, "bad .define", NULL);
+			return false;
+		}
+		return add_define(as, tok[i], value);
+	}
+	if(!strcmp(tok[0], ".lang_opt"))
+		return true;
+	if(!prog)
+	{
+		asm_error(as, "directive outside of a program", tok[0]);
+		return false;
+	}
+	if(!strcmp(tok[0], ".side_set"))
+	{
+		if(n<2 || !parse_value(as, tok[1], &prog->sideset_bits) || prog->sideset_bits<0 || prog->sideset_bits>5)
+		{
+			asm_error(as, "bad .side_set", NULL);
+			return false;
+		}
+		for(int i=2; i<n; i++)
+		{
+			if(!strcasecmp(tok[i], "opt"))
+				prog->sideset_opt = true;
+			else if(!strcasecmp(tok[i], "pindirs"))
+				prog->sideset_pindirs = true;
+		}
+		if(prog->sideset_bits+(prog->sideset_opt ? 1 : 0)>5)
+		{
+			asm_error(as, "side-set too wide", NULL);
+			return false;
+		}
+		return true;
+	}
+	if(!strcmp(tok[0], ".origin"))
+	{
+		if(n<2 || !parse_value(as, tok[1], &prog->origin))
+		{
+			asm_error(as, "bad .origin", NULL);
+			return false;
+		}
+		return true;
+	}
+	if(!strcmp(tok[0], ".wrap_target"))
+	{
+		prog->wrap_target = prog->length;
+		as->wrap_target_set = true;
+		return true;
+	}
+	if(!strcmp(tok[0], ".wrap"))
+	{
+		prog->wrap = prog->length-1;
+		as->wrap_set = true;
+		return true;
+	}
+	asm_error(as, "unsupported directive", tok[0]);
+	return false;
+}
+
+int pio_assemble_text(const char *text, const char *file_name, const struct pio_define_t *defines, int define_count,
+	struct pio_program_t *programs, int max_programs)
+{
+	struct asm_state_t *as = (struct asm_state_t *)calloc(1, sizeof(struct asm_state_t));
+	as->file_name = file_name ? file_name : "<text>";
+	as->ext = defines;
+	as->ext_count = define_count;
+	as->programs = programs;
+	as->max_programs = max_programs;
+
+	bool ok = true;
+	const char *p = text;
+	while(ok && *p)
+	{
+		const char *eol = strchr(p, '\n');
+		int len = eol ? (int)(eol-p) : (int)strlen(p);
+		char raw[ASM_LINE_LEN];
+		if(len>=ASM_LINE_LEN)
+			len = ASM_LINE_LEN-1;
+		memcpy(raw, p, len);
+		raw[len] = 0;
+		p = eol ? eol+1 : p+strlen(p);
+		as->line++;
+
+		char *c = strstr(raw, "//");
+		if(c)
+			*c = 0;
+		c = strchr(raw, ';');
+		if(c)
+			*c = 0;
+		char *line = trim(raw);
+		if(!*line)
+			continue;
+		if(*line=='.')
+		{
+			ok = parse_directive(as, line);
+			continue;
+		}
+
+		// Labels: "name:" or "public name:", not to be confused with "mov x, ::y"
+		char *colon = strchr(line, ':');
+		if(colon && colon[1]!=':' && (colon==line || colon[-1]!=':'))
+		{
+			*colon = 0;
+			char *label = trim(line);
+			bool is_public = false;
+			if(!strncasecmp(label, "public", 6) && isspace((unsigned char)label[6]))
+			{
+				is_public = true;
+				label = trim(label+6);
+			}
+			if(!as->cur || as->cur->label_count>=PIO_MAX_LABELS || strlen(label)>=PIO_NAME_LEN)
+			{
+				asm_error(as, "bad label", label);
+				ok = false;
+				break;
+			}
+			struct pio_label_t *l = &as->cur->labels[as->cur->label_count++];
+			snprintf(l->name, PIO_NAME_LEN, "%s", label);
+			l->offset = as->cur->length;
+			l->is_public = is_public;
+			line = trim(colon+1);
+			if(!*line)
+				continue;
+		}
+
+		if(!as->cur || as->cur->length>=PIO_INSTR_MEM)
+		{
+			asm_error(as, as->cur ? "program too long" : "instruction outside of a program", NULL);
+			ok = false;
+			break;
+		}
+		snprintf(as->text[as->cur->length], ASM_LINE_LEN, "%s", line);
+		as->cur->source_line[as->cur->length++] = as->line;
+	}
+	if(ok)
+		ok = finish_program(as);
+	int count = as->count;
+	free(as);
+	return ok ? count : -1;
+}
+
+int pio_assemble_file(const char *path, const struct pio_define_t *defines, int define_count,
+	struct pio_program_t *programs, int max_programs)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		fprintf(stderr, "Can't open %s\n", path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *text = (char *)malloc(size+1);
+	size_t got = fread(text, 1, size, f);
+	text[got] = 0;
+	fclose(f);
+	int count = pio_assemble_text(text, path, defines, define_count, programs, max_programs);
+	free(text);
+	return count;
+}
+
+const struct pio_program_t *pio_find_program(const struct pio_program_t *programs, int count, const char *name)
+{
+	for(int i=0; i<count; i++)
+	{
+		if(!strcmp(programs[i].name, name))
+			return &programs[i];
+	}
+	return NULL;
+}
+
+const struct pio_program_t *pio_load_program(const char *src_dir, const char *file, const char *name,
+	const struct pio_define_t *defines, int define_count, struct pio_program_t *programs)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", src_dir, file);
+	int count = pio_assemble_file(path, defines, define_count, programs, PIO_MAX_PROGRAMS);
+	if(count<0)
+		return NULL;
+	const struct pio_program_t *prog = pio_find_program(programs, count, name);
+	if(!prog)
+		fprintf(stderr, "No %s in %s\n", name, path);
+	return prog;
+}
+
+int pio_find_label(const struct pio_program_t *program, const char *name)
+{
+	for(int i=0; i<program->label_count; i++)
+	{
+		if(!strcmp(program->labels[i].name, name))
+			return program->labels[i].offset;
+	}
+	return -1;
+}
+
+/* Emulator */
+
+void pio_emu_init(struct pio_emu_t *emu)
+{
+	memset(emu, 0, sizeof(struct pio_emu_t));
+}
+
+// Loads a program at offset (or its .origin, or the highest free spot if both are -1) and relocates its jumps.
+int pio_emu_load(struct pio_emu_t *emu, const struct pio_program_t *program, int offset)
+{
+	if(offset<0)
+		offset = program->origin;
+	if(offset<0)
+	{
+		for(int o=PIO_INSTR_MEM-program->length; o>=0 && offset<0; o--)
+		{
+			bool free_spot = true;
+			for(int i=0; i<program->length; i++)
+				free_spot = free_spot && !emu->used[o+i];
+			if(free_spot)
+				offset = o;
+		}
+	}
+	if(offset<0 || offset+program->length>PIO_INSTR_MEM)
+		return -1;
+	for(int i=0; i<program->length; i++)
+	{
+		if(emu->used[offset+i])
+			return -1;
+	}
+	for(int i=0; i<program->length; i++)
+	{
+		uint16_t instr = program->instr[i];
+		if((instr>>13)==OP_JMP)
+			instr = (instr&~0x1f)|(((instr&0x1f)+offset)&0x1f);
+		emu->imem[offset+i] = instr;
+		emu->used[offset+i] = true;
+	}
+	return offset;
+}
+
+void pio_sm_default_config(struct pio_sm_config_t *cfg)
+{
+	memset(cfg, 0, sizeof(struct pio_sm_config_t));
+	cfg->out_count = 32;
+	cfg->in_shift_right = true;
+	cfg->out_shift_right = true;
+	cfg->push_threshold = 32;
+	cfg->pull_threshold = 32;
+	cfg->clkdiv = 1;
+}
+
+void pio_sm_start(struct pio_emu_t *emu, int sm, const struct pio_program_t *program, int offset, int entry,
+	const struct pio_sm_config_t *cfg)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	memset(s, 0, sizeof(struct pio_sm_t));
+	s->cfg = *cfg;
+	if(s->cfg.clkdiv<1)
+		s->cfg.clkdiv = 1;
+	s->offset = offset;
+	s->wrap_target = offset+program->wrap_target;
+	s->wrap = offset+program->wrap;
+	s->sideset_bits = program->sideset_bits;
+	s->sideset_opt = program->sideset_opt;
+	s->sideset_pindirs = program->sideset_pindirs;
+	s->pc = offset+entry;
+	s->osr_count = 32; // OSR starts empty
+	s->enabled = true;
+}
+
+int pio_sm_fifo_depth(struct pio_emu_t *emu, int sm, bool tx)
+{
+	struct pio_sm_config_t *cfg = &emu->sm[sm].cfg;
+	if(tx)
+		return cfg->join_tx ? 2*PIO_FIFO_DEPTH : (cfg->join_rx ? 0 : PIO_FIFO_DEPTH);
+	return cfg->join_rx ? 2*PIO_FIFO_DEPTH : (cfg->join_tx ? 0 : PIO_FIFO_DEPTH);
+}
+
+int pio_sm_tx_level(struct pio_emu_t *emu, int sm)
+{
+	return emu->sm[sm].tx_level;
+}
+
+int pio_sm_rx_level(struct pio_emu_t *emu, int sm)
+{
+	return emu->sm[sm].rx_level;
+}
+
+bool pio_sm_put(struct pio_emu_t *emu, int sm, uint32_t word)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	if(s->tx_level>=pio_sm_fifo_depth(emu, sm, true))
+		return false;
+	s->tx_fifo[(s->tx_head+s->tx_level++)%(2*PIO_FIFO_DEPTH)] = word;
+	return true;
+}
+
+bool pio_sm_get(struct pio_emu_t *emu, int sm, uint32_t *word)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	if(!s->rx_level)
+		return false;
+	*word = s->rx_fifo[s->rx_head];
+	s->rx_head = (s->rx_head+1)%(2*PIO_FIFO_DEPTH);
+	s->rx_level--;
+	return true;
+}
+
+static bool tx_pop(struct pio_sm_t *s, uint32_t *word)
+{
+	if(!s->tx_level)
+		return false;
+	*word = s->tx_fifo[s->tx_head];
+	s->tx_head = (s->tx_head+1)%(2*PIO_FIFO_DEPTH);
+	s->tx_level--;
+	return true;
+}
+
+static bool rx_push(struct pio_emu_t *emu, int sm, uint32_t word)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	if(s->rx_level>=pio_sm_fifo_depth(emu, sm, false))
+		return false;
+	s->rx_fifo[(s->rx_head+s->rx_level++)%(2*PIO_FIFO_DEPTH)] = word;
+	return true;
+}
+
+static inline uint32_t rotr32(uint32_t x, int n)
+{
+	n &= 31;
+	return n ? (x>>n)|(x<<(32-n)) : x;
+}
+
+static inline uint32_t bit_mask(int bits)
+{
+	return bits>=32 ? 0xffffffffu : ((1u<<bits)-1);
+}
+
+static void write_pins(uint32_t *reg, int base, int count, uint32_t data)
+{
+	for(int i=0; i<count; i++)
+	{
+		int pin = (base+i)&31;
+		*reg = (*reg&~(1u<<pin))|(((data>>i)&1u)<<pin);
+	}
+}
+
+static uint32_t bit_reverse(uint32_t x)
+{
+	uint32_t r = 0;
+	for(int i=0; i<32; i++)
+	{
+		r = (r<<1)|(x&1);
+		x >>= 1;
+	}
+	return r;
+}
+
+static int irq_index(int sm, int index)
+{
+	if(index&0x10)
+		return (index&0x4)|((index+sm)&0x3);
+	return index&0x7;
+}
+
+// Refills the OSR if autopull is on and it's empty. Returns false if the OUT has to stall.
+static bool autopull(struct pio_sm_t *s)
+{
+	if(!s->cfg.autopull || s->osr_count<s->cfg.pull_threshold)
+		return true;
+	if(!tx_pop(s, &s->osr))
+		return false;
+	s->osr_count = 0;
+	return true;
+}
+
+// Runs the current instruction for one cycle. Returns false if it stalled.
+// next_pc is set if the instruction jumps.
+static bool exec_instr(struct pio_emu_t *emu, int sm, uint16_t instr, uint32_t gpio, int *next_pc)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	int op = instr>>13;
+	int a = (instr>>5)&7, b = instr&0x1f;
+	switch(op)
+	{
+		case OP_JMP:
+		{
+			bool take = false;
+			switch(a)
+			{
+				case 0: take = true; break;
+				case 1: take = s->x==0; break;
+				case 2: take = s->x!=0; s->x--; break;
+				case 3: take = s->y==0; break;
+				case 4: take = s->y!=0; s->y--; break;
+				case 5: take = s->x!=s->y; break;
+				case 6: take = (gpio>>s->cfg.jmp_pin)&1; break;
+				case 7: take = s->osr_count<s->cfg.pull_threshold; break;
+			}
+			if(take)
+				*next_pc = b;
+			return true;
+		}
+		case OP_WAIT:
+		{
+			int pol = (instr>>7)&1, source = (instr>>5)&3;
+			if(source==2)
+			{
+				int irq = irq_index(sm, b);
+				bool set = (emu->irq>>irq)&1;
+				if(set!=(bool)pol)
+					return false;
+				if(pol)
+					emu->irq &= ~(1u<<irq);
+				return true;
+			}
+			int pin = source==0 ? b : (s->cfg.in_base+b)&31;
+			return ((gpio>>pin)&1)==(uint32_t)pol;
+		}
+		case OP_IN:
+		{
+			if(s->cfg.autopush && s->isr_count>=s->cfg.push_threshold)
+			{
+				// A previous IN filled the ISR while the RX FIFO was full.
+				if(!rx_push(emu, sm, s->isr))
+				{
+					s->rx_overflow++;
+					return false;
+				}
+				s->isr = 0;
+				s->isr_count = 0;
+			}
+			int bits = b ? b : 32;
+			uint32_t data;
+			switch(a)
+			{
+				case 0: data = rotr32(gpio, s->cfg.in_base); break;
+				case 1: data = s->x; break;
+				case 2: data = s->y; break;
+				case 6: data = s->isr; break;
+				case 7: data = s->osr; break;
+				default: data = 0; break;
+			}
+			data &= bit_mask(bits);
+			if(s->cfg.in_shift_right)
+				s->isr = bits==32 ? data : (s->isr>>bits)|(data<<(32-bits));
+			else
+				s->isr = bits==32 ? data : (s->isr<<bits)|data;
+			s->isr_count += bits;
+			if(s->isr_count>32)
+				s->isr_count = 32;
+			if(s->cfg.autopush && s->isr_count>=s->cfg.push_threshold && rx_push(emu, sm, s->isr))
+			{
+				s->isr = 0;
+				s->isr_count = 0;
+			}
+			return true;
+		}
+		case OP_OUT:
+		{
+			if(!autopull(s))
+			{
+				s->tx_underflow++;
+				return false;
+			}
+			int bits = b ? b : 32;
+			uint32_t data;
+			if(s->cfg.out_shift_right)
+			{
+				data = s->osr&bit_mask(bits);
+				s->osr = bits==32 ? 0 : s->osr>>bits;
+			}
+			else
+			{
+				data = bits==32 ? s->osr : s->osr>>(32-bits);
+				s->osr = bits==32 ? 0 : s->osr<<bits;
+			}
+			s->osr_count += bits;
+			if(s->osr_count>32)
+				s->osr_count = 32;
+			switch(a)
+			{
+				case 0: write_pins(&emu->pins, s->cfg.out_base, s->cfg.out_count, data); break;
+				case 1: s->x = data; break;
+				case 2: s->y = data; break;
+				case 4: write_pins(&emu->pindirs, s->cfg.out_base, s->cfg.out_count, data); break;
+				case 5: *next_pc = data&0x1f; break;
+				case 6: s->isr = data; s->isr_count = bits; break;
+				case 7:
+					fprintf(stderr, "pio_emu: OUT EXEC isn't supported\n");
+					exit(1);
+				default: break;
+			}
+			// The refill for the next OUT happens in the background if there's data.
+			autopull(s);
+			return true;
+		}
+		case OP_PUSH_PULL:
+		{
+			bool is_pull = (instr>>7)&1, if_flag = (instr>>6)&1, block = (instr>>5)&1;
+			if(!is_pull)
+			{
+				if(if_flag && s->isr_count<s->cfg.push_threshold)
+					return true;
+				if(!rx_push(emu, sm, s->isr))
+				{
+					if(block)
+					{
+						s->rx_overflow++;
+						return false;
+					}
+				}
+				s->isr = 0;
+				s->isr_count = 0;
+				return true;
+			}
+			if(if_flag && s->osr_count<s->cfg.pull_threshold)
+				return true;
+			if(!tx_pop(s, &s->osr))
+			{
+				if(block)
+				{
+					s->tx_underflow++;
+					return false;
+				}
+				s->osr = s->x;
+			}
+			s->osr_count = 0;
+			return true;
+		}
+		case OP_MOV:
+		{
+			int mov_op = (instr>>3)&3, source = instr&7;
+			uint32_t data;
+			switch(source)
+			{
+				case 0: data = rotr32(gpio, s->cfg.in_base); break;
+				case 1: data = s->x; break;
+				case 2: data = s->y; break;
+				case 5: data = s->tx_level<s->cfg.status_n ? 0xffffffffu : 0; break;
+				case 6: data = s->isr; break;
+				case 7: data = s->osr; break;
+				default: data = 0; break;
+			}
+			if(mov_op==1)
+				data = ~data;
+			else if(mov_op==2)
+				data = bit_reverse(data);
+			switch(a)
+			{
+				case 0: write_pins(&emu->pins, s->cfg.out_base, s->cfg.out_count, data); break;
+				case 1: s->x = data; break;
+				case 2: s->y = data; break;
+				case 5: *next_pc = data&0x1f; break;
+				case 6: s->isr = data; s->isr_count = 0; break;
+				case 7: s->osr = data; s->osr_count = 0; break;
+				case 4:
+					fprintf(stderr, "pio_emu: MOV EXEC isn't supported\n");
+					exit(1);
+				default: break;
+			}
+			return true;
+		}
+		case OP_IRQ:
+		{
+			bool clear = (instr>>6)&1, wait = (instr>>5)&1;
+			int irq = irq_index(sm, b);
+			if(clear)
+			{
+				emu->irq &= ~(1u<<irq);
+				return true;
+			}
+			if(!s->irq_waiting)
+			{
+				emu->irq_next |= 1u<<irq;
+				if(!wait)
+					return true;
+				s->irq_waiting = true;
+				return false;
+			}
+			if((emu->irq>>irq)&1)
+				return false;
+			s->irq_waiting = false;
+			return true;
+		}
+		case OP_SET:
+		{
+			switch(a)
+			{
+				case 0: write_pins(&emu->pins, s->cfg.set_base, s->cfg.set_count, b); break;
+				case 1: s->x = b; break;
+				case 2: s->y = b; break;
+				case 4: write_pins(&emu->pindirs, s->cfg.set_base, s->cfg.set_count, b); break;
+				default: break;
+			}
+			return true;
+		}
+	}
+	return true;
+}
+
+static void step_sm(struct pio_emu_t *emu, int sm, uint32_t gpio)
+{
+	struct pio_sm_t *s = &emu->sm[sm];
+	if(++s->div_count<s->cfg.clkdiv)
+		return;
+	s->div_count = 0;
+	s->cycles++;
+	if(s->delay)
+	{
+		s->delay--;
+		s->delay_cycles++;
+		return;
+	}
+
+	uint16_t instr = emu->imem[s->pc];
+	int field = (instr>>8)&0x1f;
+	int side_total = s->sideset_bits+(s->sideset_opt ? 1 : 0);
+	int delay_bits = 5-side_total;
+	// Side-set happens as soon as the instruction starts, even if it stalls.
+	if(s->sideset_bits && (!s->sideset_opt || (field&0x10)))
+	{
+		uint32_t side = (field>>delay_bits)&bit_mask(s->sideset_bits);
+		write_pins(s->sideset_pindirs ? &emu->pindirs : &emu->pins, s->cfg.sideset_base, s->sideset_bits, side);
+	}
+
+	int next_pc = -1;
+	s->stalled = !exec_instr(emu, sm, instr, gpio, &next_pc);
+	if(s->stalled)
+	{
+		s->stall_cycles++;
+		return;
+	}
+	s->exec_count++;
+	if(next_pc>=0)
+		s->pc = next_pc;
+	else if(s->pc==s->wrap)
+		s->pc = s->wrap_target;
+	else
+		s->pc = (s->pc+1)&(PIO_INSTR_MEM-1);
+	s->delay = field&bit_mask(delay_bits);
+}
+
+// One system clock for every enabled state machine. All of them see the GPIO levels from the start of the cycle.
+void pio_emu_step(struct pio_emu_t *emu)
+{
+	uint32_t gpio = emu->read_gpio ? emu->read_gpio(emu->ctx, emu->cycle, emu->pins, emu->pindirs) : emu->pins;
+	for(int sm=0; sm<PIO_SM_COUNT; sm++)
+	{
+		if(emu->sm[sm].enabled)
+			step_sm(emu, sm, gpio);
+	}
+	emu->irq |= emu->irq_next;
+	emu->irq_next = 0;
+	emu->cycle++;
+}
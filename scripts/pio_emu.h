@@ -0,0 +1,134 @@
+/*
+	pio_emu.h
+
+	A small assembler and cycle-level emulator for RP2040 PIO programs, so the .pio files in src can be checked on the host.
+	The assembler reads the same syntax as pioasm (.program, .side_set, .origin, .wrap_target, .wrap, .define, labels,
+	side-set and delays.) Names that aren't defined in the file itself (like 'V' in vsync.pio) can be passed in as defines.
+	It's a bit more lenient than pioasm with commas, since some of the programs here were written before being assembled.
+
+	The emulator runs one PIO block (4 state machines, 32 instruction slots, shared IRQ flags) one system clock at a time.
+	GPIO inputs come from a callback, which gets the current PIO outputs so it can model external logic (like the '541
+	output enables in lcd_cap_15bpp_mux.pio.) An IRQ flag set by one state machine is seen by the others (and by WAIT IRQ)
+	from the next cycle on, whatever order they're stepped in.
+	Not emulated: OUT/MOV EXEC, MOV STATUS other than "TX FIFO level < N", fractional clock dividers, and input synchronizers.
+*/
+
+#ifndef PIO_EMU_H
+#define PIO_EMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIO_INSTR_MEM 32
+#define PIO_SM_COUNT 4
+#define PIO_MAX_LABELS 32
+#define PIO_MAX_PROGRAMS 8
+#define PIO_NAME_LEN 32
+#define PIO_FIFO_DEPTH 4
+
+struct pio_define_t
+{
+	const char *name;
+	int value;
+};
+
+struct pio_label_t
+{
+	char name[PIO_NAME_LEN];
+	int offset;
+	bool is_public;
+};
+
+struct pio_program_t
+{
+	char name[PIO_NAME_LEN];
+	uint16_t instr[PIO_INSTR_MEM];
+	int source_line[PIO_INSTR_MEM];
+	int length;
+	int origin; // -1 if the program can go anywhere
+	int wrap_target, wrap; // relative to the start of the program
+	int sideset_bits; // not counting the opt bit
+	bool sideset_opt, sideset_pindirs;
+	struct pio_label_t labels[PIO_MAX_LABELS];
+	int label_count;
+};
+
+struct pio_sm_config_t
+{
+	int in_base;
+	int out_base, out_count;
+	int set_base, set_count;
+	int sideset_base;
+	int jmp_pin;
+	bool in_shift_right, out_shift_right;
+	bool autopush, autopull;
+	int push_threshold, pull_threshold; // 1-32
+	bool join_tx, join_rx;
+	int clkdiv; // integer dividers only
+	int status_n; // MOV STATUS: all ones if TX level < status_n
+};
+
+struct pio_sm_t
+{
+	bool enabled;
+	struct pio_sm_config_t cfg;
+	int offset; // where the program was loaded
+	int wrap_target, wrap; // absolute
+	int sideset_bits;
+	bool sideset_opt, sideset_pindirs;
+	uint32_t x, y, isr, osr;
+	int isr_count, osr_count;
+	int pc;
+	int delay;
+	int div_count;
+	uint32_t tx_fifo[2*PIO_FIFO_DEPTH], rx_fifo[2*PIO_FIFO_DEPTH];
+	int tx_head, tx_level, rx_head, rx_level;
+	bool stalled;
+	bool irq_waiting; // IRQ WAIT has set its flag and is waiting for it to be cleared
+	// Statistics
+	uint64_t cycles, exec_count, stall_cycles, delay_cycles;
+	uint64_t tx_underflow; // cycles stalled on an empty TX FIFO
+	uint64_t rx_overflow; // cycles stalled on a full RX FIFO
+};
+
+struct pio_emu_t
+{
+	uint16_t imem[PIO_INSTR_MEM];
+	bool used[PIO_INSTR_MEM];
+	struct pio_sm_t sm[PIO_SM_COUNT];
+	uint8_t irq;
+	uint8_t irq_next; // set by IRQ this cycle, the state machines see them from the next one
+	uint32_t pins; // output levels driven by this PIO
+	uint32_t pindirs;
+	uint64_t cycle;
+	// Returns the level of all 32 GPIOs. outputs is what this PIO is currently driving.
+	uint32_t (*read_gpio)(void *ctx, uint64_t cycle, uint32_t outputs, uint32_t pindirs);
+	void *ctx;
+};
+
+// Assembler
+int pio_assemble_text(const char *text, const char *file_name, const struct pio_define_t *defines, int define_count,
+	struct pio_program_t *programs, int max_programs);
+int pio_assemble_file(const char *path, const struct pio_define_t *defines, int define_count,
+	struct pio_program_t *programs, int max_programs);
+const struct pio_program_t *pio_find_program(const struct pio_program_t *programs, int count, const char *name);
+// Assembles src_dir/file into programs (PIO_MAX_PROGRAMS of them) and returns the one called name. NULL, after saying
+// what's missing, if the file doesn't assemble or doesn't have it.
+const struct pio_program_t *pio_load_program(const char *src_dir, const char *file, const char *name,
+	const struct pio_define_t *defines, int define_count, struct pio_program_t *programs);
+int pio_find_label(const struct pio_program_t *program, const char *name);
+
+// Emulator
+void pio_emu_init(struct pio_emu_t *emu);
+int pio_emu_load(struct pio_emu_t *emu, const struct pio_program_t *program, int offset);
+void pio_sm_default_config(struct pio_sm_config_t *cfg);
+void pio_sm_start(struct pio_emu_t *emu, int sm, const struct pio_program_t *program, int offset, int entry,
+	const struct pio_sm_config_t *cfg);
+void pio_emu_step(struct pio_emu_t *emu);
+bool pio_sm_put(struct pio_emu_t *emu, int sm, uint32_t word);
+bool pio_sm_get(struct pio_emu_t *emu, int sm, uint32_t *word);
+int pio_sm_tx_level(struct pio_emu_t *emu, int sm);
+int pio_sm_rx_level(struct pio_emu_t *emu, int sm);
+int pio_sm_fifo_depth(struct pio_emu_t *emu, int sm, bool tx);
+
+#endif
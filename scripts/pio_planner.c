@@ -0,0 +1,893 @@
+/*
+	pio_planner.c
+
+	Plans the PIO resources of a feature set: which PIO every program goes on, where in its 32 instruction slots, which
+	state machines run it, and the GPIOs and DREQs that come with that. Fails (exit code 1, no header) when the
+	combination can't fit, so a build that runs it stops there.
+
+	It assembles every .pio file in src with pio_emu's assembler and prints the footprint of every program: length,
+	fixed origin, the FIFOs it uses and the GPIOs it waits on. Then, for the features asked for:
+	-GPIO: every pin driven by one feature (out, side-set and set pins, and outputs that aren't PIO like the HDMI clock
+	 pair) can't be driven or read as an input by another one
+	-state machines: at most 4 per PIO, with the fixed ones (vga_output.c uses SM 0-2) and the consecutive ones (the 3
+	 TMDS lanes, blank_spans.c) where they have to be
+	-instructions: the programs of a PIO are placed into its 32 slots with a search that lets 2 programs share slots
+	 when their instructions there are the same after relocation (JMP targets included), so a program that is the tail
+	 of another costs nothing. A program run by several state machines is only loaded once.
+	Features that have to be on the same PIO (the capture programs and vsync_interruptor share the capture PIO, since
+	model_detect.c switches between them) are planned as a group, and every way of putting the groups on PIO0/PIO1 is
+	tried. Of the ones that fit, the plan keeps the current layout when it can (capture on PIO0, video and lcd_timing on
+	PIO1, the DREQs in the DMA table of the documentation), then the most free instructions and state machines on the
+	fuller PIO, for whatever comes next.
+	It also points out wrap opportunities: a program that ends in an unconditional JMP without delay or side-set can
+	lose it with .wrap_target/.wrap.
+
+	Programs that aren't features yet (audio, a controller) can be added with -x: the file in src, the program, the
+	state machines it needs and the pins it drives or reads. They're planned as a group of their own.
+
+	Output: a header with PIO_PLAN_<PROGRAM>_PIO/_SM/_OFFSET for every program, the DREQs and the GPIO functions. The
+	offsets are for pio_add_program_at_offset(); pio_add_program() would place them on its own and can't share slots.
+
+	Build: gcc -O2 -o pio_planner pio_planner.c pio_emu.c
+	Usage: ./pio_planner [options]
+	-f feature,...       capture, capture_lut, capture_9bpp, dmg, model_detect, hdmi, hdmi_pair, hdmi_3lane, vga, clkout
+	                     (default capture,dmg,model_detect,hdmi: the current firmware)
+	-x file:program:sms[:pins]   extra program; pins is a list like out=26+2,side=28,in=27,set=0+2,jmp=10
+	-d path              src folder (default ../src)
+	-o file              output header (default pio_plan.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "pio_emu.h"
+#include "host_util.h"
+
+#define PIO_COUNT 2
+#define GPIO_COUNT 30
+#define MAX_USES 4
+#define MAX_FEATURES 16
+#define MAX_PLAN_PROGRAMS 16
+#define MAX_FILES 32
+#define MAX_GROUPS 8
+// Placement search nodes per PIO before it settles for the best so far
+#define PLACE_NODE_LIMIT 2000000
+
+// vsync_interruptor waits on 'V', the LCD vsync
+#define VSYNC_PIN 11
+
+#define OP_JMP 0
+#define OP_WAIT 1
+#define OP_IN 2
+#define OP_OUT 3
+#define OP_PUSH_PULL 4
+
+struct pin_range_t
+{
+	int base;
+	int count;
+};
+
+struct use_t
+{
+	const char *file;
+	const char *program;
+	int sms; // 0: runs on the first state machine of its group (a program that's switched to)
+	int first_sm; // fixed state machine, or -1
+	int pin_step; // pins move up by this much for every state machine after the first
+	struct pin_range_t out, side, set, in;
+	int jmp_pin; // -1 if none
+};
+
+struct feature_t
+{
+	const char *name;
+	const char *group;
+	int prefer_pio; // -1 for none
+	struct use_t uses[MAX_USES];
+	struct pin_range_t other_out; // outputs that aren't driven by the PIO
+	const char *other_what;
+};
+
+#define NO_PINS {0, 0}
+#define USE(file, program, sms, first_sm, step, out, side, set, in, jmp) {file, program, sms, first_sm, step, out, side, set, in, jmp}
+
+static const struct feature_t feature_table[] =
+{
+	{"capture", "capture", 0, {
+		USE("lcd_cap_15bpp_mux.pio", "lcd_capture", 1, -1, 0, NO_PINS, NO_PINS, ((struct pin_range_t){0, 2}), ((struct pin_range_t){2, 8}), -1),
+		USE("vsync.pio", "vsync_interruptor", 1, -1, 0, NO_PINS, NO_PINS, NO_PINS, NO_PINS, -1)}, NO_PINS, NULL},
+	{"capture_lut", "capture", 0, {
+		USE("lcd_cap_lut.pio", "lcd_capture_lut", 1, -1, 0, NO_PINS, NO_PINS, ((struct pin_range_t){0, 2}), ((struct pin_range_t){2, 8}), -1),
+		USE("vsync.pio", "vsync_interruptor", 1, -1, 0, NO_PINS, NO_PINS, NO_PINS, NO_PINS, -1)}, NO_PINS, NULL},
+	{"capture_9bpp", "capture", 0, {
+		USE("lcd_cap_9bpp.pio", "lcd_cap_9bpp", 1, -1, 0, NO_PINS, NO_PINS, NO_PINS, ((struct pin_range_t){0, 10}), -1),
+		USE("vsync.pio", "vsync_interruptor", 1, -1, 0, NO_PINS, NO_PINS, NO_PINS, NO_PINS, -1)}, NO_PINS, NULL},
+	{"dmg", "capture", 0, {
+		USE("lcd_cap_dmg.pio", "lcd_capture_dmg", 0, -1, 0, NO_PINS, NO_PINS, ((struct pin_range_t){0, 2}), ((struct pin_range_t){2, 2}), -1)},
+		NO_PINS, NULL},
+	{"model_detect", "timing", 1, {
+		USE("lcd_timing.pio", "lcd_timing", 1, -1, 0, NO_PINS, NO_PINS, NO_PINS, NO_PINS, 10)}, NO_PINS, NULL},
+	{"hdmi", "video", 1, {
+		USE("tmds_output.pio", "tmds_output", 3, -1, 2, NO_PINS, ((struct pin_range_t){14, 2}), NO_PINS, NO_PINS, -1)},
+		{20, 2}, "HDMI clock pair"},
+	{"hdmi_pair", "video", 1, {
+		USE("tmds_output_pair.pio", "tmds_output_pair", 3, -1, 2, ((struct pin_range_t){14, 2}), NO_PINS, NO_PINS, NO_PINS, -1)},
+		{20, 2}, "HDMI clock pair"},
+	{"hdmi_3lane", "video", 1, {
+		USE("tmds_output_3lane.pio", "tmds_output_3lane", 1, -1, 0, ((struct pin_range_t){14, 6}), NO_PINS, NO_PINS, NO_PINS, -1)},
+		{20, 2}, "HDMI clock pair"},
+	{"vga", "video", 1, {
+		USE("vga_output_9bpp.pio", "vga_hsync", 1, 0, 0, NO_PINS, ((struct pin_range_t){23, 1}), NO_PINS, NO_PINS, -1),
+		USE("vga_output_9bpp.pio", "vga_vsync", 1, 1, 0, NO_PINS, ((struct pin_range_t){24, 1}), NO_PINS, NO_PINS, -1),
+		USE("vga_output_9bpp.pio", "vga_out_9bpp", 1, 2, 0, ((struct pin_range_t){13, 10}), NO_PINS, NO_PINS, NO_PINS, -1)},
+		NO_PINS, NULL},
+	{"clkout", "clkout", -1, {{NULL}}, {13, 1}, "optional system clock output"}
+};
+#define FEATURE_TABLE_SIZE ((int)(sizeof(feature_table)/sizeof(feature_table[0])))
+
+// A program in the plan, with everything that runs it
+struct plan_program_t
+{
+	const struct pio_program_t *prog;
+	int group;
+	int sms; // state machines of its own
+	int first_sm;
+	int pin_step;
+	const struct use_t *use;
+	const char *feature;
+	// Results
+	int pio, sm, offset;
+	bool tx, rx;
+};
+
+struct group_t
+{
+	char name[32];
+	int prefer_pio;
+};
+
+struct source_t
+{
+	char name[64];
+	struct pio_program_t programs[PIO_MAX_PROGRAMS];
+	int count;
+};
+
+struct layout_t
+{
+	int offset[MAX_PLAN_PROGRAMS];
+	int sm[MAX_PLAN_PROGRAMS];
+	int used[PIO_COUNT];
+	int sms_used[PIO_COUNT];
+	int shared[PIO_COUNT]; // slots that hold more than one program
+};
+
+static struct source_t sources[MAX_FILES];
+static int source_count;
+static struct feature_t features[MAX_FEATURES];
+static int feature_count;
+static struct plan_program_t plan[MAX_PLAN_PROGRAMS];
+static int plan_count;
+static struct group_t groups[MAX_GROUPS];
+static int group_count;
+static char extra_text[MAX_FEATURES][4][64];
+
+static const char *src_dir = "../src";
+
+static struct source_t *load_source(const char *file)
+{
+	for(int i=0; i<source_count; i++)
+	{
+		if(!strcmp(sources[i].name, file))
+			return &sources[i];
+	}
+	if(source_count==MAX_FILES)
+		return NULL;
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", src_dir, file);
+	struct pio_define_t define = {"V", VSYNC_PIN};
+	struct source_t *s = &sources[source_count];
+	s->count = pio_assemble_file(path, &define, 1, s->programs, PIO_MAX_PROGRAMS);
+	if(s->count<0)
+		return NULL;
+	snprintf(s->name, sizeof(s->name), "%s", file);
+	source_count++;
+	return s;
+}
+
+static uint16_t relocate(uint16_t instr, int offset)
+{
+	if((instr>>13)==OP_JMP)
+		instr = (uint16_t)((instr&~0x1f)|(((instr&0x1f)+offset)&0x1f));
+	return instr;
+}
+
+static void fifo_use(const struct pio_program_t *p, bool *tx, bool *rx)
+{
+	*tx = *rx = false;
+	for(int i=0; i<p->length; i++)
+	{
+		int op = p->instr[i]>>13;
+		bool pull = (p->instr[i]>>7)&1;
+		*tx = *tx || op==OP_OUT || (op==OP_PUSH_PULL && pull);
+		*rx = *rx || op==OP_IN || (op==OP_PUSH_PULL && !pull);
+	}
+}
+
+// GPIOs the program waits on (WAIT GPIO has the absolute pin number)
+static uint32_t wait_pins(const struct pio_program_t *p)
+{
+	uint32_t pins = 0;
+	for(int i=0; i<p->length; i++)
+	{
+		if((p->instr[i]>>13)==OP_WAIT && ((p->instr[i]>>5)&3)==0)
+			pins |= 1u<<(p->instr[i]&0x1f);
+	}
+	return pins;
+}
+
+// An unconditional JMP at the wrap point, with no delay or side-set, can go: the wrap does the same for free.
+static int wrap_saving(const struct pio_program_t *p, int *target)
+{
+	uint16_t last = p->instr[p->wrap];
+	if(p->wrap!=p->length-1 || (last>>13)!=OP_JMP || ((last>>5)&7) || ((last>>8)&0x1f))
+		return 0;
+	*target = last&0x1f;
+	return 1;
+}
+
+static void pin_list(char *out, size_t size, uint32_t pins)
+{
+	out[0] = 0;
+	for(int pin=0; pin<GPIO_COUNT; pin++)
+	{
+		if(!(pins&(1u<<pin)))
+			continue;
+		int end = pin;
+		while(end+1<GPIO_COUNT && (pins&(1u<<(end+1))))
+			end++;
+		size_t len = strlen(out);
+		snprintf(out+len, size-len, end>pin ? "%sGP%d-%d" : "%sGP%d", len ? "," : "", pin, end);
+		pin = end;
+	}
+	if(!out[0])
+		snprintf(out, size, "-");
+}
+
+static void print_footprints(void)
+{
+	DIR *dir = opendir(src_dir);
+	if(!dir)
+	{
+		perror(src_dir);
+		return;
+	}
+	struct dirent *e;
+	char names[MAX_FILES][64];
+	int count = 0;
+	while((e = readdir(dir)) && count<MAX_FILES)
+	{
+		size_t len = strlen(e->d_name);
+		if(len>4 && !strcmp(e->d_name+len-4, ".pio"))
+			snprintf(names[count++], sizeof(names[0]), "%s", e->d_name);
+	}
+	closedir(dir);
+	qsort(names, count, sizeof(names[0]), (int (*)(const void *, const void *))strcmp);
+
+	printf("%-24s %-20s %6s %6s %5s %s\n", "file", "program", "instr", "origin", "fifo", "waits on");
+	for(int f=0; f<count; f++)
+	{
+		struct source_t *s = load_source(names[f]);
+		if(!s)
+			continue;
+		for(int i=0; i<s->count; i++)
+		{
+			const struct pio_program_t *p = &s->programs[i];
+			bool tx, rx;
+			char origin[8], waits[64];
+			fifo_use(p, &tx, &rx);
+			snprintf(origin, sizeof(origin), p->origin<0 ? "any" : "%d", p->origin);
+			pin_list(waits, sizeof(waits), wait_pins(p));
+			printf("%-24s %-20s %6d %6s %2s%-3s %s\n", names[f], p->name, p->length, origin, tx ? "TX" : "", rx ? "RX" : "",
+				waits);
+			int target;
+			if(wrap_saving(p, &target))
+				printf("%46s-> ends in 'jmp %d': .wrap_target there and .wrap before it saves 1 instruction\n", "", target);
+		}
+	}
+}
+
+static bool parse_range(const char *s, struct pin_range_t *r)
+{
+	char *end;
+	r->base = (int)strtol(s, &end, 10);
+	r->count = 1;
+	if(*end=='+')
+		r->count = (int)strtol(end+1, &end, 10);
+	return end!=s && r->base>=0 && r->count>0 && r->base+r->count<=GPIO_COUNT;
+}
+
+// file:program:sms[:out=a+n,side=..,set=..,in=..,jmp=n]
+static bool parse_extra(const char *arg)
+{
+	if(feature_count==MAX_FEATURES)
+		return false;
+	char copy[256], *fields[4] = {NULL};
+	snprintf(copy, sizeof(copy), "%s", arg);
+	int n = 0;
+	for(char *tok=strtok(copy, ":"); tok && n<4; tok=strtok(NULL, ":"))
+		fields[n++] = tok;
+	if(n<3)
+		return false;
+	int i = feature_count;
+	struct feature_t *f = &features[i];
+	memset(f, 0, sizeof(*f));
+	snprintf(extra_text[i][0], sizeof(extra_text[i][0]), "%s", fields[0]);
+	snprintf(extra_text[i][1], sizeof(extra_text[i][1]), "%s", fields[1]);
+	snprintf(extra_text[i][2], sizeof(extra_text[i][2]), "extra_%s", fields[1]);
+	f->name = extra_text[i][2];
+	f->group = extra_text[i][2];
+	f->prefer_pio = -1;
+	struct use_t *u = &f->uses[0];
+	u->file = extra_text[i][0];
+	u->program = extra_text[i][1];
+	u->sms = atoi(fields[2]);
+	u->first_sm = -1;
+	u->jmp_pin = -1;
+	if(u->sms<1 || u->sms>PIO_SM_COUNT)
+		return false;
+	for(char *tok=fields[3] ? strtok(fields[3], ",") : NULL; tok; tok=strtok(NULL, ","))
+	{
+		struct pin_range_t r;
+		char *eq = strchr(tok, '=');
+		if(!eq || !parse_range(eq+1, &r))
+			return false;
+		*eq = 0;
+		if(!strcmp(tok, "out"))
+			u->out = r;
+		else if(!strcmp(tok, "side"))
+			u->side = r;
+		else if(!strcmp(tok, "set"))
+			u->set = r;
+		else if(!strcmp(tok, "in"))
+			u->in = r;
+		else if(!strcmp(tok, "jmp"))
+			u->jmp_pin = r.base;
+		else
+			return false;
+	}
+	feature_count++;
+	return true;
+}
+
+static bool parse_features(char *list)
+{
+	for(char *tok=strtok(list, ","); tok; tok=strtok(NULL, ","))
+	{
+		int i;
+		for(i=0; i<FEATURE_TABLE_SIZE && strcmp(tok, feature_table[i].name); i++)
+			;
+		if(i==FEATURE_TABLE_SIZE)
+		{
+			fprintf(stderr, "Unknown feature: %s\n", tok);
+			return false;
+		}
+		if(feature_count==MAX_FEATURES)
+			return false;
+		features[feature_count++] = feature_table[i];
+	}
+	return true;
+}
+
+static uint32_t range_mask(struct pin_range_t r, int shift)
+{
+	if(!r.count)
+		return 0;
+	return (uint32_t)(((1ull<<r.count)-1)<<(r.base+shift));
+}
+
+// Pins a use drives and reads, over all its state machines
+static void use_pins(const struct use_t *u, const struct pio_program_t *p, uint32_t *out, uint32_t *in)
+{
+	*out = *in = 0;
+	int sms = u->sms ? u->sms : 1;
+	for(int s=0; s<sms; s++)
+	{
+		int shift = s*u->pin_step;
+		*out |= range_mask(u->out, shift)|range_mask(u->side, shift)|range_mask(u->set, shift);
+		*in |= range_mask(u->in, shift);
+	}
+	if(u->jmp_pin>=0)
+		*in |= 1u<<u->jmp_pin;
+	if(p)
+		*in |= wait_pins(p);
+}
+
+static int find_group(const char *name, int prefer_pio)
+{
+	for(int g=0; g<group_count; g++)
+	{
+		if(!strcmp(groups[g].name, name))
+			return g;
+	}
+	snprintf(groups[group_count].name, sizeof(groups[0].name), "%s", name);
+	groups[group_count].prefer_pio = prefer_pio;
+	return group_count++;
+}
+
+static bool feature_switched(const struct feature_t *f)
+{
+	for(int u=0; u<MAX_USES && f->uses[u].file; u++)
+	{
+		if(f->uses[u].sms)
+			return false;
+	}
+	return f->uses[0].file!=NULL;
+}
+
+// Builds the program list from the features, and checks the GPIOs. Returns false if it can't go on.
+static bool build_plan(uint32_t *driven, uint32_t *read)
+{
+	uint32_t feature_out[MAX_FEATURES], feature_in[MAX_FEATURES];
+	bool ok = true;
+	*driven = *read = 0;
+	for(int f=0; f<feature_count; f++)
+	{
+		const struct feature_t *ft = &features[f];
+		int g = find_group(ft->group, ft->prefer_pio);
+		uint32_t out = range_mask(ft->other_out, 0), in = 0;
+		for(int u=0; u<MAX_USES && ft->uses[u].file; u++)
+		{
+			const struct use_t *use = &ft->uses[u];
+			struct source_t *s = load_source(use->file);
+			const struct pio_program_t *p = s ? pio_find_program(s->programs, s->count, use->program) : NULL;
+			if(!p)
+			{
+				fprintf(stderr, "No program %s in %s/%s\n", use->program, src_dir, use->file);
+				return false;
+			}
+			uint32_t o, i;
+			use_pins(use, p, &o, &i);
+			out |= o;
+			in |= i;
+			// The same program from 2 features (vsync_interruptor) is one program
+			int existing = -1;
+			for(int k=0; k<plan_count; k++)
+			{
+				if(plan[k].prog==p)
+					existing = k;
+			}
+			if(existing>=0)
+			{
+				if(plan[existing].group!=g)
+				{
+					fprintf(stderr, "%s is in 2 groups\n", p->name);
+					return false;
+				}
+				continue;
+			}
+			if(plan_count==MAX_PLAN_PROGRAMS)
+				return false;
+			struct plan_program_t *pp = &plan[plan_count++];
+			memset(pp, 0, sizeof(*pp));
+			pp->prog = p;
+			pp->group = g;
+			pp->sms = use->sms;
+			pp->first_sm = use->first_sm;
+			pp->pin_step = use->pin_step;
+			pp->use = use;
+			pp->feature = ft->name;
+			fifo_use(p, &pp->tx, &pp->rx);
+		}
+			// A pin driven by this feature can't be used by another one, and the other way around. A program that's switched to
+		// on the state machine of its group (lcd_capture_dmg) takes over the pins of the one it replaces.
+		for(int j=0; j<f; j++)
+		{
+			uint32_t both_out = out&feature_out[j], clash = (out&feature_in[j])|(in&feature_out[j]);
+			bool switched = !strcmp(features[j].group, ft->group) && (feature_switched(ft) || feature_switched(&features[j]));
+			if(switched || !(both_out|clash))
+				continue;
+			char pins[64];
+			pin_list(pins, sizeof(pins), both_out|clash);
+			fprintf(stderr, "%s: used by %s and %s, %s\n", pins, features[j].name, ft->name,
+				both_out ? "both driving them" : "one driving and one reading them");
+			ok = false;
+		}
+		feature_out[f] = out;
+		feature_in[f] = in;
+		*driven |= out;
+		*read |= in;
+	}
+	return ok;
+}
+
+// Placement search for the programs of one PIO
+struct place_state_t
+{
+	int order[MAX_PLAN_PROGRAMS];
+	int count;
+	uint16_t mem[PIO_INSTR_MEM];
+	int refs[PIO_INSTR_MEM];
+	int offset[MAX_PLAN_PROGRAMS];
+	int best_used;
+	int best_offset[MAX_PLAN_PROGRAMS];
+	long nodes;
+};
+
+static void place(struct place_state_t *st, int depth, int used)
+{
+	if(used>=st->best_used || st->nodes++>PLACE_NODE_LIMIT)
+		return;
+	if(depth==st->count)
+	{
+		st->best_used = used;
+		memcpy(st->best_offset, st->offset, sizeof(st->offset));
+		return;
+	}
+	int k = st->order[depth];
+	const struct pio_program_t *p = plan[k].prog;
+	int first = p->origin>=0 ? p->origin : PIO_INSTR_MEM-p->length;
+	int last = p->origin>=0 ? p->origin : 0;
+	// From the top down, like pio_add_program()
+	for(int o=first; o>=last; o--)
+	{
+		bool fits = true;
+		int added = 0;
+		for(int i=0; i<p->length && fits; i++)
+		{
+			uint16_t instr = relocate(p->instr[i], o);
+			fits = !st->refs[o+i] || st->mem[o+i]==instr;
+			added += !st->refs[o+i];
+		}
+		if(!fits)
+			continue;
+		for(int i=0; i<p->length; i++)
+		{
+			st->mem[o+i] = relocate(p->instr[i], o);
+			st->refs[o+i]++;
+		}
+		st->offset[k] = o;
+		place(st, depth+1, used+added);
+		for(int i=0; i<p->length; i++)
+			st->refs[o+i]--;
+	}
+}
+
+// Places the programs on pio into l. Returns false if they don't fit into 32 slots.
+static bool place_pio(const int *pio_of, int pio, struct layout_t *l)
+{
+	struct place_state_t st;
+	memset(&st, 0, sizeof(st));
+	st.best_used = PIO_INSTR_MEM+1;
+	for(int k=0; k<plan_count; k++)
+	{
+		if(pio_of[plan[k].group]==pio)
+			st.order[st.count++] = k;
+	}
+	// Fixed origins first, then the longest
+	for(int i=0; i<st.count; i++)
+	{
+		for(int j=i+1; j<st.count; j++)
+		{
+			const struct pio_program_t *a = plan[st.order[i]].prog, *b = plan[st.order[j]].prog;
+			if((b->origin>=0 && a->origin<0) || ((a->origin<0)==(b->origin<0) && b->length>a->length))
+			{
+				int t = st.order[i];
+				st.order[i] = st.order[j];
+				st.order[j] = t;
+			}
+		}
+	}
+	place(&st, 0, 0);
+	if(st.best_used>PIO_INSTR_MEM)
+		return false;
+	int total = 0;
+	for(int i=0; i<st.count; i++)
+	{
+		l->offset[st.order[i]] = st.best_offset[st.order[i]];
+		total += plan[st.order[i]].prog->length;
+	}
+	l->used[pio] = st.best_used;
+	l->shared[pio] = total-st.best_used;
+	return true;
+}
+
+// State machines of one PIO: fixed ones, then consecutive runs, then single ones. Programs with 0 of their own run on
+// the first state machine of their group.
+static bool assign_sms(const int *pio_of, int pio, struct layout_t *l)
+{
+	bool busy[PIO_SM_COUNT] = {false};
+	int group_sm[MAX_GROUPS];
+	for(int g=0; g<MAX_GROUPS; g++)
+		group_sm[g] = -1;
+	for(int pass=0; pass<3; pass++)
+	{
+		for(int k=0; k<plan_count; k++)
+		{
+			struct plan_program_t *pp = &plan[k];
+			if(pio_of[pp->group]!=pio || !pp->sms)
+				continue;
+			bool fixed = pp->first_sm>=0;
+			if((pass==0)!=fixed || (pass==1 && pp->sms<2) || (pass==2 && (fixed || pp->sms>=2)))
+				continue;
+			int first = -1;
+			for(int s=fixed ? pp->first_sm : 0; s+pp->sms<=PIO_SM_COUNT && first<0; s++)
+			{
+				bool free_run = true;
+				for(int i=0; i<pp->sms; i++)
+					free_run = free_run && !busy[s+i];
+				if(free_run)
+					first = s;
+				if(fixed)
+					break;
+			}
+			if(first<0)
+				return false;
+			for(int i=0; i<pp->sms; i++)
+				busy[first+i] = true;
+			l->sm[k] = first;
+			l->sms_used[pio] += pp->sms;
+			if(group_sm[pp->group]<0)
+				group_sm[pp->group] = first;
+		}
+	}
+	for(int k=0; k<plan_count; k++)
+	{
+		if(pio_of[plan[k].group]==pio && !plan[k].sms)
+		{
+			if(group_sm[plan[k].group]<0)
+				return false;
+			l->sm[k] = group_sm[plan[k].group];
+		}
+	}
+	return true;
+}
+
+static void write_header(const char *name, const char *feature_list, const struct layout_t *l, uint32_t driven, uint32_t read)
+{
+	FILE *out = header_open(name, "pio_plan.h", "pio_planner.c");
+	if(!out)
+		return;
+	fprintf(out, "\tFeatures: %s\n", feature_list);
+	for(int pio=0; pio<PIO_COUNT; pio++)
+		fprintf(out, "\tPIO%d: %d of %d instructions (%d shared), %d of %d state machines\n", pio, l->used[pio],
+			PIO_INSTR_MEM, l->shared[pio], l->sms_used[pio], PIO_SM_COUNT);
+	fprintf(out, "\tOffsets are for pio_add_program_at_offset().\n");
+	header_guard(out, "pio_plan.h");
+	for(int k=0; k<plan_count; k++)
+	{
+		const struct plan_program_t *pp = &plan[k];
+		char upper[PIO_NAME_LEN];
+		int i;
+		for(i=0; pp->prog->name[i] && i<PIO_NAME_LEN-1; i++)
+			upper[i] = (char)(pp->prog->name[i]>='a' && pp->prog->name[i]<='z' ? pp->prog->name[i]-32 : pp->prog->name[i]);
+		upper[i] = 0;
+		fprintf(out, "// %s (%s): %d instruction%s, %s\n", pp->prog->name, pp->feature, pp->prog->length,
+			pp->prog->length==1 ? "" : "s", pp->sms>1 ? "consecutive state machines from _SM" :
+			pp->sms ? "1 state machine" : "switched to on the state machine of its group");
+		fprintf(out, "#define PIO_PLAN_%s_PIO %d\n#define PIO_PLAN_%s_SM %d\n#define PIO_PLAN_%s_OFFSET %d\n", upper,
+			pp->pio, upper, pp->sm, upper, pp->offset);
+		for(int s=0; s<pp->sms; s++)
+		{
+			if(pp->tx)
+				fprintf(out, "// DREQ_PIO%d_TX%d (%d)\n", pp->pio, pp->sm+s, pp->pio*8+pp->sm+s);
+			if(pp->rx)
+				fprintf(out, "// DREQ_PIO%d_RX%d (%d)\n", pp->pio, pp->sm+s, pp->pio*8+4+pp->sm+s);
+		}
+		fprintf(out, "\n");
+	}
+	char pins[128];
+	for(int pio=0; pio<PIO_COUNT; pio++)
+	{
+		uint32_t mask = 0;
+		for(int k=0; k<plan_count; k++)
+		{
+			uint32_t o, in;
+			use_pins(plan[k].use, NULL, &o, &in);
+			if(plan[k].pio==pio)
+				mask |= o;
+		}
+		pin_list(pins, sizeof(pins), mask);
+		fprintf(out, "// GPIO_FUNC_PIO%d: %s\n#define PIO_PLAN_PIO%d_PINS 0x%08xu\n", pio, pins, pio, mask);
+	}
+	pin_list(pins, sizeof(pins), read&~driven);
+	fprintf(out, "// Inputs: %s\n\n", pins);
+	header_close(out);
+}
+
+int main(int argc, char **argv)
+{
+	char feature_list[256] = "capture,dmg,model_detect,hdmi";
+	char features_arg[256];
+	const char *out_name = "pio_plan.h";
+	const char *extras[MAX_FEATURES];
+	int extra_count = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "f:x:d:o:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': snprintf(feature_list, sizeof(feature_list), "%s", optarg); break;
+			case 'x':
+				if(extra_count<MAX_FEATURES)
+					extras[extra_count++] = optarg;
+				break;
+			case 'd': src_dir = optarg; break;
+			case 'o': out_name = optarg; break;
+			default:
+				fprintf(stderr, "See the top of pio_planner.c for the options.\n");
+				return 1;
+		}
+	}
+
+	print_footprints();
+
+	snprintf(features_arg, sizeof(features_arg), "%s", feature_list);
+	if(!parse_features(features_arg))
+		return 1;
+	for(int i=0; i<extra_count; i++)
+	{
+		if(!parse_extra(extras[i]))
+		{
+			fprintf(stderr, "Can't read -x %s, see the top of pio_planner.c.\n", extras[i]);
+			return 1;
+		}
+		size_t len = strlen(feature_list);
+		snprintf(feature_list+len, sizeof(feature_list)-len, ",%s", features[feature_count-1].name);
+	}
+	printf("\nFeatures: %s\n", feature_list);
+	uint32_t driven, read;
+	if(!build_plan(&driven, &read))
+	{
+		fprintf(stderr, "FAIL: the features can't be used together\n");
+		return 1;
+	}
+
+	// Every way of putting the groups on the 2 PIOs
+	struct layout_t best, l;
+	int best_pio_of[MAX_GROUPS];
+	bool found = false;
+	int best_score[3] = {0, 0, 0};
+	// The failed combination that came closest, to say why
+	int closest_cost = -1, closest_demand[PIO_COUNT][2] = {{0}};
+	int closest_pio_of[MAX_GROUPS];
+	for(int combo=0; combo<(1<<group_count); combo++)
+	{
+		int pio_of[MAX_GROUPS];
+		for(int g=0; g<group_count; g++)
+			pio_of[g] = (combo>>g)&1;
+		memset(&l, 0, sizeof(l));
+		bool fits = true;
+		int cost = 0, demands[PIO_COUNT][2];
+		for(int pio=0; pio<PIO_COUNT; pio++)
+		{
+			int demand = 0, sm_demand = 0;
+			for(int k=0; k<plan_count; k++)
+			{
+				if(pio_of[plan[k].group]==pio)
+				{
+					demand += plan[k].prog->length;
+					sm_demand += plan[k].sms;
+				}
+			}
+			demands[pio][0] = demand;
+			demands[pio][1] = sm_demand;
+			if(!assign_sms(pio_of, pio, &l))
+			{
+				fits = false;
+				cost += PIO_INSTR_MEM*(sm_demand>PIO_SM_COUNT ? sm_demand-PIO_SM_COUNT : 1);
+			}
+			else if(!place_pio(pio_of, pio, &l))
+			{
+				fits = false;
+				cost += demand>PIO_INSTR_MEM ? demand-PIO_INSTR_MEM : 1;
+			}
+		}
+		if(!fits)
+		{
+			if(closest_cost<0 || cost<closest_cost)
+			{
+				closest_cost = cost;
+				memcpy(closest_demand, demands, sizeof(demands));
+				memcpy(closest_pio_of, pio_of, sizeof(pio_of));
+			}
+			continue;
+		}
+		// Keep the current layout first, then the most room on the fuller PIO
+		int mismatches = 0;
+		for(int g=0; g<group_count; g++)
+			mismatches += groups[g].prefer_pio>=0 && groups[g].prefer_pio!=pio_of[g];
+		int free_instr = PIO_INSTR_MEM-(l.used[0]>l.used[1] ? l.used[0] : l.used[1]);
+		int free_sms = PIO_SM_COUNT-(l.sms_used[0]>l.sms_used[1] ? l.sms_used[0] : l.sms_used[1]);
+		int score[3] = {-mismatches, free_instr, free_sms};
+		int better = !found;
+		for(int i=0; i<3 && !better; i++)
+		{
+			if(score[i]!=best_score[i])
+			{
+				better = score[i]>best_score[i] ? 1 : -1;
+				break;
+			}
+		}
+		if(better>0)
+		{
+			found = true;
+			best = l;
+			memcpy(best_pio_of, pio_of, sizeof(pio_of));
+			memcpy(best_score, score, sizeof(score));
+		}
+	}
+	if(!found)
+	{
+		fprintf(stderr, "FAIL: the programs don't fit into the 2 PIOs. Closest:\n");
+		for(int pio=0; pio<PIO_COUNT; pio++)
+		{
+			fprintf(stderr, "  PIO%d:", pio);
+			for(int g=0; g<group_count; g++)
+			{
+				if(closest_pio_of[g]==pio)
+					fprintf(stderr, " %s", groups[g].name);
+			}
+			fprintf(stderr, "%s %d instructions before sharing, %d state machines\n", closest_demand[pio][1] ? ":" : " nothing:",
+				closest_demand[pio][0], closest_demand[pio][1]);
+		}
+		return 1;
+	}
+
+	for(int k=0; k<plan_count; k++)
+	{
+		plan[k].pio = best_pio_of[plan[k].group];
+		plan[k].sm = best.sm[k];
+		plan[k].offset = best.offset[k];
+	}
+	for(int pio=0; pio<PIO_COUNT; pio++)
+	{
+		printf("\nPIO%d: %d/%d instructions", pio, best.used[pio], PIO_INSTR_MEM);
+		if(best.shared[pio])
+			printf(" (%d shared between programs)", best.shared[pio]);
+		printf(", %d/%d state machines\n", best.sms_used[pio], PIO_SM_COUNT);
+		for(int k=0; k<plan_count; k++)
+		{
+			const struct plan_program_t *pp = &plan[k];
+			if(pp->pio!=pio)
+				continue;
+			char sm[16], dreq[64] = "";
+			if(pp->sms>1)
+				snprintf(sm, sizeof(sm), "SM%d-%d", pp->sm, pp->sm+pp->sms-1);
+			else
+				snprintf(sm, sizeof(sm), pp->sms ? "SM%d" : "(SM%d)", pp->sm);
+			for(int s=0; s<pp->sms; s++)
+			{
+				size_t len = strlen(dreq);
+				if(pp->tx)
+					len += snprintf(dreq+len, sizeof(dreq)-len, "%sTX%d=%d", len ? " " : "", pp->sm+s, pio*8+pp->sm+s);
+				if(pp->rx)
+					snprintf(dreq+len, sizeof(dreq)-len, "%sRX%d=%d", len ? " " : "", pp->sm+s, pio*8+4+pp->sm+s);
+			}
+			uint32_t o, in;
+			char pins_out[64], pins_in[64];
+			use_pins(pp->use, pp->prog, &o, &in);
+			pin_list(pins_out, sizeof(pins_out), o);
+			pin_list(pins_in, sizeof(pins_in), in);
+			printf("  %-20s %-14s %-8s offset %2d-%-2d  drives %-12s reads %-14s DREQ %s\n", pp->prog->name, pp->feature, sm,
+				pp->offset, pp->offset+pp->prog->length-1, pins_out, pins_in, dreq[0] ? dreq : "-");
+		}
+	}
+	for(int f=0; f<feature_count; f++)
+	{
+		if(features[f].other_what)
+		{
+			char pins[32];
+			pin_list(pins, sizeof(pins), range_mask(features[f].other_out, 0));
+			printf("  %s: %s (not PIO)\n", pins, features[f].other_what);
+		}
+	}
+	write_header(out_name, feature_list, &best, driven, read);
+	printf("\nWrote %s\n", out_name);
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+	profile_decode.c
+
+	Decodes the text dump printed by profiler_dump() (src/scanline_profiler.c.)
+	The dump can be anywhere in a serial log; everything outside of PROF BEGIN/PROF END is ignored.
+	If the log has more than one dump, the last one is used, since the counters only go up.
+
+	Prints:
+	-Slack histogram over all lines (on-time and late lines), in cycles and microseconds
+	-Histogram of the worst slack per frame
+	-The scanlines with the least slack, and every scanline that missed
+	-A per-line table rebuilt from the raw event rings around the first miss (or the end of the rings)
+
+	Build: gcc -O2 -o profile_decode profile_decode.c
+	Usage: ./profile_decode [log file] (reads stdin without one)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_BINS 256
+#define MAX_LINES 1024
+#define MAX_EVENTS 4096
+#define HIST_WIDTH 50
+
+enum
+{
+	PROF_ENC_START = 0,
+	PROF_ENC_END = 1,
+	PROF_DMA_DONE = 2,
+	PROF_RELEASE = 3,
+	PROF_FRAME = 4
+};
+
+struct profile_dump_t
+{
+	int bins;
+	int bin_shift;
+	int lines_per_frame;
+	unsigned long clock_khz;
+	unsigned long lines, frames, misses;
+	unsigned long hist[MAX_BINS];
+	unsigned long late[MAX_BINS];
+	unsigned long frame[MAX_BINS];
+	int line_worst[MAX_LINES];
+	unsigned long line_misses[MAX_LINES];
+	int event_count[3];
+	uint32_t events[3][MAX_EVENTS];
+};
+
+// Per-line info rebuilt from the event rings.
+struct line_info_t
+{
+	int line;
+	bool has_start[2], has_end[2], has_release;
+	uint16_t start[2], end[2], release;
+};
+
+static int bin_low(struct profile_dump_t *dump, int bin)
+{
+	return (bin<<dump->bin_shift)-32768;
+}
+
+static double cycles_to_us(struct profile_dump_t *dump, double cycles)
+{
+	return cycles*1000.0/(double)dump->clock_khz;
+}
+
+static void print_hist(struct profile_dump_t *dump, const char *title, unsigned long *hist, unsigned long *late)
+{
+	unsigned long total = 0;
+	for(int i=0; i<dump->bins; i++)
+		total += hist[i]+(late ? late[i] : 0);
+	printf("\n%s (%lu entries)\n", title, total);
+	if(!total)
+		return;
+	printf("   slack from (cycles)        us      count\n");
+	for(int i=0; i<dump->bins; i++)
+	{
+		unsigned long count = hist[i]+(late ? late[i] : 0);
+		if(!count)
+			continue;
+		// Bars are logarithmic-ish so that single misses still show up next to millions of good lines.
+		int width = 1;
+		for(unsigned long c=count; c>1 && width<HIST_WIDTH; c=(c*2)/3)
+			width++;
+		printf("%s %8d %10.2f %10lu ", bin_low(dump, i)<0 ? "LATE" : "    ", bin_low(dump, i),
+			cycles_to_us(dump, bin_low(dump, i)), count);
+		for(int j=0; j<width; j++)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+static bool parse_dump(FILE *in, struct profile_dump_t *dump)
+{
+	char line[256];
+	bool inside = false, found = false;
+	struct profile_dump_t cur;
+	while(fgets(line, sizeof(line), in))
+	{
+		char *p = strstr(line, "PROF BEGIN");
+		if(p)
+		{
+			int version = 0;
+			memset(&cur, 0, sizeof(cur));
+			if(sscanf(p, "PROF BEGIN %d %d %d %d %lu", &version, &cur.bins, &cur.bin_shift, &cur.lines_per_frame, &cur.clock_khz)==5
+				&& version==1 && cur.bins<=MAX_BINS && cur.lines_per_frame<=MAX_LINES)
+				inside = true;
+			else
+				fprintf(stderr, "Unsupported dump header: %s", p);
+			continue;
+		}
+		if(!inside)
+			continue;
+		int a, b;
+		unsigned long c;
+		unsigned int word;
+		if(strstr(line, "PROF END"))
+		{
+			*dump = cur;
+			found = true;
+			inside = false;
+		}
+		else if(sscanf(line, "TOTAL %lu %lu %lu", &cur.lines, &cur.frames, &cur.misses)==3)
+			;
+		else if(sscanf(line, "HIST %d %lu", &a, &c)==2 && a>=0 && a<cur.bins)
+			cur.hist[a] += c;
+		else if(sscanf(line, "LATE %d %lu", &a, &c)==2 && a>=0 && a<cur.bins)
+			cur.late[a] += c;
+		else if(sscanf(line, "FRAME %d %lu", &a, &c)==2 && a>=0 && a<cur.bins)
+			cur.frame[a] += c;
+		else if(sscanf(line, "LINE %d %d %lu", &a, &b, &c)==3 && a>=0 && a<cur.lines_per_frame)
+		{
+			cur.line_worst[a] = b;
+			cur.line_misses[a] = c;
+		}
+		else if(sscanf(line, "EVT %d %x", &a, &word)==2 && a>=0 && a<3 && cur.event_count[a]<MAX_EVENTS)
+			cur.events[a][cur.event_count[a]++] = word;
+	}
+	return found;
+}
+
+static struct line_info_t *find_line(struct line_info_t *info, int *count, int line)
+{
+	for(int i=0; i<*count; i++)
+	{
+		if(info[i].line==line)
+			return &info[i];
+	}
+	if(*count>=MAX_EVENTS)
+		return NULL;
+	memset(&info[*count], 0, sizeof(struct line_info_t));
+	info[*count].line = line;
+	return &info[(*count)++];
+}
+
+// Rebuilds per-line timing from the rings. Only differences between timestamps are used,
+// since each ring's 16-bit counter can't be lined up with the others in absolute time.
+static void print_events(struct profile_dump_t *dump)
+{
+	struct line_info_t *info = (struct line_info_t *)malloc(MAX_EVENTS*sizeof(struct line_info_t));
+	int count = 0;
+	for(int src=0; src<3; src++)
+	{
+		for(int i=0; i<dump->event_count[src]; i++)
+		{
+			uint32_t word = dump->events[src][i];
+			int type = word>>28;
+			int line = (word>>16)&0xfff;
+			uint16_t t = word&0xffff;
+			struct line_info_t *li = find_line(info, &count, line);
+			if(!li)
+				break;
+			if(src<2 && type==PROF_ENC_START)
+			{
+				li->has_start[src] = true;
+				li->start[src] = t;
+			}
+			else if(src<2 && type==PROF_ENC_END)
+			{
+				li->has_end[src] = true;
+				li->end[src] = t;
+			}
+			else if(src==2 && type==PROF_RELEASE)
+			{
+				li->has_release = true;
+				li->release = t;
+			}
+		}
+	}
+	printf("\nLines in the event rings (line numbers are modulo 4096):\n");
+	printf(" line  core 0 cycles  core 1 cycles    slack\n");
+	for(int i=0; i<count; i++)
+	{
+		struct line_info_t *li = &info[i];
+		if(!li->has_release)
+			continue;
+		printf("%5d ", li->line);
+		for(int c=0; c<2; c++)
+		{
+			if(li->has_start[c] && li->has_end[c])
+				printf(" %14u", (unsigned int)(uint16_t)(li->end[c]-li->start[c]));
+			else
+				printf(" %14s", "-");
+		}
+		int slack = 32767;
+		bool known = false;
+		for(int c=0; c<2; c++)
+		{
+			if(li->has_end[c])
+			{
+				int s = (int16_t)(uint16_t)(li->release-li->end[c]);
+				if(s<slack)
+					slack = s;
+				known = true;
+			}
+		}
+		if(known)
+			printf(" %8d%s\n", slack, slack<0 ? "  MISS" : "");
+		else
+			printf(" %8s\n", "-");
+	}
+	free(info);
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	if(argc>1)
+	{
+		in = fopen(argv[1], "r");
+		if(!in)
+		{
+			fprintf(stderr, "Can't open %s\n", argv[1]);
+			return 1;
+		}
+	}
+	struct profile_dump_t *dump = (struct profile_dump_t *)malloc(sizeof(struct profile_dump_t));
+	if(!parse_dump(in, dump))
+	{
+		fprintf(stderr, "No complete profiler dump found.\n");
+		free(dump);
+		return 1;
+	}
+	if(in!=stdin)
+		fclose(in);
+
+	printf("System clock: %lu kHz, %d lines per frame\n", dump->clock_khz, dump->lines_per_frame);
+	printf("Lines: %lu, frames: %lu, missed lines: %lu", dump->lines, dump->frames, dump->misses);
+	if(dump->lines)
+		printf(" (1 in %.0f)", dump->misses ? (double)dump->lines/(double)dump->misses : 0.0);
+	printf("\n");
+
+	print_hist(dump, "Slack per line", dump->hist, dump->late);
+	print_hist(dump, "Worst slack per frame", dump->frame, NULL);
+
+	// 10 tightest scanlines
+	printf("\nTightest scanlines:\n");
+	bool used[MAX_LINES] = {false};
+	for(int n=0; n<10 && n<dump->lines_per_frame; n++)
+	{
+		int worst = -1;
+		for(int i=0; i<dump->lines_per_frame; i++)
+		{
+			if(!used[i] && (worst<0 || dump->line_worst[i]<dump->line_worst[worst]))
+				worst = i;
+		}
+		used[worst] = true;
+		printf("  line %3d: worst slack %6d cycles (%.2f us), %lu misses\n", worst, dump->line_worst[worst],
+			cycles_to_us(dump, dump->line_worst[worst]), dump->line_misses[worst]);
+	}
+	int missed_lines = 0;
+	for(int i=0; i<dump->lines_per_frame; i++)
+	{
+		if(dump->line_misses[i])
+			missed_lines++;
+	}
+	if(missed_lines)
+	{
+		printf("\nScanlines with misses:");
+		for(int i=0; i<dump->lines_per_frame; i++)
+		{
+			if(dump->line_misses[i])
+				printf(" %d(%lu)", i, dump->line_misses[i]);
+		}
+		printf("\n");
+	}
+
+	print_events(dump);
+	free(dump);
+	return 0;
+}
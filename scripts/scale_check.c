@@ -0,0 +1,246 @@
+/*
+	scale_check.c
+
+	Checks the scale plans of src/scale_plan.h for the Gameboy geometries (240x160 and 160x144) at 2x, 3x, 4x and the
+	largest ratio that fits, on 720x480 and 720x576, all the way down to the TMDS symbols.
+
+	For every case it works out the plan and encodes random frames with scale_encode_channel() and the 1, 2 and 3
+	symbol LUTs from tmds_util.c, then builds every output line of every lane the way the DMA blocks of scale_plan.c
+	send it (border word, image words, border word, or one border word for a border line) and decodes it. Every symbol
+	has to decode to the input pixel the nearest neighbour reference puts there, or to the border. The split encoder
+	has to release each line buffer with vrun (split_encode_line_sent()) right after the last output line showing it.
+
+	It reports, per case: the ratio, where the image goes, the border values, the line buffer words and DMA blocks per
+	lane, and the LUT lookups per line (the encode cost, 720 for a plain 3x line.) Cases that don't fit (4x on 480
+	lines) have to be turned down by scale_plan_init(). It also lists the disparity neutral values of the LUT.
+
+	Options: -f frames per case, -s seed, -b border pixel (15-bit.)
+
+	Build: gcc -O2 -o scale_check scale_check.c tmds_util.c tmds_decode.c -DTMDS_UTIL_NO_MAIN -DTMDS_DECODE_NO_MAIN
+	Usage: ./scale_check [-f 2] [-s seed] [-b 0]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+#define RNG_SEED 0x5ca1e
+#include "host_util.h"
+#include "../src/scale_plan.h"
+#include "../src/tmds_encode_split.h"
+
+#define MAX_LINE_WORDS (H_ACTIVE/BLANK_SYMBOLS_PER_WORD)
+#define MODE_FIT 0
+
+struct scale_case_t
+{
+	const char *name;
+	int in_width, in_height, out_width, out_height;
+	int mode; // integer ratio, or MODE_FIT
+	bool fits;
+};
+
+static const struct scale_case_t cases[] =
+{
+	{"GBA", 240, 160, 720, 480, 2, true},
+	{"GBA", 240, 160, 720, 480, 3, true},
+	{"GBA", 240, 160, 720, 480, 4, false},
+	{"GBA", 240, 160, 720, 480, MODE_FIT, true},
+	{"GB", 160, 144, 720, 480, 2, true},
+	{"GB", 160, 144, 720, 480, 3, true},
+	{"GB", 160, 144, 720, 480, 4, false},
+	{"GB", 160, 144, 720, 480, MODE_FIT, true},
+	{"GBA", 240, 160, 720, 576, MODE_FIT, true},
+	{"GB", 160, 144, 720, 576, 4, true},
+	{"GB", 160, 144, 720, 576, MODE_FIT, true},
+};
+
+static int frames = 2;
+static uint32_t *luts[4];
+static uint16_t pixels[SCALE_MAX_IN_HEIGHT][SCALE_MAX_IN_WIDTH];
+static uint32_t image[SCALE_MAX_IN_HEIGHT][3][MAX_LINE_WORDS];
+
+// Input pixel for output pixel s of the image
+static int scale_source(int s, int num, int den)
+{
+	return ((s+1)*den+num-1)/num-1;
+}
+
+// Runs one case. Returns false if it failed.
+static bool run_case(const struct scale_case_t *c, uint32_t border)
+{
+	static struct scale_plan_t plan;
+	int num = c->mode, den = 1;
+	if(c->mode==MODE_FIT)
+		scale_fit(c->in_width, c->in_height, c->out_width, c->out_height, &num, &den);
+	char ratio[16];
+	sprintf(ratio, den==1 ? "%dx" : "%d/%d", num, den);
+	printf("%-3s %dx%d -> %dx%d at %-5s", c->name, c->in_width, c->in_height, c->out_width, c->out_height, ratio);
+	bool ok = scale_plan_init(&plan, c->in_width, c->in_height, c->out_width, c->out_height, num, den, luts[3], border);
+	if(!ok || !c->fits)
+	{
+		printf(" %s\n", ok ? "FAIL: should not fit" : (c->fits ? "FAIL: no plan" : "doesn't fit"));
+		return ok==c->fits;
+	}
+
+	int errors = 0;
+	long lookups = 0;
+	int line_words = c->out_width/BLANK_SYMBOLS_PER_WORD;
+	for(int frame=0; frame<frames; frame++)
+	{
+		for(int l=0; l<c->in_height; l++)
+		{
+			// Some solid lines, where all the repeats of a color are next to each other
+			uint16_t solid = (uint16_t)(rng()&0x7fff);
+			for(int x=0; x<c->in_width; x++)
+				pixels[l][x] = (l%8==0) ? solid : (uint16_t)(rng()&0x7fff);
+		}
+		lookups = 0;
+		for(int l=0; l<c->in_height; l++)
+		{
+			for(int ch=0; ch<3; ch++)
+			{
+				uint8_t values[SCALE_MAX_IN_WIDTH];
+				for(int x=0; x<c->in_width; x++)
+				{
+					values[x] = (uint8_t)((pixels[l][x]>>tmds_channel_shift(ch))&0x1f);
+					lookups += (plan.hrep[x]+2)/3;
+				}
+				scale_encode_channel((const uint32_t *const *)luts, &plan, values, image[l][ch], plan.border_word[ch],
+					TMDS_DISP_RESET);
+			}
+		}
+
+		for(int y=0; y<c->out_height; y++)
+		{
+			int src = plan.line_src[y];
+			for(int ch=0; ch<3; ch++)
+			{
+				// What the blocks of scale_plan_blocks() send
+				uint32_t words[MAX_LINE_WORDS];
+				int n = 0;
+				if(src==SCALE_BORDER)
+				{
+					for(int i=0; i<plan.left_words+plan.image_words+plan.right_words; i++)
+						words[n++] = plan.border_word[ch];
+				}
+				else
+				{
+					for(int i=0; i<plan.left_words; i++)
+						words[n++] = plan.border_word[ch];
+					for(int i=0; i<plan.image_words; i++)
+						words[n++] = image[src][ch][i];
+					for(int i=0; i<plan.right_words; i++)
+						words[n++] = plan.border_word[ch];
+				}
+				if(n!=line_words)
+				{
+					if(errors++<8)
+						printf("\n  line %d lane %d: %d words instead of %d", y, ch, n, line_words);
+					continue;
+				}
+
+				for(int x=0; x<c->out_width; x++)
+				{
+					uint16_t symbol = (uint16_t)((words[x/3]>>(10*(x%3)))&0x3ff);
+					int value = plan.border[ch];
+					int s = x-plan.left;
+					if(src!=SCALE_BORDER && s>=0 && s<plan.image_width)
+						value = (pixels[src][scale_source(s, num, den)]>>tmds_channel_shift(ch))&0x1f;
+					if(tmds_decode_video(symbol)!=depth_convert((uint8_t)value) && errors++<8)
+						printf("\n  frame %d line %d lane %d pixel %d: %02x instead of %02x", frame, y, ch, x,
+							tmds_decode_video(symbol), depth_convert((uint8_t)value));
+				}
+			}
+		}
+		// The vertical schedule has to be what the reference gives
+		for(int y=0; y<c->out_height; y++)
+		{
+			int s = y-plan.top;
+			int want = (s>=0 && s<plan.image_height) ? scale_source(s, num, den) : SCALE_BORDER;
+			if(plan.line_src[y]!=want && errors++<8)
+				printf("\n  line %d shows %d instead of %d", y, plan.line_src[y], want);
+		}
+	}
+
+	// The line buffer releases of the split encoder, with every line already encoded
+	static struct split_encode_t enc;
+	memset(&enc, 0, sizeof(enc));
+	enc.vrun = plan.vrun;
+	enc.runs = plan.runs;
+	enc.core_done[0] = enc.core_done[1] = UINT32_MAX;
+	for(int frame=0; frame<frames; frame++)
+	{
+		for(int y=0; y<c->out_height; y++)
+		{
+			int src = plan.line_src[y];
+			bool last = src!=SCALE_BORDER && (y+1==c->out_height || plan.line_src[y+1]!=src);
+			if(split_encode_line_sent(&enc)!=last && errors++<8)
+				printf("\n  frame %d line %d: buffer %s", frame, y, last ? "not released" : "released");
+		}
+	}
+	if(enc.line_release!=(uint32_t)(frames*c->in_height) && errors++<8)
+		printf("\n  %u line buffers released instead of %d", enc.line_release, frames*c->in_height);
+
+	int blocks = (plan.left_words ? 1 : 0)+1+(plan.right_words ? 1 : 0);
+	printf(" image %dx%d at %d,%d, border %d/%d/%d, %d+%d+%d words, %d blocks, %d runs, %ld lookups/line%s: %s\n",
+		plan.image_width, plan.image_height, plan.left, plan.top, plan.border[0], plan.border[1], plan.border[2],
+		plan.left_words, plan.image_words, plan.right_words, blocks, plan.runs, lookups/c->in_height,
+		plan.uniform==3 ? " (plain)" : "", errors ? "FAIL" : "ok");
+	return errors==0;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t border = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "f:s:b:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': frames = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+			case 'b': border = (uint32_t)strtoul(optarg, NULL, 0)&0x7fff; break;
+			default:
+				fprintf(stderr, "See the top of scale_check.c for the options.\n");
+				return 1;
+		}
+	}
+	if(frames<1)
+	{
+		fprintf(stderr, "At least 1 frame\n");
+		return 1;
+	}
+
+	uint32_t *plain = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(plain);
+	for(int n=1; n<4; n++)
+	{
+		luts[n] = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+		create_tmds_lut_symbols(luts[n], n);
+	}
+	luts[0] = luts[1];
+	bool pass = !memcmp(plain, luts[3], TMDS_LUT_WORDS*sizeof(uint32_t));
+	if(!pass)
+		printf("FAIL: the 3 symbol LUT isn't the normal LUT\n");
+	printf("Disparity neutral values:");
+	for(int v=0; v<32; v++)
+	{
+		if(scale_value_neutral(luts[3], v))
+			printf(" %d", v);
+	}
+	printf("\n");
+
+	for(size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++)
+		pass &= run_case(&cases[i], border);
+
+	for(int n=1; n<4; n++)
+		free(luts[n]);
+	free(plain);
+	printf("%s\n", pass ? "PASS" : "FAIL");
+	return pass ? 0 : 1;
+}
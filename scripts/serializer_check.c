@@ -0,0 +1,351 @@
+/*
+	serializer_check.c
+
+	Checks that src/tmds_output_pair.pio (interleaved P/N data, 'out pins, 2') and src/tmds_output_3lane.pio (all 3
+	lanes from one state machine, 'out pins, 6') put exactly the same serial bits on the HDMI pins as
+	src/tmds_output.pio (single-ended data, PC-as-LUT side-set.)
+	The programs are assembled from the .pio files and run in pio_emu on GP14-19, with 3 state machines each (one per
+	lane) or 1 for the 3-lane one (pull threshold 30, joined FIFO), with the TX FIFOs kept full like the DMA would.
+	The lines sent are built from the same symbol types as the real ones (control symbols with sync, preamble, guard
+	bands, TERC4 and encoded pixels.)
+
+	For every lane and every bit it checks:
+	-the P leg matches the expected serial bit (symbols LSB first)
+	-the N leg is always the inverse of the P leg
+	-there are no stalls (the output never has a gap)
+	It also checks the 3-lane line encoder (tmds_3lane_encode_line() with the LUT of create_tmds_lut_3lane()) against
+	tmds_encode_channel_30() with the normal LUT, bit by bit on every lane, for random lines.
+	And prints the memory/bandwidth cost of each format.
+
+	Note that the interleaved program does not halve the system clock: PIO outputs change at most once per
+	PIO clock, so a pair still gets one bit-time per system clock. What it gets rid of is the .origin 0/PC-as-LUT
+	requirement (1 instruction instead of 2, and no side-set), at the cost of twice the data.
+
+	Build: gcc -O2 -o serializer_check serializer_check.c pio_emu.c tmds_simd.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./serializer_check [-l lines] [-s seed] [-d path to src]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "pio_emu.h"
+#include "tmds_simd.h"
+#include "host_util.h"
+
+#define LANES 3
+#define HDMI_PIN_BASE 14
+#define SYS_CLOCK_MHZ 294.0
+#define ENCODE_LINES 64
+
+// Output programs
+enum serializer_kind_t
+{
+	SER_SINGLE, // tmds_output.pio, one state machine per lane
+	SER_PAIR, // tmds_output_pair.pio, one state machine per lane
+	SER_3LANE // tmds_output_3lane.pio, one state machine for all lanes
+};
+
+struct serializer_t
+{
+	const char *name;
+	struct pio_emu_t emu;
+	int sms; // state machines, each with its own words
+	uint32_t *words[LANES];
+	int word_count;
+	int pos[LANES];
+	int latency; // cycles before the first data bit appears on the pins
+	unsigned long errors, inversion_errors;
+	uint64_t stalls, underflow; // only counted while there's still data to send
+};
+
+// One line of symbols for each lane: control period with sync, video preamble, guard band and pixels,
+// with a TERC4 data island in the back porch.
+static void build_line(uint16_t *lane[LANES], int line)
+{
+	uint8_t colors[H_ACTIVE];
+	int hsync_start = H_FRONT, hsync_end = H_FRONT+H_PULSE;
+	int island_start = H_FRONT+H_PULSE+4, island_end = island_start+36;
+	int preamble = H_TOTAL-H_ACTIVE-10;
+	for(int ch=0; ch<LANES; ch++)
+	{
+		for(int i=0; i<H_TOTAL-H_ACTIVE; i++)
+		{
+			uint16_t sym;
+			int hsync = i>=hsync_start && i<hsync_end;
+			int vsync = (line&7)==3;
+			if(i>=H_TOTAL-H_ACTIVE-2)
+				sym = guardband_states[ch==1 ? 1 : 0];
+			else if(i>=island_start && i<island_end)
+			{
+				if(i<island_start+2 || i>=island_end-2)
+					sym = ch==0 ? terc4_table[0xc|(vsync<<1)|hsync] : guardband_states[1];
+				else
+					sym = terc4_table[ch==0 ? (0x8|(vsync<<1)|hsync) : (int)(rng()&0xf)];
+			}
+			else if(i>=preamble && ch!=0)
+				sym = sync_ctl_states[ch==1 ? 1 : 0];
+			else
+				sym = sync_ctl_states[ch==0 ? (vsync<<1)|hsync : 0];
+			lane[ch][i] = sym;
+		}
+		// The pixels come after everything else that takes random numbers, so they're encoded in one go.
+		int disparity = 0;
+		for(int i=0; i<H_ACTIVE; i++)
+			colors[i] = depth_convert(rng()&0x1f);
+		tmds_encode_bytes(colors, lane[ch]+H_TOTAL-H_ACTIVE, H_ACTIVE, &disparity);
+	}
+}
+
+static bool setup(struct serializer_t *ser, const char *src_dir, const char *file, const char *program_name, int kind)
+{
+	struct pio_program_t programs[PIO_MAX_PROGRAMS];
+	const struct pio_program_t *prog = pio_load_program(src_dir, file, program_name, NULL, 0, programs);
+	if(!prog)
+		return false;
+	pio_emu_init(&ser->emu);
+	int offset = pio_emu_load(&ser->emu, prog, -1);
+	if(offset<0)
+	{
+		fprintf(stderr, "Can't load %s\n", program_name);
+		return false;
+	}
+	printf("%s: %d instruction%s at offset %d%s\n", program_name, prog->length, prog->length==1 ? "" : "s", offset,
+		prog->origin>=0 ? " (fixed origin)" : "");
+	ser->sms = kind==SER_3LANE ? 1 : LANES;
+	for(int lane=0; lane<ser->sms; lane++)
+	{
+		struct pio_sm_config_t cfg;
+		pio_sm_default_config(&cfg);
+		cfg.out_shift_right = true;
+		cfg.autopull = true;
+		cfg.pull_threshold = 32;
+		if(kind==SER_3LANE)
+		{
+			cfg.out_base = HDMI_PIN_BASE;
+			cfg.out_count = 2*LANES;
+			cfg.pull_threshold = TMDS_3LANE_BITS_PER_WORD*TMDS_3LANE_PINS;
+			cfg.join_tx = true;
+		}
+		else if(kind==SER_PAIR)
+		{
+			cfg.out_base = HDMI_PIN_BASE+2*lane;
+			cfg.out_count = 2;
+		}
+		else
+			cfg.sideset_base = HDMI_PIN_BASE+2*lane;
+		// The DMA has the FIFOs full before the state machines start.
+		pio_sm_start(&ser->emu, lane, prog, offset, 0, &cfg);
+		while(pio_sm_put(&ser->emu, lane, ser->words[lane][ser->pos[lane]]))
+			ser->pos[lane]++;
+	}
+	return true;
+}
+
+static void run(struct serializer_t *ser, uint8_t *expected[LANES], long bits)
+{
+	// The PC-as-LUT program shows the side-set of whichever instruction the last bit picked, so its output is
+	// a cycle behind; the latency is found from the first cycles, then every bit after it is checked.
+	long cycles = bits+8;
+	uint8_t *p[LANES];
+	for(int lane=0; lane<LANES; lane++)
+		p[lane] = (uint8_t *)malloc(cycles);
+	for(long c=0; c<cycles; c++)
+	{
+		pio_emu_step(&ser->emu);
+		if(c==bits-1)
+		{
+			for(int sm=0; sm<ser->sms; sm++)
+			{
+				ser->stalls += ser->emu.sm[sm].stall_cycles;
+				ser->underflow += ser->emu.sm[sm].tx_underflow;
+			}
+		}
+		for(int lane=0; lane<LANES; lane++)
+		{
+			int pin = HDMI_PIN_BASE+2*lane;
+			int pos_bit = (ser->emu.pins>>pin)&1, neg_bit = (ser->emu.pins>>(pin+1))&1;
+			p[lane][c] = pos_bit;
+			if(pos_bit==neg_bit)
+				ser->inversion_errors++;
+		}
+		for(int sm=0; sm<ser->sms; sm++)
+		{
+			if(pio_sm_tx_level(&ser->emu, sm)<pio_sm_fifo_depth(&ser->emu, sm, true) && ser->pos[sm]<ser->word_count)
+				pio_sm_put(&ser->emu, sm, ser->words[sm][ser->pos[sm]++]);
+		}
+	}
+	ser->latency = -1;
+	for(int lat=0; lat<8 && ser->latency<0; lat++)
+	{
+		if(!memcmp(p[0]+lat, expected[0], 64))
+			ser->latency = lat;
+	}
+	if(ser->latency<0)
+		ser->latency = 0;
+	for(int lane=0; lane<LANES; lane++)
+	{
+		for(long b=0; b<bits; b++)
+		{
+			if(p[lane][b+ser->latency]!=expected[lane][b])
+				ser->errors++;
+		}
+		free(p[lane]);
+	}
+}
+
+// Encodes random framebuffer lines both ways and compares every bit-time of every lane. Returns the number of errors.
+static unsigned long check_encoder(const uint32_t *lut, const uint32_t *lut_3lane)
+{
+	uint32_t fb_line[TMDS_FB_LINE_WORDS], lane_words[TMDS_LINE_PIXELS], out[TMDS_3LANE_LINE_WORDS];
+	uint8_t values[TMDS_LINE_PIXELS];
+	unsigned long errors = 0;
+	for(int line=0; line<ENCODE_LINES; line++)
+	{
+		for(int i=0; i<TMDS_FB_LINE_WORDS; i++)
+			fb_line[i] = rng()&0x7fff7fff;
+		// Some lines of one color, for the longest disparity runs
+		if(line&1)
+		{
+			for(int i=1; i<TMDS_FB_LINE_WORDS; i++)
+				fb_line[i] = fb_line[0]&0x7fff;
+		}
+		tmds_3lane_encode_line(lut_3lane, fb_line, out);
+		for(int lane=0; lane<LANES; lane++)
+		{
+			tmds_separate_channel(fb_line, values, 0, TMDS_LINE_PIXELS, tmds_channel_shift(lane));
+			tmds_encode_channel_30(lut, values, lane_words, TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+			for(int i=0; i<TMDS_LINE_PIXELS; i++)
+			{
+				for(int t=0; t<30; t++)
+				{
+					uint32_t bit = (lane_words[i]>>t)&1;
+					uint32_t pair = (out[6*i+t/5]>>(6*(t%5)+2*lane))&3;
+					if(pair!=(bit|((bit^1)<<1)))
+						errors++;
+				}
+			}
+		}
+	}
+	printf("3-lane encoder: %d random lines against tmds_encode_channel_30(), %lu bit errors -> %s\n", ENCODE_LINES,
+		errors, errors ? "FAIL" : "OK");
+	return errors;
+}
+
+static bool report(struct serializer_t *ser, long bits)
+{
+	bool ok = !ser->errors && !ser->inversion_errors && !ser->stalls;
+	printf("%s: %ld bits per lane, latency %d cycle%s, %lu bit errors, %lu P/N errors, %lu stall cycles (%lu on empty FIFO) -> %s\n",
+		ser->name, bits, ser->latency, ser->latency==1 ? "" : "s", ser->errors, ser->inversion_errors,
+		(unsigned long)ser->stalls, (unsigned long)ser->underflow, ok ? "OK" : "FAIL");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	int lines = 4;
+	const char *src_dir = "../src";
+	int opt;
+	while((opt = getopt(argc, argv, "l:s:d:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'l': lines = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0) | 1; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-l lines] [-s seed] [-d path to src]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(lines<1)
+		lines = 1;
+
+	int symbols = lines*H_TOTAL;
+	long bits = (long)symbols*10;
+	uint16_t *lane_syms[LANES];
+	uint8_t *expected[LANES];
+	struct serializer_t *single = (struct serializer_t *)calloc(1, sizeof(struct serializer_t));
+	struct serializer_t *pair = (struct serializer_t *)calloc(1, sizeof(struct serializer_t));
+	struct serializer_t *three = (struct serializer_t *)calloc(1, sizeof(struct serializer_t));
+	single->name = "tmds_output      ";
+	pair->name = "tmds_output_pair ";
+	three->name = "tmds_output_3lane";
+	// Line length is a multiple of 16 symbols, so both packings come out even.
+	single->word_count = symbols*10/32;
+	pair->word_count = symbols*20/32;
+	three->word_count = TMDS_3LANE_WORDS(symbols);
+	three->words[0] = (uint32_t *)malloc(three->word_count*sizeof(uint32_t));
+	for(int lane=0; lane<LANES; lane++)
+	{
+		lane_syms[lane] = (uint16_t *)malloc(symbols*sizeof(uint16_t));
+		expected[lane] = (uint8_t *)malloc(bits);
+		single->words[lane] = (uint32_t *)malloc(single->word_count*sizeof(uint32_t));
+		pair->words[lane] = (uint32_t *)malloc(pair->word_count*sizeof(uint32_t));
+	}
+	for(int line=0; line<lines; line++)
+	{
+		uint16_t *line_syms[LANES];
+		for(int lane=0; lane<LANES; lane++)
+			line_syms[lane] = lane_syms[lane]+line*H_TOTAL;
+		build_line(line_syms, line);
+	}
+	for(int lane=0; lane<LANES; lane++)
+	{
+		for(int i=0; i<symbols; i++)
+		{
+			for(int b=0; b<10; b++)
+				expected[lane][i*10+b] = (lane_syms[lane][i]>>b)&1;
+		}
+		pack_buffer_single(lane_syms[lane], single->words[lane], symbols/16);
+		pack_buffer_interleaved(lane_syms[lane], pair->words[lane], symbols/8);
+	}
+	tmds_3lane_pack(lane_syms[0], lane_syms[1], lane_syms[2], three->words[0], symbols);
+
+	if(!setup(single, src_dir, "tmds_output.pio", "tmds_output", SER_SINGLE)
+		|| !setup(pair, src_dir, "tmds_output_pair.pio", "tmds_output_pair", SER_PAIR)
+		|| !setup(three, src_dir, "tmds_output_3lane.pio", "tmds_output_3lane", SER_3LANE))
+		return 1;
+	run(single, expected, bits);
+	run(pair, expected, bits);
+	run(three, expected, bits);
+	printf("\n");
+	bool ok = report(single, bits);
+	ok = report(pair, bits) && ok;
+	ok = report(three, bits) && ok;
+
+	uint32_t *lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	uint32_t *lut_3lane = (uint32_t *)malloc(TMDS_3LANE_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(lut);
+	create_tmds_lut_3lane(lut_3lane, lut);
+	ok = !check_encoder(lut, lut_3lane) && ok;
+	free(lut);
+	free(lut_3lane);
+
+	// Memory and bandwidth, per lane and for all 3 lanes
+	double line_rate = SYS_CLOCK_MHZ*1e6/10.0/H_TOTAL;
+	printf("\nPer line, all 3 lanes: single-ended %d words (%d bytes), interleaved %d words (%d bytes), 3-lane %d words "
+		"(%d bytes)\n", LANES*H_TOTAL*10/32, LANES*H_TOTAL*10/8, LANES*H_TOTAL*20/32, LANES*H_TOTAL*20/8,
+		TMDS_3LANE_WORDS(H_TOTAL), TMDS_3LANE_WORDS(H_TOTAL)*4);
+	printf("DMA bandwidth at %.0fMHz: single-ended %.1fMB/s, interleaved %.1fMB/s, 3-lane %.1fMB/s\n", SYS_CLOCK_MHZ,
+		line_rate*LANES*H_TOTAL*10/8/1e6, line_rate*LANES*H_TOTAL*20/8/1e6, line_rate*TMDS_3LANE_WORDS(H_TOTAL)*4/1e6);
+	printf("DMA channels for the video (data+control): 6, 6 and 2; state machines: 3, 3 and 1\n");
+	printf("Bits per pair per system clock: 1 for all of them (PIO pins change once per clock), so the system clock stays at %.0fMHz\n",
+		SYS_CLOCK_MHZ);
+
+	for(int lane=0; lane<LANES; lane++)
+	{
+		free(lane_syms[lane]);
+		free(expected[lane]);
+		free(single->words[lane]);
+		free(pair->words[lane]);
+	}
+	free(three->words[0]);
+	free(single);
+	free(pair);
+	free(three);
+	return ok ? 0 : 1;
+}
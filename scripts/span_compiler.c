@@ -0,0 +1,626 @@
+/*
+	span_compiler.c
+
+	Turns the modeline and a data island schedule into the span lists of src/blank_spans.h, and writes them to
+	blank_spans_table.h.
+
+	Every blanking line variant (hblank, and the 3 vsync edges/pulse lines) with every island count in the schedule is
+	built with fill_blank_line() from tmds_util.c, framed into 30-bit words (3 symbols each), and split into spans:
+	-island words (anything that has a data island symbol in it) are one literal span, pointing into the island buffer
+	-the rest is split by cost: a constant span is one 16 byte control block and one pool word, a literal span is
+	 a control block plus a pool word per word. Runs of one word always end up as constant spans.
+	Constant words and literal runs are shared across all lists, and so are identical lists.
+
+	Checks before writing anything:
+	-every list, expanded from the table, gives back the exact words of its line
+	-every list, sent through src/tmds_output.pio in pio_emu (pull threshold 30, joined FIFO) with the DMA modeled
+	 as a few cycles of control block reload between spans and an IRQ restart at the end of the line, puts out
+	 exactly the symbols of fill_blank_line() followed by the active part, with no stalls
+
+	Build: gcc -O2 -o span_compiler span_compiler.c pio_emu.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./span_compiler [options]
+	-f front -p pulse -b back   horizontal blanking (default H_FRONT, H_PULSE, H_BACK from tmds_util.h)
+	-i islands                  data islands on every line (default 2)
+	-s file                     schedule: lines of "first last islands", line 0 being the first active line
+	-d path                     path to src, for tmds_output.pio (default ../src)
+	-o file                     output header (default blank_spans_table.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "pio_emu.h"
+#include "host_util.h"
+#include "../src/blank_spans.h"
+#include "../src/tmds_channel_encode.h"
+
+#define LANES 3
+#define VARIANTS 4
+#define MAX_BLANK_WORDS 256
+#define MAX_SPANS 4096
+#define MAX_POOL 8192
+#define MAX_LISTS (VARIANTS*(MAX_ISLANDS+1))
+
+// DMA model for the PIO check: cycles between the end of one span and the first word of the next
+// (4 control words through the ring, plus the chain), and the end-of-line IRQ restart.
+#define DMA_RELOAD_CYCLES 12
+#define DMA_RESTART_CYCLES 120
+#define SPAN_BLOCK_BYTES 16
+
+struct span_list_t
+{
+	int variant, islands;
+	int first[LANES], count[LANES];
+	int island_words[LANES];
+	uint16_t symbols[LANES][MAX_BLANK_WORDS*BLANK_SYMBOLS_PER_WORD];
+	uint32_t words[LANES][MAX_BLANK_WORDS];
+};
+
+static struct blank_timing_t timing = {H_FRONT, H_PULSE, H_BACK};
+static int blank_words;
+static uint8_t line_islands[V_TOTAL];
+static uint8_t line_list[V_TOTAL];
+
+static struct span_list_t lists[MAX_LISTS];
+static int list_count;
+static struct blank_span_t spans[MAX_SPANS];
+static int span_count;
+static uint32_t pool[MAX_POOL];
+static int pool_words;
+
+// Vsync edges happen at the start of the hsync pulse: EN is the first line of the pulse, EX the first line after it.
+static int line_variant(int line)
+{
+	int pulse_start = V_ACTIVE+V_FRONT;
+	if(line==pulse_start)
+		return BLANK_VBLANK_EN;
+	if(line>pulse_start && line<pulse_start+V_PULSE)
+		return BLANK_VBLANK_SYN;
+	if(line==pulse_start+V_PULSE)
+		return BLANK_VBLANK_EX;
+	return BLANK_HBLANK;
+}
+
+static int max_islands(void)
+{
+	// Island preamble (8) and guard band (2) come out of the front porch, the trailing guard band (2)
+	// and the video preamble and guard band (10) out of the rest.
+	int blank = timing.front+timing.pulse+timing.back;
+	int n = (blank-timing.front-12)/32;
+	return n>MAX_ISLANDS ? MAX_ISLANDS : n;
+}
+
+static bool read_schedule(const char *name)
+{
+	FILE *in = fopen(name, "r");
+	if(!in)
+	{
+		fprintf(stderr, "Can't read %s\n", name);
+		return false;
+	}
+	char text[256];
+	int line_no = 0;
+	while(fgets(text, sizeof(text), in))
+	{
+		int first, last, islands;
+		line_no++;
+		char *comment = strchr(text, '#');
+		if(comment)
+			*comment = 0;
+		if(sscanf(text, "%d %d %d", &first, &last, &islands)!=3)
+			continue;
+		if(first<0 || last>=V_TOTAL || first>last || islands<0 || islands>max_islands())
+		{
+			fprintf(stderr, "%s:%d: lines have to be 0-%d and islands 0-%d\n", name, line_no, V_TOTAL-1, max_islands());
+			fclose(in);
+			return false;
+		}
+		for(int l=first; l<=last; l++)
+			line_islands[l] = (uint8_t)islands;
+	}
+	fclose(in);
+	return true;
+}
+
+// Finds a run of words in the pool, or adds it.
+static int pool_add(const uint32_t *words, int count)
+{
+	for(int i=0; i+count<=pool_words; i++)
+	{
+		if(!memcmp(pool+i, words, count*sizeof(uint32_t)))
+			return i;
+	}
+	if(pool_words+count>MAX_POOL)
+	{
+		fprintf(stderr, "Pool is full\n");
+		exit(1);
+	}
+	memcpy(pool+pool_words, words, count*sizeof(uint32_t));
+	pool_words += count;
+	return pool_words-count;
+}
+
+// Cheapest split of words [start, end) into constant and literal spans, appended to out.
+static int split_region(const uint32_t *words, int start, int end, struct blank_span_t *out)
+{
+	int cost[MAX_BLANK_WORDS+1], next[MAX_BLANK_WORDS+1];
+	bool constant[MAX_BLANK_WORDS+1];
+	cost[end] = 0;
+	for(int i=end-1; i>=start; i--)
+	{
+		int run = 1;
+		while(i+run<end && words[i+run]==words[i])
+			run++;
+		cost[i] = -1;
+		for(int j=i+1; j<=end; j++)
+		{
+			if(j-i<=run && (cost[i]<0 || SPAN_BLOCK_BYTES+4+cost[j]<=cost[i]))
+			{
+				cost[i] = SPAN_BLOCK_BYTES+4+cost[j];
+				next[i] = j;
+				constant[i] = true;
+			}
+			if(SPAN_BLOCK_BYTES+4*(j-i)+cost[j]<cost[i])
+			{
+				cost[i] = SPAN_BLOCK_BYTES+4*(j-i)+cost[j];
+				next[i] = j;
+				constant[i] = false;
+			}
+		}
+	}
+	int n = 0;
+	for(int i=start; i<end; i=next[i])
+	{
+		out[n].count = (uint16_t)(next[i]-i);
+		out[n].flags = constant[i] ? 0 : BLANK_SPAN_INCR;
+		out[n].pool_index = (uint16_t)pool_add(words+i, constant[i] ? 1 : next[i]-i);
+		out[n].island_offset = 0;
+		n++;
+	}
+	return n;
+}
+
+static void compile_list(struct span_list_t *list)
+{
+	int island_start = timing.front, island_end = timing.front+32*list->islands;
+	fill_blank_line(list->symbols[0], list->symbols[1], list->symbols[2], &timing, list->variant, list->islands);
+	for(int lane=0; lane<LANES; lane++)
+	{
+		struct blank_span_t lane_spans[MAX_BLANK_WORDS];
+		int n = 0;
+		const uint16_t *sym = list->symbols[lane];
+		for(int w=0; w<blank_words; w++)
+			list->words[lane][w] = sym[3*w]|((uint32_t)sym[3*w+1]<<10)|((uint32_t)sym[3*w+2]<<20);
+		// Words with island symbols in them
+		int first_island = island_start/3, end_island = (island_end+2)/3;
+		if(!list->islands)
+			first_island = end_island = blank_words;
+		n += split_region(list->words[lane], 0, first_island, lane_spans+n);
+		if(end_island>first_island)
+		{
+			lane_spans[n].count = (uint16_t)(end_island-first_island);
+			lane_spans[n].flags = BLANK_SPAN_INCR|BLANK_SPAN_ISLAND;
+			lane_spans[n].pool_index = (uint16_t)pool_add(list->words[lane]+first_island, end_island-first_island);
+			lane_spans[n].island_offset = 0;
+			n++;
+		}
+		n += split_region(list->words[lane], end_island, blank_words, lane_spans+n);
+		list->island_words[lane] = end_island-first_island;
+
+		// Share identical lists
+		int first = -1;
+		for(int i=0; i+n<=span_count && first<0; i++)
+		{
+			if(!memcmp(spans+i, lane_spans, n*sizeof(struct blank_span_t)))
+				first = i;
+		}
+		if(first<0)
+		{
+			if(span_count+n>MAX_SPANS)
+			{
+				fprintf(stderr, "Too many spans\n");
+				exit(1);
+			}
+			first = span_count;
+			memcpy(spans+span_count, lane_spans, n*sizeof(struct blank_span_t));
+			span_count += n;
+		}
+		list->first[lane] = first;
+		list->count[lane] = n;
+	}
+}
+
+// Expands one lane of a list from the table, like the DMA would with the null packet island words.
+static int expand(const struct span_list_t *list, int lane, uint32_t *out)
+{
+	int n = 0;
+	for(int i=0; i<list->count[lane]; i++)
+	{
+		const struct blank_span_t *span = &spans[list->first[lane]+i];
+		for(int w=0; w<span->count; w++)
+			out[n++] = pool[span->pool_index+((span->flags&BLANK_SPAN_INCR) ? w : 0)];
+	}
+	return n;
+}
+
+static bool check_expand(void)
+{
+	bool ok = true;
+	uint32_t words[MAX_BLANK_WORDS*2];
+	for(int l=0; l<list_count; l++)
+	{
+		for(int lane=0; lane<LANES; lane++)
+		{
+			int n = expand(&lists[l], lane, words);
+			if(n!=blank_words || memcmp(words, lists[l].words[lane], n*sizeof(uint32_t)))
+			{
+				fprintf(stderr, "List %d lane %d doesn't expand to its line\n", l, lane);
+				ok = false;
+			}
+		}
+	}
+	return ok;
+}
+
+// Feeds one lane through its spans the way the control blocks would: words only become available
+// after the reload time of each span, and the second line after the IRQ restart time.
+struct lane_feed_t
+{
+	const struct span_list_t *list;
+	const uint32_t *active;
+	int line;
+	int span, word; // span == count means the line buffer
+	uint64_t ready; // cycle the current span's first word can be sent
+};
+
+static uint32_t feed_next(struct lane_feed_t *feed, int lane, uint64_t cycle, bool *have)
+{
+	const struct span_list_t *list = feed->list;
+	*have = false;
+	if(cycle<feed->ready)
+		return 0;
+	if(feed->span<list->count[lane])
+	{
+		const struct blank_span_t *span = &spans[list->first[lane]+feed->span];
+		uint32_t w = pool[span->pool_index+((span->flags&BLANK_SPAN_INCR) ? feed->word : 0)];
+		*have = true;
+		if(++feed->word==span->count)
+		{
+			feed->word = 0;
+			feed->span++;
+			feed->ready = cycle+DMA_RELOAD_CYCLES;
+		}
+		return w;
+	}
+	if(feed->word<H_ACTIVE/BLANK_SYMBOLS_PER_WORD)
+	{
+		uint32_t w = feed->active[feed->word++];
+		*have = true;
+		if(feed->word==H_ACTIVE/BLANK_SYMBOLS_PER_WORD && !feed->line)
+		{
+			feed->line = 1;
+			feed->span = 0;
+			feed->word = 0;
+			feed->ready = cycle+DMA_RESTART_CYCLES;
+		}
+		return w;
+	}
+	return 0;
+}
+
+static bool check_pio(const char *src_dir, const uint32_t *tmds_lut)
+{
+	struct pio_program_t programs[PIO_MAX_PROGRAMS];
+	const struct pio_program_t *prog = pio_load_program(src_dir, "tmds_output.pio", "tmds_output", NULL, 0, programs);
+	if(!prog)
+		return false;
+
+	int active_words = H_ACTIVE/BLANK_SYMBOLS_PER_WORD;
+	int line_bits = (blank_words*BLANK_SYMBOLS_PER_WORD+H_ACTIVE)*10;
+	int bits = 2*line_bits;
+	uint32_t *active[LANES];
+	uint8_t *expected[LANES], *got[LANES];
+	uint8_t values[H_ACTIVE/BLANK_SYMBOLS_PER_WORD];
+	long cycles = bits+2*DMA_RESTART_CYCLES;
+	for(int lane=0; lane<LANES; lane++)
+	{
+		active[lane] = (uint32_t *)malloc(active_words*sizeof(uint32_t));
+		expected[lane] = (uint8_t *)malloc(bits);
+		got[lane] = (uint8_t *)malloc(cycles);
+	}
+
+	bool ok = true;
+	int latency = -1;
+	for(int l=0; l<list_count; l++)
+	{
+		struct pio_emu_t emu;
+		struct lane_feed_t feed[LANES];
+		uint64_t stalls = 0;
+		pio_emu_init(&emu);
+		int offset = pio_emu_load(&emu, prog, -1);
+		for(int lane=0; lane<LANES; lane++)
+		{
+			for(int i=0; i<active_words; i++)
+				values[i] = (uint8_t)(rng()&0x1f);
+			tmds_encode_channel_30(tmds_lut, values, active[lane], active_words, TMDS_DISP_RESET);
+			// Expected bits: the symbols from fill_blank_line(), then the 3 symbols of every LUT word
+			int b = 0;
+			for(int i=0; i<blank_words*BLANK_SYMBOLS_PER_WORD; i++)
+			{
+				for(int k=0; k<10; k++)
+					expected[lane][b++] = (lists[l].symbols[lane][i]>>k)&1;
+			}
+			for(int i=0; i<active_words; i++)
+			{
+				for(int k=0; k<30; k++)
+					expected[lane][b++] = (active[lane][i]>>k)&1;
+			}
+			// Same line again, to check the restart
+			memcpy(expected[lane]+line_bits, expected[lane], line_bits);
+
+			struct pio_sm_config_t cfg;
+			pio_sm_default_config(&cfg);
+			cfg.out_shift_right = true;
+			cfg.autopull = true;
+			cfg.pull_threshold = 30;
+			cfg.join_tx = true;
+			cfg.sideset_base = 14+2*lane;
+			pio_sm_start(&emu, lane, prog, offset, 0, &cfg);
+			feed[lane].list = &lists[l];
+			feed[lane].active = active[lane];
+			feed[lane].line = 0;
+			feed[lane].span = 0;
+			feed[lane].word = 0;
+			feed[lane].ready = 0;
+			// The first words are in the FIFO before the state machines start, like at the end of the previous line.
+			bool have = true;
+			while(pio_sm_tx_level(&emu, lane)<pio_sm_fifo_depth(&emu, lane, true) && have)
+			{
+				uint32_t w = feed_next(&feed[lane], lane, 0, &have);
+				if(have)
+					pio_sm_put(&emu, lane, w);
+			}
+		}
+		for(long c=0; c<cycles; c++)
+		{
+			pio_emu_step(&emu);
+			if(c==bits-1)
+			{
+				for(int lane=0; lane<LANES; lane++)
+					stalls += emu.sm[lane].stall_cycles;
+			}
+			for(int lane=0; lane<LANES; lane++)
+			{
+				got[lane][c] = (emu.pins>>(14+2*lane))&1;
+				if(pio_sm_tx_level(&emu, lane)<pio_sm_fifo_depth(&emu, lane, true))
+				{
+					bool have;
+					uint32_t w = feed_next(&feed[lane], lane, emu.cycle, &have);
+					if(have)
+						pio_sm_put(&emu, lane, w);
+				}
+			}
+		}
+		// The PC-as-LUT program is a cycle or so behind its input; find that on the first list and hold every list to it.
+		if(latency<0)
+		{
+			for(int lat=0; lat<8 && latency<0; lat++)
+			{
+				if(!memcmp(got[0]+lat, expected[0], 64))
+					latency = lat;
+			}
+			if(latency<0)
+				latency = 0;
+		}
+		unsigned long errors = 0;
+		for(int lane=0; lane<LANES; lane++)
+		{
+			for(int b=0; b<bits; b++)
+			{
+				if(got[lane][b+latency]!=expected[lane][b])
+					errors++;
+			}
+		}
+		if(errors || stalls)
+		{
+			fprintf(stderr, "List %d (variant %d, %d island%s): %lu bit errors, %lu stall cycles\n", l, lists[l].variant,
+				lists[l].islands, lists[l].islands==1 ? "" : "s", errors, (unsigned long)stalls);
+			ok = false;
+		}
+	}
+	printf("PIO check: %d list%s, 2 lines each through tmds_output.pio (pull threshold 30, %d cycle reloads, %d cycle restart) -> %s\n",
+		list_count, list_count==1 ? "" : "s", DMA_RELOAD_CYCLES, DMA_RESTART_CYCLES, ok ? "OK" : "FAIL");
+
+	for(int lane=0; lane<LANES; lane++)
+	{
+		free(active[lane]);
+		free(expected[lane]);
+		free(got[lane]);
+	}
+	return ok;
+}
+
+static void print_report(void)
+{
+	const char *variant_names[] = {"hblank", "vblank_en", "vblank_syn", "vblank_ex"};
+	int blank = blank_words*BLANK_SYMBOLS_PER_WORD;
+	int max_spans = 0, min_span = MAX_BLANK_WORDS, max_island_words = 0;
+	bool island_counts[MAX_ISLANDS+1] = {false};
+	printf("\nBlanking: %d symbols, %d words per lane\n", blank, blank_words);
+	for(int l=0; l<list_count; l++)
+	{
+		printf("%-10s %d island%s: spans per lane %d/%d/%d\n", variant_names[lists[l].variant], lists[l].islands,
+			lists[l].islands==1 ? " " : "s", lists[l].count[0], lists[l].count[1], lists[l].count[2]);
+		island_counts[lists[l].islands] = true;
+		for(int lane=0; lane<LANES; lane++)
+		{
+			if(lists[l].count[lane]>max_spans)
+				max_spans = lists[l].count[lane];
+			if(lists[l].island_words[lane]>max_island_words)
+				max_island_words = lists[l].island_words[lane];
+			for(int i=0; i<lists[l].count[lane]; i++)
+			{
+				if(spans[lists[l].first[lane]+i].count<min_span)
+					min_span = spans[lists[l].first[lane]+i].count;
+			}
+		}
+	}
+
+	int sets = 0;
+	for(int i=0; i<=MAX_ISLANDS; i++)
+		sets += island_counts[i];
+	int packed = sets*VARIANTS*LANES*(blank*10/32)*4;
+	int framed = sets*VARIANTS*LANES*blank_words*4;
+	int table = span_count*(int)sizeof(struct blank_span_t)+pool_words*4+list_count*LANES*(int)sizeof(struct blank_span_list_t)+V_TOTAL;
+	int blocks = 2*LANES*(max_spans+1)*SPAN_BLOCK_BYTES;
+	printf("\nMemory for %d island count%s:\n", sets, sets==1 ? "" : "s");
+	printf("  packed buffers (32-bit, as tmds_util writes them): %6d bytes%s\n", packed,
+		blank%16 ? " (blanking isn't a multiple of 16 symbols, so these don't even exist)" : "");
+	printf("  full buffers in 30-bit words:                      %6d bytes\n", framed);
+	printf("  spans: %d entries, %d pool words, %d lists, line table: %6d bytes\n", span_count, pool_words, list_count, table);
+	printf("  + control blocks, 2 lines of %d per lane:              %6d bytes\n", max_spans+1, blocks);
+	printf("  + island buffers, 2 lines of %d words per lane:         %6d bytes\n", max_island_words, 2*LANES*max_island_words*4);
+	printf("Another packet type or audio slot in a line: %d bytes of island words per line, and one read_addr in its\n"
+		"control block, instead of another set of %d-byte blanking buffers.\n", LANES*max_island_words*4,
+		VARIANTS*LANES*blank_words*4);
+	printf("DMA: at most %d control words per lane per line on top of %d data words; the shortest span is %d word%s\n"
+		"(%d bit times) against a %d cycle reload.\n", 4*(max_spans+1), blank_words+H_ACTIVE/BLANK_SYMBOLS_PER_WORD,
+		min_span, min_span==1 ? "" : "s", min_span*30, DMA_RELOAD_CYCLES);
+}
+
+static bool write_header(const char *name, const char *schedule)
+{
+	FILE *out = header_open(name, "blank_spans_table.h", "span_compiler.c");
+	if(!out)
+		return false;
+	int max_spans = 0, max_island_words = 0;
+	for(int l=0; l<list_count; l++)
+	{
+		for(int lane=0; lane<LANES; lane++)
+		{
+			if(lists[l].count[lane]>max_spans)
+				max_spans = lists[l].count[lane];
+			if(lists[l].island_words[lane]>max_island_words)
+				max_island_words = lists[l].island_words[lane];
+		}
+	}
+	fprintf(out, "\tBlanking: front %d, pulse %d, back %d. Islands: %s\n", timing.front, timing.pulse, timing.back,
+		schedule ? schedule : "same count on every line");
+	header_guard(out, "blank_spans_table.h");
+	fprintf(out, "#include \"blank_spans.h\"\n\n");
+	fprintf(out, "#define BLANK_SPAN_WORDS %d\n", blank_words);
+	fprintf(out, "#define BLANK_SPAN_MAX %d\n", max_spans);
+	fprintf(out, "#define BLANK_SPAN_ISLAND_WORDS %d\n", max_island_words);
+	fprintf(out, "#define BLANK_SPAN_POOL_WORDS %d\n", pool_words);
+	fprintf(out, "#define BLANK_SPAN_LINES %d\n\n", V_TOTAL);
+
+	fprintf(out, "static const uint32_t blank_span_pool[BLANK_SPAN_POOL_WORDS] =\n{");
+	for(int i=0; i<pool_words; i++)
+		fprintf(out, "%s0x%08x%s", i%8 ? " " : "\n\t", pool[i], i<pool_words-1 ? "," : "");
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "// pool_index, island_offset, count, flags\nstatic const struct blank_span_t blank_span_data[%d] =\n{\n", span_count);
+	for(int i=0; i<span_count; i++)
+	{
+		fprintf(out, "\t{%d, %d, %d, %d}%s\n", spans[i].pool_index, spans[i].island_offset, spans[i].count, spans[i].flags,
+			i<span_count-1 ? "," : "");
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "// Variant/island count of each list, in order:");
+	for(int l=0; l<list_count; l++)
+		fprintf(out, "%s %d/%d", l ? "," : "", lists[l].variant, lists[l].islands);
+	fprintf(out, "\nstatic const struct blank_span_list_t blank_span_lists[%d][3] =\n{\n", list_count);
+	for(int l=0; l<list_count; l++)
+	{
+		fprintf(out, "\t{{%d, %d}, {%d, %d}, {%d, %d}}%s\n", lists[l].first[0], lists[l].count[0], lists[l].first[1],
+			lists[l].count[1], lists[l].first[2], lists[l].count[2], l<list_count-1 ? "," : "");
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "// List of each line, line 0 being the first active line\nstatic const uint8_t blank_span_line[BLANK_SPAN_LINES] =\n{");
+	for(int i=0; i<V_TOTAL; i++)
+		fprintf(out, "%s%d%s", i%32 ? " " : "\n\t", line_list[i], i<V_TOTAL-1 ? "," : "");
+	fprintf(out, "\n};\n\n");
+	header_close(out);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	const char *schedule = NULL, *out_name = "blank_spans_table.h", *src_dir = "../src";
+	int islands = 2;
+	int opt;
+	while((opt = getopt(argc, argv, "f:p:b:i:s:d:o:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': timing.front = atoi(optarg); break;
+			case 'p': timing.pulse = atoi(optarg); break;
+			case 'b': timing.back = atoi(optarg); break;
+			case 'i': islands = atoi(optarg); break;
+			case 's': schedule = optarg; break;
+			case 'd': src_dir = optarg; break;
+			case 'o': out_name = optarg; break;
+			default:
+				fprintf(stderr, "See the top of span_compiler.c for the options.\n");
+				return 1;
+		}
+	}
+	int blank = timing.front+timing.pulse+timing.back;
+	if(blank%BLANK_SYMBOLS_PER_WORD || blank>MAX_BLANK_WORDS*BLANK_SYMBOLS_PER_WORD || timing.front<12 || timing.pulse<1)
+	{
+		fprintf(stderr, "Blanking has to be a multiple of 3 symbols (and the front porch at least 12): %d\n", blank);
+		return 1;
+	}
+	if(H_ACTIVE%BLANK_SYMBOLS_PER_WORD)
+	{
+		fprintf(stderr, "Active video has to be a multiple of 3 symbols\n");
+		return 1;
+	}
+	blank_words = blank/BLANK_SYMBOLS_PER_WORD;
+	if(islands<0 || islands>max_islands())
+	{
+		fprintf(stderr, "Islands have to be 0-%d with this blanking\n", max_islands());
+		return 1;
+	}
+	memset(line_islands, islands, sizeof(line_islands));
+	if(schedule && !read_schedule(schedule))
+		return 1;
+
+	// One list per variant/island count that's actually used
+	int list_of[MAX_LISTS];
+	for(int i=0; i<MAX_LISTS; i++)
+		list_of[i] = -1;
+	for(int line=0; line<V_TOTAL; line++)
+	{
+		int key = line_variant(line)*(MAX_ISLANDS+1)+line_islands[line];
+		if(list_of[key]<0)
+		{
+			list_of[key] = list_count;
+			lists[list_count].variant = line_variant(line);
+			lists[list_count].islands = line_islands[line];
+			compile_list(&lists[list_count]);
+			list_count++;
+		}
+		line_list[line] = (uint8_t)list_of[key];
+	}
+
+	uint32_t *tmds_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+	create_tmds_lut(tmds_lut);
+	bool ok = check_expand();
+	printf("Expand check: %s\n", ok ? "OK" : "FAIL");
+	ok = check_pio(src_dir, tmds_lut) && ok;
+	free(tmds_lut);
+	print_report();
+	if(!ok)
+		return 1;
+	if(!write_header(out_name, schedule))
+		return 1;
+	printf("\nWrote %s\n", out_name);
+	return 0;
+}
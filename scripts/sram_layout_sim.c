@@ -0,0 +1,684 @@
+/*
+	sram_layout_sim.c
+
+	Bus contention model of the SRAM layouts in src/sram_layout.h. The RP2040 has 4 striped SRAM banks (word n of the
+	striped range is in bank n&3) plus the 4KB scratch banks X and Y, and every one of them serves one access per
+	cycle. When 2 bus masters want the same bank in the same cycle, one of them waits. The masters here are:
+	-core 0 and core 1 running the split encode (tmds_encode_split.h) of every input line: separating the channel
+	 (framebuffer loads, value stores), the LUT lookups (2 words per pixel), the line buffer stores, and the
+	 instruction fetches of the loops (one 32-bit fetch per 2 Thumb instructions, which the cycle counts of
+	 encode_split_sim.c put at about every other cycle without a data access.) Core 0 also takes the line DMA IRQs,
+	 and core 1 polls for the channel 1 handoff.
+	-the DMA read master: every lane of the output reads one word every 32 cycles (10 bits per symbol, 1 bit per system
+	 clock), the blanking part from the blank spans and the active part from the line buffer of the line being sent,
+	 plus the control blocks of the span chain
+	-the DMA write master: the capture DMA, about one framebuffer word every 180 cycles (120 words per GBA line, with
+	 2.4 output lines per GBA line)
+	The 3 lanes run in lockstep, so their reads come in bursts of 3, but the DMA can't wait on itself: only a core or
+	the other DMA master can hold it up.
+	Each bank arbitrates round robin between the masters that want it, like the bus fabric with all the priorities
+	equal; -P gives the DMA masters priority over the cores (BUSCTRL_BUS_PRIORITY.)
+
+	The layouts that have a name in src/sram_layout.h are the ones the firmware can be built with; the others are there
+	to compare. Every layout places the objects (code, LUTs, framebuffers, line buffers...) in the striped range, in one bank through
+	its non-striped alias (memmap_banks.ld), or in a scratch bank, and is checked for room in each of them. For every
+	layout and data pattern (random pixels, a flat color, a gradient) it reports the stall cycles per encoded line of
+	both cores, the stall probability per access (what encode_split_sim.c and e2e_sim.c take with -p), the worst finish
+	time of a line against its deadline, and the DMA stall cycles per output line with the longest a lane's word waited.
+	In the striped layouts, the bank a LUT lookup goes to depends on the pixel values, which is why a flat color is the
+	worst case there.
+
+	Whether the layouts with the encode loops in the scratch banks fit depends on how big the loops are once the line
+	cache, frame sources and OSD are inlined, and nothing here can know that: -k takes the bigger of .scratch_x and
+	.scratch_y from the firmware build (arm-none-eabi-size -A). Without it they are placed with a 1KB guess, their
+	stalls are still shown, but they are marked as not measured and never picked as the best.
+
+	Build: gcc -O2 -o sram_layout_sim sram_layout_sim.c
+	Usage: ./sram_layout_sim [-n input lines] [-l layout] [-c line cache entries] [-k scratch code bytes] [-P] [-v]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "host_util.h"
+#include "../src/tmds_encode_split.h"
+
+#define H_TOTAL 912
+#define H_ACTIVE 720
+#define CYCLES_PER_SYMBOL 10
+#define LINE_CYCLES (H_TOTAL*CYCLES_PER_SYMBOL)
+#define BLANK_WORDS ((H_TOTAL-H_ACTIVE)*CYCLES_PER_SYMBOL/32)
+#define WORD_CYCLES 32
+#define LANES 3
+// See encode_split_sim.c
+#define DEADLINE_CYCLES ((SPLIT_LINE_REPEAT*H_TOTAL+(H_TOTAL-H_ACTIVE))*CYCLES_PER_SYMBOL)
+#define FB_HEIGHT 160
+#define CAPTURE_WRITE_CYCLES 180
+#define SPANS_PER_LINE 3
+#define CTRL_BLOCK_WORDS 4
+#define IRQ_CYCLES 48
+#define IRQ_STACK_WORDS 8
+#define POLL_CYCLES 5
+
+// Size of the encode code of each core when -k doesn't give it
+#define CODE_BYTES_GUESS 1024
+// Sizes of the loops, for the instruction fetches
+#define SEPARATE_LOOP_BYTES 48
+#define ENCODE_LOOP_BYTES 96
+#define IRQ_BYTES 96
+
+// SRAM: the top SRAM_BANK_BYTES of every bank are taken out of the striped range when a layout uses them
+#define STRIPED_BYTES (256*1024)
+#define SCRATCH_BYTES 4096
+// Code and data of the rest of the firmware (PICO_COPY_TO_RAM), a rough guess
+#define OTHER_BYTES (40*1024)
+#define STACK_BYTES 2048
+
+enum region_t {R_STRIPED, R_BANK0, R_BANK1, R_BANK2, R_BANK3, R_SCRATCH_X, R_SCRATCH_Y, R_COUNT};
+static const char *const region_names[R_COUNT] = {"striped", "bank 0", "bank 1", "bank 2", "bank 3", "scratch X",
+	"scratch Y"};
+#define SLAVES 6 // banks 0-3, scratch X, scratch Y
+
+enum object_t {O_CODE0, O_CODE1, O_IRQ, O_LUT0, O_LUT1, O_FB, O_VALUES0, O_VALUES1, O_LANE0, O_LANE1, O_LANE2, O_BLANK,
+	O_STACK0, O_STACK1, O_SHARED, O_CACHE, O_OTHER, O_COUNT};
+static const char *const object_names[O_COUNT] = {"core 0 encode", "core 1 encode", "DMA IRQ", "LUT", "core 1 LUT",
+	"framebuffers", "core 0 values", "core 1 values", "lane 0 buffers", "lane 1 buffers", "lane 2 buffers",
+	"blank spans", "core 0 stack", "core 1 stack", "shared state", "line cache", "everything else"};
+
+enum master_t {M_CORE0, M_CORE1, M_DMA_READ, M_DMA_WRITE, M_COUNT};
+
+struct layout_t
+{
+	const char *name;
+	const char *what;
+	int region[O_COUNT]; // R_STRIPED unless given
+	bool lut_per_core; // core 1 has a LUT copy of its own, at O_LUT1
+};
+
+// The stacks are where the SDK puts them
+#define SDK_STACKS [O_STACK0] = R_SCRATCH_Y, [O_STACK1] = R_SCRATCH_X
+// tmds_encode_split.c
+#define TREE_VALUES [O_VALUES0] = R_SCRATCH_X, [O_VALUES1] = R_SCRATCH_Y
+// Encode loop and values of each core in the scratch bank of its own stack
+#define CORE_SCRATCH [O_CODE0] = R_SCRATCH_Y, [O_CODE1] = R_SCRATCH_X, [O_VALUES0] = R_SCRATCH_Y, [O_VALUES1] = R_SCRATCH_X
+
+static const struct layout_t layouts[] =
+{
+	{"striped", "SRAM_LAYOUT_STRIPED: the SDK default with PICO_COPY_TO_RAM, only the values in scratch",
+		{SDK_STACKS, TREE_VALUES}, false},
+	{"lanes", "line buffers of lane n in bank n", {SDK_STACKS, TREE_VALUES, [O_LANE0] = R_BANK0, [O_LANE1] = R_BANK1,
+		[O_LANE2] = R_BANK2}, false},
+	{"core_scratch", "SRAM_LAYOUT_CORE_SCRATCH: encode loop and values of each core in the scratch bank of its stack", {SDK_STACKS, CORE_SCRATCH},
+		false},
+	{"lut_scratch", "as core_scratch, with a LUT copy in each scratch bank", {SDK_STACKS, CORE_SCRATCH,
+		[O_LUT0] = R_SCRATCH_Y, [O_LUT1] = R_SCRATCH_X}, true},
+	{"lut_banks", "as core_scratch, with a LUT copy per core in banks 3 and 2", {SDK_STACKS, CORE_SCRATCH,
+		[O_LUT0] = R_BANK3, [O_LUT1] = R_BANK2}, true},
+	{"banked", "SRAM_LAYOUT_BANKED: as lut_banks, with the line buffers of lanes 0 and 2 in bank 0, lane 1 in bank 1", {SDK_STACKS,
+		CORE_SCRATCH, [O_LUT0] = R_BANK3, [O_LUT1] = R_BANK2, [O_LANE0] = R_BANK0, [O_LANE1] = R_BANK1,
+		[O_LANE2] = R_BANK0}, true},
+	{"banked_lanes", "as lut_banks, with the line buffers of lane n in bank n", {SDK_STACKS, CORE_SCRATCH,
+		[O_LUT0] = R_BANK3, [O_LUT1] = R_BANK2, [O_LANE0] = R_BANK0, [O_LANE1] = R_BANK1, [O_LANE2] = R_BANK2}, true}
+};
+#define LAYOUTS ((int)(sizeof(layouts)/sizeof(layouts[0])))
+
+enum pattern_t {P_RANDOM, P_FLAT, P_GRADIENT, P_COUNT};
+static const char *const pattern_names[P_COUNT] = {"random", "flat", "gradient"};
+
+// One cycle of a core: an access (object and byte offset), nothing, or the channel 1 handoff (core 0 publishes it,
+// core 1 polls for it)
+enum event_type_t {E_IDLE, E_ACCESS, E_HANDOFF_MARK, E_HANDOFF_WAIT};
+
+struct event_t
+{
+	uint8_t type;
+	uint8_t object;
+	uint32_t offset;
+};
+
+struct core_trace_t
+{
+	struct event_t *events;
+	int count, size;
+	// Instruction fetch state
+	int code_object;
+	uint32_t code_base, code_bytes, code_pos;
+	bool fetch_next;
+};
+
+struct object_place_t
+{
+	int region;
+	uint32_t address; // byte address inside the region (for striped: the word index decides the bank)
+	uint32_t bytes;
+};
+
+struct stats_t
+{
+	uint64_t core_stalls[2], core_accesses[2];
+	uint64_t dma_stalls, dma_reads, write_stalls;
+	int dma_max_wait;
+	int worst_finish;
+};
+
+static struct object_place_t place[O_COUNT];
+static uint32_t region_used[R_COUNT];
+static int cache_entries = LINE_CACHE_ENTRIES;
+static bool dma_priority;
+static uint32_t code_bytes; // -k, 0 when not measured
+
+static uint32_t object_bytes(int o)
+{
+	switch(o)
+	{
+		case O_CODE0: case O_CODE1: return code_bytes ? code_bytes : CODE_BYTES_GUESS;
+		case O_IRQ: return 256;
+		case O_LUT0: case O_LUT1: return SRAM_LUT_SLOTS*SRAM_LUT_WORDS*4;
+		case O_FB: return 2*FB_HEIGHT*TMDS_FB_LINE_WORDS*4;
+		case O_VALUES0: case O_VALUES1: return TMDS_LINE_PIXELS;
+		case O_LANE0: case O_LANE1: case O_LANE2: return 2*TMDS_LINE_WORDS*4;
+		case O_BLANK: return 1024;
+		case O_STACK0: case O_STACK1: return STACK_BYTES;
+		case O_SHARED: return 256;
+		case O_CACHE: return (uint32_t)cache_entries*LANES*TMDS_LINE_WORDS*4;
+		default: return OTHER_BYTES;
+	}
+}
+
+static uint32_t region_size(int r, bool banks_used)
+{
+	if(r==R_STRIPED)
+		return banks_used ? STRIPED_BYTES-4*SRAM_BANK_BYTES : STRIPED_BYTES;
+	return r<=R_BANK3 ? SRAM_BANK_BYTES : SCRATCH_BYTES;
+}
+
+// Lays the objects out in their regions. Returns false if one of them overflows.
+static bool place_objects(const struct layout_t *l, char *why, size_t why_size)
+{
+	bool banks_used = false;
+	memset(region_used, 0, sizeof(region_used));
+	for(int o=0; o<O_COUNT; o++)
+	{
+		int r = l->region[o];
+		if(o==O_LUT1 && !l->lut_per_core)
+		{
+			place[o] = place[O_LUT0];
+			continue;
+		}
+		banks_used = banks_used || (r>=R_BANK0 && r<=R_BANK3);
+		place[o].region = r;
+		place[o].bytes = object_bytes(o);
+		place[o].address = region_used[r];
+		// Every object starts on a 16-byte boundary, so word 0 of a striped one is in bank 0
+		region_used[r] += (place[o].bytes+15)&~15u;
+	}
+	why[0] = 0;
+	for(int r=0; r<R_COUNT; r++)
+	{
+		if(region_used[r]>region_size(r, banks_used))
+		{
+			size_t len = strlen(why);
+			snprintf(why+len, why_size-len, "%s%s %uKB of %uKB", len ? ", " : "", region_names[r],
+				(unsigned)(region_used[r]+1023)/1024, (unsigned)region_size(r, banks_used)/1024);
+		}
+	}
+	return !why[0];
+}
+
+static int slave_of(int object, uint32_t offset)
+{
+	const struct object_place_t *p = &place[object];
+	switch(p->region)
+	{
+		case R_STRIPED: return (int)(((p->address+offset)>>2)&3);
+		case R_SCRATCH_X: return 4;
+		case R_SCRATCH_Y: return 5;
+		default: return p->region-R_BANK0;
+	}
+}
+
+static void push_event(struct core_trace_t *t, int type, int object, uint32_t offset)
+{
+	if(t->count==t->size)
+	{
+		t->size = t->size ? t->size*2 : 16384;
+		t->events = realloc(t->events, (size_t)t->size*sizeof(struct event_t));
+	}
+	t->events[t->count++] = (struct event_t){(uint8_t)type, (uint8_t)object, offset};
+}
+
+static void set_loop(struct core_trace_t *t, int object, uint32_t base, uint32_t bytes)
+{
+	t->code_object = object;
+	t->code_base = base;
+	t->code_bytes = bytes;
+	t->code_pos = 0;
+}
+
+// n cycles without a data access: every other one fetches the next instruction word of the loop
+static void alu(struct core_trace_t *t, int n)
+{
+	for(int i=0; i<n; i++)
+	{
+		if(t->fetch_next)
+		{
+			push_event(t, E_ACCESS, t->code_object, t->code_base+t->code_pos);
+			t->code_pos = (t->code_pos+4)%t->code_bytes;
+		}
+		else
+			push_event(t, E_IDLE, 0, 0);
+		t->fetch_next = !t->fetch_next;
+	}
+}
+
+static void load_store(struct core_trace_t *t, int object, uint32_t offset)
+{
+	push_event(t, E_ACCESS, object, offset);
+}
+
+// Same work as tmds_separate_channel() and tmds_encode_channel(), with the cycle counts of encode_split_sim.c
+static void trace_channel(struct core_trace_t *t, int core, const uint16_t *pixels, int fb_offset, int first, int count,
+	int shift, int lane, int out_word)
+{
+	int code = core ? O_CODE1 : O_CODE0;
+	int values = core ? O_VALUES1 : O_VALUES0;
+	int lut = core ? O_LUT1 : O_LUT0;
+	set_loop(t, code, 0, SEPARATE_LOOP_BYTES);
+	for(int i=0; i<count; i+=2)
+	{
+		load_store(t, O_FB, (uint32_t)(fb_offset+(first+i)/2)*4);
+		alu(t, 5);
+		load_store(t, values, (uint32_t)i);
+		alu(t, 5);
+		load_store(t, values, (uint32_t)i+1);
+		alu(t, 2);
+	}
+	set_loop(t, code, SEPARATE_LOOP_BYTES, ENCODE_LOOP_BYTES);
+	uint32_t disp = TMDS_DISP_RESET;
+	for(int i=0; i<count; i+=TMDS_PACK_GROUP)
+	{
+		for(int j=0; j<TMDS_PACK_GROUP; j++)
+		{
+			uint32_t value = (pixels[first+i+j]>>shift)&0x1f;
+			uint32_t entry = (value<<1)|disp;
+			load_store(t, values, (uint32_t)(i+j));
+			alu(t, 3);
+			load_store(t, lut, entry*4);
+			load_store(t, lut, entry*4+4);
+			alu(t, 6);
+			// Close enough to the real disparity walk for the banks: it only moves whole 64-word blocks
+			disp = ((disp>>6)+(value&1 ? 1 : 15))%16<<6;
+		}
+		for(int w=0; w<TMDS_PACK_WORDS; w++)
+		{
+			load_store(t, O_LANE0+lane, (uint32_t)(out_word++)*4);
+			alu(t, 1);
+		}
+		alu(t, 6);
+	}
+}
+
+// Both cores' work for one input line, as in split_encode_core0() and split_encode_core1()
+static void trace_line(struct core_trace_t t[2], const uint16_t *pixels, int line, int buffer)
+{
+	int fb_offset = (line%FB_HEIGHT)*TMDS_FB_LINE_WORDS;
+	int lane_words = buffer*TMDS_LINE_WORDS;
+	t[0].count = t[1].count = 0;
+	trace_channel(&t[0], 0, pixels, fb_offset, 0, SPLIT_CH1_PIXELS, tmds_channel_shift(1), 1, lane_words);
+	load_store(&t[0], O_SHARED, 0);
+	push_event(&t[0], E_HANDOFF_MARK, 0, 0);
+	trace_channel(&t[0], 0, pixels, fb_offset, 0, TMDS_LINE_PIXELS, tmds_channel_shift(0), 0, lane_words);
+	load_store(&t[0], O_SHARED, 4);
+
+	trace_channel(&t[1], 1, pixels, fb_offset, 0, TMDS_LINE_PIXELS, tmds_channel_shift(2), 2, lane_words);
+	push_event(&t[1], E_HANDOFF_WAIT, 0, 0);
+	trace_channel(&t[1], 1, pixels, fb_offset, SPLIT_CH1_PIXELS, TMDS_LINE_PIXELS-SPLIT_CH1_PIXELS, tmds_channel_shift(1),
+		1, lane_words+SPLIT_CH1_WORDS);
+	load_store(&t[1], O_SHARED, 8);
+}
+
+static void make_line(uint16_t *pixels, int pattern, int line)
+{
+	for(int x=0; x<TMDS_LINE_PIXELS; x++)
+	{
+		switch(pattern)
+		{
+			case P_RANDOM: pixels[x] = (uint16_t)(rng()&0x7fff); break;
+			case P_FLAT: pixels[x] = 0x2d6b; break;
+			default: pixels[x] = (uint16_t)(((x*31/TMDS_LINE_PIXELS)<<10)|((line*31/FB_HEIGHT)<<5)|((x+line)&0x1f)); break;
+		}
+	}
+}
+
+// A DMA read waiting to be done
+struct dma_read_t
+{
+	int object;
+	uint32_t offset;
+	int since;
+};
+
+#define DMA_QUEUE 64
+
+struct dma_state_t
+{
+	struct dma_read_t queue[DMA_QUEUE];
+	int head, tail;
+	uint32_t write_word;
+	int writes_due; // capture words waiting in the RX FIFO
+};
+
+static void dma_queue(struct dma_state_t *d, int object, uint32_t offset, int cycle)
+{
+	d->queue[d->tail] = (struct dma_read_t){object, offset, cycle};
+	d->tail = (d->tail+1)%DMA_QUEUE;
+}
+
+// The DMA reads of an output line cycle: the span control blocks at the start of the line, then one word per lane
+// every 32 cycles, the blanking words first. buffer is the line buffer of the input line being sent.
+static void dma_line_cycle(struct dma_state_t *d, int cycle, int line_cycle, int buffer)
+{
+	if(line_cycle<SPANS_PER_LINE*CTRL_BLOCK_WORDS && !(line_cycle%CTRL_BLOCK_WORDS))
+	{
+		for(int lane=0; lane<LANES; lane++)
+		{
+			for(int w=0; w<CTRL_BLOCK_WORDS; w++)
+				dma_queue(d, O_BLANK, (uint32_t)(512+(lane*SPANS_PER_LINE*CTRL_BLOCK_WORDS+w)*4), cycle);
+		}
+	}
+	if(line_cycle%WORD_CYCLES)
+		return;
+	int word = line_cycle/WORD_CYCLES;
+	for(int lane=0; lane<LANES; lane++)
+	{
+		if(word<BLANK_WORDS)
+			dma_queue(d, O_BLANK, (uint32_t)(lane*BLANK_WORDS+word)*4, cycle);
+		else if(word-BLANK_WORDS<TMDS_LINE_WORDS)
+			dma_queue(d, O_LANE0+lane, (uint32_t)(buffer*TMDS_LINE_WORDS+word-BLANK_WORDS)*4, cycle);
+	}
+}
+
+struct core_state_t
+{
+	int pos;
+	int irq_left; // cycles of IRQ still to run on core 0
+	int irq_pos;
+	int poll; // cycle inside the handoff poll loop
+	bool done;
+	int finish;
+};
+
+// What a core wants this cycle: slave, or -1 for nothing
+static int core_request(struct core_state_t *c, const struct core_trace_t *t, int core, bool handoff, int *object,
+	uint32_t *offset)
+{
+	if(core==0 && c->irq_left)
+	{
+		// Pushes and pops on the stack, a few loads of the shared state, and fetches of the handler
+		int i = c->irq_pos;
+		if(i<IRQ_STACK_WORDS || i>=IRQ_CYCLES-IRQ_STACK_WORDS)
+		{
+			*object = O_STACK0;
+			*offset = STACK_BYTES-4-(uint32_t)(i%IRQ_STACK_WORDS)*4;
+		}
+		else if(i%4==0)
+		{
+			*object = O_SHARED;
+			*offset = (uint32_t)(i&0x3c);
+		}
+		else if(i&1)
+		{
+			*object = O_IRQ;
+			*offset = (uint32_t)(i*2)%IRQ_BYTES;
+		}
+		else
+			return -1;
+		return slave_of(*object, *offset);
+	}
+	if(c->done)
+		return -1;
+	const struct event_t *e = &t->events[c->pos];
+	if(e->type==E_HANDOFF_WAIT && !handoff)
+	{
+		// Load of ch1_handoff, then the rest of the poll loop
+		if(c->poll==0)
+		{
+			*object = O_SHARED;
+			*offset = 0;
+			return slave_of(*object, *offset);
+		}
+		if(c->poll&1)
+		{
+			*object = core ? O_CODE1 : O_CODE0;
+			*offset = (uint32_t)(SEPARATE_LOOP_BYTES+ENCODE_LOOP_BYTES+c->poll*2);
+			return slave_of(*object, *offset);
+		}
+		return -1;
+	}
+	if(e->type!=E_ACCESS)
+		return -1;
+	*object = e->object;
+	*offset = e->offset;
+	return slave_of(e->object, e->offset);
+}
+
+static void core_advance(struct core_state_t *c, const struct core_trace_t *t, int core, bool *handoff, int cycle)
+{
+	if(core==0 && c->irq_left)
+	{
+		c->irq_left--;
+		c->irq_pos++;
+		return;
+	}
+	if(c->done)
+		return;
+	const struct event_t *e = &t->events[c->pos];
+	if(e->type==E_HANDOFF_WAIT && !*handoff)
+	{
+		c->poll = (c->poll+1)%POLL_CYCLES;
+		return;
+	}
+	if(e->type==E_HANDOFF_MARK)
+		*handoff = true;
+	if(++c->pos==t->count)
+	{
+		c->done = true;
+		c->finish = cycle+1;
+	}
+}
+
+static void run_layout(int pattern, int lines, struct stats_t *s)
+{
+	struct core_trace_t trace[2];
+	struct dma_state_t dma;
+	uint16_t pixels[TMDS_LINE_PIXELS];
+	int rr[SLAVES] = {0};
+	memset(trace, 0, sizeof(trace));
+	memset(&dma, 0, sizeof(dma));
+	memset(s, 0, sizeof(*s));
+	rng_state = 1;
+
+	for(int line=0; line<lines; line++)
+	{
+		// Line 'line' is encoded into buffer line&1 while line-1 is sent from the other one. Both cores start at the
+		// beginning of the 3 output lines of line-1, which is when the buffer is released in the worst case.
+		make_line(pixels, pattern, line);
+		trace_line(trace, pixels, line, line&1);
+		struct core_state_t core[2];
+		memset(core, 0, sizeof(core));
+		bool handoff = false;
+		for(int cycle=0; cycle<SPLIT_LINE_REPEAT*LINE_CYCLES; cycle++)
+		{
+			int line_cycle = cycle%LINE_CYCLES;
+			if(line_cycle==0 && cycle)
+			{
+				core[0].irq_left = IRQ_CYCLES;
+				core[0].irq_pos = 0;
+			}
+			dma_line_cycle(&dma, cycle, line_cycle, (line+1)&1);
+
+			int want[M_COUNT], object[M_COUNT];
+			uint32_t offset[M_COUNT];
+			for(int m=0; m<2; m++)
+				want[m] = core_request(&core[m], &trace[m], m, handoff, &object[m], &offset[m]);
+			want[M_DMA_READ] = dma.head!=dma.tail ? slave_of(dma.queue[dma.head].object, dma.queue[dma.head].offset) : -1;
+			dma.writes_due += (cycle%CAPTURE_WRITE_CYCLES)==0;
+			want[M_DMA_WRITE] = dma.writes_due ?
+				slave_of(O_FB, (FB_HEIGHT*TMDS_FB_LINE_WORDS+(dma.write_word%(FB_HEIGHT*TMDS_FB_LINE_WORDS)))*4) : -1;
+
+			// Round robin per bank, the DMA first with -P
+			bool granted[M_COUNT] = {false};
+			for(int slave=0; slave<SLAVES; slave++)
+			{
+				int winner = -1;
+				for(int k=0; k<M_COUNT && winner<0; k++)
+				{
+					int m = (rr[slave]+k)%M_COUNT;
+					if(want[m]==slave && (!dma_priority || m>=M_DMA_READ))
+						winner = m;
+				}
+				for(int k=0; k<M_COUNT && winner<0; k++)
+				{
+					int m = (rr[slave]+k)%M_COUNT;
+					if(want[m]==slave)
+						winner = m;
+				}
+				if(winner>=0)
+				{
+					granted[winner] = true;
+					rr[slave] = (winner+1)%M_COUNT;
+				}
+			}
+
+			for(int m=0; m<2; m++)
+			{
+				bool was_irq = m==0 && core[0].irq_left;
+				if(want[m]>=0)
+				{
+					s->core_accesses[m] += !was_irq;
+					if(!granted[m])
+					{
+						s->core_stalls[m] += !was_irq;
+						continue;
+					}
+				}
+				core_advance(&core[m], &trace[m], m, &handoff, cycle);
+			}
+
+			if(want[M_DMA_READ]>=0)
+			{
+				s->dma_reads++;
+				if(granted[M_DMA_READ])
+				{
+					int wait = cycle-dma.queue[dma.head].since;
+					s->dma_max_wait = wait>s->dma_max_wait ? wait : s->dma_max_wait;
+					dma.head = (dma.head+1)%DMA_QUEUE;
+				}
+				else
+					s->dma_stalls++;
+			}
+			if(want[M_DMA_WRITE]>=0)
+			{
+				if(granted[M_DMA_WRITE])
+				{
+					dma.write_word++;
+					dma.writes_due--;
+				}
+				else
+					s->write_stalls++;
+			}
+		}
+		for(int m=0; m<2; m++)
+		{
+			int finish = core[m].done ? core[m].finish : SPLIT_LINE_REPEAT*LINE_CYCLES;
+			s->worst_finish = finish>s->worst_finish ? finish : s->worst_finish;
+		}
+	}
+	free(trace[0].events);
+	free(trace[1].events);
+}
+
+int main(int argc, char **argv)
+{
+	int lines = FB_HEIGHT;
+	const char *only = NULL;
+	bool verbose = false;
+	int opt;
+	while((opt = getopt(argc, argv, "n:l:c:k:Pv"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'n': lines = atoi(optarg); break;
+			case 'l': only = optarg; break;
+			case 'c': cache_entries = atoi(optarg); break;
+			case 'k': code_bytes = (uint32_t)strtoul(optarg, NULL, 0); break;
+			case 'P': dma_priority = true; break;
+			case 'v': verbose = true; break;
+			default:
+				fprintf(stderr, "Usage: %s [-n input lines] [-l layout] [-c line cache entries] [-k scratch code bytes] "
+					"[-P] [-v]\n", argv[0]);
+				return 1;
+		}
+	}
+	if(lines<1)
+		lines = 1;
+
+	char code_size[32];
+	snprintf(code_size, sizeof(code_size), code_bytes ? "%u bytes" : "not measured", (unsigned)code_bytes);
+	printf("%d input lines per pattern, deadline %d cycles per input line, %d line cache entries, scratch code %s%s\n\n",
+		lines, DEADLINE_CYCLES, cache_entries, code_size, dma_priority ? ", DMA first" : "");
+	printf("%-13s %-9s %23s %12s %16s %18s\n", "layout", "pattern", "core stalls/line (0, 1)", "p per access",
+		"worst finish", "DMA stalls/line");
+	int best = -1;
+	double best_stalls = 0;
+	for(int i=0; i<LAYOUTS; i++)
+	{
+		const struct layout_t *l = &layouts[i];
+		char why[128];
+		if(only && strcmp(only, l->name))
+			continue;
+		bool fits = place_objects(l, why, sizeof(why));
+		if(verbose)
+		{
+			printf("%s: %s\n", l->name, l->what);
+			for(int o=0; o<O_COUNT; o++)
+			{
+				if(o!=O_LUT1 || l->lut_per_core)
+					printf("  %-16s %-10s %6u bytes at %u\n", object_names[o], region_names[place[o].region],
+						(unsigned)place[o].bytes, (unsigned)place[o].address);
+			}
+		}
+		double worst_stalls = 0;
+		for(int p=0; p<P_COUNT; p++)
+		{
+			struct stats_t s;
+			run_layout(p, lines, &s);
+			double c0 = (double)s.core_stalls[0]/lines, c1 = (double)s.core_stalls[1]/lines;
+			double prob = (double)(s.core_stalls[0]+s.core_stalls[1])/(double)(s.core_accesses[0]+s.core_accesses[1]);
+			double out_lines = (double)lines*SPLIT_LINE_REPEAT;
+			char core_col[32], dma_col[32];
+			snprintf(core_col, sizeof(core_col), "%.0f, %.0f", c0, c1);
+			snprintf(dma_col, sizeof(dma_col), "%.1f (max %d)", (double)(s.dma_stalls+s.write_stalls)/out_lines,
+				s.dma_max_wait);
+			printf("%-13s %-9s %23s %11.2f%% %7d (%4.1f%%) %18s\n", p ? "" : l->name, pattern_names[p], core_col, 100.0*prob,
+				s.worst_finish, 100.0*s.worst_finish/DEADLINE_CYCLES, dma_col);
+			worst_stalls = c0+c1>worst_stalls ? c0+c1 : worst_stalls;
+		}
+		bool code_in_scratch = l->region[O_CODE0]==R_SCRATCH_X || l->region[O_CODE0]==R_SCRATCH_Y;
+		if(!fits)
+			printf("%-13s doesn't fit: %s\n", "", why);
+		else if(code_in_scratch && !code_bytes)
+			printf("%-13s encode code size not measured: give the bigger of .scratch_x and .scratch_y with -k\n", "");
+		else if(best<0 || worst_stalls<best_stalls)
+		{
+			best = i;
+			best_stalls = worst_stalls;
+		}
+	}
+	if(best>=0)
+		printf("\nFewest stalls in the worst pattern that fits: %s (%s)\n", layouts[best].name, layouts[best].what);
+	return 0;
+}
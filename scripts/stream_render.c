@@ -0,0 +1,478 @@
+/*
+	stream_render.c
+
+	Renders recorded gameplay into the TMDS stream the board would send for it, as a reference for hardware-in-the-loop
+	comparison: every output frame, all 3 lanes, blanking included, in the single-ended format of tmds_output.pio.
+	The lines are built like the firmware builds them: the blanking of the line (fill_blank_line() with 2 null packets,
+	the "nm" set of create_sync_buffers()), then the active part, which is the framebuffer line encoded with
+	tmds_encode_channel() and the LUT of create_tmds_lut() and sent 3 times, or the control symbols of a vblank line.
+	Line 0 is the first active line, like on the board.
+
+	Input, 240x160, one frame per output frame:
+	-r file: an emulator's raw frame dump, 16-bit little-endian pixels (bits 0-4 red, 5-9 green, 10-14 blue), one frame
+	 after the other (same as line_cache_bench.c -r)
+	-p pattern: a numbered sequence of binary PPMs, e.g. -p frames/%05d.ppm, from -b on to the first one that's
+	 missing. There's no PNG decoder here; convert PNGs first (e.g. ffmpeg -i %05d.png %05d.ppm.)
+
+	The disparity starts over on every line, so any band of lines encodes on its own: the frames are cut into bands of
+	BAND_LINES framebuffer lines, and a pool of worker threads takes the bands in order, a frame as soon as it's read,
+	while the next frames are read and finished ones written. There are only SLOTS frames in flight, so the memory
+	doesn't grow with the recording, and the output is written as each frame is finished.
+
+	Output container (native byte order, little endian on anything this runs on):
+	-header: "TMDSSTRM", then uint32 version (1), frame count (0xffffffff while it's being written; filled in at the end
+	 if the output can seek), lanes (3), words per lane and line, lines per frame, active width and height, islands
+	-per frame: uint32 frame number, uint32 FNV-1a of the frame's words (a word at a time, not bytes), then V_TOTAL
+	 lines of 3 lanes of PACKED_WORDS(H_TOTAL) words each, lane 0 first
+	A frame can be compared by its hash alone, and cut back into symbols with unpack_single() (tmds_decode.c.)
+
+	It reports the frames and symbols per second and what every worker did. -S measures the scaling instead: it renders
+	the input with 1, 2, 4... up to -j workers without writing anything, and prints the speed of each against 1.
+
+	Build: gcc -O2 -pthread -o stream_render stream_render.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./stream_render (-r dump | -p pattern [-b first]) [-o stream.tmds] [-j workers] [-n frames] [-S]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "tmds_util.h"
+#include "host_util.h"
+#include "../src/tmds_channel_encode.h"
+
+#define LANES 3
+#define WIDTH TMDS_LINE_PIXELS
+#define HEIGHT 160
+#define LINE_REPEAT 3
+#define BLANK_SYMBOLS (H_TOTAL-H_ACTIVE)
+#define BLANK_WORDS ((BLANK_SYMBOLS*10)/32)
+#define LINE_WORDS ((H_TOTAL*10)/32)
+#define FRAME_WORDS ((size_t)V_TOTAL*LANES*LINE_WORDS)
+#define ISLANDS 2
+#define VARIANTS 4
+
+// Framebuffer lines per job, and frames in flight
+#define BAND_LINES 16
+#define BANDS (HEIGHT/BAND_LINES)
+#define SLOTS 8
+#define MAX_WORKERS 64
+
+#if H_ACTIVE!=WIDTH*3 || V_ACTIVE!=HEIGHT*LINE_REPEAT || BLANK_WORDS+TMDS_LINE_WORDS!=LINE_WORDS
+#error "stream_render needs the active area to be the framebuffer at 3x"
+#endif
+
+struct stream_header_t
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t frames;
+	uint32_t lanes;
+	uint32_t line_words;
+	uint32_t lines;
+	uint32_t width;
+	uint32_t height;
+	uint32_t islands;
+};
+
+struct slot_t
+{
+	uint32_t fb[HEIGHT*TMDS_FB_LINE_WORDS];
+	// The whole output frame. The vblank lines are the same in every frame, so they're only filled in once.
+	uint32_t frame[V_TOTAL][LANES][LINE_WORDS];
+	int bands_left;
+};
+
+struct input_t
+{
+	FILE *raw;
+	const char *pattern;
+	int next;
+};
+
+struct render_t
+{
+	pthread_mutex_t lock;
+	pthread_cond_t work; // a frame was read, or the input ended
+	pthread_cond_t done; // a frame is finished
+	pthread_cond_t slot_free; // a frame was written out
+	struct slot_t *slots;
+	int read; // frames read into slots
+	int written;
+	int next_job; // frame*BANDS+band
+	bool input_done;
+	FILE *out;
+	uint64_t bytes;
+	int workers;
+	int jobs[MAX_WORKERS];
+	double busy[MAX_WORKERS];
+};
+
+static uint32_t tmds_lut[TMDS_LUT_WORDS];
+static uint32_t blank_words[VARIANTS][LANES][BLANK_WORDS];
+static uint32_t vblank_words[VARIANTS][LANES][TMDS_LINE_WORDS];
+
+// Vsync edges happen at the start of the hsync pulse (same as e2e_sim.c), line 0 being the first active line
+static int line_variant(int line)
+{
+	int pulse_start = V_ACTIVE+V_FRONT;
+	if(line==pulse_start)
+		return BLANK_VBLANK_EN;
+	if(line>pulse_start && line<pulse_start+V_PULSE)
+		return BLANK_VBLANK_SYN;
+	if(line==pulse_start+V_PULSE)
+		return BLANK_VBLANK_EX;
+	return BLANK_HBLANK;
+}
+
+static void build_blanking(void)
+{
+	// vsync level after the start of the hsync pulse, as in fill_blank_line_packets()
+	const int vsync_after[VARIANTS] = {1, 0, 0, 1};
+	struct blank_timing_t timing = {H_FRONT, H_PULSE, H_BACK};
+	static uint16_t symbols[LANES][BLANK_SYMBOLS], vblank[H_ACTIVE];
+	for(int v=0; v<VARIANTS; v++)
+	{
+		fill_blank_line(symbols[0], symbols[1], symbols[2], &timing, v, ISLANDS);
+		for(int lane=0; lane<LANES; lane++)
+		{
+			pack_symbols(symbols[lane], blank_words[v][lane], BLANK_SYMBOLS);
+			uint16_t ctl = lane==0 ? sync_ctl_states[(vsync_after[v]<<1)|1] : sync_ctl_states[0];
+			for(int i=0; i<H_ACTIVE; i++)
+				vblank[i] = ctl;
+			pack_symbols(vblank, vblank_words[v][lane], H_ACTIVE);
+		}
+	}
+}
+
+static bool read_raw(FILE *f, uint32_t *fb)
+{
+	uint8_t pixels[WIDTH*2];
+	for(int y=0; y<HEIGHT; y++)
+	{
+		if(fread(pixels, 1, sizeof(pixels), f)!=sizeof(pixels))
+			return false;
+		for(int x=0; x<WIDTH; x+=2)
+		{
+			uint32_t p0 = (pixels[2*x]|(pixels[2*x+1]<<8))&0x7fff;
+			uint32_t p1 = (pixels[2*x+2]|(pixels[2*x+3]<<8))&0x7fff;
+			fb[y*TMDS_FB_LINE_WORDS+x/2] = (p0<<16)|p1;
+		}
+	}
+	return true;
+}
+
+static bool read_frame(struct input_t *in, uint32_t *fb)
+{
+	if(in->raw)
+		return read_raw(in->raw, fb);
+	char name[512];
+	snprintf(name, sizeof(name), in->pattern, in->next++);
+	// The first missing file ends the sequence
+	if(access(name, F_OK))
+		return false;
+	static uint16_t pixels[HEIGHT][WIDTH];
+	if(!read_ppm(name, &pixels[0][0], WIDTH, HEIGHT))
+		return false;
+	for(int y=0; y<HEIGHT; y++)
+	{
+		for(int x=0; x<WIDTH; x+=2)
+			fb[y*TMDS_FB_LINE_WORDS+x/2] = ((uint32_t)pixels[y][x]<<16)|pixels[y][x+1];
+	}
+	return true;
+}
+
+// Output line: the blanking of its variant, then the active part (line buffer or control symbols)
+static void fill_line(uint32_t (*line)[LINE_WORDS], int number)
+{
+	int variant = line_variant(number);
+	for(int lane=0; lane<LANES; lane++)
+	{
+		memcpy(line[lane], blank_words[variant][lane], sizeof(blank_words[variant][lane]));
+		if(number>=V_ACTIVE)
+			memcpy(line[lane]+BLANK_WORDS, vblank_words[variant][lane], sizeof(vblank_words[variant][lane]));
+	}
+}
+
+static void init_slot(struct slot_t *slot)
+{
+	for(int line=0; line<V_TOTAL; line++)
+		fill_line(slot->frame[line], line);
+}
+
+// Encodes a band of framebuffer lines into its LINE_REPEAT output lines each
+static void render_band(struct slot_t *slot, int band)
+{
+	uint8_t values[TMDS_LINE_PIXELS];
+	for(int y=band*BAND_LINES; y<(band+1)*BAND_LINES; y++)
+	{
+		uint32_t (*line)[LINE_WORDS] = slot->frame[y*LINE_REPEAT];
+		uint32_t *lane[LANES] = {line[0]+BLANK_WORDS, line[1]+BLANK_WORDS, line[2]+BLANK_WORDS};
+		tmds_encode_line(tmds_lut, slot->fb+y*TMDS_FB_LINE_WORDS, lane, values);
+		for(int r=1; r<LINE_REPEAT; r++)
+			memcpy(slot->frame[y*LINE_REPEAT+r], line, sizeof(slot->frame[0]));
+	}
+}
+
+struct worker_arg_t
+{
+	struct render_t *r;
+	int id;
+};
+
+static void *worker(void *p)
+{
+	struct worker_arg_t *arg = (struct worker_arg_t *)p;
+	struct render_t *r = arg->r;
+	pthread_mutex_lock(&r->lock);
+	for(;;)
+	{
+		while(r->next_job>=r->read*BANDS && !r->input_done)
+			pthread_cond_wait(&r->work, &r->lock);
+		if(r->next_job>=r->read*BANDS)
+			break;
+		int job = r->next_job++;
+		struct slot_t *slot = &r->slots[(job/BANDS)%SLOTS];
+		pthread_mutex_unlock(&r->lock);
+
+		double start = now();
+		render_band(slot, job%BANDS);
+		double busy = now()-start;
+
+		pthread_mutex_lock(&r->lock);
+		r->jobs[arg->id]++;
+		r->busy[arg->id] += busy;
+		if(--slot->bands_left==0)
+			pthread_cond_broadcast(&r->done);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+// FNV-1a over 32-bit words
+static uint32_t fnv1a(uint32_t hash, const uint32_t *words, size_t count)
+{
+	for(size_t i=0; i<count; i++)
+		hash = (hash^words[i])*0x01000193u;
+	return hash;
+}
+
+// Writes a finished frame (or only hashes it without an output)
+static void write_frame(struct render_t *r, const struct slot_t *slot, uint32_t number)
+{
+	uint32_t head[2] = {number, fnv1a(0x811c9dc5u, &slot->frame[0][0][0], FRAME_WORDS)};
+	if(r->out)
+	{
+		fwrite(head, sizeof(uint32_t), 2, r->out);
+		fwrite(slot->frame, sizeof(uint32_t), FRAME_WORDS, r->out);
+	}
+	r->bytes += sizeof(head)+FRAME_WORDS*sizeof(uint32_t);
+}
+
+static void *writer(void *p)
+{
+	struct render_t *r = (struct render_t *)p;
+	pthread_mutex_lock(&r->lock);
+	for(;;)
+	{
+		while(!(r->written<r->read && r->slots[r->written%SLOTS].bands_left==0) &&
+			!(r->input_done && r->written>=r->read))
+			pthread_cond_wait(&r->done, &r->lock);
+		if(r->written>=r->read)
+			break;
+		struct slot_t *slot = &r->slots[r->written%SLOTS];
+		pthread_mutex_unlock(&r->lock);
+		write_frame(r, slot, (uint32_t)r->written);
+		pthread_mutex_lock(&r->lock);
+		r->written++;
+		pthread_cond_signal(&r->slot_free);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+// Renders up to max_frames (0: all) of the input with the given number of workers. Returns the frames rendered.
+static int render(struct input_t *in, FILE *out, int workers, int max_frames, struct render_t *r, double *seconds)
+{
+	memset(r, 0, sizeof(*r));
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->work, NULL);
+	pthread_cond_init(&r->done, NULL);
+	pthread_cond_init(&r->slot_free, NULL);
+	r->slots = (struct slot_t *)calloc(SLOTS, sizeof(struct slot_t));
+	for(int i=0; i<SLOTS; i++)
+		init_slot(&r->slots[i]);
+	r->out = out;
+	r->workers = workers;
+
+	double start = now();
+	pthread_t threads[MAX_WORKERS], write_thread;
+	struct worker_arg_t args[MAX_WORKERS];
+	for(int i=0; i<workers; i++)
+	{
+		args[i].r = r;
+		args[i].id = i;
+		pthread_create(&threads[i], NULL, worker, &args[i]);
+	}
+	pthread_create(&write_thread, NULL, writer, r);
+
+	// Reads the frames into free slots as long as there are any
+	for(int f=0; !max_frames || f<max_frames; f++)
+	{
+		pthread_mutex_lock(&r->lock);
+		while(f-r->written>=SLOTS)
+			pthread_cond_wait(&r->slot_free, &r->lock);
+		pthread_mutex_unlock(&r->lock);
+		struct slot_t *slot = &r->slots[f%SLOTS];
+		if(!read_frame(in, slot->fb))
+			break;
+		pthread_mutex_lock(&r->lock);
+		slot->bands_left = BANDS;
+		r->read = f+1;
+		pthread_cond_broadcast(&r->work);
+		pthread_mutex_unlock(&r->lock);
+	}
+	pthread_mutex_lock(&r->lock);
+	r->input_done = true;
+	pthread_cond_broadcast(&r->work);
+	pthread_cond_broadcast(&r->done);
+	pthread_mutex_unlock(&r->lock);
+
+	for(int i=0; i<workers; i++)
+		pthread_join(threads[i], NULL);
+	pthread_join(write_thread, NULL);
+	*seconds = now()-start;
+	free(r->slots);
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->work);
+	pthread_cond_destroy(&r->done);
+	pthread_cond_destroy(&r->slot_free);
+	return r->written;
+}
+
+static bool open_input(struct input_t *in, const char *raw, const char *pattern, int first)
+{
+	memset(in, 0, sizeof(*in));
+	in->pattern = pattern;
+	in->next = first;
+	if(raw)
+	{
+		in->raw = fopen(raw, "rb");
+		if(!in->raw)
+		{
+			perror(raw);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void close_input(struct input_t *in)
+{
+	if(in->raw)
+		fclose(in->raw);
+}
+
+int main(int argc, char **argv)
+{
+	const char *raw = NULL, *pattern = NULL, *out_name = "stream.tmds";
+	int first = 0, max_frames = 0, scaling = 0;
+	int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while((opt = getopt(argc, argv, "r:p:b:o:j:n:S"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'r': raw = optarg; break;
+			case 'p': pattern = optarg; break;
+			case 'b': first = atoi(optarg); break;
+			case 'o': out_name = optarg; break;
+			case 'j': workers = atoi(optarg); break;
+			case 'n': max_frames = atoi(optarg); break;
+			case 'S': scaling = 1; break;
+			default:
+				fprintf(stderr, "See the top of stream_render.c for the options.\n");
+				return 1;
+		}
+	}
+	if(!raw==!pattern)
+	{
+		fprintf(stderr, "Needs either -r or -p, see the top of stream_render.c.\n");
+		return 1;
+	}
+	if(workers<1)
+		workers = 1;
+	if(workers>MAX_WORKERS)
+		workers = MAX_WORKERS;
+
+	create_tmds_lut(tmds_lut);
+	build_blanking();
+	static struct render_t r;
+	struct input_t in;
+	double seconds;
+	double symbols_per_frame = (double)H_TOTAL*V_TOTAL*LANES;
+
+	if(scaling)
+	{
+		double base = 0;
+		printf("%-8s %8s %10s %12s %8s\n", "workers", "frames", "frames/s", "Msymbols/s", "scaling");
+		for(int w=1; ; w = w*2>workers ? workers : w*2)
+		{
+			if(!open_input(&in, raw, pattern, first))
+				return 1;
+			int frames = render(&in, NULL, w, max_frames, &r, &seconds);
+			close_input(&in);
+			if(!frames)
+			{
+				fprintf(stderr, "No frames in the input\n");
+				return 1;
+			}
+			double rate = frames/seconds;
+			if(w==1)
+				base = rate;
+			printf("%-8d %8d %10.1f %12.1f %7.2fx\n", w, frames, rate, rate*symbols_per_frame/1e6, rate/base);
+			if(w==workers)
+				break;
+		}
+		printf("(%ld CPUs online)\n", sysconf(_SC_NPROCESSORS_ONLN));
+		return 0;
+	}
+
+	FILE *out = fopen(out_name, "wb");
+	if(!out)
+	{
+		perror(out_name);
+		return 1;
+	}
+	struct stream_header_t header = {{'T', 'M', 'D', 'S', 'S', 'T', 'R', 'M'}, 1, 0xffffffffu, LANES, LINE_WORDS,
+		V_TOTAL, H_ACTIVE, V_ACTIVE, ISLANDS};
+	fwrite(&header, sizeof(header), 1, out);
+	if(!open_input(&in, raw, pattern, first))
+		return 1;
+	int frames = render(&in, out, workers, max_frames, &r, &seconds);
+	close_input(&in);
+	// The frame count is only known now
+	header.frames = (uint32_t)frames;
+	if(!fseek(out, 0, SEEK_SET))
+		fwrite(&header, sizeof(header), 1, out);
+	bool ok = !ferror(out);
+	ok = !fclose(out) && ok;
+	if(!ok || !frames)
+	{
+		fprintf(stderr, frames ? "Couldn't write %s\n" : "No frames in the input\n", out_name);
+		return 1;
+	}
+
+	printf("%d frames to %s (%.1fMB, %.1fMB per frame) with %d worker%s in %.2fs\n", frames, out_name,
+		(r.bytes+sizeof(header))/1e6, r.bytes/1e6/frames, workers, workers==1 ? "" : "s", seconds);
+	printf("%.1f frames/s, %.1fM symbols/s (%.2fx real time at 60 frames/s)\n", frames/seconds,
+		frames*symbols_per_frame/seconds/1e6, frames/seconds/60.0);
+	printf("Memory in flight: %d frames, %.1fMB\n", SLOTS, SLOTS*sizeof(struct slot_t)/1e6);
+	for(int i=0; i<workers; i++)
+		printf("  worker %2d: %5d bands (%4.1f%%), busy %.2fs\n", i, r.jobs[i], 100.0*r.jobs[i]/(frames*BANDS), r.busy[i]);
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+	tmds_decode.c
+
+	Round-trip check for the files written by tmds_util.c in both output formats.
+	Run it in the folder where both "./tmds_util" and "./tmds_util -i" were run. For every asset it:
+	-unpacks the single-ended file and the interleaved (il_) file back into 10-bit symbols
+	-checks that every P/N pair in the interleaved file is complementary and that both give the same symbols
+	-decodes the symbols (control states, guard bands, TERC4, video) and counts them
+	For the LUTs it also decodes every entry back into the 8-bit color, and checks that the interleaved entries
+	carry the same output disparity in their top bits.
+
+	The decode functions are also used by other host tools, which build this with -DTMDS_DECODE_NO_MAIN.
+
+	Build: gcc -O2 -o tmds_decode tmds_decode.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./tmds_decode [folder]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include "tmds_util.h"
+#include "tmds_decode.h"
+
+// Undoes the XOR/XNOR chain and the bit 9 inversion. Returns -1 if the symbol can't be made by the video encoder
+// (the 4 control symbols are the only 10-bit values that decode to something but can't come out of it.)
+int tmds_decode_video(uint16_t symbol)
+{
+	if(tmds_decode_ctl(symbol)>=0)
+		return -1;
+	uint8_t q = symbol&0xff;
+	if(symbol&0x200)
+		q ^= 0xff;
+	uint8_t data = q&0x01;
+	for(int i=1; i<8; i++)
+	{
+		uint8_t bit = ((q>>i)^(q>>(i-1)))&0x01;
+		if(!(symbol&0x100))
+			bit ^= 0x01;
+		data |= bit<<i;
+	}
+	return data;
+}
+
+int tmds_decode_ctl(uint16_t symbol)
+{
+	for(int i=0; i<4; i++)
+	{
+		if(sync_ctl_states[i]==symbol)
+			return i;
+	}
+	return -1;
+}
+
+int tmds_decode_terc4(uint16_t symbol)
+{
+	for(int i=0; i<16; i++)
+	{
+		if(terc4_table[i]==symbol)
+			return i;
+	}
+	return -1;
+}
+
+// Guard band symbols are also TERC4 codes (0x8 and 0x4 in the table), so they're only told apart by position;
+// this just says which table a symbol is in first.
+enum tmds_symbol_class_t tmds_classify(uint16_t symbol)
+{
+	if(tmds_decode_ctl(symbol)>=0)
+		return TMDS_SYM_CTL;
+	if(symbol==guardband_states[0] || symbol==guardband_states[1])
+		return TMDS_SYM_GUARD;
+	if(tmds_decode_terc4(symbol)>=0)
+		return TMDS_SYM_TERC4;
+	return TMDS_SYM_VIDEO;
+}
+
+// 20 bits of P/N pairs back into a symbol. Returns the number of pairs that weren't complementary.
+int tmds_deinterleave(uint32_t pairs, uint16_t *symbol)
+{
+	int bad = 0;
+	*symbol = 0;
+	for(int i=0; i<10; i++)
+	{
+		uint32_t pair = (pairs>>(2*i))&0x03;
+		if(pair!=0x01 && pair!=0x02)
+			bad++;
+		*symbol |= (uint16_t)(pair&0x01)<<i;
+	}
+	return bad;
+}
+
+void unpack_single(const uint32_t *in_buffer, uint16_t *out_buffer, int symbols)
+{
+	uint64_t acc = 0;
+	int fill = 0, in_pos = 0;
+	for(int i=0; i<symbols; i++)
+	{
+		if(fill<10)
+		{
+			acc |= ((uint64_t)in_buffer[in_pos++])<<fill;
+			fill += 32;
+		}
+		out_buffer[i] = acc&0x3ff;
+		acc >>= 10;
+		fill -= 10;
+	}
+}
+
+// Returns the number of bad P/N pairs.
+int unpack_interleaved(const uint32_t *in_buffer, uint16_t *out_buffer, int symbols)
+{
+	uint64_t acc = 0;
+	int fill = 0, in_pos = 0, bad = 0;
+	for(int i=0; i<symbols; i++)
+	{
+		if(fill<20)
+		{
+			acc |= ((uint64_t)in_buffer[in_pos++])<<fill;
+			fill += 32;
+		}
+		bad += tmds_deinterleave(acc&0xfffff, &out_buffer[i]);
+		acc >>= 20;
+		fill -= 20;
+	}
+	return bad;
+}
+
+#ifndef TMDS_DECODE_NO_MAIN
+static const char *folder = ".";
+static unsigned long class_count[4];
+static int failures = 0;
+
+static uint32_t *load(const char *prefix, const char *name, int words)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s%s", folder, prefix, name);
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		printf("  %s: missing\n", path);
+		failures++;
+		return NULL;
+	}
+	uint32_t *buf = (uint32_t *)calloc(words, sizeof(uint32_t));
+	size_t got = fread(buf, 4, words, f);
+	// One more byte means the file is longer than it should be.
+	if(got!=(size_t)words || fgetc(f)!=EOF)
+	{
+		printf("  %s: expected %d words\n", path, words);
+		failures++;
+	}
+	fclose(f);
+	return buf;
+}
+
+// Symbols go into symbols_out if it isn't NULL.
+static void check_asset(const char *name, int symbols, uint16_t *symbols_out)
+{
+	uint32_t *single = load("", name, symbols*10/32);
+	uint32_t *il = load("il_", name, symbols*20/32);
+	if(!single || !il)
+	{
+		free(single);
+		free(il);
+		return;
+	}
+	uint16_t *a = (uint16_t *)malloc(symbols*sizeof(uint16_t));
+	uint16_t *b = (uint16_t *)malloc(symbols*sizeof(uint16_t));
+	unpack_single(single, a, symbols);
+	int bad_pairs = unpack_interleaved(il, b, symbols);
+	int mismatches = 0;
+	for(int i=0; i<symbols; i++)
+	{
+		if(a[i]!=b[i])
+			mismatches++;
+		class_count[tmds_classify(a[i])]++;
+	}
+	if(bad_pairs || mismatches)
+	{
+		printf("  %s: %d bad P/N pairs, %d symbols differ\n", name, bad_pairs, mismatches);
+		failures++;
+	}
+	if(symbols_out)
+		memcpy(symbols_out, a, symbols*sizeof(uint16_t));
+	free(a);
+	free(b);
+	free(single);
+	free(il);
+}
+
+static void check_lut(void)
+{
+	uint32_t *single = load("", "tmds_lut.bin", TMDS_LUT_WORDS);
+	uint32_t *il = load("il_", "tmds_lut.bin", TMDS_LUT_WORDS);
+	if(!single || !il)
+	{
+		free(single);
+		free(il);
+		return;
+	}
+	int bad = 0;
+	for(int color=0; color<32; color++)
+	{
+		for(int disp=0; disp<16; disp++)
+		{
+			int index = (color<<1)|(disp<<6);
+			int expected = depth_convert(color);
+			// Single-ended: 3 symbols in word 0, disparity<<6 in word 1
+			uint16_t s[3];
+			for(int i=0; i<3; i++)
+			{
+				s[i] = (single[index]>>(10*i))&0x3ff;
+				if(tmds_decode_video(s[i])!=expected)
+					bad++;
+			}
+			if(single[index+1]&~0x3c0u)
+				bad++;
+			// Interleaved: 60 bits of pairs, disparity in bits 28-31 of word 1
+			uint64_t pairs = ((uint64_t)(il[index+1]&0x0fffffff)<<32)|il[index];
+			for(int i=0; i<3; i++)
+			{
+				uint16_t sym;
+				if(tmds_deinterleave((pairs>>(20*i))&0xfffff, &sym) || sym!=s[i])
+					bad++;
+			}
+			if((il[index+1]>>28)!=((single[index+1]>>6)&0x0f))
+				bad++;
+		}
+	}
+	printf("tmds_lut.bin: 512 entries, %d errors\n", bad);
+	if(bad)
+		failures++;
+	free(single);
+	free(il);
+}
+
+int main(int argc, char **argv)
+{
+	if(argc>1)
+		folder = argv[1];
+	const char *sets[] = {"nm", "nd"};
+	const char *buffers[] = {"hblank", "vblank_en", "vblank_syn", "vblank_ex"};
+	char name[64];
+
+	check_lut();
+
+	int blank = H_TOTAL-H_ACTIVE;
+	for(int set=0; set<2; set++)
+	{
+		for(int buf=0; buf<4; buf++)
+		{
+			for(int ch=0; ch<3; ch++)
+			{
+				snprintf(name, sizeof(name), "%s_ch%d_%s.bin", buffers[buf], ch, sets[set]);
+				check_asset(name, blank, NULL);
+			}
+		}
+	}
+	printf("Sync buffers: %d files of %d symbols\n", 2*4*3, blank);
+
+	// The data island header is in bit 2 of the channel 0 TERC4 nibbles, with hsync/vsync in bits 0-1.
+	const char *islands[] = {"terc4_hblank_ch0.bin", "terc4_vsync_ch0.bin", "terc4_blank_ch1.bin", "terc4_blank_ch2.bin"};
+	uint16_t island[4][32];
+	for(int i=0; i<4; i++)
+		check_asset(islands[i], 32, island[i]);
+	// Channel 1 and 2 carry bits 2i and 2i+1 of the 4 subpackets (src/data_island.h); the BCH bytes and the InfoFrame
+	// checksum have to be right too.
+	uint8_t header[4] = {0}, sub[4][8] = {{0}};
+	for(int i=0; i<32; i++)
+	{
+		int nibble[4];
+		for(int n=0; n<4; n++)
+			nibble[n] = tmds_decode_terc4(island[n][i]);
+		if(nibble[0]<0 || nibble[2]<0 || nibble[3]<0)
+		{
+			printf("  data island symbol %d isn't TERC4\n", i);
+			failures++;
+			break;
+		}
+		header[i/8] |= ((nibble[0]>>2)&1)<<(i%8);
+		for(int n=0; n<4; n++)
+		{
+			sub[n][(2*i)/8] |= ((nibble[2]>>n)&1)<<((2*i)%8);
+			sub[n][(2*i+1)/8] |= ((nibble[3]>>n)&1)<<((2*i+1)%8);
+		}
+	}
+	uint8_t sum = (uint8_t)(header[0]+header[1]+header[2]);
+	bool ecc_ok = header[3]==data_island_ecc(header, 3);
+	for(int n=0; n<4; n++)
+	{
+		ecc_ok &= sub[n][7]==data_island_ecc(sub[n], 7);
+		for(int k=0; k<7; k++)
+			sum = (uint8_t)(sum+sub[n][k]);
+	}
+	printf("Data islands: header %02x %02x %02x %02x, payload bytes 0-4 %02x %02x %02x %02x %02x\n",
+		header[0], header[1], header[2], header[3], sub[0][0], sub[0][1], sub[0][2], sub[0][3], sub[0][4]);
+	if(header[0]!=PACKET_INFOFRAME_AVI || header[2]!=13 || sub[0][4]!=AVI_VIC || !ecc_ok || sum)
+	{
+		printf("  AVI InfoFrame doesn't decode back\n");
+		failures++;
+	}
+
+	const char *solid[] = {"pixel_0x00.bin", "pixel_0xff.bin"};
+	for(int i=0; i<2; i++)
+	{
+		uint16_t line[H_ACTIVE];
+		check_asset(solid[i], H_ACTIVE, line);
+		int expected = depth_convert(i ? 0x1f : 0x00), bad = 0;
+		for(int j=0; j<H_ACTIVE; j++)
+			bad += tmds_decode_video(line[j])!=expected;
+		printf("%s: %d pixels, %d don't decode to 0x%02x\n", solid[i], H_ACTIVE, bad, expected);
+		if(bad)
+			failures++;
+	}
+
+	printf("Symbols seen: %lu control, %lu guard band, %lu TERC4, %lu video\n", class_count[TMDS_SYM_CTL],
+		class_count[TMDS_SYM_GUARD], class_count[TMDS_SYM_TERC4], class_count[TMDS_SYM_VIDEO]);
+	printf("%s\n", failures ? "FAIL" : "OK");
+	return failures ? 1 : 0;
+}
+#endif
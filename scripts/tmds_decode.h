@@ -0,0 +1,30 @@
+/*
+	tmds_decode.h
+
+	Decoder side of tmds_util.c: unpacks single-ended or interleaved buffers back into symbols,
+	and symbols back into video data, control states or TERC4 nibbles.
+*/
+
+#ifndef TMDS_DECODE_H
+#define TMDS_DECODE_H
+
+#include <stdint.h>
+
+// Symbol classes, in the order they're tried by tmds_classify()
+enum tmds_symbol_class_t
+{
+	TMDS_SYM_CTL = 0,
+	TMDS_SYM_GUARD = 1,
+	TMDS_SYM_TERC4 = 2,
+	TMDS_SYM_VIDEO = 3
+};
+
+int tmds_decode_video(uint16_t symbol);
+int tmds_decode_ctl(uint16_t symbol);
+int tmds_decode_terc4(uint16_t symbol);
+enum tmds_symbol_class_t tmds_classify(uint16_t symbol);
+int tmds_deinterleave(uint32_t pairs, uint16_t *symbol);
+void unpack_single(const uint32_t *in_buffer, uint16_t *out_buffer, int symbols);
+int unpack_interleaved(const uint32_t *in_buffer, uint16_t *out_buffer, int symbols);
+
+#endif
@@ -0,0 +1,663 @@
+/*
+	tmds_reference_check.c
+
+	Checks every symbol tmds_util.c writes against a reference encoder written straight from the DVI 1.0 and HDMI 1.4
+	specs, sharing no code or tables with the generator (only the mode timing from tmds_util.h):
+	-video: the 8b/10b flow chart of DVI 1.0 (3.3.3) with its running disparity, on bit arrays
+	-control, guard band and TERC4 symbols: the code tables, as the bit strings the specs list
+	-data islands: the packet layout, the BCH ECC as polynomial division by x^8+x^7+x^6+1, and the InfoFrame checksum
+	It runs in the folder where "./tmds_util", "./tmds_util -i" and "./tmds_util -3" were run, unpacks all 3 formats on
+	its own (and checks every P/N pair of the interleaved and 3-lane ones), and compares:
+	-every entry of tmds_lut, dmg_lut, grid_lut (level 128) and tmds_lut_1/2: the symbols from the entry's disparity and
+	 the next disparity. It also walks the LUT from the reset disparity and checks that the disparity it carries is the
+	 real DC balance of the symbols sent, and how far it goes.
+	-every entry of tmds_lut_pairs: each symbol is what the reference sends for a value of the pixel's color, and the
+	 6 symbols of the entry add up to 0
+	-the blanking lines (hblank/vblank_*, with 2 null packets and without), symbol by symbol against the line format of
+	 fill_blank_line_packets(), including channel 0 bit 3 being set on pixel 0 of the second packet of an island
+	-the AVI InfoFrame island files and the solid lines
+	-the 3-lane vblank control words (3l_ctl_active.bin)
+	Any difference is printed and fails the check. scripts/check_golden.sh runs it with the sanitizers on.
+
+	Build: gcc -O2 -o tmds_reference_check tmds_reference_check.c
+	Usage: ./tmds_reference_check [folder]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include "tmds_util.h"
+
+#define BLANK (H_TOTAL-H_ACTIVE)
+#define MAX_SYMBOLS H_ACTIVE
+#define PRINT_LIMIT 8
+
+// q_out[9:0], as in the spec tables
+static const char *ref_ctl_bits[4] = {"1101010100", "0010101011", "0101010100", "1010101011"}; // C1C0 = 00, 01, 10, 11
+static const char *ref_terc4_bits[16] =
+{
+	"1010011100", "1001100011", "1011100100", "1011100010", "0101110001", "0100011110", "0110001110", "0100111100",
+	"1011001100", "0100111001", "0110011100", "1011000110", "1010001110", "1001110001", "0101100011", "1011000011"
+};
+static const char *ref_video_guard_bits[3] = {"1011001100", "0100110011", "1011001100"};
+static const char *ref_island_guard_bits = "0100110011";
+// The DMG LUT's palette and channel codes (tmds_util.c main() and src/model_detect.h): blue, green, red of each shade
+static const uint32_t ref_dmg_palette[4] = {0x9bbc0f, 0x8bac0f, 0x306230, 0x0f380f};
+
+static const char *folder = ".";
+static int failures;
+
+static uint16_t ref_symbol(const char *bits)
+{
+	uint16_t symbol = 0;
+	for(int i=0; i<10; i++)
+		symbol = (uint16_t)((symbol<<1)|(bits[i]=='1'));
+	return symbol;
+}
+
+static uint16_t ref_ctl(int c1, int c0)
+{
+	return ref_symbol(ref_ctl_bits[(c1<<1)|c0]);
+}
+
+static uint16_t ref_terc4(int nibble)
+{
+	return ref_symbol(ref_terc4_bits[nibble&0x0f]);
+}
+
+// DVI 1.0 section 3.3.3. cnt is the running disparity (ones minus zeros sent.)
+static uint16_t ref_tmds(uint8_t data, int *cnt)
+{
+	int d[8], q_m[9], q_out[10];
+	int n1_d = 0;
+	for(int i=0; i<8; i++)
+	{
+		d[i] = (data>>i)&1;
+		n1_d += d[i];
+	}
+	bool use_xnor = n1_d>4 || (n1_d==4 && d[0]==0);
+	q_m[0] = d[0];
+	for(int i=1; i<8; i++)
+		q_m[i] = use_xnor ? !(q_m[i-1]^d[i]) : (q_m[i-1]^d[i]);
+	q_m[8] = !use_xnor;
+	int n1 = 0;
+	for(int i=0; i<8; i++)
+		n1 += q_m[i];
+	int n0 = 8-n1;
+
+	q_out[8] = q_m[8];
+	if(*cnt==0 || n1==n0)
+	{
+		q_out[9] = !q_m[8];
+		for(int i=0; i<8; i++)
+			q_out[i] = q_m[8] ? q_m[i] : !q_m[i];
+		*cnt += q_m[8] ? n1-n0 : n0-n1;
+	}
+	else if((*cnt>0 && n1>n0) || (*cnt<0 && n0>n1))
+	{
+		q_out[9] = 1;
+		for(int i=0; i<8; i++)
+			q_out[i] = !q_m[i];
+		*cnt += 2*q_m[8]+n0-n1;
+	}
+	else
+	{
+		q_out[9] = 0;
+		for(int i=0; i<8; i++)
+			q_out[i] = q_m[i];
+		*cnt += -2*!q_m[8]+n1-n0;
+	}
+	uint16_t symbol = 0;
+	for(int i=9; i>=0; i--)
+		symbol = (uint16_t)((symbol<<1)|q_out[i]);
+	return symbol;
+}
+
+// Ones minus zeros of a symbol
+static int ref_balance(uint16_t symbol)
+{
+	int ones = 0;
+	for(int i=0; i<10; i++)
+		ones += (symbol>>i)&1;
+	return 2*ones-10;
+}
+
+// 5-bit channel to 8 bits by repeating the top bits. The generator stays off 0x00 and 0xff (see depth_convert().)
+static uint8_t ref_off_limits(uint8_t c)
+{
+	return (c==0x00 || c==0xff) ? (uint8_t)(c^1) : c;
+}
+
+static uint8_t ref_expand(int c)
+{
+	return ref_off_limits((uint8_t)((c<<3)|(c>>2)));
+}
+
+// BCH parity: remainder of M(x)*x^8 divided by G(x) = x^8+x^7+x^6+1, with the bits of data in the order they're sent
+// (LSB first) as the coefficients from the top down. The first parity bit sent is the top coefficient.
+static uint8_t ref_bch(const uint8_t *data, int length)
+{
+	const int g[9] = {1, 0, 0, 0, 0, 0, 1, 1, 1}; // g[k] is the coefficient of x^k
+	int bits = 8*length;
+	int poly[64+8] = {0};
+	// poly[k] is the coefficient of x^k; the first bit sent is the highest one
+	for(int i=0; i<bits; i++)
+		poly[bits+8-1-i] = (data[i/8]>>(i%8))&1;
+	for(int k=bits+8-1; k>=8; k--)
+	{
+		if(!poly[k])
+			continue;
+		for(int j=0; j<=8; j++)
+			poly[k-8+j] ^= g[j];
+	}
+	uint8_t parity = 0;
+	for(int i=0; i<8; i++)
+		parity |= (uint8_t)(poly[7-i]<<i);
+	return parity;
+}
+
+// 32 pixels of a packet on all 3 channels, for the given hsync/vsync levels (HDMI 1.4 5.2.3). Channel 0 bit 3 is
+// only zero on the first pixel of the island, so first says if the packet starts it.
+static void ref_island(const uint8_t header3[3], const uint8_t payload[28], int hsync, int vsync, int first,
+	uint16_t out[3][32])
+{
+	uint8_t header[4], sub[4][8];
+	memcpy(header, header3, 3);
+	header[3] = ref_bch(header, 3);
+	for(int n=0; n<4; n++)
+	{
+		memcpy(sub[n], payload+7*n, 7);
+		sub[n][7] = ref_bch(sub[n], 7);
+	}
+	for(int i=0; i<32; i++)
+	{
+		int ch0 = hsync|(vsync<<1)|(((header[i/8]>>(i%8))&1)<<2)|((i!=0 || !first)<<3);
+		int ch1 = 0, ch2 = 0;
+		for(int n=0; n<4; n++)
+		{
+			ch1 |= ((sub[n][(2*i)/8]>>((2*i)%8))&1)<<n;
+			ch2 |= ((sub[n][(2*i+1)/8]>>((2*i+1)%8))&1)<<n;
+		}
+		out[0][i] = ref_terc4(ch0);
+		out[1][i] = ref_terc4(ch1);
+		out[2][i] = ref_terc4(ch2);
+	}
+}
+
+// AVI InfoFrame (CEA-861): RGB, 4:3 picture and active format, the VIC, no pixel repetition.
+static void ref_avi(uint8_t header[3], uint8_t payload[28])
+{
+	memset(payload, 0, 28);
+	header[0] = 0x82;
+	header[1] = 0x02;
+	header[2] = 13;
+	payload[2] = 0x18;
+	payload[4] = AVI_VIC;
+	uint8_t sum = (uint8_t)(header[0]+header[1]+header[2]);
+	for(int i=1; i<28; i++)
+		sum = (uint8_t)(sum+payload[i]);
+	payload[0] = (uint8_t)(0x100-sum);
+}
+
+// One blanking line of the repo's format (fill_blank_line_packets() in tmds_util.c): control symbols with the syncs
+// (both active low, vsync changing at the start of the hsync pulse), islands null packets from the start of the hsync
+// pulse with their preamble and guard bands, and the video preamble and guard band at the end.
+static void ref_blank_line(int variant, int islands, uint16_t out[3][BLANK])
+{
+	const int vsync_before[4] = {1, 1, 0, 0};
+	const int vsync_after[4] = {1, 0, 0, 1};
+	uint8_t header[3] = {0}, payload[28] = {0};
+	uint16_t null_island[2][2][3][32]; // later packets, first packet; vsync low, high
+	for(int first=0; first<2; first++)
+	{
+		for(int v=0; v<2; v++)
+			ref_island(header, payload, 0, v, first, null_island[first][v]);
+	}
+	int start = H_FRONT, end = H_FRONT+32*islands;
+	for(int i=0; i<BLANK; i++)
+	{
+		int hsync = !(i>=H_FRONT && i<H_FRONT+H_PULSE);
+		int vsync = i<H_FRONT ? vsync_before[variant] : vsync_after[variant];
+		out[0][i] = ref_ctl(vsync, hsync);
+		out[1][i] = ref_ctl(0, 0);
+		out[2][i] = ref_ctl(0, 0);
+		if(i>=BLANK-2)
+		{
+			for(int ch=0; ch<3; ch++)
+				out[ch][i] = ref_symbol(ref_video_guard_bits[ch]);
+		}
+		else if(i>=BLANK-10)
+			out[1][i] = ref_ctl(0, 1); // CTL0..3 = 1000
+		else if(islands && i>=start-10 && i<start-2)
+		{
+			out[1][i] = ref_ctl(0, 1); // CTL0..3 = 1010
+			out[2][i] = ref_ctl(0, 1);
+		}
+		else if(islands && ((i>=start-2 && i<start) || (i>=end && i<end+2)))
+		{
+			out[0][i] = ref_terc4(0x0c|(vsync<<1)|hsync);
+			out[1][i] = ref_symbol(ref_island_guard_bits);
+			out[2][i] = ref_symbol(ref_island_guard_bits);
+		}
+		else if(i>=start && i<end)
+		{
+			for(int ch=0; ch<3; ch++)
+				out[ch][i] = null_island[i<start+32][vsync][ch][(i-start)%32];
+		}
+	}
+}
+
+static uint32_t *load(const char *prefix, const char *name, int words)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s%s", folder, prefix, name);
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		printf("  %s%s: missing\n", prefix, name);
+		failures++;
+		return NULL;
+	}
+	uint32_t *buffer = (uint32_t *)calloc((size_t)words+1, sizeof(uint32_t));
+	size_t got = fread(buffer, 4, (size_t)words+1, f);
+	fclose(f);
+	if(got!=(size_t)words)
+	{
+		printf("  %s%s: %zu words instead of %d\n", prefix, name, got, words);
+		failures++;
+		free(buffer);
+		return NULL;
+	}
+	return buffer;
+}
+
+// Formats, in the order of tmds_util's output_format
+enum ref_format_t
+{
+	REF_SINGLE,
+	REF_INTERLEAVED,
+	REF_3LANE
+};
+static const char *ref_prefix[3] = {"", "il_", "3l_"};
+
+// Bit i of the stream is bit i%32 of word i/32; symbols are 10 bits, or 20 bits of P/N pairs (P first.)
+// Returns the number of bad pairs.
+static int unpack(const uint32_t *words, uint16_t *symbols, int count, bool interleaved)
+{
+	int width = interleaved ? 20 : 10, bad = 0;
+	for(int s=0; s<count; s++)
+	{
+		uint16_t symbol = 0;
+		for(int b=0; b<10; b++)
+		{
+			int pos = s*width+(interleaved ? 2*b : b);
+			int p = (words[pos/32]>>(pos%32))&1;
+			if(interleaved)
+			{
+				int n = (words[(pos+1)/32]>>((pos+1)%32))&1;
+				bad += p==n;
+			}
+			symbol |= (uint16_t)(p<<b);
+		}
+		symbols[s] = symbol;
+	}
+	return bad;
+}
+
+// 3-lane stream: 30 bits per word, bit-time t in bits 6*(t%5) to 6*(t%5)+5 of word t/5, with the P/N pair of lane l
+// at bit 2*l. Lanes that are NULL are skipped. Returns the number of bad pairs, and counts bits 30-31 being set as bad
+// too.
+static int unpack_3lane(const uint32_t *words, uint16_t *lanes[3], int count)
+{
+	int bad = 0;
+	for(int w=0; w<2*count; w++)
+		bad += (words[w]>>30)!=0;
+	for(int lane=0; lane<3; lane++)
+	{
+		for(int s=0; s<count && lanes[lane]; s++)
+		{
+			uint16_t symbol = 0;
+			for(int b=0; b<10; b++)
+			{
+				int t = s*10+b;
+				uint32_t bits = (words[t/5]>>(6*(t%5)+2*lane))&3;
+				bad += bits==0 || bits==3;
+				symbol |= (uint16_t)((bits&1)<<b);
+			}
+			lanes[lane][s] = symbol;
+		}
+	}
+	return bad;
+}
+
+static int compare(const char *name, const uint16_t *got, const uint16_t *want, int count, int *printed)
+{
+	int bad = 0;
+	for(int i=0; i<count; i++)
+	{
+		if(got[i]==want[i])
+			continue;
+		if((*printed)++<PRINT_LIMIT)
+			printf("  %s symbol %d: %03x instead of %03x\n", name, i, got[i], want[i]);
+		bad++;
+	}
+	return bad;
+}
+
+// What a LUT's entry for a 5-bit value sends as symbol s
+enum lut_kind_t
+{
+	LUT_RGB555,
+	LUT_DMG,
+	LUT_GRID,
+	LUT_SYMBOLS_1,
+	LUT_SYMBOLS_2
+};
+
+static uint8_t lut_value(int kind, int color, int s)
+{
+	if(kind==LUT_DMG)
+	{
+		for(int shade=0; shade<4; shade++)
+		{
+			if(color==(0x1c|shade))
+				return ref_off_limits((uint8_t)(ref_dmg_palette[shade]&0xff));
+			if(color==(shade<<3))
+				return ref_off_limits((uint8_t)((ref_dmg_palette[shade]>>8)&0xff));
+			if(color==(0x04|shade))
+				return ref_off_limits((uint8_t)((ref_dmg_palette[shade]>>16)&0xff));
+		}
+	}
+	if(kind==LUT_GRID && s==2)
+		return ref_off_limits((uint8_t)((ref_expand(color)*128)>>8));
+	return ref_expand(color);
+}
+
+static void check_lut(const char *name, int kind, int format)
+{
+	const char *prefix = ref_prefix[format];
+	uint32_t *lut = load(prefix, name, format==REF_3LANE ? TMDS_3LANE_LUT_WORDS : TMDS_LUT_WORDS);
+	if(!lut)
+		return;
+	int symbols = kind==LUT_SYMBOLS_1 ? 1 : (kind==LUT_SYMBOLS_2 ? 2 : 3);
+	int bad = 0, bad_pairs = 0, printed = 0;
+	// Half the running disparity after each entry, and the real balance of its symbols
+	int next[32][16], balance[32][16];
+	for(int color=0; color<32; color++)
+	{
+		for(int h=0; h<16; h++)
+		{
+			int index = (color<<1)|(h<<6);
+			int cnt = 2*(h-8);
+			uint16_t want[3], got[3];
+			for(int s=0; s<symbols; s++)
+				want[s] = ref_tmds(lut_value(kind, color, s), &cnt);
+			uint32_t stream[2] = {lut[index], lut[index+1]&0x0fffffff};
+			if(format==REF_3LANE)
+			{
+				// 8 words per entry at (color<<3)|(h<<8): the symbols on lane 0, nothing on lanes 1 and 2
+				const uint32_t *entry = lut+((color<<3)|(h<<8));
+				uint16_t *lanes[3] = {got, NULL, NULL};
+				bad_pairs += unpack_3lane(entry, lanes, symbols);
+				for(int w=0; w<6; w++)
+					bad += (entry[w]&0x3cf3cf3c)!=0;
+				next[color][h] = (int)((entry[6]>>8)&0x0f);
+				bad += (entry[6]&~0xf00u) || entry[7];
+			}
+			else if(format==REF_INTERLEAVED)
+			{
+				bad_pairs += unpack(stream, got, symbols, true);
+				next[color][h] = (int)(lut[index+1]>>28);
+			}
+			else
+			{
+				unpack(stream, got, symbols, false);
+				next[color][h] = (int)((lut[index+1]>>6)&0x0f);
+				// Nothing but the symbols and the disparity bits
+				if((symbols<3 && (lut[index]>>(10*symbols))) || (lut[index]>>30) || (lut[index+1]&~0x3c0u))
+					bad++;
+			}
+			balance[color][h] = 0;
+			for(int s=0; s<symbols; s++)
+				balance[color][h] += ref_balance(got[s]);
+			char entry[64];
+			snprintf(entry, sizeof(entry), "%s%s value %d disparity %d", prefix, name, color, 2*(h-8));
+			bad += compare(entry, got, want, symbols, &printed);
+			if(cnt<-16 || cnt>14 || next[color][h]!=cnt/2+8)
+			{
+				if(printed++<PRINT_LIMIT)
+					printf("  %s%s value %d from disparity %d: next disparity %d instead of %d\n", prefix, name, color,
+						2*(h-8), 2*(next[color][h]-8), cnt);
+				bad++;
+			}
+		}
+	}
+
+	// Walk it from the reset disparity: the disparity it carries has to be what the symbols really add up to
+	bool reached[16] = {false};
+	reached[8] = true;
+	int low = 0, high = 0, drift = 0;
+	for(bool changed=true; changed; )
+	{
+		changed = false;
+		for(int h=0; h<16; h++)
+		{
+			if(!reached[h])
+				continue;
+			for(int color=0; color<32; color++)
+			{
+				int n = next[color][h];
+				if(2*(n-h)!=balance[color][h])
+					drift++;
+				low = 2*(n-8)<low ? 2*(n-8) : low;
+				high = 2*(n-8)>high ? 2*(n-8) : high;
+				if(!reached[n])
+					reached[n] = changed = true;
+			}
+		}
+	}
+	if(drift)
+	{
+		printf("  %s%s: %d reachable entries carry a disparity their symbols don't add up to\n", prefix, name, drift);
+		bad += drift;
+	}
+	printf("%s%s: 512 entries of %d symbols, %d errors, %d bad pairs, running disparity %d to %d\n", prefix, name, symbols,
+		bad, bad_pairs, low, high);
+	if(bad || bad_pairs)
+		failures++;
+	free(lut);
+}
+
+// Pair LUT: every symbol has to be what the reference sends for a value with the color of its pixel in the top 5 bits,
+// from a disparity of -2 or 2, and every entry has to add up to 0
+static void check_pair_lut(void)
+{
+	uint32_t *lut = load("", "tmds_lut_pairs.bin", TMDS_PAIR_LUT_WORDS);
+	if(!lut)
+		return;
+	int bad = 0, printed = 0, nudged = 0, peak = 0;
+	for(int index=0; index<TMDS_PAIR_LUT_WORDS; index+=2)
+	{
+		int colors[2] = {index>>6, (index>>1)&0x1f};
+		int sum = 0;
+		bool exact = true, ok = !(lut[index]>>30) && !(lut[index+1]>>30);
+		for(int s=0; s<6; s++)
+		{
+			uint16_t symbol = (uint16_t)((lut[index+s/3]>>(10*(s%3)))&0x3ff);
+			int color = colors[s/3], found = -1;
+			for(int v=color<<3; v<(color<<3)+8 && found<0; v++)
+			{
+				for(int cnt=-2; cnt<=2 && found<0; cnt+=4)
+				{
+					int c = cnt;
+					if(ref_tmds((uint8_t)v, &c)==symbol)
+						found = v;
+				}
+			}
+			if(found<0 && printed++<PRINT_LIMIT)
+				printf("  tmds_lut_pairs.bin colors %d %d symbol %d: %03x isn't color %d\n", colors[0], colors[1], s, symbol,
+					color);
+			ok = ok && found>=0;
+			exact = exact && found==ref_expand(color);
+			sum += ref_balance(symbol);
+			peak = abs(sum)>peak ? abs(sum) : peak;
+		}
+		if(sum && printed++<PRINT_LIMIT)
+			printf("  tmds_lut_pairs.bin colors %d %d: adds up to %d\n", colors[0], colors[1], sum);
+		bad += !ok || sum;
+		nudged += !exact;
+	}
+	printf("tmds_lut_pairs.bin: 1024 pairs of 6 symbols, %d errors, %d with other values of the same color, running "
+		"disparity within %d\n", bad, nudged, peak);
+	if(bad)
+		failures++;
+	free(lut);
+}
+
+// A file of count symbols against the reference
+static void check_symbols(const char *name, const uint16_t *want, int count, bool interleaved, int *errors)
+{
+	const char *prefix = ref_prefix[interleaved];
+	int words = (count*(interleaved ? 20 : 10))/32;
+	uint32_t *buffer = load(prefix, name, words);
+	if(!buffer)
+	{
+		(*errors)++;
+		return;
+	}
+	uint16_t got[MAX_SYMBOLS];
+	int printed = 0;
+	char full[80];
+	snprintf(full, sizeof(full), "%s%s", prefix, name);
+	int bad_pairs = unpack(buffer, got, count, interleaved);
+	int bad = compare(full, got, want, count, &printed);
+	if(bad_pairs)
+		printf("  %s: %d bad P/N pairs\n", full, bad_pairs);
+	*errors += bad+bad_pairs;
+	free(buffer);
+}
+
+// Same for a 3-lane file, all 3 lanes in one stream
+static void check_symbols_3lane(const char *name, const uint16_t *const want[3], int count, int *errors)
+{
+	uint32_t *buffer = load(ref_prefix[REF_3LANE], name, 2*count);
+	if(!buffer)
+	{
+		(*errors)++;
+		return;
+	}
+	uint16_t got[3][MAX_SYMBOLS];
+	uint16_t *lanes[3] = {got[0], got[1], got[2]};
+	int printed = 0;
+	char full[80];
+	int bad_pairs = unpack_3lane(buffer, lanes, count);
+	for(int lane=0; lane<3; lane++)
+	{
+		snprintf(full, sizeof(full), "%s%s lane %d", ref_prefix[REF_3LANE], name, lane);
+		*errors += compare(full, got[lane], want[lane], count, &printed);
+	}
+	if(bad_pairs)
+		printf("  %s%s: %d bad P/N pairs\n", ref_prefix[REF_3LANE], name, bad_pairs);
+	*errors += bad_pairs;
+	free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+	if(argc>1)
+		folder = argv[1];
+	static const char *luts[] = {"tmds_lut.bin", "dmg_lut.bin", "grid_lut.bin", "tmds_lut_1.bin", "tmds_lut_2.bin"};
+	for(int kind=0; kind<5; kind++)
+	{
+		check_lut(luts[kind], kind, REF_SINGLE);
+		// The 1 and 2 symbol LUTs are only written single-ended
+		if(kind<LUT_SYMBOLS_1)
+		{
+			check_lut(luts[kind], kind, REF_INTERLEAVED);
+			check_lut(luts[kind], kind, REF_3LANE);
+		}
+	}
+	check_pair_lut();
+
+	const char *sets[2] = {"nd", "nm"};
+	const char *variants[4] = {"hblank", "vblank_en", "vblank_syn", "vblank_ex"};
+	int errors = 0, files = 0;
+	for(int set=0; set<2; set++)
+	{
+		for(int v=0; v<4; v++)
+		{
+			uint16_t want[3][BLANK];
+			ref_blank_line(v, 2*set, want);
+			for(int ch=0; ch<3; ch++)
+			{
+				char name[64];
+				snprintf(name, sizeof(name), "%s_ch%d_%s.bin", variants[v], ch, sets[set]);
+				for(int il=0; il<2; il++, files++)
+					check_symbols(name, want[ch], BLANK, il, &errors);
+			}
+			char name[64];
+			const uint16_t *lanes[3] = {want[0], want[1], want[2]};
+			snprintf(name, sizeof(name), "%s_%s.bin", variants[v], sets[set]);
+			check_symbols_3lane(name, lanes, BLANK, &errors);
+			files++;
+		}
+	}
+	printf("Blanking lines: %d files of %d symbols, %d errors\n", files, BLANK, errors);
+	if(errors)
+		failures++;
+
+	uint8_t header[3], payload[28];
+	uint16_t avi[2][3][32];
+	ref_avi(header, payload);
+	ref_island(header, payload, 0, 1, 1, avi[1]);
+	ref_island(header, payload, 0, 0, 1, avi[0]);
+	const uint16_t *island_want[4] = {avi[1][0], avi[0][0], avi[1][1], avi[1][2]};
+	const char *island_names[4] = {"terc4_hblank_ch0.bin", "terc4_vsync_ch0.bin", "terc4_blank_ch1.bin",
+		"terc4_blank_ch2.bin"};
+	errors = 0;
+	for(int i=0; i<4; i++)
+	{
+		for(int il=0; il<2; il++)
+			check_symbols(island_names[i], island_want[i], 32, il, &errors);
+	}
+	const uint16_t *island_3lane[2][3] = {{avi[1][0], avi[1][1], avi[1][2]}, {avi[0][0], avi[0][1], avi[0][2]}};
+	check_symbols_3lane("terc4_hblank.bin", island_3lane[0], 32, &errors);
+	check_symbols_3lane("terc4_vsync.bin", island_3lane[1], 32, &errors);
+	printf("AVI InfoFrame (VIC %d, checksum %02x, header ECC %02x): 10 files, %d errors\n", AVI_VIC, payload[0],
+		ref_bch(header, 3), errors);
+	if(errors)
+		failures++;
+
+	errors = 0;
+	const int solid[2] = {0x00, 0x1f};
+	for(int i=0; i<2; i++)
+	{
+		uint16_t want[H_ACTIVE];
+		int cnt = 0;
+		for(int x=0; x<H_ACTIVE; x++)
+			want[x] = ref_tmds(ref_expand(solid[i]), &cnt);
+		char name[32];
+		snprintf(name, sizeof(name), "pixel_0x%02x.bin", i ? 0xff : 0x00);
+		for(int il=0; il<2; il++)
+			check_symbols(name, want, H_ACTIVE, il, &errors);
+		const uint16_t *lanes[3] = {want, want, want};
+		check_symbols_3lane(name, lanes, H_ACTIVE, &errors);
+	}
+	printf("Solid lines: 6 files of %d symbols, %d errors\n", H_ACTIVE, errors);
+	if(errors)
+		failures++;
+
+	// Vblank active part of the 3-lane output: hsync high, vsync high then low, channels 1 and 2 low
+	errors = 0;
+	uint16_t ctl_ch0[2] = {ref_ctl(1, 1), ref_ctl(0, 1)}, ctl_low[2] = {ref_ctl(0, 0), ref_ctl(0, 0)};
+	const uint16_t *ctl_lanes[3] = {ctl_ch0, ctl_low, ctl_low};
+	check_symbols_3lane("ctl_active.bin", ctl_lanes, 2, &errors);
+	printf("3-lane vblank control words: %d errors\n", errors);
+	if(errors)
+		failures++;
+
+	printf("%s\n", failures ? "FAIL" : "PASS");
+	return failures ? 1 : 0;
+}
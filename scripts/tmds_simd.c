@@ -0,0 +1,209 @@
+/*
+	tmds_simd.c
+
+	See tmds_simd.h. The vector stages work out everything about a value that doesn't depend on the disparity:
+	-q_m bits 0-7: with XOR, bit i is the XOR of data bits 0-i (a prefix XOR, 3 shift steps); XNOR is the same with the
+	 odd bits flipped (0xaa), since every XNOR step flips the bit before it once more
+	-whether it used XNOR (q_m bit 8 is the inverse)
+	-whether bits 0-7 get inverted, for a running disparity below, at and above 0 (bits 0-2 of invert)
+	-what the symbol adds to the disparity when they are and when they aren't
+	That turns the DC balancing step into a table-driven scan: the sign of the disparity picks one bit of invert, and
+	that picks the symbol and the delta, with no branches and 4 operations on the dependency chain.
+	There are no 8-bit shifts in SSE2/AVX2, so the shifts are 16-bit ones with the bits that came from the byte below
+	masked off. The popcounts are the usual bit halving steps for SSE2 and a nibble table (pshufb) for AVX2.
+	The AVX2 path is compiled with a target attribute, so the file builds with plain gcc flags and the CPU is only asked
+	at run time.
+*/
+
+#include <stdint.h>
+#include "tmds_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TMDS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Values per block of the vector stage, the most any path does at once
+#define BLOCK 32
+
+struct qm_block_t
+{
+	uint8_t qm[BLOCK];
+	uint8_t xnor[BLOCK]; // 0xff if XNOR was used
+	uint8_t invert[BLOCK]; // bit 0: disparity below 0, bit 1: at 0, bit 2: above 0
+	int8_t delta_invert[BLOCK];
+	int8_t delta_keep[BLOCK];
+};
+
+// The DC balancing step, the only one that needs the disparity of the symbol before
+static int balance_block(const struct qm_block_t *b, uint16_t *symbols, int count, int cnt)
+{
+	for(int i=0; i<count; i++)
+	{
+		int invert = (b->invert[i]>>((cnt>0)-(cnt<0)+1))&1;
+		symbols[i] = (uint16_t)((b->qm[i]^(-invert&0xff))|((~b->xnor[i]&1)<<8)|(invert<<9));
+		cnt += invert ? b->delta_invert[i] : b->delta_keep[i];
+	}
+	return cnt;
+}
+
+// From the flow chart: with a disparity or a q_m balance of 0, bits 0-7 are inverted when bit 8 is 0, otherwise when
+// both have the same sign. Inverted, the disparity changes by 2*bit8-balance, otherwise by balance-2*!bit8.
+static void qm_scalar(const uint8_t *data, struct qm_block_t *b, int count)
+{
+	for(int i=0; i<count; i++)
+	{
+		uint32_t d = data[i];
+		int ones = __builtin_popcount(d);
+		int xnor = ones>4 || (ones==4 && !(d&1));
+		uint32_t qm = d;
+		qm ^= (qm<<1)&0xfe;
+		qm ^= (qm<<2)&0xfc;
+		qm ^= (qm<<4)&0xf0;
+		if(xnor)
+			qm ^= 0xaa;
+		int balance = 2*__builtin_popcount(qm)-8;
+		b->qm[i] = (uint8_t)qm;
+		b->xnor[i] = xnor ? 0xff : 0;
+		b->invert[i] = (uint8_t)((balance<0 || (!balance && xnor)) | (xnor<<1) | ((balance>0 || (!balance && xnor))<<2));
+		b->delta_invert[i] = (int8_t)(2*!xnor-balance);
+		b->delta_keep[i] = (int8_t)(balance-2*xnor);
+	}
+}
+
+#ifdef TMDS_SIMD_X86
+
+static __m128i popcount_sse2(__m128i x)
+{
+	x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), _mm_set1_epi8(0x55)));
+	x = _mm_add_epi8(_mm_and_si128(x, _mm_set1_epi8(0x33)), _mm_and_si128(_mm_srli_epi16(x, 2), _mm_set1_epi8(0x33)));
+	return _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), _mm_set1_epi8(0x0f));
+}
+
+static void qm_sse2(const uint8_t *data, struct qm_block_t *b)
+{
+	const __m128i four = _mm_set1_epi8(4);
+	for(int i=0; i<BLOCK; i+=16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i *)(data+i));
+		__m128i ones = popcount_sse2(d);
+		__m128i even = _mm_cmpeq_epi8(_mm_and_si128(d, _mm_set1_epi8(1)), _mm_setzero_si128());
+		__m128i xnor = _mm_or_si128(_mm_cmpgt_epi8(ones, four), _mm_and_si128(_mm_cmpeq_epi8(ones, four), even));
+		__m128i qm = d;
+		qm = _mm_xor_si128(qm, _mm_and_si128(_mm_slli_epi16(qm, 1), _mm_set1_epi8((char)0xfe)));
+		qm = _mm_xor_si128(qm, _mm_and_si128(_mm_slli_epi16(qm, 2), _mm_set1_epi8((char)0xfc)));
+		qm = _mm_xor_si128(qm, _mm_and_si128(_mm_slli_epi16(qm, 4), _mm_set1_epi8((char)0xf0)));
+		qm = _mm_xor_si128(qm, _mm_and_si128(xnor, _mm_set1_epi8((char)0xaa)));
+		__m128i qm_ones = popcount_sse2(qm);
+		__m128i balanced_xnor = _mm_and_si128(_mm_cmpeq_epi8(qm_ones, four), xnor);
+		__m128i below = _mm_or_si128(_mm_cmplt_epi8(qm_ones, four), balanced_xnor);
+		__m128i above = _mm_or_si128(_mm_cmpgt_epi8(qm_ones, four), balanced_xnor);
+		__m128i invert = _mm_or_si128(_mm_and_si128(below, _mm_set1_epi8(1)),
+			_mm_or_si128(_mm_and_si128(xnor, _mm_set1_epi8(2)), _mm_and_si128(above, _mm_set1_epi8(4))));
+		// balance = 2*ones-8, and xnor is -1 where it's set
+		__m128i balance = _mm_sub_epi8(_mm_add_epi8(qm_ones, qm_ones), _mm_set1_epi8(8));
+		__m128i twice_xnor = _mm_add_epi8(xnor, xnor);
+		_mm_storeu_si128((__m128i *)(b->qm+i), qm);
+		_mm_storeu_si128((__m128i *)(b->xnor+i), xnor);
+		_mm_storeu_si128((__m128i *)(b->invert+i), invert);
+		_mm_storeu_si128((__m128i *)(b->delta_invert+i),
+			_mm_sub_epi8(_mm_add_epi8(_mm_set1_epi8(2), twice_xnor), balance));
+		_mm_storeu_si128((__m128i *)(b->delta_keep+i), _mm_add_epi8(balance, twice_xnor));
+	}
+}
+
+__attribute__((target("avx2"))) static __m256i popcount_avx2(__m256i x)
+{
+	const __m256i nibble = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	__m256i low = _mm256_and_si256(x, _mm256_set1_epi8(0x0f));
+	__m256i high = _mm256_and_si256(_mm256_srli_epi16(x, 4), _mm256_set1_epi8(0x0f));
+	return _mm256_add_epi8(_mm256_shuffle_epi8(nibble, low), _mm256_shuffle_epi8(nibble, high));
+}
+
+__attribute__((target("avx2"))) static void qm_avx2(const uint8_t *data, struct qm_block_t *b)
+{
+	const __m256i four = _mm256_set1_epi8(4);
+	__m256i d = _mm256_loadu_si256((const __m256i *)data);
+	__m256i ones = popcount_avx2(d);
+	__m256i even = _mm256_cmpeq_epi8(_mm256_and_si256(d, _mm256_set1_epi8(1)), _mm256_setzero_si256());
+	__m256i xnor = _mm256_or_si256(_mm256_cmpgt_epi8(ones, four), _mm256_and_si256(_mm256_cmpeq_epi8(ones, four), even));
+	__m256i qm = d;
+	qm = _mm256_xor_si256(qm, _mm256_and_si256(_mm256_slli_epi16(qm, 1), _mm256_set1_epi8((char)0xfe)));
+	qm = _mm256_xor_si256(qm, _mm256_and_si256(_mm256_slli_epi16(qm, 2), _mm256_set1_epi8((char)0xfc)));
+	qm = _mm256_xor_si256(qm, _mm256_and_si256(_mm256_slli_epi16(qm, 4), _mm256_set1_epi8((char)0xf0)));
+	qm = _mm256_xor_si256(qm, _mm256_and_si256(xnor, _mm256_set1_epi8((char)0xaa)));
+	__m256i qm_ones = popcount_avx2(qm);
+	__m256i balanced_xnor = _mm256_and_si256(_mm256_cmpeq_epi8(qm_ones, four), xnor);
+	__m256i below = _mm256_or_si256(_mm256_cmpgt_epi8(four, qm_ones), balanced_xnor);
+	__m256i above = _mm256_or_si256(_mm256_cmpgt_epi8(qm_ones, four), balanced_xnor);
+	__m256i invert = _mm256_or_si256(_mm256_and_si256(below, _mm256_set1_epi8(1)),
+		_mm256_or_si256(_mm256_and_si256(xnor, _mm256_set1_epi8(2)), _mm256_and_si256(above, _mm256_set1_epi8(4))));
+	__m256i balance = _mm256_sub_epi8(_mm256_add_epi8(qm_ones, qm_ones), _mm256_set1_epi8(8));
+	__m256i twice_xnor = _mm256_add_epi8(xnor, xnor);
+	_mm256_storeu_si256((__m256i *)b->qm, qm);
+	_mm256_storeu_si256((__m256i *)b->xnor, xnor);
+	_mm256_storeu_si256((__m256i *)b->invert, invert);
+	_mm256_storeu_si256((__m256i *)b->delta_invert, _mm256_sub_epi8(_mm256_add_epi8(_mm256_set1_epi8(2), twice_xnor), balance));
+	_mm256_storeu_si256((__m256i *)b->delta_keep, _mm256_add_epi8(balance, twice_xnor));
+}
+
+#endif
+
+int tmds_simd_supported(int path)
+{
+#ifdef TMDS_SIMD_X86
+	if(path==TMDS_SIMD_SSE2)
+		return __builtin_cpu_supports("sse2");
+	if(path==TMDS_SIMD_AVX2)
+		return __builtin_cpu_supports("avx2");
+#endif
+	return path==TMDS_SIMD_SCALAR;
+}
+
+int tmds_simd_best(void)
+{
+	static int best = -1;
+	if(best<0)
+	{
+		best = TMDS_SIMD_SCALAR;
+		for(int path=TMDS_SIMD_SSE2; path<TMDS_SIMD_PATHS; path++)
+		{
+			if(tmds_simd_supported(path))
+				best = path;
+		}
+	}
+	return best;
+}
+
+const char *tmds_simd_name(int path)
+{
+	static const char *names[TMDS_SIMD_PATHS] = {"scalar", "SSE2", "AVX2"};
+	return path>=0 && path<TMDS_SIMD_PATHS ? names[path] : "?";
+}
+
+void tmds_encode_bytes_path(int path, const uint8_t *data, uint16_t *symbols, int count, int *disparity)
+{
+	struct qm_block_t b;
+	int cnt = *disparity;
+	for(int i=0; i<count; i+=BLOCK)
+	{
+		int n = count-i<BLOCK ? count-i : BLOCK;
+		// The vector stages only do whole blocks; the tail of the stream is done like the scalar path.
+#ifdef TMDS_SIMD_X86
+		if(n==BLOCK && path==TMDS_SIMD_AVX2)
+			qm_avx2(data+i, &b);
+		else if(n==BLOCK && path==TMDS_SIMD_SSE2)
+			qm_sse2(data+i, &b);
+		else
+#endif
+			qm_scalar(data+i, &b, n);
+		cnt = balance_block(&b, symbols+i, n, cnt);
+	}
+	*disparity = cnt;
+}
+
+void tmds_encode_bytes(const uint8_t *data, uint16_t *symbols, int count, int *disparity)
+{
+	tmds_encode_bytes_path(tmds_simd_best(), data, symbols, count, disparity);
+}
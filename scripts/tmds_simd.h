@@ -0,0 +1,32 @@
+/*
+	tmds_simd.h
+
+	Bulk TMDS video encoder for the host tools: a stream of 8-bit values of one channel to 10-bit symbols with the
+	running disparity of DVI 1.0 3.3.3, bit-exact with tmds_calc_disparity() in tmds_util.c.
+	The transition minimizing stage and the popcounts don't depend on the disparity, so they're done 16 (SSE2) or 32
+	(AVX2) values at a time. Only the DC balancing step, which does, runs one symbol at a time, as a short branch on the
+	sign of the disparity and the balance of q_m that were worked out before.
+	tmds_encode_bytes() picks the fastest path the CPU has the first time it's called; the others are there for
+	tmds_simd_bench.c. Anything that isn't x86 gets the scalar path.
+*/
+
+#ifndef TMDS_SIMD_H
+#define TMDS_SIMD_H
+
+#include <stdint.h>
+
+#define TMDS_SIMD_SCALAR 0
+#define TMDS_SIMD_SSE2 1
+#define TMDS_SIMD_AVX2 2
+#define TMDS_SIMD_PATHS 3
+
+// Best path this CPU runs, and whether it runs path at all
+int tmds_simd_best(void);
+int tmds_simd_supported(int path);
+const char *tmds_simd_name(int path);
+
+// Encodes count values into symbols, starting from and updating the running disparity *disparity.
+void tmds_encode_bytes(const uint8_t *data, uint16_t *symbols, int count, int *disparity);
+void tmds_encode_bytes_path(int path, const uint8_t *data, uint16_t *symbols, int count, int *disparity);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+	tmds_simd_bench.c
+
+	Checks the bulk encoder of tmds_simd.c against tmds_calc_disparity() (tmds_util.c) on every path this CPU runs, and
+	measures how many symbols per second each one encodes.
+	-every value from every running disparity the 8b/10b code can reach (-16..16, even), one symbol
+	-random streams with lengths that aren't a multiple of the block size, with the disparity carried across calls
+	-the worst cases for the disparity: long runs of 0x00 and 0xff and values alternating between the two
+	-a frame of 720x480 3-channel pixels from the 5-bit values of the LUT (depth_convert()), which is what the
+	 frame tools encode
+	Every symbol and the final disparity have to match. Then every path (and tmds_calc_disparity() itself, one pixel at
+	a time like the generator) encodes the frame over and over, and the speed is printed.
+
+	Build: gcc -O2 -o tmds_simd_bench tmds_simd_bench.c tmds_simd.c tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./tmds_simd_bench [-f frames to time] [-s seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "tmds_simd.h"
+#include "host_util.h"
+
+#define STREAM_MAX 4096
+#define FRAME_SYMBOLS (H_ACTIVE*V_ACTIVE*3)
+
+// The generator's encoder, one value at a time
+static void encode_reference(const uint8_t *data, uint16_t *symbols, int count, int *disparity)
+{
+	struct tmds_pixel_t pixel;
+	pixel.disparity = *disparity;
+	for(int i=0; i<count; i++)
+	{
+		pixel.color_data = data[i];
+		tmds_calc_disparity(&pixel);
+		symbols[i] = pixel.tmds_data;
+	}
+	*disparity = pixel.disparity;
+}
+
+// Encodes data with both, split into calls of the lengths in splits (0 ends them), and compares.
+static bool compare_stream(int path, const char *name, const uint8_t *data, int count, const int *splits)
+{
+	static uint16_t expected[STREAM_MAX], got[STREAM_MAX];
+	int ref_disparity = 0, disparity = 0;
+	encode_reference(data, expected, count, &ref_disparity);
+	int pos = 0;
+	for(int s=0; pos<count; s++)
+	{
+		int n = splits && splits[s] ? splits[s] : count-pos;
+		if(n>count-pos)
+			n = count-pos;
+		tmds_encode_bytes_path(path, data+pos, got+pos, n, &disparity);
+		pos += n;
+	}
+	for(int i=0; i<count; i++)
+	{
+		if(expected[i]!=got[i])
+		{
+			printf("  %s, %s: symbol %d of %02x is %03x, should be %03x\n", tmds_simd_name(path), name, i, data[i],
+				got[i], expected[i]);
+			return false;
+		}
+	}
+	if(disparity!=ref_disparity)
+	{
+		printf("  %s, %s: disparity %d, should be %d\n", tmds_simd_name(path), name, disparity, ref_disparity);
+		return false;
+	}
+	return true;
+}
+
+static bool check_path(int path)
+{
+	static uint8_t data[STREAM_MAX];
+	int errors = 0;
+
+	// Every value from every disparity. The vector stages only run on whole blocks, so each value is the last one
+	// of a block of 32, after values that bring the disparity to where it has to be.
+	for(int start=-16; start<=16; start+=2)
+	{
+		for(int v=0; v<256; v++)
+		{
+			uint16_t expected, got[32];
+			int ref_disparity = start, disparity = start;
+			uint8_t one = (uint8_t)v, block[32];
+			encode_reference(&one, &expected, 1, &ref_disparity);
+			// 0x10 has a q_m of 4 ones with bit 8 set, so it keeps the disparity where it is, whatever it is
+			memset(block, 0x10, sizeof(block));
+			block[31] = one;
+			tmds_encode_bytes_path(path, block, got, 32, &disparity);
+			if(got[31]!=expected || disparity!=ref_disparity)
+			{
+				if(errors<8)
+					printf("  %s: %02x from disparity %d is %03x (%d), should be %03x (%d)\n", tmds_simd_name(path), v,
+						start, got[31], disparity, expected, ref_disparity);
+				errors++;
+			}
+		}
+	}
+
+	static const int splits[] = {1, 31, 33, 64, 15, 17, 100, 7, 0};
+	for(int t=0; t<64; t++)
+	{
+		int count = 1+(int)(rng()%STREAM_MAX);
+		for(int i=0; i<count; i++)
+			data[i] = (uint8_t)rng();
+		errors += !compare_stream(path, "random", data, count, t&1 ? splits : NULL);
+	}
+	memset(data, 0x00, STREAM_MAX);
+	errors += !compare_stream(path, "0x00", data, STREAM_MAX, NULL);
+	memset(data, 0xff, STREAM_MAX);
+	errors += !compare_stream(path, "0xff", data, STREAM_MAX, NULL);
+	for(int i=0; i<STREAM_MAX; i++)
+		data[i] = (i&1) ? 0xff : 0x00;
+	errors += !compare_stream(path, "0x00/0xff", data, STREAM_MAX, splits);
+	for(int i=0; i<STREAM_MAX; i++)
+		data[i] = depth_convert((uint8_t)(rng()&0x1f));
+	errors += !compare_stream(path, "depth_convert", data, STREAM_MAX, splits);
+
+	printf("%-7s %s\n", tmds_simd_name(path), errors ? "FAIL" : "bit-exact");
+	return !errors;
+}
+
+// Symbols per second of one path (-1: tmds_calc_disparity()) over frames, each channel of each line a call
+static double measure(int path, const uint8_t *frame, uint16_t *symbols, int frames)
+{
+	double start = now();
+	for(int f=0; f<frames; f++)
+	{
+		for(int line=0; line<V_ACTIVE*3; line++)
+		{
+			int disparity = 0;
+			const uint8_t *in = frame+line*H_ACTIVE;
+			uint16_t *out = symbols+line*H_ACTIVE;
+			if(path<0)
+				encode_reference(in, out, H_ACTIVE, &disparity);
+			else
+				tmds_encode_bytes_path(path, in, out, H_ACTIVE, &disparity);
+		}
+	}
+	return (double)FRAME_SYMBOLS*frames/(now()-start);
+}
+
+int main(int argc, char **argv)
+{
+	int frames = 20;
+	int opt;
+	while((opt = getopt(argc, argv, "f:s:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': frames = atoi(optarg); break;
+			case 's': rng_state = (uint32_t)strtoul(optarg, NULL, 0)|1; break;
+			default:
+				fprintf(stderr, "See the top of tmds_simd_bench.c for the options.\n");
+				return 1;
+		}
+	}
+	if(frames<1)
+		frames = 1;
+
+	printf("Best path on this CPU: %s\n\n", tmds_simd_name(tmds_simd_best()));
+	bool ok = true;
+	for(int path=0; path<TMDS_SIMD_PATHS; path++)
+	{
+		if(tmds_simd_supported(path))
+			ok &= check_path(path);
+		else
+			printf("%-7s not supported here\n", tmds_simd_name(path));
+	}
+
+	// One frame, each channel's lines one after the other
+	uint8_t *frame = (uint8_t *)malloc(FRAME_SYMBOLS);
+	uint16_t *symbols = (uint16_t *)malloc(FRAME_SYMBOLS*sizeof(uint16_t));
+	for(int i=0; i<FRAME_SYMBOLS; i++)
+		frame[i] = depth_convert((uint8_t)(rng()&0x1f));
+	printf("\n%d frames of %dx%d, 3 channels (%.1fM symbols each run):\n", frames, H_ACTIVE, V_ACTIVE,
+		FRAME_SYMBOLS*frames/1e6);
+	double reference = measure(-1, frame, symbols, frames);
+	printf("%-20s %8.1fM symbols/s\n", "tmds_calc_disparity", reference/1e6);
+	for(int path=0; path<TMDS_SIMD_PATHS; path++)
+	{
+		if(!tmds_simd_supported(path))
+			continue;
+		double rate = measure(path, frame, symbols, frames);
+		printf("%-20s %8.1fM symbols/s  %5.1fx\n", tmds_simd_name(path), rate/1e6, rate/reference);
+	}
+	free(frame);
+	free(symbols);
+
+	printf("\n%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
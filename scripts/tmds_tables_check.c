@@ -0,0 +1,86 @@
+/*
+	tmds_tables_check.c
+
+	Checks that the tables the compiler works out from src/tmds_tables.hpp (tmds_tables in src/tmds_tables.cpp) are
+	word for word what tmds_util.c writes for the single-ended format: the LUT of create_tmds_lut() (tmds_lut.bin) and
+	all 4 blanking lines on all 3 channels of both sets, "nm" with 2 null packets and "nd" without data islands
+	(fill_sync_buffers() packed with pack_buffer_single().)
+	The two are written independently, so a difference is a bug in one of them; tmds_reference_check says which.
+
+	Build: g++ -std=c++17 -O2 -c -o tmds_tables.o ../src/tmds_tables.cpp
+	       gcc -O2 -o tmds_tables_check tmds_tables_check.c tmds_tables.o tmds_util.c -DTMDS_UTIL_NO_MAIN
+	Usage: ./tmds_tables_check
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tmds_util.h"
+#include "../src/tmds_tables.h"
+
+#if TMDS_TABLES_BLANK_SYMBOLS!=H_TOTAL-H_ACTIVE
+#error "tmds_tables.h and tmds_util.h have different modelines"
+#endif
+
+static const char *variant_name[4] = {"hblank", "vblank_en", "vblank_syn", "vblank_ex"};
+
+static int compare(const char *name, const uint32_t *expected, const uint32_t *got, int words)
+{
+	int errors = 0;
+	for(int i=0; i<words; i++)
+	{
+		if(expected[i]!=got[i])
+		{
+			if(errors<4)
+				printf("  %s word %d: %08x, tmds_tables %08x\n", name, i, expected[i], got[i]);
+			errors++;
+		}
+	}
+	printf("%-22s %4d words  %s\n", name, words, errors ? "FAIL" : "ok");
+	return errors;
+}
+
+static int check_blank(const char *set, int islands, uint32_t (*tables)[3][TMDS_TABLES_BLANK_WORDS])
+{
+	struct sync_buffer_t *sync_buffer = (struct sync_buffer_t *)malloc(sizeof(struct sync_buffer_t));
+	allocate_sync_buffers(sync_buffer);
+	fill_sync_buffers(sync_buffer, islands);
+	uint16_t *lines[4][3] =
+	{
+		{sync_buffer->hblank_ch0, sync_buffer->hblank_ch1, sync_buffer->hblank_ch2},
+		{sync_buffer->vblank_en_ch0, sync_buffer->vblank_en_ch1, sync_buffer->vblank_en_ch2},
+		{sync_buffer->vblank_syn_ch0, sync_buffer->vblank_syn_ch1, sync_buffer->vblank_syn_ch2},
+		{sync_buffer->vblank_ex_ch0, sync_buffer->vblank_ex_ch1, sync_buffer->vblank_ex_ch2}
+	};
+	int errors = 0;
+	for(int v=0; v<4; v++)
+	{
+		for(int ch=0; ch<3; ch++)
+		{
+			uint32_t packed[TMDS_TABLES_BLANK_WORDS];
+			char name[32];
+			pack_buffer_single(lines[v][ch], packed, TMDS_TABLES_BLANK_SYMBOLS/16);
+			snprintf(name, sizeof(name), "%s %s ch%d", set, variant_name[v], ch);
+			errors += compare(name, packed, tables[v][ch], TMDS_TABLES_BLANK_WORDS);
+		}
+	}
+	free_sync_buffers(sync_buffer);
+	return errors;
+}
+
+int main()
+{
+	static uint32_t lut[TMDS_LUT_WORDS];
+	create_tmds_lut(lut);
+	int errors = compare("tmds_lut", lut, tmds_tables.lut, TMDS_LUT_WORDS);
+	errors += check_blank("nm", 2, tmds_tables.blank_nm);
+	errors += check_blank("nd", 0, tmds_tables.blank_nd);
+
+	if(errors)
+	{
+		printf("FAIL: %d words differ\n", errors);
+		return 1;
+	}
+	printf("OK: tmds_tables matches tmds_util\n");
+	return 0;
+}
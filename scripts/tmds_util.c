@@ -59,39 +59,65 @@ const uint16_t terc4_table[] =
 	0b0000001011000011
 };
 
-// OR these with the InfoFrame header bits.
-// 0 = during vsync, 1 = during active video (in the hblank interval, during the hsync pulse)
-const uint8_t sync_masks[] = 
-{
-	0b00001000,
-	0b00001010
-};
+// Format of everything main() writes; set with -i or -3 on the command line.
+int output_format = TMDS_FORMAT_SINGLE;
 
-// Creates the TMDS lookup table, where each entry has 3 separate pixels and an output disparity value (stored in 2 separate words.)
-int main()
+// Other host tools (simulators etc.) link against this file for the generator functions,
+// so they build it with -DTMDS_UTIL_NO_MAIN to leave this main() out.
+#ifndef TMDS_UTIL_NO_MAIN
+int main(int argc, char **argv)
 {
-    uint32_t *tmds_lut = (uint32_t *)malloc(0x400*sizeof(uint32_t));
-    struct tmds_pixel_t *tmds_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
-    uint8_t color = 0, color_8b = 0;
-    int dispy = 0;
-    for(color=0; color<32; color++)
+    // -i writes everything pre-interleaved for src/tmds_output_pair.pio, with "il_" in front of the file names.
+    // -3 writes everything for src/tmds_output_3lane.pio, with "3l_" in front of the file names.
+    if(argc>1 && !strcmp(argv[1], "-i"))
+        output_format = TMDS_FORMAT_INTERLEAVED;
+    else if(argc>1 && !strcmp(argv[1], "-3"))
+        output_format = TMDS_FORMAT_3LANE;
+
+    uint32_t *tmds_lut = (uint32_t *)malloc(TMDS_LUT_WORDS*sizeof(uint32_t));
+    create_tmds_lut(tmds_lut);
+    write_lut("tmds_lut.bin", tmds_lut);
+
+    // DMG LUT with the original green palette
+    const uint32_t dmg_palette[4] = {0x9bbc0f, 0x8bac0f, 0x306230, 0x0f380f};
+    create_tmds_lut_dmg(tmds_lut, dmg_palette);
+    write_lut("dmg_lut.bin", tmds_lut);
+    // LCD grid LUT for src/line_effect.h, third symbol at half brightness
+    create_tmds_lut_grid(tmds_lut, 128);
+    write_lut("grid_lut.bin", tmds_lut);
+    // 1 and 2 symbol LUTs for the scaler (src/scale_plan.h), which only runs on 30-bit single-ended lanes
+    if(output_format==TMDS_FORMAT_SINGLE)
     {
-    	for(dispy=-8; dispy<8; dispy++)
-    	{
-    		color_8b = depth_convert(color);
-    		tmds_pixel->color_data_5b = color;
-    		tmds_pixel->color_data = color_8b;
-    		tmds_pixel->tmds_data = 0;
-    		tmds_pixel->disparity = dispy;
-    		tmds_pixel_repeat(tmds_lut, tmds_pixel);
-    	}
+        for(int symbols=1; symbols<3; symbols++)
+        {
+            char lut_name[32];
+            sprintf(lut_name, "tmds_lut_%d.bin", symbols);
+            create_tmds_lut_symbols(tmds_lut, symbols);
+            FILE *pico_symbol_lut = open_output(lut_name);
+            fwrite(tmds_lut, 4, TMDS_LUT_WORDS, pico_symbol_lut);
+            fclose(pico_symbol_lut);
+        }
     }
-
-    FILE *pico_tmds_lut = fopen("tmds_lut.bin", "wb");
-    fwrite(tmds_lut, 4, 1024, pico_tmds_lut);
-    fclose(pico_tmds_lut);
-    free(tmds_pixel);
     free(tmds_lut);
+    // Stateless pair LUT for tmds_encode_channel_pairs() (single-ended lanes), checked before it's written
+    if(output_format==TMDS_FORMAT_SINGLE)
+    {
+        uint32_t *pair_lut = (uint32_t *)malloc(TMDS_PAIR_LUT_WORDS*sizeof(uint32_t));
+        int nudged, peak;
+        create_tmds_lut_pairs(pair_lut);
+        int bad = check_tmds_lut_pairs(pair_lut, &nudged, &peak);
+        printf("tmds_lut_pairs.bin: %d of 1024 pairs not DC balanced, %d with other 8-bit values, running disparity "
+            "within %d\n", bad, nudged, peak);
+        if(bad)
+        {
+            free(pair_lut);
+            return 1;
+        }
+        FILE *pico_pair_lut = open_output("tmds_lut_pairs.bin");
+        fwrite(pair_lut, 4, TMDS_PAIR_LUT_WORDS, pico_pair_lut);
+        fclose(pico_pair_lut);
+        free(pair_lut);
+    }
     // These functions create the sync buffers with the null packets and with no packets.
     // They do everything automatically, including packing the data and writing it to files.
     create_sync_buffers();
@@ -99,23 +125,354 @@ int main()
     // Now create the AVI (video) InfoFrame.
     // Creates both hsync and during vsync variants.
 
-    create_avi_infoframe(); // Also writes them to files and frees the structs.
+    create_avi_infoframe(); // Also writes them to files.
+    // The 3-lane output sends the active part of a vblank line from a 2 word ring instead of a blanking buffer.
+    if(output_format==TMDS_FORMAT_3LANE)
+        create_ctl_active_3lane();
     // Create a solid line that can be used to get a solid color on the screen.
     // Black, white, red, green, blue, magenta, cyan, or yellow can be made with different combinations.
     // The create_solid_line() function also writes it to a file.
     struct tmds_pixel_t *solid_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
     solid_pixel->color_data_5b = 0x00;
+    solid_pixel->disparity = 0;
     char *pixel_name = (char *)malloc(32);
     sprintf(pixel_name, "pixel_0x00.bin");
     create_solid_line(pixel_name, solid_pixel);
     solid_pixel->color_data_5b = 0x1f;
+    solid_pixel->disparity = 0;
     sprintf(pixel_name, "pixel_0xff.bin");
     create_solid_line(pixel_name, solid_pixel);
     free(pixel_name);
     free(solid_pixel);
+
+    if(output_format!=TMDS_FORMAT_SINGLE)
+        print_format_report();
     
     return 0;
 }
+#endif
+
+// LUT disparity bits (6-9 of the entry address) for a running disparity. The running disparity is always even and
+// stays within -8..8 from the start of a line, so the LUT keeps half of it, offset by 8 (0 is TMDS_DISP_RESET.)
+uint32_t lut_disparity(int disparity)
+{
+    return ((uint32_t)(disparity/2+8)&0x0f)<<6;
+}
+
+// Creates the TMDS lookup table, where each entry has 3 separate pixels and an output disparity value (stored in 2 separate words.)
+// tmds_lut has to be TMDS_LUT_WORDS long.
+void create_tmds_lut(uint32_t *tmds_lut)
+{
+    struct tmds_pixel_t *tmds_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
+    uint8_t color = 0, color_8b = 0;
+    int dispy = 0;
+    for(color=0; color<32; color++)
+    {
+    	for(dispy=-8; dispy<8; dispy++)
+    	{
+    		color_8b = depth_convert(color);
+    		tmds_pixel->color_data_5b = color;
+    		tmds_pixel->color_data = color_8b;
+    		tmds_pixel->tmds_data = 0;
+    		tmds_pixel->disparity = 2*dispy;
+    		tmds_pixel_repeat(tmds_lut, tmds_pixel);
+    	}
+    }
+    free(tmds_pixel);
+
+    return;
+}
+
+// Same entries as create_tmds_lut(), but with the 3 symbols interleaved for src/tmds_output_pair.pio.
+// 3 symbols are 60 bits, so the output disparity goes into the top 4 bits of the second word:
+// word 0 = symbol 0, bottom 12 bits of symbol 1
+// word 1 = top 8 bits of symbol 1, symbol 2, the LUT disparity (see lut_disparity()) in bits 28-31
+// The next index is still (color<<1)|(disparity<<6), with the disparity part being (word1>>22)&0x3c0,
+// but the disparity has to be masked off word 1 before it's stored in the line.
+void create_tmds_lut_interleaved(uint32_t *tmds_lut)
+{
+    create_tmds_lut(tmds_lut);
+    interleave_tmds_lut(tmds_lut);
+
+    return;
+}
+
+// Same as create_tmds_lut(), with symbols (1 to 3) symbols per entry instead of 3, in the bottom 10*symbols bits of
+// word 0. Word 1 is the disparity after the last one. With 3 this gives the same LUT as create_tmds_lut().
+void create_tmds_lut_symbols(uint32_t *tmds_lut, int symbols)
+{
+    struct tmds_pixel_t *tmds_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
+    for(int color=0; color<32; color++)
+    {
+        for(int dispy=-8; dispy<8; dispy++)
+        {
+            uint32_t index = ((uint32_t)color<<1)|lut_disparity(2*dispy);
+            tmds_pixel->color_data_5b = (uint8_t)color;
+            tmds_pixel->color_data = depth_convert((uint8_t)color);
+            tmds_pixel->tmds_data = 0;
+            tmds_pixel->disparity = 2*dispy;
+            tmds_lut[index] = 0;
+            for(int s=0; s<symbols; s++)
+            {
+                tmds_calc_disparity(tmds_pixel);
+                tmds_lut[index] |= ((uint32_t)tmds_pixel->tmds_data)<<(10*s);
+            }
+            tmds_lut[index+1] = lut_disparity(tmds_pixel->disparity);
+        }
+    }
+    free(tmds_pixel);
+
+    return;
+}
+
+// LUT for the LCD grid effect (src/line_effect.h): symbols 0 and 1 of every entry are the color, symbol 2 is the color
+// at level/256 brightness (grid_dim().)
+void create_tmds_lut_grid(uint32_t *tmds_lut, int level)
+{
+    struct tmds_pixel_t *tmds_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
+    for(int color=0; color<32; color++)
+    {
+        uint8_t color_8b = depth_convert((uint8_t)color);
+        for(int dispy=-8; dispy<8; dispy++)
+        {
+            uint32_t index = ((uint32_t)color<<1)|lut_disparity(2*dispy);
+            tmds_pixel->color_data_5b = (uint8_t)color;
+            tmds_pixel->color_data = color_8b;
+            tmds_pixel->tmds_data = 0;
+            tmds_pixel->disparity = 2*dispy;
+            tmds_lut[index] = 0;
+            for(int s=0; s<3; s++)
+            {
+                if(s==2)
+                    tmds_pixel->color_data = grid_dim(color_8b, level);
+                tmds_calc_disparity(tmds_pixel);
+                tmds_lut[index] |= ((uint32_t)tmds_pixel->tmds_data)<<(10*s);
+            }
+            tmds_lut[index+1] = lut_disparity(tmds_pixel->disparity);
+        }
+    }
+    free(tmds_pixel);
+
+    return;
+}
+
+// Turns a LUT from create_tmds_lut() or create_tmds_lut_dmg() into the interleaved layout, in place.
+void interleave_tmds_lut(uint32_t *tmds_lut)
+{
+    for(int i=0; i<TMDS_LUT_WORDS; i+=2)
+    {
+        uint32_t s0 = tmds_interleave(tmds_lut[i]&0x3ff);
+        uint32_t s1 = tmds_interleave((tmds_lut[i]>>10)&0x3ff);
+        uint32_t s2 = tmds_interleave((tmds_lut[i]>>20)&0x3ff);
+        uint32_t disparity = (tmds_lut[i+1]>>6)&0x0f;
+        tmds_lut[i] = s0|(s1<<20);
+        tmds_lut[i+1] = (s1>>12)|(s2<<8)|(disparity<<28);
+    }
+
+    return;
+}
+
+// Spreads a LUT from create_tmds_lut() (or the DMG and grid ones) into the 3-lane layout of src/tmds_output_3lane.h:
+// TMDS_3LANE_LUT_ENTRY words per entry, the 3 symbols on lane 0 in words 0-5 and the next disparity in word 6.
+// lut_3lane has to be TMDS_3LANE_LUT_WORDS long.
+void create_tmds_lut_3lane(uint32_t *lut_3lane, const uint32_t *tmds_lut)
+{
+    for(int i=0; i<TMDS_LUT_WORDS; i+=2)
+    {
+        uint32_t *entry = lut_3lane+(i<<2);
+        for(int w=0; w<TMDS_3LANE_LUT_ENTRY; w++)
+            entry[w] = 0;
+        for(int s=0; s<3; s++)
+            tmds_3lane_put_symbol(entry+TMDS_3LANE_WORDS(s), (tmds_lut[i]>>(10*s))&0x3ff, 0);
+        // Disparity from bits 6-9 to bits 8-11, like the index of the entry
+        entry[6] = tmds_lut[i+1]<<2;
+    }
+
+    return;
+}
+
+// LUT for the DMG capture (src/lcd_cap_dmg.pio): the 5-bit values are the channel codes of the 4 shades (see
+// src/model_detect.h), and each one gives that channel of the palette color of its shade. palette has 4 0xRRGGBB
+// colors, lightest first. The other 20 values keep their create_tmds_lut() entries.
+void create_tmds_lut_dmg(uint32_t *tmds_lut, const uint32_t *palette)
+{
+    struct tmds_pixel_t *tmds_pixel = (struct tmds_pixel_t *)malloc(sizeof(struct tmds_pixel_t));
+    uint8_t color_8b[32];
+    for(int color=0; color<32; color++)
+        color_8b[color] = depth_convert((uint8_t)color);
+    for(int shade=0; shade<4; shade++)
+    {
+        color_8b[0x1c|shade] = (uint8_t)(palette[shade]&0xff);
+        color_8b[shade<<3] = (uint8_t)((palette[shade]>>8)&0xff);
+        color_8b[0x04|shade] = (uint8_t)((palette[shade]>>16)&0xff);
+    }
+    for(int color=0; color<32; color++)
+    {
+        // Same disparity limit as depth_convert()
+        if(color_8b[color]==0xff || color_8b[color]==0x00)
+            color_8b[color] ^= 0x01;
+        for(int dispy=-8; dispy<8; dispy++)
+        {
+            tmds_pixel->color_data_5b = (uint8_t)color;
+            tmds_pixel->color_data = color_8b[color];
+            tmds_pixel->tmds_data = 0;
+            tmds_pixel->disparity = 2*dispy;
+            tmds_pixel_repeat(tmds_lut, tmds_pixel);
+        }
+    }
+    free(tmds_pixel);
+
+    return;
+}
+
+// Symbols of one pixel of the pair LUT, and what they cost: how far their 8-bit values are from depth_convert()'s,
+// and the running disparity after each of them, from 0.
+struct pair_triple_t
+{
+    uint32_t symbols;
+    int error, peak;
+    int prefix[3];
+    bool valid;
+};
+
+// Ones minus zeros of a symbol
+static int symbol_balance(uint16_t symbol)
+{
+    return 2*(ones_count((uint8_t)symbol)+((symbol>>8)&1)+((symbol>>9)&1))-10;
+}
+
+// For every disparity 3 symbols of color can add up to, the 3 with the 8-bit values closest to depth_convert(), then
+// the lowest running disparity. Any 8-bit value with color in its top 5 bits shows as color, and every symbol is one
+// tmds_calc_disparity() sends for its value from a disparity of -2 or 2.
+static void pair_triples(uint8_t color, struct pair_triple_t *triples)
+{
+    struct tmds_pixel_t pixel;
+    uint16_t symbols[16];
+    int errors[16], count = 0;
+    uint8_t ideal = depth_convert(color);
+    for(int low=0; low<8; low++)
+    {
+        pixel.color_data = (uint8_t)((color<<3)|low);
+        for(int sign=-1; sign<=1; sign+=2)
+        {
+            pixel.disparity = 2*sign;
+            pixel.tmds_data = 0;
+            tmds_calc_disparity(&pixel);
+            if(count && symbols[count-1]==pixel.tmds_data)
+                continue;
+            symbols[count] = pixel.tmds_data;
+            errors[count++] = abs((int)pixel.color_data-(int)ideal);
+        }
+    }
+    for(int d=0; d<TMDS_PAIR_SUMS; d++)
+        triples[d].valid = false;
+    for(int i=0; i<count*count*count; i++)
+    {
+        int pick[3] = {i%count, (i/count)%count, i/(count*count)};
+        struct pair_triple_t t;
+        t.symbols = 0;
+        t.error = 0;
+        t.peak = 0;
+        int sum = 0;
+        for(int s=0; s<3; s++)
+        {
+            t.symbols |= ((uint32_t)symbols[pick[s]])<<(10*s);
+            t.error += errors[pick[s]];
+            sum += symbol_balance(symbols[pick[s]]);
+            t.prefix[s] = sum;
+            t.peak = abs(sum)>t.peak ? abs(sum) : t.peak;
+        }
+        t.valid = true;
+        struct pair_triple_t *best = &triples[sum/2+TMDS_PAIR_SUMS/2];
+        if(!best->valid || t.error<best->error || (t.error==best->error && t.peak<best->peak))
+            *best = t;
+    }
+}
+
+// Stateless LUT for the pair encoder (tmds_encode_channel_pairs() in src/tmds_channel_encode.h): one entry of 2 words
+// for every pair of neighbouring pixels of a channel, at ((color0<<5)|color1)<<1, word 0 the 3 tripled symbols of
+// the first pixel and word 1 of the second. Every entry adds up to a disparity of 0, so there's no disparity to carry
+// from one pair to the next, and a line can be encoded in any order. To get there, the symbols are allowed to be
+// either of the 2 a DVI encoder sends for a value, and the value can move within the 8 that show the same 5-bit color:
+// of all that add up to 0, each entry has the ones closest to depth_convert(), then the lowest running disparity.
+// pair_lut has to be TMDS_PAIR_LUT_WORDS long.
+void create_tmds_lut_pairs(uint32_t *pair_lut)
+{
+    static struct pair_triple_t triples[32][TMDS_PAIR_SUMS];
+    for(int color=0; color<32; color++)
+        pair_triples((uint8_t)color, triples[color]);
+    for(int c0=0; c0<32; c0++)
+    {
+        for(int c1=0; c1<32; c1++)
+        {
+            const struct pair_triple_t *first = NULL, *second = NULL;
+            int error = 0, peak = 0;
+            // Pixels that balance on their own first
+            for(int k=0; k<TMDS_PAIR_SUMS; k++)
+            {
+                int d = (k&1) ? (k+1)/2 : -k/2;
+                const struct pair_triple_t *t0 = &triples[c0][d+TMDS_PAIR_SUMS/2];
+                const struct pair_triple_t *t1 = &triples[c1][-d+TMDS_PAIR_SUMS/2];
+                if(d+TMDS_PAIR_SUMS/2<0 || d+TMDS_PAIR_SUMS/2>=TMDS_PAIR_SUMS || -d+TMDS_PAIR_SUMS/2<0 ||
+                    -d+TMDS_PAIR_SUMS/2>=TMDS_PAIR_SUMS || !t0->valid || !t1->valid)
+                    continue;
+                int p = t0->peak;
+                for(int s=0; s<3; s++)
+                    p = abs(2*d+t1->prefix[s])>p ? abs(2*d+t1->prefix[s]) : p;
+                if(!first || t0->error+t1->error<error || (t0->error+t1->error==error && p<peak))
+                {
+                    first = t0;
+                    second = t1;
+                    error = t0->error+t1->error;
+                    peak = p;
+                }
+            }
+            // pair_triples() always finds some, check_tmds_lut_pairs() checks that they add up
+            uint32_t index = (((uint32_t)c0<<5)|(uint32_t)c1)<<1;
+            pair_lut[index] = first ? first->symbols : 0;
+            pair_lut[index+1] = second ? second->symbols : 0;
+        }
+    }
+
+    return;
+}
+
+// Checks a LUT from create_tmds_lut_pairs(): every entry has to add up to a disparity of 0, and every symbol has to
+// decode to a value with the color of its pixel in its top 5 bits. Returns the number of bad entries, and the entries
+// that don't send depth_convert()'s values and the highest running disparity within an entry in nudged and peak.
+int check_tmds_lut_pairs(const uint32_t *pair_lut, int *nudged, int *peak)
+{
+    int bad = 0;
+    *nudged = 0;
+    *peak = 0;
+    for(int c0=0; c0<32; c0++)
+    {
+        for(int c1=0; c1<32; c1++)
+        {
+            const uint32_t *entry = pair_lut+((((uint32_t)c0<<5)|(uint32_t)c1)<<1);
+            int sum = 0;
+            bool ok = !(entry[0]>>30) && !(entry[1]>>30), exact = true;
+            for(int s=0; s<6; s++)
+            {
+                uint16_t symbol = (uint16_t)((entry[s/3]>>(10*(s%3)))&0x3ff);
+                uint8_t color = (uint8_t)(s<3 ? c0 : c1);
+                // DVI decode: bit 9 inverts bits 0-7, bit 8 picks XOR or XNOR
+                uint8_t q = (uint8_t)((symbol&0xff)^((symbol&0x200) ? 0xff : 0x00)), value = q&1;
+                for(int i=1; i<8; i++)
+                    value |= (uint8_t)((((q>>i)^(q>>(i-1))^((symbol&0x100) ? 0 : 1))&1)<<i);
+                ok = ok && (value>>3)==color;
+                exact = exact && value==depth_convert(color);
+                sum += symbol_balance(symbol);
+                *peak = abs(sum)>*peak ? abs(sum) : *peak;
+            }
+            if(!ok || sum)
+                bad++;
+            if(!exact)
+                (*nudged)++;
+        }
+    }
+    return bad;
+}
 
 // Frees the allocated buffers before the program exits to prevent bad stuff from happening.
 void free_sync_buffers(struct sync_buffer_t *sync_buffer)
@@ -169,7 +526,7 @@ void allocate_sync_buffer(uint16_t **buffer)
 
 void allocate_sync_buffer_32(uint32_t **buffer)
 {
-	*buffer = (uint32_t *)malloc((((H_TOTAL-H_ACTIVE)*10)/32)*sizeof(uint32_t)); // Whoops! Initially forgot to put the multiplication factor there.
+	*buffer = (uint32_t *)malloc(PACKED_WORDS(H_TOTAL-H_ACTIVE)*sizeof(uint32_t)); // Whoops! Initially forgot to put the multiplication factor there.
 
 	return;
 }
@@ -187,206 +544,106 @@ void allocate_sync_buffer_32(uint32_t **buffer)
 // Line 501 active start interrupt: prepare exit vsync buffer
 // Line 1 hblank start interrupt: reconfigure sync transmit as active video transmit again
 
-// Creates 2 static data buffers: one for hsync, one for vsync.
-// Vsync buffer does not include a video data period preamble or guard band
-// They have null data during the data island periods.
-// Since there will be only one output resolution, this uses global defines.
-void create_sync_buffers()
+// Fills one blanking line (front porch, hsync pulse, back porch, video preamble and guard band) for all 3 channels.
+// Each channel buffer has to be timing->front+timing->pulse+timing->back long.
+// Format, starting in hblank:
+// Normal sync data for at least 4 pixel clocks
+// Preamble for 8 pixel clocks (TMDS channel 1, channel 2): (data island here)
+// Data island: 0b01, 0b01; Video period: 0b01, 0b00
+// Guard band for 2 pixel clocks (channel 0, 1, 2): (data island here)
+// Video: 0b1011001100, 0b0100110011, 0b1011001100; Data: n/a, 0b0100110011, 0b0100110011
+// Data island period: 32 clocks per InfoFrame/packet, starting with the hsync pulse
+// Guard band for 2 pixel clocks (data island exit)
+// Normal sync data for at least 4 pixel clocks
+// Preamble for 8 pixel clocks (video period here)
+// Guard band for 2 pixel clocks (video period here)
+// Active video data (not included in sync buffers)
+// Vsync changes at the start of the hsync pulse: it goes low there on the vblank_en line and high on vblank_ex.
+// Islands is how many packets go into the data island, encoded with data_island_encode() (see src/data_island.h.)
+void fill_blank_line_packets(uint16_t *ch0, uint16_t *ch1, uint16_t *ch2, const struct blank_timing_t *timing, int variant,
+	const struct data_island_t *packets, int islands)
 {
-	struct sync_buffer_t *sync_buffer = (struct sync_buffer_t *)malloc(sizeof(struct sync_buffer_t));
-
-	allocate_sync_buffer(&(sync_buffer->hblank_ch0));
-	allocate_sync_buffer(&(sync_buffer->hblank_ch1));
-	allocate_sync_buffer(&(sync_buffer->hblank_ch2));
-
-	allocate_sync_buffer(&(sync_buffer->vblank_en_ch0));
-	allocate_sync_buffer(&(sync_buffer->vblank_en_ch1));
-	allocate_sync_buffer(&(sync_buffer->vblank_en_ch2));
-
-	allocate_sync_buffer(&(sync_buffer->vblank_syn_ch0));
-	allocate_sync_buffer(&(sync_buffer->vblank_syn_ch1));
-	allocate_sync_buffer(&(sync_buffer->vblank_syn_ch2));
-
-	allocate_sync_buffer(&(sync_buffer->vblank_ex_ch0));
-	allocate_sync_buffer(&(sync_buffer->vblank_ex_ch1));
-	allocate_sync_buffer(&(sync_buffer->vblank_ex_ch2));
-	// Format, starting in hblank:
-	// Normal sync data for at least 4 pixel clocks
-	// Preamble for 8 pixel clocks (TMDS channel 1, channel 2): (data island here)
-	// Data island: 0b01, 0b01; Video period: 0b01, 0b00
-	// Guard band for 2 pixel clocks (channel 0, 1, 2): (data island here)
-	// Video: 0b1011001100, 0b0100110011, 0b1011001100; Data: n/a, 0b0100110011, 0b0100110011
-	// Data island period: 64 clocks total, 32 per InfoFrame/packet
-	// Guard band for 2 pixel clocks (data island exit)
-	// Normal sync data for at least 4 pixel clocks
-	// Preamble for 8 pixel clocks (video period here)
-	// Guard band for 2 pixel clocks (video period here)
-	// Active video data (not included in sync buffers)
-	int data_pad = H_FRONT - 10;
-	int video_pad = H_BACK - 12; // Data island has 2 guardbands, so we subtract 2 guardbands total (2nd data island one and video data one)
-	int j = 0;
-	for(int i=0; i<data_pad; i++)
+	// vsync level (active low) before and after the start of the hsync pulse
+	const int vsync_before[] = {1, 1, 0, 0};
+	const int vsync_after[] = {1, 0, 0, 1};
+	int blank = timing->front+timing->pulse+timing->back;
+	int island_start = timing->front, island_end = timing->front+32*islands;
+	for(int i=0; i<blank; i++)
 	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3]; // Since signals are active low, during this period they're both high
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[0]; // Channels 1 and 2 are to be kept low
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[3]; // The falling edge of vsync comes later
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[0]; // Program throws a segmentation fault here because it accesses the wrong address, wtf???
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1]; // Bit 1 is vsync, so it is to be kept low during this period
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[1]; // The rising edge of vsync comes later
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
-	}
-	for(int i=0; i<8; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3];
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[1];
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[1];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[3]; // Not yet
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[1];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[1];
-
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[1]; // Not yet
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[1];
-	}
-	for(int i=0; i<2; i++)
-	{
-		// Channel 0: transmits hsync and vsync terc4 encoded with top 2 bits set
-		// Channels 1 and 2: transmit guardband
-		sync_buffer->hblank_ch0[j] = terc4_table[15];
-		sync_buffer->hblank_ch1[j] = guardband_states[1]; //0b0100110011
-		sync_buffer->hblank_ch2[j] = guardband_states[1];
-
-		sync_buffer->vblank_en_ch0[j] = terc4_table[15];
-		sync_buffer->vblank_en_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_en_ch2[j] = guardband_states[1];
-
-		sync_buffer->vblank_syn_ch0[j] = terc4_table[13]; // vsync is still active, so transmit 0b1101
-		sync_buffer->vblank_syn_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_syn_ch2[j] = guardband_states[1];
-
-		sync_buffer->vblank_ex_ch0[j] = terc4_table[13];
-		sync_buffer->vblank_ex_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = guardband_states[1];
-	}
-	for(int i=0; i<H_PULSE; i++)
-	{
-		// Here is where the vsync pulse is allowed to transition (can't remember if it's before or after the hsync pulse though)
-		// Channel 0 transmits sync signals terc4 encoded either with bit 3 set or reset, bit 2 is reset for null header
-		// Bit 3 reset: 2 and 0, bit 3 set: 10 and 8 (going with bit set first)
-		sync_buffer->hblank_ch0[j] = terc4_table[10]; //0b1010
-		sync_buffer->hblank_ch1[j] = terc4_table[8]; // Transmit null packets
-		sync_buffer->hblank_ch2[j] = terc4_table[8];
-
-		sync_buffer->vblank_en_ch0[j] = terc4_table[8]; //0b1000
-		sync_buffer->vblank_en_ch1[j] = terc4_table[8];
-		sync_buffer->vblank_en_ch2[j] = terc4_table[8];
-
-		sync_buffer->vblank_syn_ch0[j] = terc4_table[8]; //0b1000
-		sync_buffer->vblank_syn_ch1[j] = terc4_table[8];
-		sync_buffer->vblank_syn_ch2[j] = terc4_table[8];
-
-		sync_buffer->vblank_ex_ch0[j] = terc4_table[10]; //0b1010
-		sync_buffer->vblank_ex_ch1[j] = terc4_table[8];
-		sync_buffer->vblank_ex_ch2[j++] = terc4_table[8];
-	}
-	for(int i=0; i<2; i++)
-	{
-		sync_buffer->hblank_ch0[j] = terc4_table[15];
-		sync_buffer->hblank_ch1[j] = guardband_states[0]; //0b0100110011
-		sync_buffer->hblank_ch2[j] = guardband_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = terc4_table[13]; //vsync is now active, so transmit 0b1101
-		sync_buffer->vblank_en_ch1[j] = guardband_states[0];
-		sync_buffer->vblank_en_ch2[j] = guardband_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = terc4_table[13]; //vsync is still active
-		sync_buffer->vblank_syn_ch1[j] = guardband_states[0];
-		sync_buffer->vblank_syn_ch2[j] = guardband_states[0];
-
-		sync_buffer->vblank_ex_ch0[j] = terc4_table[15]; //vsync is no longer active
-		sync_buffer->vblank_ex_ch1[j] = guardband_states[0];
-		sync_buffer->vblank_ex_ch2[j++] = guardband_states[0];
-	}
-	for(int i=0; i<video_pad; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3]; // Since signals are active low, during this period they're both high
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[0]; // Channels 1 and 2 are to be kept low
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[1]; // vsync is low
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1]; // vsync is low
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[3]; // vsync is high
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
+		int hsync = (i>=timing->front && i<timing->front+timing->pulse) ? 0 : 1;
+		int vsync = i<timing->front ? vsync_before[variant] : vsync_after[variant];
+		int sync = (vsync<<1)|hsync;
+		// Normal sync data, channels 1 and 2 are kept low
+		ch0[i] = sync_ctl_states[sync];
+		ch1[i] = sync_ctl_states[0];
+		ch2[i] = sync_ctl_states[0];
+		if(i>=blank-2)
+		{
+			// Video guard band
+			ch0[i] = guardband_states[0];
+			ch1[i] = guardband_states[1];
+			ch2[i] = guardband_states[0];
+		}
+		else if(i>=blank-10)
+		{
+			// Video preamble
+			ch1[i] = sync_ctl_states[1];
+		}
+		else if(islands && i>=island_start-10 && i<island_start-2)
+		{
+			// Data island preamble
+			ch1[i] = sync_ctl_states[1];
+			ch2[i] = sync_ctl_states[1];
+		}
+		else if(islands && ((i>=island_start-2 && i<island_start) || (i>=island_end && i<island_end+2)))
+		{
+			// Data island guard bands: channel 0 transmits hsync and vsync TERC4 encoded with the top 2 bits set
+			ch0[i] = terc4_table[0x0c|sync];
+			ch1[i] = guardband_states[1];
+			ch2[i] = guardband_states[1];
+		}
+		else if(i>=island_start && i<island_end)
+		{
+			// Channel 0: sync bits added to the header bit, and bit 3 on all but the first pixel of the island
+			const struct data_island_t *packet = packets+(i-island_start)/DATA_ISLAND_PIXELS;
+			int pixel = (i-island_start)%DATA_ISLAND_PIXELS;
+			int flags = sync|(i==island_start ? 0 : DATA_ISLAND_NOT_FIRST);
+			ch0[i] = terc4_table[packet->nibble[0][pixel]|flags];
+			ch1[i] = terc4_table[packet->nibble[1][pixel]];
+			ch2[i] = terc4_table[packet->nibble[2][pixel]];
+		}
 	}
-	for(int i=0; i<8; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3];
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[1];
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
 
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[3];
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
-	}
-	for(int i=0; i<2; i++)
-	{
-		sync_buffer->hblank_ch0[j] = guardband_states[0]; //0b1011001100
-		sync_buffer->hblank_ch1[j] = guardband_states[1]; 
-		sync_buffer->hblank_ch2[j] = guardband_states[0];
+	return;
+}
 
-		sync_buffer->vblank_en_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_en_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_en_ch2[j] = guardband_states[0];
+// Same with null packets in every island.
+void fill_blank_line(uint16_t *ch0, uint16_t *ch1, uint16_t *ch2, const struct blank_timing_t *timing, int variant, int islands)
+{
+	struct data_packet_t null_packet;
+	struct data_island_t packets[MAX_ISLANDS];
+	data_packet_null(&null_packet);
+	for(int i=0; i<islands && i<MAX_ISLANDS; i++)
+		data_island_encode(&null_packet, &packets[i]);
+	fill_blank_line_packets(ch0, ch1, ch2, timing, variant, packets, islands);
 
-		sync_buffer->vblank_syn_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_syn_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_syn_ch2[j] = guardband_states[0];
+	return;
+}
 
-		sync_buffer->vblank_ex_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_ex_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = guardband_states[0];
-	}
-	char buffer_name[] = "nm";
-	create_sync_files(buffer_name, sync_buffer);
+// Fills the 4 blanking variants of a sync buffer set.
+void fill_sync_buffers(struct sync_buffer_t *sync_buffer, int islands)
+{
+	struct blank_timing_t timing = {H_FRONT, H_PULSE, H_BACK};
+	fill_blank_line(sync_buffer->hblank_ch0, sync_buffer->hblank_ch1, sync_buffer->hblank_ch2, &timing, BLANK_HBLANK, islands);
+	fill_blank_line(sync_buffer->vblank_en_ch0, sync_buffer->vblank_en_ch1, sync_buffer->vblank_en_ch2, &timing, BLANK_VBLANK_EN, islands);
+	fill_blank_line(sync_buffer->vblank_syn_ch0, sync_buffer->vblank_syn_ch1, sync_buffer->vblank_syn_ch2, &timing, BLANK_VBLANK_SYN, islands);
+	fill_blank_line(sync_buffer->vblank_ex_ch0, sync_buffer->vblank_ex_ch1, sync_buffer->vblank_ex_ch2, &timing, BLANK_VBLANK_EX, islands);
 
 	return;
 }
 
-// Creates sync buffers without the data island period.
-// Basically, just 190 pixel clocks' worth of normal sync data before the video guardband.
-// No data island preamble, no data island guardbands, just the video preamble and guard band.
-void create_sync_buffers_nodat()
+void allocate_sync_buffers(struct sync_buffer_t *sync_buffer)
 {
-	struct sync_buffer_t *sync_buffer = (struct sync_buffer_t *)malloc(sizeof(struct sync_buffer_t));
-
 	allocate_sync_buffer(&(sync_buffer->hblank_ch0));
 	allocate_sync_buffer(&(sync_buffer->hblank_ch1));
 	allocate_sync_buffer(&(sync_buffer->hblank_ch2));
@@ -403,82 +660,32 @@ void create_sync_buffers_nodat()
 	allocate_sync_buffer(&(sync_buffer->vblank_ex_ch1));
 	allocate_sync_buffer(&(sync_buffer->vblank_ex_ch2));
 
-	int video_pad = (H_TOTAL - H_ACTIVE) - 10; // Subtract the 10 pixels used for video preamble and guardband
-	int sync_pad = ((H_TOTAL - H_ACTIVE) - H_BACK) - H_PULSE;
-	int j = 0;
-	for(int i=0; i<sync_pad; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3];
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[0];
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[3];
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
-	}
-	for(int i=0; i<H_PULSE; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[2]; 
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[0];
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[0];
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[0]; 
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[2];
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[0];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
-	}
-	// Only these last two remain the same
-	for(int i=0; i<8; i++)
-	{
-		sync_buffer->hblank_ch0[j] = sync_ctl_states[3];
-		sync_buffer->hblank_ch1[j] = sync_ctl_states[1];
-		sync_buffer->hblank_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_en_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_en_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_en_ch2[j] = sync_ctl_states[0];
-
-		sync_buffer->vblank_syn_ch0[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_syn_ch2[j] = sync_ctl_states[0];
+	return;
+}
 
-		sync_buffer->vblank_ex_ch0[j] = sync_ctl_states[3];
-		sync_buffer->vblank_ex_ch1[j] = sync_ctl_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = sync_ctl_states[0];
-	}
-	for(int i=0; i<2; i++)
-	{
-		sync_buffer->hblank_ch0[j] = guardband_states[0];
-		sync_buffer->hblank_ch1[j] = guardband_states[1]; 
-		sync_buffer->hblank_ch2[j] = guardband_states[0];
+// Creates 2 static data buffers: one for hsync, one for vsync.
+// Vsync buffer does not include a video data period preamble or guard band
+// They have null data during the data island periods.
+// Since there will be only one output resolution, this uses global defines.
+void create_sync_buffers()
+{
+	struct sync_buffer_t *sync_buffer = (struct sync_buffer_t *)malloc(sizeof(struct sync_buffer_t));
+	allocate_sync_buffers(sync_buffer);
+	fill_sync_buffers(sync_buffer, 2);
 
-		sync_buffer->vblank_en_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_en_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_en_ch2[j] = guardband_states[0];
+	char buffer_name[] = "nm";
+	create_sync_files(buffer_name, sync_buffer);
 
-		sync_buffer->vblank_syn_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_syn_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_syn_ch2[j] = guardband_states[0];
+	return;
+}
 
-		sync_buffer->vblank_ex_ch0[j] = guardband_states[0];
-		sync_buffer->vblank_ex_ch1[j] = guardband_states[1];
-		sync_buffer->vblank_ex_ch2[j++] = guardband_states[0];
-	}
+// Creates sync buffers without the data island period.
+// Basically, just 182 pixel clocks' worth of normal sync data before the video preamble and guard band.
+void create_sync_buffers_nodat()
+{
+	struct sync_buffer_t *sync_buffer = (struct sync_buffer_t *)malloc(sizeof(struct sync_buffer_t));
+	allocate_sync_buffers(sync_buffer);
+	fill_sync_buffers(sync_buffer, 0);
 
 	char buffer_name[] = "nd";
 	create_sync_files(buffer_name, sync_buffer);
@@ -522,12 +729,125 @@ void pack_buffer_single(uint16_t *in_buffer, uint32_t *out_buffer, int buffer_si
 		temp_word = ((uint32_t)(in_buffer[in_pos++]))>>8;
 		temp_word |= ((uint32_t)(in_buffer[in_pos++]))<<2;
 		temp_word |= ((uint32_t)(in_buffer[in_pos++]))<<12;
-		temp_word |= (((uint32_t)(in_buffer[in_pos]))&0x3ff)<<22;
+		temp_word |= (((uint32_t)(in_buffer[in_pos++]))&0x3ff)<<22;
 		out_buffer[out_pos++] = temp_word;
 	}
 	return;
 }
 
+// Interleaves a 10-bit TMDS symbol into 20 bits of P/N pairs for 'out pins, 2' (src/tmds_output_pair.pio.)
+// Bit 2n is the positive leg and bit 2n+1 the negative leg of symbol bit n, so the symbol still goes out LSB first.
+// Format = nnnnnnnn-nnnnNPNP-NPNPNPNP-NPNPNPNP (little endian)
+uint32_t tmds_interleave(uint16_t tmds_data)
+{
+	uint32_t out_word = 0;
+	for(int i=0; i<10; i++)
+	{
+		uint32_t bit = (tmds_data>>i)&0x01;
+		out_word |= (bit|((bit^0x01)<<1))<<(2*i);
+	}
+	return out_word;
+}
+
+// Same as pack_buffer_single(), but for interleaved symbols. 8 symbols (160 bits) fit into 5 32-bit words.
+// Buffer size is in multiples of 8 symbols.
+void pack_buffer_interleaved(uint16_t *in_buffer, uint32_t *out_buffer, int buffer_size)
+{
+	uint64_t acc = 0;
+	int fill = 0, out_pos = 0;
+	for(int i=0; i<buffer_size*8; i++)
+	{
+		acc |= ((uint64_t)tmds_interleave(in_buffer[i]))<<fill;
+		fill += 20;
+		if(fill>=32)
+		{
+			out_buffer[out_pos++] = (uint32_t)acc;
+			acc >>= 32;
+			fill -= 32;
+		}
+	}
+	return;
+}
+
+// Packs symbols in whichever format main() is writing. Symbols has to be a multiple of 16.
+// Not for the 3-lane format, which needs all 3 lanes at once (tmds_3lane_pack().)
+// Returns the number of words written.
+int pack_symbols(uint16_t *in_buffer, uint32_t *out_buffer, int symbols)
+{
+	if(output_format==TMDS_FORMAT_INTERLEAVED)
+		pack_buffer_interleaved(in_buffer, out_buffer, symbols/8);
+	else
+		pack_buffer_single(in_buffer, out_buffer, symbols/16);
+	return PACKED_WORDS(symbols);
+}
+
+// Opens an output file, adding "il_" or "3l_" to the name for the other formats so they can all sit in the same folder.
+FILE *open_output(const char *name)
+{
+	const char *prefix[] = {"", "il_", "3l_"};
+	char file_name[64];
+	snprintf(file_name, sizeof(file_name), "%s%s", prefix[output_format], name);
+	return fopen(file_name, "wb");
+}
+
+// Writes a LUT from create_tmds_lut() (TMDS_LUT_WORDS) in the current output format.
+void write_lut(const char *name, const uint32_t *tmds_lut)
+{
+	int words = output_format==TMDS_FORMAT_3LANE ? TMDS_3LANE_LUT_WORDS : TMDS_LUT_WORDS;
+	uint32_t *out = (uint32_t *)malloc(words*sizeof(uint32_t));
+	if(output_format==TMDS_FORMAT_3LANE)
+		create_tmds_lut_3lane(out, tmds_lut);
+	else
+	{
+		memcpy(out, tmds_lut, TMDS_LUT_WORDS*sizeof(uint32_t));
+		if(output_format==TMDS_FORMAT_INTERLEAVED)
+			interleave_tmds_lut(out);
+	}
+	FILE *lut_file = open_output(name);
+	fwrite(out, 4, words, lut_file);
+	fclose(lut_file);
+	free(out);
+
+	return;
+}
+
+// Memory and DMA cost of the interleaved and 3-lane formats against the single-ended one.
+void print_format_report()
+{
+	int blank = H_TOTAL-H_ACTIVE;
+	// LUT entries keep 2 words for the first two, since the disparity fits into the spare bits. 3-lane entries are 8.
+	int lut_bytes = TMDS_LUT_WORDS*4, lut_3l = TMDS_3LANE_LUT_WORDS*4;
+	// 2 sets (nm, nd) of 12 buffers, 4 data island buffers, 2 line buffers of 3 lanes, 2 solid lines.
+	// 3-lane: 2 sets of 4 buffers and the 2 vblank control words, 2 data island buffers, everything for all lanes.
+	int sync_single = 2*12*((blank*10)/32)*4, sync_il = 2*12*((blank*20)/32)*4, sync_3l = 2*4*TMDS_3LANE_WORDS(blank)*4+16;
+	int island_single = 4*((32*10)/32)*4, island_il = 4*((32*20)/32)*4, island_3l = 2*TMDS_3LANE_WORDS(32)*4;
+	int line_single = 2*3*((H_ACTIVE*10)/32)*4, line_il = 2*3*((H_ACTIVE*20)/32)*4, line_3l = 2*TMDS_3LANE_WORDS(H_ACTIVE)*4;
+	int solid_single = 2*((H_ACTIVE*10)/32)*4, solid_il = 2*((H_ACTIVE*20)/32)*4, solid_3l = 2*TMDS_3LANE_WORDS(H_ACTIVE)*4;
+	double pixel_clock = 29.4e6;
+	double words_single = pixel_clock*3*10/32, words_il = pixel_clock*3*20/32;
+	double words_3l = pixel_clock*TMDS_3LANE_SYMBOL_WORDS;
+
+	printf("                          single-ended  interleaved   3-lane\n");
+	printf("TMDS LUT                  %8d B    %8d B    %8d B\n", lut_bytes, lut_bytes, lut_3l);
+	printf("Sync buffers (nm+nd)      %8d B    %8d B    %8d B\n", sync_single, sync_il, sync_3l);
+	printf("Data island buffers       %8d B    %8d B    %8d B\n", island_single, island_il, island_3l);
+	printf("Line buffers (2x3 lanes)  %8d B    %8d B    %8d B\n", line_single, line_il, line_3l);
+	printf("Solid lines               %8d B    %8d B    %8d B\n", solid_single, solid_il, solid_3l);
+	printf("Total                     %8d B    %8d B    %8d B\n", lut_bytes+sync_single+island_single+line_single+solid_single,
+		lut_bytes+sync_il+island_il+line_il+solid_il, lut_3l+sync_3l+island_3l+line_3l+solid_3l);
+	printf("DMA to PIO, 3 lanes       %7.2f MB/s  %7.2f MB/s  %7.2f MB/s\n", words_single*4/1e6, words_il*4/1e6,
+		words_3l*4/1e6);
+	printf("DMA transfers per clock   %7.1f %%     %7.1f %%     %7.1f %%\n",
+		100.0*words_single/(pixel_clock*10), 100.0*words_il/(pixel_clock*10), 100.0*words_3l/(pixel_clock*10));
+	printf("DMA channels (data+ctrl)  %8d      %8d      %8d\n", 6, 6, 2);
+	printf("State machines            %8d      %8d      %8d\n", 3, 3, 1);
+	printf("Encode stores per line    %8d      %8d      %8d\n", 3*((H_ACTIVE*10)/32), 3*((H_ACTIVE*20)/32),
+		TMDS_3LANE_WORDS(H_ACTIVE));
+	printf("PIO instructions          %8d      %8d      %8d\n", 2, 1, 1);
+
+	return;
+}
+
 // Creates the files for the hblank stuff.
 // Copying and pasting is the bane of my existance but at the moment I don't know a better way to do this.
 // Also packs the data from the sync buffers. 16 10-bit TMDS words fit into 5 32-bit words.
@@ -535,6 +855,11 @@ void pack_buffer_single(uint16_t *in_buffer, uint32_t *out_buffer, int buffer_si
 // All variations take up a total of 2880 bytes in RAM.
 void create_sync_files(char *name, struct sync_buffer_t *sync_buffer)
 {
+	if(output_format==TMDS_FORMAT_3LANE)
+	{
+		create_sync_files_3lane(name, sync_buffer);
+		return;
+	}
 	struct sync_buffer_32_t *pack_buffer = (struct sync_buffer_32_t *)malloc(sizeof(struct sync_buffer_32_t));
 
 	allocate_sync_buffer_32(&(pack_buffer->hblank_ch0));
@@ -554,88 +879,133 @@ void create_sync_files(char *name, struct sync_buffer_t *sync_buffer)
 	allocate_sync_buffer_32(&(pack_buffer->vblank_ex_ch2));
 
 	// 16 TMDS words fit into 5 32-bit words. There are 192 pixels during hblank in total, so the buffers are 60 words each.
-	pack_buffer_single(sync_buffer->hblank_ch0, pack_buffer->hblank_ch0, 12);
-	pack_buffer_single(sync_buffer->hblank_ch1, pack_buffer->hblank_ch1, 12);
-	pack_buffer_single(sync_buffer->hblank_ch1, pack_buffer->hblank_ch2, 12);
+	// (Or 120 words each when interleaved.)
+	int sync_words = PACKED_WORDS(H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->hblank_ch0, pack_buffer->hblank_ch0, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->hblank_ch1, pack_buffer->hblank_ch1, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->hblank_ch2, pack_buffer->hblank_ch2, H_TOTAL-H_ACTIVE);
 
-	pack_buffer_single(sync_buffer->vblank_en_ch0, pack_buffer->vblank_en_ch0, 12);
-	pack_buffer_single(sync_buffer->vblank_en_ch1, pack_buffer->vblank_en_ch1, 12);
-	pack_buffer_single(sync_buffer->vblank_en_ch2, pack_buffer->vblank_en_ch2, 12);
+	pack_symbols(sync_buffer->vblank_en_ch0, pack_buffer->vblank_en_ch0, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_en_ch1, pack_buffer->vblank_en_ch1, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_en_ch2, pack_buffer->vblank_en_ch2, H_TOTAL-H_ACTIVE);
 
-	pack_buffer_single(sync_buffer->vblank_syn_ch0, pack_buffer->vblank_syn_ch0, 12);
-	pack_buffer_single(sync_buffer->vblank_syn_ch1, pack_buffer->vblank_syn_ch1, 12);
-	pack_buffer_single(sync_buffer->vblank_syn_ch2, pack_buffer->vblank_syn_ch2, 12);
+	pack_symbols(sync_buffer->vblank_syn_ch0, pack_buffer->vblank_syn_ch0, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_syn_ch1, pack_buffer->vblank_syn_ch1, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_syn_ch2, pack_buffer->vblank_syn_ch2, H_TOTAL-H_ACTIVE);
 
-	pack_buffer_single(sync_buffer->vblank_ex_ch0, pack_buffer->vblank_ex_ch0, 12);
-	pack_buffer_single(sync_buffer->vblank_ex_ch1, pack_buffer->vblank_ex_ch1, 12);
-	pack_buffer_single(sync_buffer->vblank_ex_ch2, pack_buffer->vblank_ex_ch2, 12);
+	pack_symbols(sync_buffer->vblank_ex_ch0, pack_buffer->vblank_ex_ch0, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_ex_ch1, pack_buffer->vblank_ex_ch1, H_TOTAL-H_ACTIVE);
+	pack_symbols(sync_buffer->vblank_ex_ch2, pack_buffer->vblank_ex_ch2, H_TOTAL-H_ACTIVE);
 
     free_sync_buffers(sync_buffer); // Frees the struct too. Works properly.
 
     char file_name[32];
 	
 	sprintf(file_name, "hblank_ch0_%s.bin", name);
-	FILE *hblank_ch0 = fopen(file_name, "wb");
-	fwrite(pack_buffer->hblank_ch0, 4, 60, hblank_ch0);
+	FILE *hblank_ch0 = open_output(file_name);
+	fwrite(pack_buffer->hblank_ch0, 4, sync_words, hblank_ch0);
 	fclose(hblank_ch0);
 
 	sprintf(file_name, "hblank_ch1_%s.bin", name);
-	FILE *hblank_ch1 = fopen(file_name, "wb");
-	fwrite(pack_buffer->hblank_ch1, 4, 60, hblank_ch1);
+	FILE *hblank_ch1 = open_output(file_name);
+	fwrite(pack_buffer->hblank_ch1, 4, sync_words, hblank_ch1);
 	fclose(hblank_ch1);
 
 	sprintf(file_name, "hblank_ch2_%s.bin", name);
-	FILE *hblank_ch2 = fopen(file_name, "wb");
-	fwrite(pack_buffer->hblank_ch2, 4, 60, hblank_ch2);
+	FILE *hblank_ch2 = open_output(file_name);
+	fwrite(pack_buffer->hblank_ch2, 4, sync_words, hblank_ch2);
 	fclose(hblank_ch2);
 	// Enter
 	sprintf(file_name, "vblank_en_ch0_%s.bin", name);
-	FILE *vblank_en_ch0 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_en_ch0, 4, 60, vblank_en_ch0);
+	FILE *vblank_en_ch0 = open_output(file_name);
+	fwrite(pack_buffer->vblank_en_ch0, 4, sync_words, vblank_en_ch0);
 	fclose(vblank_en_ch0);
 
 	sprintf(file_name, "vblank_en_ch1_%s.bin", name);
-	FILE *vblank_en_ch1 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_en_ch1, 4, 60, vblank_en_ch1);
+	FILE *vblank_en_ch1 = open_output(file_name);
+	fwrite(pack_buffer->vblank_en_ch1, 4, sync_words, vblank_en_ch1);
 	fclose(vblank_en_ch1);
 
 	sprintf(file_name, "vblank_en_ch2_%s.bin", name);
-	FILE *vblank_en_ch2 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_en_ch2, 4, 60, vblank_en_ch2);
+	FILE *vblank_en_ch2 = open_output(file_name);
+	fwrite(pack_buffer->vblank_en_ch2, 4, sync_words, vblank_en_ch2);
 	fclose(vblank_en_ch2);
 	// Sync
 	sprintf(file_name, "vblank_syn_ch0_%s.bin", name);
-	FILE *vblank_syn_ch0 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_syn_ch0, 4, 60, vblank_syn_ch0);
+	FILE *vblank_syn_ch0 = open_output(file_name);
+	fwrite(pack_buffer->vblank_syn_ch0, 4, sync_words, vblank_syn_ch0);
 	fclose(vblank_syn_ch0);
 
 	sprintf(file_name, "vblank_syn_ch1_%s.bin", name);
-	FILE *vblank_syn_ch1 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_syn_ch1, 4, 60, vblank_syn_ch1);
+	FILE *vblank_syn_ch1 = open_output(file_name);
+	fwrite(pack_buffer->vblank_syn_ch1, 4, sync_words, vblank_syn_ch1);
 	fclose(vblank_syn_ch1);
 
 	sprintf(file_name, "vblank_syn_ch2_%s.bin", name);
-	FILE *vblank_syn_ch2 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_syn_ch2, 4, 60, vblank_syn_ch2);
+	FILE *vblank_syn_ch2 = open_output(file_name);
+	fwrite(pack_buffer->vblank_syn_ch2, 4, sync_words, vblank_syn_ch2);
 	fclose(vblank_syn_ch2);
 	// Exit
 	sprintf(file_name, "vblank_ex_ch0_%s.bin", name);
-	FILE *vblank_ex_ch0 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_ex_ch0, 4, 60, vblank_ex_ch0);
+	FILE *vblank_ex_ch0 = open_output(file_name);
+	fwrite(pack_buffer->vblank_ex_ch0, 4, sync_words, vblank_ex_ch0);
 	fclose(vblank_ex_ch0);
 
 	sprintf(file_name, "vblank_ex_ch1_%s.bin", name);
-	FILE *vblank_ex_ch1 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_ex_ch1, 4, 60, vblank_ex_ch1);
+	FILE *vblank_ex_ch1 = open_output(file_name);
+	fwrite(pack_buffer->vblank_ex_ch1, 4, sync_words, vblank_ex_ch1);
 	fclose(vblank_ex_ch1);
 
 	sprintf(file_name, "vblank_ex_ch2_%s.bin", name);
-	FILE *vblank_ex_ch2 = fopen(file_name, "wb");
-	fwrite(pack_buffer->vblank_ex_ch2, 4, 60, vblank_ex_ch2);
+	FILE *vblank_ex_ch2 = open_output(file_name);
+	fwrite(pack_buffer->vblank_ex_ch2, 4, sync_words, vblank_ex_ch2);
 	fclose(vblank_ex_ch2);
 
 	free_sync_buffers_32(pack_buffer);
-	// Program never gets to this point because only the first array of the sync_buffer_32_t pack_buffer can be freed (hblank_ch0)
+	return;
+}
+
+// Same for the 3-lane format: the 3 channels of each variant go into one file of 2 words per symbol (384 words.)
+void create_sync_files_3lane(char *name, struct sync_buffer_t *sync_buffer)
+{
+	const char *variant_names[4] = {"hblank", "vblank_en", "vblank_syn", "vblank_ex"};
+	uint16_t *variants[4][3] = {
+		{sync_buffer->hblank_ch0, sync_buffer->hblank_ch1, sync_buffer->hblank_ch2},
+		{sync_buffer->vblank_en_ch0, sync_buffer->vblank_en_ch1, sync_buffer->vblank_en_ch2},
+		{sync_buffer->vblank_syn_ch0, sync_buffer->vblank_syn_ch1, sync_buffer->vblank_syn_ch2},
+		{sync_buffer->vblank_ex_ch0, sync_buffer->vblank_ex_ch1, sync_buffer->vblank_ex_ch2}
+	};
+	int sync_words = PACKED_WORDS(H_TOTAL-H_ACTIVE);
+	uint32_t *packed = (uint32_t *)malloc(sync_words*sizeof(uint32_t));
+	char file_name[32];
+	for(int v=0; v<4; v++)
+	{
+		tmds_3lane_pack(variants[v][0], variants[v][1], variants[v][2], packed, H_TOTAL-H_ACTIVE);
+		sprintf(file_name, "%s_%s.bin", variant_names[v], name);
+		FILE *sync_file = open_output(file_name);
+		fwrite(packed, 4, sync_words, sync_file);
+		fclose(sync_file);
+	}
+	free(packed);
+	free_sync_buffers(sync_buffer);
+
+	return;
+}
+
+// Active part of a vblank line for the 3-lane output: control symbols with hsync high, channels 1 and 2 low, as 2 words
+// that repeat. The file has vsync high, then vsync low (the EN and SYN lines.)
+void create_ctl_active_3lane()
+{
+	uint32_t words[2*TMDS_3LANE_SYMBOL_WORDS];
+	for(int vsync=1; vsync>=0; vsync--)
+	{
+		uint16_t ch0 = sync_ctl_states[(vsync<<1)|1], ch12 = sync_ctl_states[0];
+		tmds_3lane_pack(&ch0, &ch12, &ch12, words+(1-vsync)*TMDS_3LANE_SYMBOL_WORDS, 1);
+	}
+	FILE *ctl_file = open_output("ctl_active.bin");
+	fwrite(words, 4, 2*TMDS_3LANE_SYMBOL_WORDS, ctl_file);
+	fclose(ctl_file);
+
 	return;
 }
 
@@ -647,7 +1017,8 @@ uint16_t tmds_xor(uint8_t color_data)
 	uint16_t tmds_word = (this_color&0x01)<<15;
 	this_color = this_color>>1;
 	tmds_word = tmds_word>>1;
-	for(int i=0; i<8; i++)
+	// 7 more bits after bit 0; an 8th pass would push bit 0 out of the bottom byte.
+	for(int i=0; i<7; i++)
 	{
 		//shifts bit 0 of this_color to bit 15 to be XORed with the previous tmds_word bit shifted left by one
 		//so it can be put back, shifted right and XORed again
@@ -666,7 +1037,7 @@ uint16_t tmds_xnor(uint8_t color_data)
 	uint16_t tmds_word = (this_color&0x01)<<15;
 	this_color = this_color>>1;
 	tmds_word = tmds_word>>1;
-	for(int i=0; i<8; i++)
+	for(int i=0; i<7; i++)
 	{
 		tmds_word |= (~(((this_color&0x01)<<15)^((tmds_word&0x4000)<<1)))&0x8000;
 		tmds_word = tmds_word>>1;
@@ -689,7 +1060,7 @@ int ones_count(uint8_t color_data)
 	return ones_cnt;
 }
 
-//disparity is a 4-bit signed integer converted to a 4-bit unsigned integer
+//disparity is the running disparity (ones minus zeros sent so far), see lut_disparity() for how the LUT keeps it
 //Current LUT has 2 words per entry: one for the 3 TMDS words it outputs for the same pixel, and one for the resulting disparity.
 void tmds_calc_disparity(struct tmds_pixel_t *tmds_pixel)
 {
@@ -708,7 +1079,10 @@ void tmds_calc_disparity(struct tmds_pixel_t *tmds_pixel)
 		// If no, XOR
 		tmds_word = tmds_xor(tmds_pixel->color_data);
 	}
-	
+	// The DC balancing below counts the ones of the XOR/XNOR output (q_m bits 0-7 in the DVI spec), not of the input.
+	ones_cnt = ones_count((uint8_t)(tmds_word&0xff));
+	zeros_cnt = 8-ones_cnt;
+
 	// Is the previous disparity equal to 0 or ones equal to zeroes (4)?
 	if(ones_cnt==zeros_cnt || (tmds_pixel->disparity)==0)
 	{
@@ -786,14 +1160,14 @@ void tmds_calc_disparity(struct tmds_pixel_t *tmds_pixel)
 // The LUT is 16*32*2 words long, or 4096 bytes.
 void tmds_pixel_repeat(uint32_t *lut_buf, struct tmds_pixel_t *tmds_pixel)
 {
-	int dispy = tmds_pixel->disparity;
+	uint32_t index = (((tmds_pixel->color_data_5b)<<1)|lut_disparity(tmds_pixel->disparity))&0x3fe;
 	tmds_calc_disparity(tmds_pixel);
-	lut_buf[(((tmds_pixel->color_data_5b)<<1)|((((uint32_t)(dispy+8))&0x0f)<<6))&0x3fe] = (uint32_t)(tmds_pixel->tmds_data);
+	lut_buf[index] = (uint32_t)(tmds_pixel->tmds_data);
 	tmds_calc_disparity(tmds_pixel);
-	lut_buf[(((tmds_pixel->color_data_5b)<<1)|((((uint32_t)(dispy+8))&0x0f)<<6))&0x3fe] |= (uint32_t)((tmds_pixel->tmds_data)<<10);
+	lut_buf[index] |= (uint32_t)((tmds_pixel->tmds_data)<<10);
 	tmds_calc_disparity(tmds_pixel);
-	lut_buf[(((tmds_pixel->color_data_5b)<<1)|((((uint32_t)(dispy+8))&0x0f)<<6))&0x3fe] |= (uint32_t)((tmds_pixel->tmds_data)<<20);
-	lut_buf[((((tmds_pixel->color_data_5b)<<1)|((((uint32_t)(dispy+8))&0x0f)<<6))&0x3fe)+1] = ((uint32_t)((tmds_pixel->disparity)+8))<<6;
+	lut_buf[index] |= (uint32_t)((tmds_pixel->tmds_data)<<20);
+	lut_buf[index+1] = lut_disparity(tmds_pixel->disparity);
 
 	return;
 }
@@ -810,114 +1184,61 @@ uint8_t depth_convert(uint8_t c_in)
 	return c_out;
 }
 
-void create_avi_infoframe()
+// 8-bit color at level/256 brightness, with the same disparity limit as depth_convert().
+uint8_t grid_dim(uint8_t c_in, int level)
 {
-	struct infoframe_header_t *packet_header = (struct infoframe_header_t *)malloc(sizeof(struct infoframe_header_t));
-	struct infoframe_header_t *packet_header_v = (struct infoframe_header_t *)malloc(sizeof(struct infoframe_header_t));
-    struct infoframe_packet_t *info_packet = (struct infoframe_packet_t *)malloc(sizeof(struct infoframe_packet_t));
-
-	packet_header->terc4_r_header = (uint16_t *)malloc(32*sizeof(uint16_t));
-	packet_header->terc4_en_header = (uint32_t *)malloc(10*sizeof(uint32_t));
-	packet_header_v->terc4_r_header = (uint16_t *)malloc(32*sizeof(uint16_t));
-	packet_header_v->terc4_en_header = (uint32_t *)malloc(10*sizeof(uint32_t));
-
-	info_packet->terc4_r_ch1 = (uint16_t *)malloc(32*sizeof(uint16_t));
-	info_packet->terc4_en_ch1 = (uint32_t *)malloc(10*sizeof(uint32_t));
-	info_packet->terc4_r_ch2 = (uint16_t *)malloc(32*sizeof(uint16_t));
-	info_packet->terc4_en_ch2 = (uint32_t *)malloc(10*sizeof(uint32_t));
-	info_packet->packet_data  = (uint8_t *)malloc(31);
-
-	packet_header->packet_type = AVI_PACKET_TYPE;
-	packet_header->version = HDMI_VERSION;
-	packet_header->packet_length = AVI_PACKET_LENGTH;
-	packet_header->header_checksum = AVI_HEADER_CHECKSUM;
-
-	packet_header_v->packet_type = AVI_PACKET_TYPE;
-	packet_header_v->version = HDMI_VERSION;
-	packet_header_v->packet_length = AVI_PACKET_LENGTH;
-	packet_header_v->header_checksum = AVI_HEADER_CHECKSUM;
-
-	info_packet->packet_checksum = 0x02; // VIC
-	for(int i=0; i<31; i++)
+	uint8_t c_out = (uint8_t)((c_in*level)>>8);
+	if(c_out==0xff || c_out==0x00)
 	{
-		info_packet->packet_data[i] = 0;
+		c_out = c_out^0x01;
 	}
-	info_packet->packet_data[3] = 0x02;
+	return c_out;
+}
 
-	uint8_t header_byte = packet_header->packet_type;
-	int j = 0;
-	for(int i=0; i<8; i++)
-	{
-		packet_header->terc4_r_header[j] = terc4_table[((header_byte&0x01)<<2)|sync_masks[1]];
-		packet_header_v->terc4_r_header[j++] = terc4_table[((header_byte&0x01)<<2)|sync_masks[0]];
-		header_byte = header_byte>>1;
-	}
-	header_byte = packet_header->version;
-	for(int i=0; i<8; i++)
+// AVI InfoFrame packet for the data island during the hsync pulse (src/data_island.h does the checksum, BCH and
+// subpacket layout.) Channel 0 carries hsync (low in the pulse) and vsync, so it comes in 2 variants: terc4_hblank_ch0
+// with vsync high and terc4_vsync_ch0 with it low. Channels 1 and 2 are the same for both. The 3-lane format has all
+// 3 channels of each variant in one file (terc4_hblank and terc4_vsync.)
+void create_avi_infoframe()
+{
+	struct data_packet_t avi;
+	struct data_island_t island;
+	uint16_t symbols[4][DATA_ISLAND_PIXELS];
+	uint32_t packed[PACKED_WORDS_MAX(DATA_ISLAND_PIXELS)];
+	const char *names[4] = {"terc4_hblank_ch0.bin", "terc4_vsync_ch0.bin", "terc4_blank_ch1.bin", "terc4_blank_ch2.bin"};
+
+	data_packet_avi(&avi, AVI_VIC);
+	data_island_encode(&avi, &island);
+	for(int i=0; i<DATA_ISLAND_PIXELS; i++)
 	{
-		packet_header->terc4_r_header[j] = terc4_table[((header_byte&0x01)<<2)|sync_masks[1]];
-		packet_header_v->terc4_r_header[j++] = terc4_table[((header_byte&0x01)<<2)|sync_masks[0]];
-		header_byte = header_byte>>1;
+		// The packet is a whole island on its own
+		int first = i ? DATA_ISLAND_NOT_FIRST : 0;
+		symbols[0][i] = terc4_table[island.nibble[0][i]|first|0x02];
+		symbols[1][i] = terc4_table[island.nibble[0][i]|first];
+		symbols[2][i] = terc4_table[island.nibble[1][i]];
+		symbols[3][i] = terc4_table[island.nibble[2][i]];
 	}
-	header_byte = packet_header->packet_length;
-	for(int i=0; i<8; i++)
+	if(output_format==TMDS_FORMAT_3LANE)
 	{
-		packet_header->terc4_r_header[j] = terc4_table[((header_byte&0x01)<<2)|sync_masks[1]];
-		packet_header_v->terc4_r_header[j++] = terc4_table[((header_byte&0x01)<<2)|sync_masks[0]];
-		header_byte = header_byte>>1;
-	}
-	header_byte = packet_header->header_checksum;
-	for(int i=0; i<8; i++)
-	{
-		packet_header->terc4_r_header[j] = terc4_table[((header_byte&0x01)<<2)|sync_masks[1]];
-		packet_header_v->terc4_r_header[j++] = terc4_table[((header_byte&0x01)<<2)|sync_masks[0]];
-		header_byte = header_byte>>1;
+		// All 3 channels in one file, for each channel 0 variant
+		const char *names_3lane[2] = {"terc4_hblank.bin", "terc4_vsync.bin"};
+		for(int n=0; n<2; n++)
+		{
+			tmds_3lane_pack(symbols[n], symbols[2], symbols[3], packed, DATA_ISLAND_PIXELS);
+			FILE *terc4_file = open_output(names_3lane[n]);
+			fwrite(packed, 4, PACKED_WORDS(DATA_ISLAND_PIXELS), terc4_file);
+			fclose(terc4_file);
+		}
+		return;
 	}
-
-	info_packet->terc4_r_ch1[0] = terc4_table[((info_packet->packet_checksum)&0x0f)];
-	info_packet->terc4_r_ch2[0] = terc4_table[((info_packet->packet_checksum)&0xf0)>>4];
-	for(int i=1; i<32; i++)
+	for(int n=0; n<4; n++)
 	{
-		info_packet->terc4_r_ch1[i] = terc4_table[((info_packet->packet_data[i-1])&0x0f)];
-		info_packet->terc4_r_ch2[i] = terc4_table[((info_packet->packet_data[i-1])&0xf0)>>4];
+		int words = pack_symbols(symbols[n], packed, DATA_ISLAND_PIXELS);
+		FILE *terc4_file = open_output(names[n]);
+		fwrite(packed, 4, words, terc4_file);
+		fclose(terc4_file);
 	}
 
-	pack_buffer_single(packet_header->terc4_r_header, packet_header->terc4_en_header, 2);
-	pack_buffer_single(packet_header_v->terc4_r_header, packet_header_v->terc4_en_header, 2);
-	pack_buffer_single(info_packet->terc4_r_ch1, info_packet->terc4_en_ch1, 2);
-	pack_buffer_single(info_packet->terc4_r_ch2, info_packet->terc4_en_ch2, 2);
-
-	FILE *terc4_header = fopen("terc4_hblank_ch0.bin", "wb");
-	fwrite(packet_header->terc4_en_header, 4, 10, terc4_header);
-	fclose(terc4_header);
-
-	FILE *terc4_header_v = fopen("terc4_vsync_ch0.bin", "wb");
-	fwrite(packet_header_v->terc4_en_header, 4, 10, terc4_header_v);
-	fclose(terc4_header_v);
-
-	FILE *terc4_ch1 = fopen("terc4_blank_ch1.bin", "wb");
-	fwrite(info_packet->terc4_en_ch1, 4, 10, terc4_ch1);
-	fclose(terc4_ch1);
-
-	FILE *terc4_ch2 = fopen("terc4_blank_ch2.bin", "wb");
-	fwrite(info_packet->terc4_en_ch2, 4, 10, terc4_ch2);
-	fclose(terc4_ch2);
-
-	free(packet_header->terc4_r_header);
-	free(packet_header->terc4_en_header);
-	free(packet_header);
-
-	free(packet_header_v->terc4_r_header);
-	free(packet_header_v->terc4_en_header);
-	free(packet_header_v);
-
-	free(info_packet->terc4_r_ch1);
-	free(info_packet->terc4_en_ch1);
-	free(info_packet->terc4_r_ch2);
-	free(info_packet->terc4_en_ch2);
-	free(info_packet->packet_data);
-	free(info_packet);
-
 	return;
 }
 
@@ -926,18 +1247,23 @@ void create_avi_infoframe()
 void create_solid_line(char *name, struct tmds_pixel_t *pixel)
 {
 	uint16_t *tmds_r_line = (uint16_t *)malloc(720*sizeof(uint16_t));
-	uint32_t *tmds_en_line = (uint32_t *)malloc(225*sizeof(uint32_t));
+	uint32_t *tmds_en_line = (uint32_t *)malloc(PACKED_WORDS(720)*sizeof(uint32_t));
 	pixel->color_data = depth_convert(pixel->color_data_5b);
 	for(int i=0; i<720; i++)
 	{
 		tmds_calc_disparity(pixel);
 		tmds_r_line[i] = pixel->tmds_data;
 	}
-	pack_buffer_single(tmds_r_line, tmds_en_line, 45);
+	int line_words = PACKED_WORDS(720);
+	// Same line on all 3 lanes
+	if(output_format==TMDS_FORMAT_3LANE)
+		tmds_3lane_pack(tmds_r_line, tmds_r_line, tmds_r_line, tmds_en_line, 720);
+	else
+		pack_symbols(tmds_r_line, tmds_en_line, 720);
 	free(tmds_r_line);
 
-	FILE *tmds_line = fopen(name, "wb");
-	fwrite(tmds_en_line, 4, 225, tmds_line);
+	FILE *tmds_line = open_output(name);
+	fwrite(tmds_en_line, 4, line_words, tmds_line);
 	fclose(tmds_line);
 	free(tmds_en_line);
 
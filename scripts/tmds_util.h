@@ -4,6 +4,14 @@
 	Various definitions/declarations of values, structs, and function prototypes for tmds_util.c to make things less messy.
 */
 
+#ifndef TMDS_UTIL_H
+#define TMDS_UTIL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../src/data_island.h"
+#include "../src/tmds_output_3lane.h"
+
 #define H_ACTIVE 720
 #define H_FRONT 32
 #define H_PULSE 64
@@ -16,16 +24,28 @@
 #define V_BACK 38
 #define V_TOTAL 539
 
-#define AVI_PACKET_TYPE 0x82
-#define HDMI_VERSION 0x02
-#define AVI_PACKET_LENGTH 13 // 0x0D
-#define AVI_HEADER_CHECKSUM 0x91
-
-// The VIC bits of the AVI InfoFrame data byte 4 are either 0x02 or 0x03
-// because the active video is technically 720x480p 60Hz.
-// All other bytes should be set to zero.
-// Therefore, if the VIC bits are actually used, the checksum should be
-// 0x02 or 0x03.
+// 32 colors * 16 disparities * 2 words (3 packed TMDS words + output disparity)
+#define TMDS_LUT_WORDS 1024
+// Pair LUT (create_tmds_lut_pairs()): 32*32 pairs of colors * 2 words (3 packed TMDS words of each pixel)
+#define TMDS_PAIR_LUT_WORDS 2048
+// Disparities 3 symbols can add up to: -30 to 30, in steps of 2
+#define TMDS_PAIR_SUMS 31
+
+// Output formats: single-ended 10-bit symbols for tmds_output.pio, 20-bit interleaved P/N pairs for
+// tmds_output_pair.pio, or all 3 lanes in one stream for tmds_output_3lane.pio (2 words per symbol of every lane.)
+#define TMDS_FORMAT_SINGLE 0
+#define TMDS_FORMAT_INTERLEAVED 1
+#define TMDS_FORMAT_3LANE 2
+// Packed 32-bit words for a number of symbols (multiple of 16) in the current output format. For the 3-lane format
+// that's all 3 lanes, for the others one.
+#define PACKED_WORDS(symbols) (output_format==TMDS_FORMAT_3LANE ? TMDS_3LANE_WORDS(symbols) : \
+	((symbols)*(output_format==TMDS_FORMAT_INTERLEAVED ? 20 : 10))/32)
+
+// Packed words for any symbol count in the largest (3-lane) format, for buffers that fit any of them
+#define PACKED_WORDS_MAX(symbols) TMDS_3LANE_WORDS(symbols)
+
+// VIC of the AVI InfoFrame: 720x480p 60Hz 4:3 (the active video is 720x480, even with the GBA at 3x inside it)
+#define AVI_VIC 2
 
 struct tmds_pixel_t
 {
@@ -35,6 +55,26 @@ struct tmds_pixel_t
 	int disparity;
 };
 
+// Blanking line variants, in the order of the sync buffers below
+enum blank_variant_t
+{
+	BLANK_HBLANK = 0,
+	BLANK_VBLANK_EN = 1,
+	BLANK_VBLANK_SYN = 2,
+	BLANK_VBLANK_EX = 3
+};
+
+// Most data islands (packets) that fit into one line's blanking
+#define MAX_ISLANDS 4
+
+// Horizontal blanking, in pixel clocks
+struct blank_timing_t
+{
+	int front;
+	int pulse;
+	int back;
+};
+
 struct sync_buffer_t
 {
 	// Normal hblank
@@ -75,46 +115,56 @@ struct sync_buffer_32_t
 	uint32_t *vblank_ex_ch2;
 };
 
-struct infoframe_header_t
-{
-	uint8_t packet_type;
-	uint8_t version;
-	uint8_t packet_length;
-	uint8_t header_checksum;
-	uint16_t *terc4_r_header; //32*sizeof(uint16_t)
-	uint32_t *terc4_en_header; //10*sizeof(uint32_t)
-	// 16 TMDS words per 5 32-bit words; each packet is 32 TMDS words long, or 10 32-bit words
-	// OR with sync_masks[1] for normal hsync and sync_masks[0] for hsync during vsync (oops)
-};
-
-struct infoframe_packet_t
-{
-	uint8_t packet_checksum;
-	uint8_t *packet_data; // malloc(31)
-	uint16_t *terc4_r_ch1; // Channel 1 gets lower nibble, malloc(32*sizeof(uint16_t))
-	uint16_t *terc4_r_ch2; // Channel 2 gets higher nibble
-	uint32_t *terc4_en_ch1; // r = unpacked data, en = packed data malloc(10*sizeof(uint16_t))
-	uint32_t *terc4_en_ch2;
-};
+// Used by the host tools that build their own buffers
+extern const uint16_t sync_ctl_states[];
+extern const uint16_t guardband_states[];
+extern const uint16_t terc4_table[];
+extern int output_format;
 
 // Function header prototypes
 void free_sync_buffers(struct sync_buffer_t *sync_buffer);
 void free_sync_buffers_32(struct sync_buffer_32_t *sync_buffer);
 void allocate_sync_buffer(uint16_t **buffer);
 void allocate_sync_buffer_32(uint32_t **buffer);
+void allocate_sync_buffers(struct sync_buffer_t *sync_buffer);
+void fill_blank_line_packets(uint16_t *ch0, uint16_t *ch1, uint16_t *ch2, const struct blank_timing_t *timing, int variant,
+	const struct data_island_t *packets, int islands);
+void fill_blank_line(uint16_t *ch0, uint16_t *ch1, uint16_t *ch2, const struct blank_timing_t *timing, int variant, int islands);
+void fill_sync_buffers(struct sync_buffer_t *sync_buffer, int islands);
 void create_sync_buffers();
 void create_sync_buffers_nodat();
 
 void pack_buffer_single(uint16_t *in_buffer, uint32_t *out_buffer, int buffer_size);
+uint32_t tmds_interleave(uint16_t tmds_data);
+void pack_buffer_interleaved(uint16_t *in_buffer, uint32_t *out_buffer, int buffer_size);
+int pack_symbols(uint16_t *in_buffer, uint32_t *out_buffer, int symbols);
+FILE *open_output(const char *name);
+void write_lut(const char *name, const uint32_t *tmds_lut);
+void print_format_report();
 void create_sync_files(char *name, struct sync_buffer_t *sync_buffer);
+void create_sync_files_3lane(char *name, struct sync_buffer_t *sync_buffer);
 
 uint16_t tmds_xor(uint8_t color_data);
 uint16_t tmds_xnor(uint8_t color_data);
 int ones_count(uint8_t color_data);
 void tmds_calc_disparity(struct tmds_pixel_t *tmds_pixel);
 void tmds_pixel_repeat(uint32_t *lut_buf, struct tmds_pixel_t *tmds_pixel);
+uint32_t lut_disparity(int disparity);
+void create_tmds_lut(uint32_t *tmds_lut);
+void create_tmds_lut_interleaved(uint32_t *tmds_lut);
+void create_tmds_lut_symbols(uint32_t *tmds_lut, int symbols);
+void create_tmds_lut_grid(uint32_t *tmds_lut, int level);
+void interleave_tmds_lut(uint32_t *tmds_lut);
+void create_tmds_lut_3lane(uint32_t *lut_3lane, const uint32_t *tmds_lut);
+void create_ctl_active_3lane();
+void create_tmds_lut_dmg(uint32_t *tmds_lut, const uint32_t *palette);
+void create_tmds_lut_pairs(uint32_t *pair_lut);
+int check_tmds_lut_pairs(const uint32_t *pair_lut, int *nudged, int *peak);
 
 uint8_t depth_convert(uint8_t c_in);
+uint8_t grid_dim(uint8_t c_in, int level);
 void create_avi_infoframe();
 
 void create_solid_line(char *name, struct tmds_pixel_t *pixel);
+
+#endif
@@ -0,0 +1,354 @@
+/*
+	vga_sim.c
+
+	Runs the VGA output (src/vga_output_9bpp.pio, with the register values and line conversion of src/vga_output.h) in
+	pio_emu, fed by a model of the DMA of vga_output.c: 2 line buffers, each sent VGA_LINE_REPEAT times, and after the
+	last time an IRQ that starts the other one irq_latency cycles later and converts the next line into the one that's
+	free. Every output frame shows the next of 2 test frames, so a line from the wrong frame shows up too.
+
+	Every system clock it checks the pins against the modeline of tmds_util.h:
+	-the data pins only change on dot boundaries, are black outside the active area and are the right pixel inside it
+	-hsync and vsync pulses and periods, and where vsync changes in the line
+	and it measures the IRQ slack: how long after the DMA finishes a line buffer the first pixel that needs the other
+	one goes out, which is how late the IRQ handler can be.
+
+	Options: -f frames (3), -l IRQ latency in cycles (0), -t for lcd_cap_9bpp's 10-bit frames instead of RGB555,
+	-o PPM of the last frame (720x480, not written without it), -d path to src.
+
+	Build: gcc -O2 -o vga_sim vga_sim.c pio_emu.c
+	Usage: ./vga_sim [-f 3] [-l 0] [-t] [-o vga.ppm] [-d ../src]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "tmds_util.h"
+#include "pio_emu.h"
+#include "host_util.h"
+#include "../src/vga_output.h"
+
+#define SM_HSYNC 0
+#define SM_VSYNC 1
+#define SM_PIXELS 2
+#define FB_LINE_WORDS (VGA_LINE_PIXELS/2)
+#define FB_HEIGHT (V_ACTIVE/VGA_LINE_REPEAT)
+#define DATA_MASK (((1u<<VGA_DATA_BITS)-1)<<VGA_DATA_PIN)
+
+struct dma_t
+{
+	uint32_t line_buf[2][VGA_LINE_WORDS];
+	int sending; // line buffer
+	int repeat, pos;
+	int next_line; // next framebuffer line to convert
+	int frame; // output frame of the next line to convert
+	int wait; // cycles until the IRQ handler restarts it, or -1 if it's running
+	uint64_t done_cycle; // when the last line buffer was finished
+	bool done_pending;
+};
+
+static uint32_t framebuffer[2][FB_HEIGHT][FB_LINE_WORDS];
+static uint16_t expected[2][FB_HEIGHT][VGA_LINE_PIXELS]; // 10-bit output pixels
+static struct vga_palette_t palette;
+static bool source_10bpp;
+
+// Color bars, gradients of each channel and a box that moves between the 2 frames
+static void test_frames(void)
+{
+	static const uint16_t bars[8] = {0x7fff, 0x03ff, 0x7fe0, 0x03e0, 0x7c1f, 0x001f, 0x7c00, 0x0000};
+	for(int f=0; f<2; f++)
+	{
+		for(int y=0; y<FB_HEIGHT; y++)
+		{
+			for(int x=0; x<VGA_LINE_PIXELS; x++)
+			{
+				uint32_t v = (uint32_t)((x*32)/VGA_LINE_PIXELS), pixel;
+				if(y<40)
+					pixel = bars[(x*8)/VGA_LINE_PIXELS];
+				else if(y<100)
+					pixel = v<<(5*((y-40)/20));
+				else if(y<120)
+					pixel = v|(v<<5)|(v<<10);
+				else
+					pixel = (x>=40+f*120 && x<80+f*120) ? 0x7fff : (uint32_t)(((x^y)&1) ? 0x3def : 0x0421);
+				// 10-bit frames: the same picture in RRR GGGG BBB
+				if(source_10bpp)
+					pixel = vga_pixel(&palette, pixel);
+				framebuffer[f][y][x>>1] |= pixel<<((x&1) ? 0 : 16);
+				expected[f][y][x] = (uint16_t)(source_10bpp ? pixel : vga_pixel(&palette, pixel));
+			}
+		}
+	}
+}
+
+// What the IRQ handler of vga_output.c does for the line buffer that was just sent
+static void convert_next(struct dma_t *dma, int b)
+{
+	const uint32_t *line = framebuffer[dma->frame&1][dma->next_line];
+	if(source_10bpp)
+		vga_convert_line_10(line, dma->line_buf[b]);
+	else
+		vga_convert_line(&palette, line, dma->line_buf[b]);
+	if(++dma->next_line==FB_HEIGHT)
+	{
+		dma->next_line = 0;
+		dma->frame++;
+	}
+}
+
+// One system clock of the data channel: a word into the FIFO if there's room (the DREQ)
+static void dma_step(struct dma_t *dma, struct pio_emu_t *emu, int latency)
+{
+	if(dma->wait>0)
+	{
+		dma->wait--;
+		return;
+	}
+	if(dma->wait==0)
+	{
+		dma->wait = -1;
+		dma->sending ^= 1;
+		dma->repeat = 0;
+		dma->pos = 0;
+		convert_next(dma, dma->sending^1);
+	}
+	if(!pio_sm_put(emu, SM_PIXELS, dma->line_buf[dma->sending][dma->pos]))
+		return;
+	if(++dma->pos<VGA_LINE_WORDS)
+		return;
+	dma->pos = 0;
+	if(++dma->repeat<VGA_LINE_REPEAT)
+		return;
+	dma->done_cycle = emu->cycle;
+	dma->done_pending = true;
+	dma->wait = latency;
+}
+
+// The DAC levels of the pins, as 8-bit RGB
+static void write_screen(const char *name, const uint16_t *screen)
+{
+	uint8_t *rgb = (uint8_t *)malloc(H_ACTIVE*V_ACTIVE*3);
+	for(int i=0; i<H_ACTIVE*V_ACTIVE; i++)
+	{
+		uint32_t p = screen[i];
+		rgb[3*i] = (uint8_t)(((p>>VGA_RED_SHIFT)&7)*255/7);
+		rgb[3*i+1] = (uint8_t)(((p>>VGA_GREEN_SHIFT)&15)*255/15);
+		rgb[3*i+2] = (uint8_t)(((p>>VGA_BLUE_SHIFT)&7)*255/7);
+	}
+	write_ppm(name, rgb, H_ACTIVE, V_ACTIVE);
+	free(rgb);
+}
+
+int main(int argc, char **argv)
+{
+	int frames = 3, latency = 0;
+	const char *src_dir = "../src", *out_name = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "f:l:to:d:"))!=-1)
+	{
+		switch(opt)
+		{
+			case 'f': frames = atoi(optarg); break;
+			case 'l': latency = atoi(optarg); break;
+			case 't': source_10bpp = true; break;
+			case 'o': out_name = optarg; break;
+			case 'd': src_dir = optarg; break;
+			default:
+				fprintf(stderr, "See the top of vga_sim.c for the options.\n");
+				return 1;
+		}
+	}
+	if(frames<1)
+		frames = 1;
+	if(latency<0)
+		latency = 0;
+
+	const struct vga_mode_t mode = {H_ACTIVE, H_FRONT, H_PULSE, H_BACK, V_ACTIVE, V_FRONT, V_PULSE, V_BACK};
+	struct vga_timing_t t;
+	if(!vga_timing_init(&t, &mode))
+	{
+		fprintf(stderr, "The modeline doesn't work with the VGA programs\n");
+		return 1;
+	}
+	vga_palette_init(&palette);
+	test_frames();
+
+	char path[512];
+	struct pio_program_t programs[PIO_MAX_PROGRAMS];
+	snprintf(path, sizeof(path), "%s/vga_output_9bpp.pio", src_dir);
+	int count = pio_assemble_file(path, NULL, 0, programs, PIO_MAX_PROGRAMS);
+	if(count<0)
+		return 1;
+	static const char *names[3] = {"vga_hsync", "vga_vsync", "vga_out_9bpp"};
+	static struct pio_emu_t emu;
+	pio_emu_init(&emu);
+	int used = 0;
+	for(int sm=0; sm<3; sm++)
+	{
+		const struct pio_program_t *prog = pio_find_program(programs, count, names[sm]);
+		int offset = prog ? pio_emu_load(&emu, prog, -1) : -1;
+		if(offset<0)
+		{
+			fprintf(stderr, "Can't load %s from %s\n", names[sm], path);
+			return 1;
+		}
+		used += prog->length;
+		printf("%s: %d instructions at offset %d\n", names[sm], prog->length, offset);
+		struct pio_sm_config_t cfg;
+		pio_sm_default_config(&cfg);
+		cfg.clkdiv = VGA_CYCLES_PER_DOT;
+		if(sm==SM_PIXELS)
+		{
+			cfg.out_base = VGA_DATA_PIN;
+			cfg.out_count = VGA_DATA_BITS;
+			cfg.autopull = true;
+			cfg.pull_threshold = VGA_PIXELS_PER_WORD*VGA_DATA_BITS;
+			cfg.join_tx = true;
+		}
+		else
+			cfg.sideset_base = sm==SM_HSYNC ? VGA_HSYNC_PIN : VGA_VSYNC_PIN;
+		pio_sm_start(&emu, sm, prog, offset, 0, &cfg);
+	}
+	printf("%d of %d instructions used\n", used, PIO_INSTR_MEM);
+	// What vga_output_start() puts in with pio_sm_exec()
+	emu.sm[SM_HSYNC].isr = t.hsync_isr;
+	emu.sm[SM_HSYNC].osr = t.hsync_osr;
+	emu.sm[SM_VSYNC].isr = t.vsync_isr;
+	emu.sm[SM_VSYNC].y = t.vsync_y;
+	emu.sm[SM_PIXELS].isr = t.pixel_isr;
+	emu.sm[SM_PIXELS].y = t.pixel_y;
+	emu.pins = (1u<<VGA_HSYNC_PIN)|(1u<<VGA_VSYNC_PIN);
+	emu.pindirs = DATA_MASK|(1u<<VGA_HSYNC_PIN)|(1u<<VGA_VSYNC_PIN);
+
+	static struct dma_t dma;
+	dma.wait = -1;
+	convert_next(&dma, 0);
+	convert_next(&dma, 1);
+	// The FIFO is full before the state machines start
+	while(pio_sm_put(&emu, SM_PIXELS, dma.line_buf[0][dma.pos]))
+		dma.pos++;
+
+	uint16_t *screen = (uint16_t *)calloc(H_ACTIVE*V_ACTIVE, sizeof(uint16_t));
+	int line_cycles = t.h_total*VGA_CYCLES_PER_DOT;
+	uint64_t cycles = (uint64_t)frames*t.v_total*line_cycles;
+	uint32_t last = emu.pins;
+	long lines = -1; // output lines since the start, from the hsync leading edges
+	uint64_t line_start = 0, hsync_fall = 0;
+	long hsync_period_errors = 0, hsync_width_errors = 0, pixel_errors = 0, blank_errors = 0, phase_errors = 0;
+	long vsync_errors = 0, frame_errors[2] = {0, 0};
+	int vsync_offset = -1;
+	long vsync_fall_line = -1;
+	int64_t min_slack = INT64_MAX;
+	uint64_t done_cycle = 0;
+	bool slack_pending = false;
+	for(uint64_t c=0; c<cycles; c++)
+	{
+		pio_emu_step(&emu);
+		dma_step(&dma, &emu, latency);
+		if(dma.done_pending)
+		{
+			done_cycle = dma.done_cycle;
+			slack_pending = true;
+			dma.done_pending = false;
+		}
+		uint32_t pins = emu.pins;
+		uint32_t changed = pins^last;
+		last = pins;
+		uint64_t now = emu.cycle-1;
+
+		if((changed>>VGA_HSYNC_PIN)&1)
+		{
+			if(!((pins>>VGA_HSYNC_PIN)&1))
+			{
+				if(lines>=0 && now-line_start!=(uint64_t)line_cycles)
+					hsync_period_errors++;
+				lines++;
+				line_start = hsync_fall = now;
+			}
+			else if(now-hsync_fall!=(uint64_t)(H_PULSE*VGA_CYCLES_PER_DOT))
+				hsync_width_errors++;
+		}
+		if(lines<0)
+			continue;
+		long frame = lines/t.v_total, line = lines%t.v_total;
+		int64_t in_line = (int64_t)(now-line_start);
+		int dot = (int)(in_line/VGA_CYCLES_PER_DOT);
+		// Every state machine steps on the same clocks as the first hsync edge
+		if(changed && in_line%VGA_CYCLES_PER_DOT)
+			phase_errors++;
+
+		if((changed>>VGA_VSYNC_PIN)&1)
+		{
+			if(!((pins>>VGA_VSYNC_PIN)&1))
+			{
+				vsync_fall_line = lines;
+				if(line!=V_ACTIVE+V_FRONT)
+					vsync_errors++;
+				if(vsync_offset<0)
+					vsync_offset = dot;
+				else if(dot!=vsync_offset)
+					vsync_errors++;
+			}
+			else if(vsync_fall_line<0 || lines-vsync_fall_line!=V_PULSE || dot!=vsync_offset)
+				vsync_errors++;
+		}
+
+		uint32_t data = (pins&DATA_MASK)>>VGA_DATA_PIN;
+		int x = dot-t.first_dot;
+		if(line<V_ACTIVE && x>=0 && x<H_ACTIVE)
+		{
+			int fb_line = (int)line/VGA_LINE_REPEAT;
+			if(x==0 && in_line%VGA_CYCLES_PER_DOT==0 && line%VGA_LINE_REPEAT==0 && slack_pending)
+			{
+				// First pixel that needs the line buffer the DMA went on to
+				int64_t slack = (int64_t)(now-done_cycle);
+				if(slack<min_slack)
+					min_slack = slack;
+				slack_pending = false;
+			}
+			if(data!=expected[frame&1][fb_line][x/VGA_LINE_REPEAT])
+			{
+				if(pixel_errors++<8)
+					printf("frame %ld line %ld dot %d: %03x instead of %03x\n", frame, line, dot, data,
+						expected[frame&1][fb_line][x/VGA_LINE_REPEAT]);
+				if(data==expected[(frame&1)^1][fb_line][x/VGA_LINE_REPEAT])
+					frame_errors[frame&1]++;
+			}
+			if(frame==frames-1)
+				screen[line*H_ACTIVE+x] = (uint16_t)data;
+		}
+		else if(data && blank_errors++<8)
+			printf("frame %ld line %ld dot %d: %03x in the blanking\n", frame, line, dot, data);
+	}
+
+	double dot_mhz = VGA_SYS_CLOCK_KHZ/1000.0/VGA_CYCLES_PER_DOT;
+	printf("\nAt %.0fMHz (%d cycles per dot, %.1fMHz dot clock, %d cycles per Gameboy pixel):\n", VGA_SYS_CLOCK_KHZ/1000.0,
+		VGA_CYCLES_PER_DOT, dot_mhz, VGA_CYCLES_PER_DOT*VGA_LINE_REPEAT);
+	printf("Line: %d dots, %.3fkHz, hsync %d dots (%.2fus), first pixel %d dots after the hsync leading edge\n", t.h_total,
+		dot_mhz*1000.0/t.h_total, H_PULSE, H_PULSE/dot_mhz, t.first_dot);
+	printf("Frame: %d lines, %.3fHz, vsync %d lines, changes %d dots after the hsync leading edge\n", t.v_total,
+		dot_mhz*1e6/t.h_total/t.v_total, V_PULSE, vsync_offset);
+	printf("%ld lines: %ld hsync period and %ld width errors, %ld vsync errors, %ld changes off a dot boundary\n", lines+1,
+		hsync_period_errors, hsync_width_errors, vsync_errors, phase_errors);
+	printf("Pixels: %ld errors (%ld from the other frame), %ld in the blanking\n", pixel_errors,
+		frame_errors[0]+frame_errors[1], blank_errors);
+	printf("Pixel state machine: %llu cycles stalled on an empty FIFO\n", (unsigned long long)emu.sm[SM_PIXELS].tx_underflow);
+	if(min_slack!=INT64_MAX)
+		printf("IRQ slack: %lld cycles from the end of a line buffer to the first pixel of the next (%lld left with the handler %d late)\n",
+			(long long)min_slack, (long long)min_slack-latency, latency);
+	printf("Line conversion: %d cycles for each line buffer, DMA: %.1fMB/s\n", VGA_LINE_REPEAT*line_cycles,
+		VGA_LINE_WORDS*4.0*dot_mhz/t.h_total);
+
+	if(out_name)
+	{
+		write_screen(out_name, screen);
+		printf("%s written\n", out_name);
+	}
+	free(screen);
+	bool ok = !hsync_period_errors && !hsync_width_errors && !vsync_errors && !phase_errors && !pixel_errors &&
+		!blank_errors && vsync_offset>=0 && lines+1==(long)frames*t.v_total;
+	printf("%s\n", ok ? "PASS" : "FAIL");
+	return ok ? 0 : 1;
+}
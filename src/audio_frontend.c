@@ -0,0 +1,102 @@
+/*
+	audio_frontend.c
+
+	Firmware side of the audio front end (see audio_frontend.h.)
+	The ADC runs free in round robin over inputs 0 and 1, and channel 10 moves its FIFO into a buffer of 2 blocks
+	(AUDIO_ADC_BLOCK samples each, 4ms in total.) When it's done, it chains to channel 11, which writes the start of the
+	buffer back into channel 10's write address trigger, so it goes around without the CPU. There's no IRQ: the samples
+	are filtered by audio_frontend_poll(), wherever there's time for it, as long as that's at least once every block
+	(2ms.) It goes as far as channel 10 got, a few samples at a time if need be, so it can be spread over the spare time
+	of a few lines instead of taking 40k cycles in one go.
+*/
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "audio_frontend.h"
+#include "packet_sched.h"
+
+#define ADC_BUFFER_SAMPLES (2*AUDIO_ADC_BLOCK)
+// ADC samples (both channels) for one stereo output sample
+#define ADC_FRAME_SAMPLES (2*AUDIO_OVERSAMPLE)
+
+static struct audio_frontend_t *frontend;
+static struct packet_sched_t *scheduler;
+static uint adc_dma;
+static uint16_t adc_buffer[ADC_BUFFER_SAMPLES] __attribute__((aligned(4)));
+static uint16_t *adc_buffer_start = adc_buffer; // what channel 11 writes into channel 10
+static uint32_t adc_read;
+static uint32_t adc_overruns;
+
+// The first ADC sample has to be input 0, so this is called before the ADC runs.
+void audio_frontend_start(struct audio_frontend_t *af, struct packet_sched_t *s, uint32_t adc_chan,
+	uint32_t reload_chan)
+{
+	frontend = af;
+	scheduler = s;
+	adc_dma = adc_chan;
+	adc_read = 0;
+
+	adc_init();
+	adc_gpio_init(26);
+	adc_gpio_init(27);
+	adc_select_input(0);
+	adc_set_round_robin(0x3);
+	adc_fifo_setup(true, true, 1, false, false);
+	adc_set_clkdiv(AUDIO_ADC_CLOCKS-1);
+
+	dma_channel_config c = dma_channel_get_default_config(reload_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, false);
+	dma_channel_configure(reload_chan, &c, &dma_hw->ch[adc_chan].al2_write_addr_trig, &adc_buffer_start, 1, false);
+
+	c = dma_channel_get_default_config(adc_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, true);
+	channel_config_set_dreq(&c, DREQ_ADC);
+	channel_config_set_chain_to(&c, reload_chan);
+	dma_channel_configure(adc_chan, &c, adc_buffer, &adc_hw->fifo, ADC_BUFFER_SAMPLES, true);
+
+	adc_run(true);
+}
+
+// Filters up to max_samples stereo samples of what the ADC has written so far, and hands them to the packet
+// scheduler. Returns the number of samples.
+int __not_in_flash_func(audio_frontend_poll)(int max_samples)
+{
+	int16_t out[2*AUDIO_BLOCK_SAMPLES];
+	int done = 0;
+	if(adc_hw->fcs&ADC_FCS_OVER_BITS)
+	{
+		hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS);
+		adc_overruns++;
+	}
+	// 0 right between channel 10 finishing and channel 11 starting it again, which is the start of the buffer too
+	uint32_t written = (ADC_BUFFER_SAMPLES-dma_channel_hw_addr(adc_dma)->transfer_count)%ADC_BUFFER_SAMPLES;
+	while(done<max_samples)
+	{
+		// Only up to the end of the buffer, the rest is the next time around
+		uint32_t end = written>=adc_read ? written : ADC_BUFFER_SAMPLES;
+		int count = (end-adc_read)/ADC_FRAME_SAMPLES;
+		if(count>max_samples-done)
+			count = max_samples-done;
+		if(count>AUDIO_BLOCK_SAMPLES)
+			count = AUDIO_BLOCK_SAMPLES;
+		if(count==0)
+			break;
+		audio_frontend_process(frontend, adc_buffer+adc_read, out, count);
+		packet_sched_push_audio(scheduler, out, count);
+		adc_read = (adc_read+count*ADC_FRAME_SAMPLES)%ADC_BUFFER_SAMPLES;
+		done += count;
+	}
+	return done;
+}
+
+// ADC FIFO overruns so far. A lost sample swaps left and right until the next audio_frontend_start(), so this should
+// stay at 0 (channel 10 has 4 samples of FIFO, 10us, to get to it.)
+uint32_t audio_frontend_overruns(void)
+{
+	return adc_overruns;
+}
@@ -0,0 +1,186 @@
+/*
+	audio_frontend.h
+
+	Turns the raw ADC samples of the 2 audio inputs into 48kHz stereo for the packet scheduler (packet_sched.h).
+	The ADC runs round robin over inputs 0 and 1 (GP26, GP27) at 384kS/s, which is 4 times 48kHz per channel. It's
+	clocked from the 48MHz USB PLL, so that's exactly 125 ADC clocks per sample, whatever the system clock is.
+	Every channel goes through, all in integer arithmetic:
+	-a CIC decimator (order 4, decimate by 2): 192kHz to 96kHz, adds and subtracts only. The 12-bit samples come out
+	 with a gain of 16, which is exactly the int16 range.
+	-a 31-tap symmetric FIR (Q15), decimate by 2: 96kHz to 48kHz. It also makes up for the droop of the CIC, so the
+	 response is within -0.5/+0.1dB up to 20kHz, and everything that would alias under 20kHz comes out at -56dB or
+	 less. What's left comes out at 20-24kHz: 24-28kHz, and 72-76kHz, where the CIC is all there is (-38dB.)
+	 The result keeps AUDIO_FRAC_BITS bits under the int16 LSB for the stages after it.
+	-a DC blocker (one pole at about 7.5Hz, -0.6dB at 20Hz): the inputs sit around half the ADC range, give or take
+	 the bias resistors. The accumulator keeps the bits the pole shifts out (fraction saving), so a constant input
+	 really comes out as 0.
+	-gain (Q8, up to AUDIO_GAIN_MAX) and saturation to int16.
+	The oversampling spreads the ADC noise over 4 times the bandwidth, and the filters throw 3/4 of it away: that's
+	6dB more SNR than sampling at 48kHz, as long as the noise is white. The 2 channels are sampled 2.6us apart by the
+	round robin, which is left as it is.
+
+	Everything works on blocks, AUDIO_OVERSAMPLE ADC samples per channel per output sample, up to AUDIO_BLOCK_SAMPLES
+	output samples at a time (half of the ADC DMA buffer.) audio_frontend.c is the firmware side with the ADC and the
+	DMA.
+*/
+
+#ifndef AUDIO_FRONTEND_H
+#define AUDIO_FRONTEND_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_CIC_ORDER 4
+#define AUDIO_CIC_DECIMATE 2
+#define AUDIO_FIR_TAPS 31
+#define AUDIO_FIR_DECIMATE 2
+// ADC samples per channel for every output sample
+#define AUDIO_OVERSAMPLE (AUDIO_CIC_DECIMATE*AUDIO_FIR_DECIMATE)
+// 48MHz/(2*4*48kHz): the ADC clock divider is this minus 1
+#define AUDIO_ADC_CLOCKS 125
+// Output samples per channel in one half of the ADC DMA buffer (2ms)
+#define AUDIO_BLOCK_SAMPLES 96
+// ADC samples (both channels) in one half of the ADC DMA buffer
+#define AUDIO_ADC_BLOCK (AUDIO_BLOCK_SAMPLES*AUDIO_OVERSAMPLE*2)
+#define AUDIO_ADC_MID 2048
+// Bits under the int16 LSB between the FIR and the gain
+#define AUDIO_FRAC_BITS 3
+#define AUDIO_FIR_SHIFT (15-AUDIO_FRAC_BITS)
+// Pole of the DC blocker: 1-2^-AUDIO_DC_SHIFT, 48kHz/(2pi*1024) = 7.5Hz
+#define AUDIO_DC_SHIFT 10
+#define AUDIO_GAIN_UNITY 256
+// FIR overshoot and the DC blocker can take a full scale input up to 2^20 with the fraction bits for a moment, which
+// is 2^30 in the DC blocker's accumulator. AUDIO_GAIN_DROP of them go before the gain, which leaves room for up to 8
+// times in 31 bits.
+#define AUDIO_GAIN_MAX (8*AUDIO_GAIN_UNITY)
+#define AUDIO_GAIN_DROP 1
+#define AUDIO_FIR_HISTORY (AUDIO_FIR_TAPS-1)
+
+// Least squares fit for flat passband (with the CIC droop) up to 20kHz and stopband from 28kHz, sums to 32768.
+// The sum of the magnitudes is 1.88, so a full scale input can't overflow the 32-bit accumulator.
+static const int16_t audio_fir_taps[AUDIO_FIR_TAPS] = {
+	65, 191, 92, -298, -305, 420, 653, -532, -1217, 598, 2176, -523, -4132, -239, 10860, 17150,
+	10860, -239, -4132, -523, 2176, 598, -1217, -532, 653, 420, -305, -298, 92, 191, 65
+};
+
+struct audio_channel_t
+{
+	// CIC state, all of it modulo 2^32: only the output has to fit, and it always does
+	uint32_t integ[AUDIO_CIC_ORDER];
+	uint32_t comb[AUDIO_CIC_ORDER];
+	// FIR input: the last AUDIO_FIR_HISTORY CIC outputs of the previous block, then the ones of this block
+	int16_t fir[AUDIO_FIR_HISTORY+AUDIO_BLOCK_SAMPLES*AUDIO_FIR_DECIMATE];
+	// DC blocker: last input, and the output scaled up by 2^AUDIO_DC_SHIFT
+	int32_t dc_x1, dc_acc;
+};
+
+struct audio_frontend_t
+{
+	struct audio_channel_t ch[2];
+	int32_t gain; // Q8
+	// Statistics
+	uint32_t samples; // stereo samples out
+	uint32_t clipped; // samples that hit the int16 limits
+};
+
+static inline void audio_frontend_init(struct audio_frontend_t *af, int32_t gain)
+{
+	memset(af, 0, sizeof(struct audio_frontend_t));
+	af->gain = gain<0 ? 0 : gain>AUDIO_GAIN_MAX ? AUDIO_GAIN_MAX : gain;
+}
+
+// CIC: count*AUDIO_CIC_DECIMATE ADC samples, every stride-th one, into count samples at the end of the FIR input.
+static inline void audio_cic_block(struct audio_channel_t *c, const uint16_t *adc, int stride, int count)
+{
+	int16_t *out = c->fir+AUDIO_FIR_HISTORY;
+	uint32_t i0 = c->integ[0], i1 = c->integ[1], i2 = c->integ[2], i3 = c->integ[3];
+	for(int n=0; n<count; n++)
+	{
+		for(int k=0; k<AUDIO_CIC_DECIMATE; k++)
+		{
+			i0 += (uint32_t)((int32_t)(*adc&0xfff)-AUDIO_ADC_MID);
+			i1 += i0;
+			i2 += i1;
+			i3 += i2;
+			adc += stride;
+		}
+		uint32_t y = i3, t;
+		for(int s=0; s<AUDIO_CIC_ORDER; s++)
+		{
+			t = y;
+			y -= c->comb[s];
+			c->comb[s] = t;
+		}
+		out[n] = (int16_t)y;
+	}
+	c->integ[0] = i0;
+	c->integ[1] = i1;
+	c->integ[2] = i2;
+	c->integ[3] = i3;
+}
+
+// FIR: count samples out of the FIR input, with AUDIO_FRAC_BITS fraction bits, then the history moves up.
+static inline void audio_fir_block(struct audio_channel_t *c, int32_t *out, int count)
+{
+	const int16_t *x = c->fir;
+	for(int n=0; n<count; n++)
+	{
+		int32_t acc = audio_fir_taps[AUDIO_FIR_TAPS/2]*x[AUDIO_FIR_TAPS/2];
+		for(int k=0; k<AUDIO_FIR_TAPS/2; k++)
+			acc += audio_fir_taps[k]*(x[k]+x[AUDIO_FIR_TAPS-1-k]);
+		out[n] = acc>>AUDIO_FIR_SHIFT;
+		x += AUDIO_FIR_DECIMATE;
+	}
+	memmove(c->fir, c->fir+count*AUDIO_FIR_DECIMATE, AUDIO_FIR_HISTORY*sizeof(int16_t));
+}
+
+// DC blocker, gain and saturation: count samples into every stride-th int16 of out.
+static inline uint32_t audio_dc_gain_block(struct audio_channel_t *c, const int32_t *in, int16_t *out, int stride,
+	int count, int32_t gain)
+{
+	uint32_t clipped = 0;
+	int32_t x1 = c->dc_x1, acc = c->dc_acc;
+	for(int n=0; n<count; n++)
+	{
+		acc += (in[n]-x1)*(1<<AUDIO_DC_SHIFT)-(acc>>AUDIO_DC_SHIFT);
+		x1 = in[n];
+		int32_t y = ((acc>>(AUDIO_DC_SHIFT+AUDIO_GAIN_DROP))*gain)>>(8+AUDIO_FRAC_BITS-AUDIO_GAIN_DROP);
+		if(y>INT16_MAX || y<INT16_MIN)
+		{
+			y = y>0 ? INT16_MAX : INT16_MIN;
+			clipped++;
+		}
+		out[n*stride] = (int16_t)y;
+	}
+	c->dc_x1 = x1;
+	c->dc_acc = acc;
+	return clipped;
+}
+
+// count stereo samples (up to AUDIO_BLOCK_SAMPLES) from count*AUDIO_OVERSAMPLE round robin ADC sample pairs
+// (input 0, input 1) into out, L and R interleaved, ready for packet_sched_push_audio().
+static inline void audio_frontend_process(struct audio_frontend_t *af, const uint16_t *adc, int16_t *out, int count)
+{
+	int32_t filtered[AUDIO_BLOCK_SAMPLES];
+	for(int ch=0; ch<2; ch++)
+	{
+		struct audio_channel_t *c = &af->ch[ch];
+		audio_cic_block(c, adc+ch, 2, count*AUDIO_FIR_DECIMATE);
+		audio_fir_block(c, filtered, count);
+		af->clipped += audio_dc_gain_block(c, filtered, out+ch, 2, count, af->gain);
+	}
+	af->samples += count;
+}
+
+struct packet_sched_t;
+
+// Firmware side (audio_frontend.c)
+// Starts the ADC and DMA channels adc_chan and reload_chan, with the filtered samples going to s.
+void audio_frontend_start(struct audio_frontend_t *af, struct packet_sched_t *s, uint32_t adc_chan,
+	uint32_t reload_chan);
+// Filters up to max_samples stereo samples of what the ADC has written so far into s. At least once every 2ms.
+int audio_frontend_poll(int max_samples);
+uint32_t audio_frontend_overruns(void);
+
+#endif
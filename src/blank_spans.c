@@ -0,0 +1,145 @@
+/*
+	blank_spans.c
+
+	Firmware side of the span-compressed blanking lines (see blank_spans.h.)
+	Every line, each lane gets a list of control blocks: one per span of the blanking region, then one for the line buffer.
+	The control channel writes them one by one into the data channel, and the data channel chains back to it after every
+	block. The last block doesn't chain and raises DMA_IRQ_0 instead (only lane 0 has the IRQ enabled), and
+	blank_spans_irq() calls blank_spans_start() with the next line's blocks. Only that restart has a deadline; the
+	blocks of the line after are built once it's done, with the whole line to go.
+
+	The state machines need joined TX FIFOs: once the last block is done there are 8 words (240 bit times) left
+	in the FIFO to get the next line started, instead of 120.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "blank_spans.h"
+#include "blank_spans_table.h"
+
+// The pool is read by DMA for the whole blanking region, so it's kept in RAM rather than read through XIP.
+static uint32_t blank_pool[BLANK_SPAN_POOL_WORDS];
+static struct blank_dma_t *blank_irq_dma;
+
+void blank_spans_init(struct blank_dma_t *dma, uint32_t pio_index, uint32_t first_sm, const uint32_t data_chan[3],
+	const uint32_t ctrl_chan[3])
+{
+	PIO pio = pio_index ? pio1 : pio0;
+	memcpy(blank_pool, blank_span_pool, sizeof(blank_pool));
+	for(int lane=0; lane<3; lane++)
+	{
+		uint sm = first_sm+lane;
+		dma->data_chan[lane] = data_chan[lane];
+		dma->ctrl_chan[lane] = ctrl_chan[lane];
+		dma->txf[lane] = &pio->txf[sm];
+
+		// Data channel: never started directly, all of its settings come from the control blocks.
+		dma_channel_config c = dma_channel_get_default_config(data_chan[lane]);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_read_increment(&c, false);
+		channel_config_set_write_increment(&c, false);
+		channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+		channel_config_set_chain_to(&c, ctrl_chan[lane]);
+		channel_config_set_irq_quiet(&c, true);
+		dma->ctrl_fixed[lane] = channel_config_get_ctrl_value(&c);
+		channel_config_set_read_increment(&c, true);
+		dma->ctrl_incr[lane] = channel_config_get_ctrl_value(&c);
+		// Chaining to itself means no chain
+		channel_config_set_chain_to(&c, data_chan[lane]);
+		channel_config_set_irq_quiet(&c, false);
+		dma->ctrl_last[lane] = channel_config_get_ctrl_value(&c);
+
+		// Control channel: 4 words per block into READ_ADDR, WRITE_ADDR, TRANS_COUNT and CTRL_TRIG of the data channel
+		c = dma_channel_get_default_config(ctrl_chan[lane]);
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_read_increment(&c, true);
+		channel_config_set_write_increment(&c, true);
+		channel_config_set_ring(&c, true, 4);
+		dma_channel_configure(ctrl_chan[lane], &c, &dma_hw->ch[data_chan[lane]].read_addr, NULL, 4, false);
+	}
+	dma_channel_set_irq0_enabled(data_chan[0], true);
+
+	return;
+}
+
+// Builds the control blocks of one lane for line (0 is the first active line.)
+// island_words is the island buffer of this lane for the line, or NULL to send the null packets from the table.
+// active is the line buffer (active_incr set) or a single control symbol word sent active_words times.
+// Returns the number of blocks.
+int __not_in_flash_func(blank_spans_build)(const struct blank_dma_t *dma, int lane, struct dma_ctrl_block_t *blocks, int line,
+	const uint32_t *island_words, const uint32_t *active, int active_words, int active_incr)
+{
+	const struct blank_span_list_t *list = &blank_span_lists[blank_span_line[line]][lane];
+	const struct blank_span_t *span = blank_span_data+list->first;
+	struct dma_ctrl_block_t *block = blocks;
+	for(int i=0; i<list->count; i++)
+	{
+		const uint32_t *src = blank_pool+span->pool_index;
+		if((span->flags&BLANK_SPAN_ISLAND) && island_words)
+			src = island_words+span->island_offset;
+		block->read_addr = src;
+		block->write_addr = dma->txf[lane];
+		block->transfer_count = span->count;
+		block->ctrl = (span->flags&BLANK_SPAN_INCR) ? dma->ctrl_incr[lane] : dma->ctrl_fixed[lane];
+		block++;
+		span++;
+	}
+	block->read_addr = active;
+	block->write_addr = dma->txf[lane];
+	block->transfer_count = active_words;
+	block->ctrl = active_incr ? dma->ctrl_last[lane] : (dma->ctrl_last[lane]&~DMA_CH0_CTRL_TRIG_INCR_READ_BITS);
+
+	return list->count+1;
+}
+
+// Starts the next line on all 3 lanes. The other lanes can be a few words behind lane 0, so each one is
+// checked before its control channel gets pointed at the new blocks.
+void __not_in_flash_func(blank_spans_start)(const struct blank_dma_t *dma, struct dma_ctrl_block_t *const blocks[3])
+{
+	uint32_t mask = 0;
+	for(int lane=0; lane<3; lane++)
+	{
+		while(dma_channel_is_busy(dma->data_chan[lane]))
+			tight_loop_contents();
+		dma_channel_set_read_addr(dma->ctrl_chan[lane], blocks[lane], false);
+		mask |= 1u<<dma->ctrl_chan[lane];
+	}
+	dma_start_channel_mask(mask);
+
+	return;
+}
+
+static void __not_in_flash_func(blank_spans_irq)(void)
+{
+	struct blank_dma_t *dma = blank_irq_dma;
+	dma_hw->ints0 = 1u<<dma->data_chan[0];
+	int done = blank_spans_next(dma);
+	blank_spans_start(dma, dma->blocks[dma->sending]);
+	blank_spans_line_sent(dma, done);
+}
+
+// Builds the first 2 lines and starts sending them, with the line IRQ taking it from there. blocks has 2 sets of
+// blocks for each lane, with room for what build_line puts in them. line_done is called after each of the first
+// active_lines lines. The state machines are started after this, so their FIFOs are full.
+void blank_spans_run(struct blank_dma_t *dma, struct dma_ctrl_block_t *const blocks[2][3], int lines,
+	int active_lines, blank_line_func_t build_line, void (*line_done)(void))
+{
+	memcpy(dma->blocks, blocks, sizeof(dma->blocks));
+	dma->sending = 0;
+	dma->line = 0;
+	dma->lines = lines;
+	dma->active_lines = active_lines;
+	dma->build_line = build_line;
+	dma->line_done = line_done;
+	blank_irq_dma = dma;
+	build_line(dma, 0, dma->blocks[0]);
+	build_line(dma, 1, dma->blocks[1]);
+	irq_set_exclusive_handler(DMA_IRQ_0, blank_spans_irq);
+	irq_set_enabled(DMA_IRQ_0, true);
+	blank_spans_start(dma, dma->blocks[0]);
+
+	return;
+}
@@ -0,0 +1,114 @@
+/*
+	blank_spans.h
+
+	Blanking lines as short lists of spans instead of fully packed buffers.
+	Almost all of a blanking line is the same symbol over and over, so instead of storing every word, each lane of each
+	blanking line variant is a list of spans: either one word repeated count times (DMA read increment off) or a run
+	of literal words (read increment on.) scripts/span_compiler.c turns the modeline and packet schedule into these
+	lists and writes them to blank_spans_table.h.
+
+	Spans need every word to hold whole symbols, so a lane that uses them runs tmds_output.pio with a pull threshold
+	of 30 (3 symbols per word) instead of 32. With 32-bit words a run of one symbol repeats every 5 words and can't
+	be sent from one word. The active part of the line is then one LUT word per pixel (tmds_encode_channel_30()),
+	so there's no packing step, at the cost of 240 words per lane instead of 225.
+
+	Each span becomes one DMA control block, in the same alias 0 layout that the chain channels of out_dma_manager.S
+	write into the data channels (4 words through a 16 byte write ring.) The line buffer is the last block of each line.
+	Data island spans are literal spans whose read address comes from the island buffer of the line, so switching a
+	line between packet types only changes one read address.
+
+	blank_spans_run() starts the output and takes DMA_IRQ_0, the output line IRQ. Its handler starts the next line,
+	which was built during the one before, calls line_done if the line that was just sent is an active one
+	(split_encode_line_done() to release the encoder's line buffers, since that can't have its own handler on the same
+	IRQ), and then has build_line build the line after that into the other set of blocks. build_line is where
+	blank_spans_build() gets the island and line buffers of a line (and where scale_plan_blocks() replaces the line
+	buffer block.) Only the active lines count for line_done: the encoder releases a buffer every SPLIT_LINE_REPEAT of
+	them (or at the end of each run of its vrun), and counting the vblank lines too would get it ahead of the DMA and out of step with every frame.
+	blank_spans_next() and blank_spans_line_sent() are that handler without the hardware, which scripts/e2e_sim.c runs
+	for every line it sends.
+*/
+
+#ifndef BLANK_SPANS_H
+#define BLANK_SPANS_H
+
+#include <stdint.h>
+
+#define BLANK_SYMBOLS_PER_WORD 3
+
+// Span flags
+#define BLANK_SPAN_INCR 0x1 // literal words, read in order; otherwise one word is sent count times
+#define BLANK_SPAN_ISLAND 0x2 // data island words; island_offset is where they are in the island buffer
+
+struct blank_span_t
+{
+	uint16_t pool_index; // first word in blank_span_pool (for island spans, the null packet version)
+	uint16_t island_offset; // island spans only: first word in the island buffer of the lane
+	uint16_t count; // words
+	uint16_t flags;
+};
+
+// Spans of one lane of one blanking line variant: blank_span_data[first] to blank_span_data[first+count-1]
+struct blank_span_list_t
+{
+	uint16_t first;
+	uint16_t count;
+};
+
+// DMA channel registers, alias 0 order
+struct dma_ctrl_block_t
+{
+	const volatile void *read_addr;
+	volatile void *write_addr;
+	uint32_t transfer_count;
+	uint32_t ctrl;
+};
+
+struct blank_dma_t;
+// Builds the control blocks of all 3 lanes for line (0 is the first active line), from the line IRQ.
+typedef void (*blank_line_func_t)(struct blank_dma_t *dma, int line, struct dma_ctrl_block_t *const blocks[3]);
+
+struct blank_dma_t
+{
+	uint32_t data_chan[3]; // paced by the PIO TX DREQ of each lane, chain to ctrl_chan
+	uint32_t ctrl_chan[3]; // write 4 words of a control block into data_chan, through a 16 byte ring
+	volatile void *txf[3]; // PIO TX FIFO of each lane
+	uint32_t ctrl_fixed[3], ctrl_incr[3], ctrl_last[3]; // CTRL_TRIG values for the data channels
+
+	// Line IRQ (blank_spans_run())
+	struct dma_ctrl_block_t *blocks[2][3]; // 2 sets of blocks for each lane, one being sent and one for the next line
+	int sending; // set being sent
+	int line, lines; // line being sent, lines per frame
+	int active_lines; // lines 0 to active_lines-1 are the active ones
+	blank_line_func_t build_line;
+	void (*line_done)(void); // after each active line, NULL for nothing
+};
+
+// The line that was being sent is done and the other set of blocks goes next. Returns the line that's done.
+static inline int blank_spans_next(struct blank_dma_t *dma)
+{
+	int done = dma->line;
+	dma->sending ^= 1;
+	if(++dma->line==dma->lines)
+		dma->line = 0;
+	return done;
+}
+
+// Once the next line is on its way: line_done if the line that's done was active, then the line after the one being
+// sent goes into the set of blocks that's free now.
+static inline void blank_spans_line_sent(struct blank_dma_t *dma, int done)
+{
+	if(dma->line_done && done<dma->active_lines)
+		dma->line_done();
+	dma->build_line(dma, dma->line+1==dma->lines ? 0 : dma->line+1, dma->blocks[dma->sending^1]);
+}
+
+// Spans for each lane are built into blocks with room for BLANK_SPAN_MAX+1 entries (the +1 is the line buffer.)
+void blank_spans_init(struct blank_dma_t *dma, uint32_t pio_index, uint32_t first_sm, const uint32_t data_chan[3],
+	const uint32_t ctrl_chan[3]);
+int blank_spans_build(const struct blank_dma_t *dma, int lane, struct dma_ctrl_block_t *blocks, int line,
+	const uint32_t *island_words, const uint32_t *active, int active_words, int active_incr);
+void blank_spans_start(const struct blank_dma_t *dma, struct dma_ctrl_block_t *const blocks[3]);
+void blank_spans_run(struct blank_dma_t *dma, struct dma_ctrl_block_t *const blocks[2][3], int lines,
+	int active_lines, blank_line_func_t build_line, void (*line_done)(void));
+
+#endif
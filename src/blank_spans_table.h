@@ -0,0 +1,107 @@
+/*
+	blank_spans_table.h
+
+	Generated by scripts/span_compiler.c, don't edit by hand.
+	Blanking: front 32, pulse 64, back 96. Islands: same count on every line
+*/
+
+#ifndef BLANK_SPANS_TABLE_H
+#define BLANK_SPANS_TABLE_H
+
+#include "blank_spans.h"
+
+#define BLANK_SPAN_WORDS 64
+#define BLANK_SPAN_MAX 6
+#define BLANK_SPAN_ISLAND_WORDS 22
+#define BLANK_SPAN_POOL_WORDS 125
+#define BLANK_SPAN_LINES 539
+
+static const uint32_t blank_span_pool[BLANK_SPAN_POOL_WORDS] =
+{
+	0x2abaaeab, 0x2e4b0ec3, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c,
+	0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c,
+	0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x2abb0ec3,
+	0x2ccb32ab, 0x354d5354, 0x0ab2af54, 0x0ab2acab, 0x0ab2acab, 0x29c4cd33, 0x29ca729c, 0x29ca729c,
+	0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c,
+	0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c, 0x29ca729c,
+	0x29ca729c, 0x29ca729c, 0x29ca729c, 0x3544cd33, 0x0abd5354, 0x0ab2acab, 0x0ab2acab, 0x1334ccab,
+	0x2ccb3354, 0x29cb0ec3, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc,
+	0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc,
+	0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x0ab9c671,
+	0x2ccb30ab, 0x29c9c671, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc,
+	0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc,
+	0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2ccb32cc, 0x2e49c671,
+	0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c,
+	0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c,
+	0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c, 0x19c6719c
+};
+
+// pool_index, island_offset, count, flags
+static const struct blank_span_t blank_span_data[32] =
+{
+	{0, 0, 10, 0},
+	{1, 0, 22, 3},
+	{23, 0, 1, 0},
+	{0, 0, 30, 0},
+	{24, 0, 1, 0},
+	{25, 0, 7, 0},
+	{26, 0, 3, 1},
+	{29, 0, 22, 3},
+	{51, 0, 1, 0},
+	{25, 0, 27, 0},
+	{52, 0, 4, 1},
+	{25, 0, 7, 0},
+	{26, 0, 3, 1},
+	{29, 0, 22, 3},
+	{51, 0, 1, 0},
+	{25, 0, 30, 0},
+	{56, 0, 1, 0},
+	{0, 0, 10, 0},
+	{57, 0, 22, 3},
+	{79, 0, 1, 0},
+	{27, 0, 30, 0},
+	{80, 0, 1, 0},
+	{27, 0, 10, 0},
+	{81, 0, 22, 3},
+	{79, 0, 1, 0},
+	{27, 0, 30, 0},
+	{80, 0, 1, 0},
+	{27, 0, 10, 0},
+	{103, 0, 22, 3},
+	{23, 0, 1, 0},
+	{0, 0, 30, 0},
+	{24, 0, 1, 0}
+};
+
+// Variant/island count of each list, in order: 0/2, 1/2, 2/2, 3/2
+static const struct blank_span_list_t blank_span_lists[4][3] =
+{
+	{{0, 5}, {5, 6}, {11, 6}},
+	{{17, 5}, {5, 6}, {11, 6}},
+	{{22, 5}, {5, 6}, {11, 6}},
+	{{27, 5}, {5, 6}, {11, 6}}
+};
+
+// List of each line, line 0 being the first active line
+static const uint8_t blank_span_line[BLANK_SPAN_LINES] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 2, 2, 2, 2, 2, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#endif
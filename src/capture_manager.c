@@ -0,0 +1,146 @@
+/*
+	capture_manager.c
+
+	Firmware side of the capture manager (see capture_manager.h.)
+	Channel 8 reads the RX FIFO of lcd_capture into the capture buffer, DMA_WORDS words at most. Channel 9 reads the word
+	vsync_interruptor pushes into a dummy word and raises DMA_IRQ_1 (DMA_IRQ_0 is the output line IRQ.) The IRQ handler
+	reads how far channel 8 got, stops it, restarts lcd_capture at its entry point with empty FIFOs (a glitch can leave it
+	halfway through a pixel pair or with words that belong to the last frame), and points channel 8 at whatever
+	capture_vsync() picked. The first pixel of a frame is at least one line after vsync, so there's plenty of time.
+
+	The encoder calls capture_frame_begin() at the start of every output frame, capture_frame_line() before every
+	framebuffer line it reads, and capture_frame_end() after the last one. vga_output.c and tmds_output_3lane.c do that
+	themselves; for the split encoder it's model_next_frame() and model_frame_line() in model_detect.c.
+
+	A vsync hook (capture_set_vsync_hook()) runs in the IRQ just before the frame is counted, while the capture is stopped.
+	It can reject the frame, switch the capture to another program that's already loaded (capture_select_program()) and
+	change the frame format, which is how model_detect.c swaps pipelines without touching the output.
+*/
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+#include "capture_manager.h"
+
+static struct capture_manager_t *manager;
+static PIO capture_pio;
+static uint capture_sm_index, capture_entry;
+static void (*vsync_hook)(struct capture_manager_t *m);
+static uint capture_dma, vsync_dma;
+static dma_channel_config capture_incr, capture_fixed;
+static spin_lock_t *capture_lock;
+static uint32_t capture_sink, vsync_dummy;
+
+static inline uint32_t capture_write_words(void)
+{
+	return CAPTURE_DMA_WORDS-dma_channel_hw_addr(capture_dma)->transfer_count;
+}
+
+static void capture_target(int target)
+{
+	if(target==CAPTURE_SINK)
+		dma_channel_configure(capture_dma, &capture_fixed, &capture_sink, &capture_pio->rxf[capture_sm_index],
+			CAPTURE_DMA_WORDS, true);
+	else
+		dma_channel_configure(capture_dma, &capture_incr, manager->buffer[target], &capture_pio->rxf[capture_sm_index],
+			CAPTURE_DMA_WORDS, true);
+}
+
+static void __not_in_flash_func(capture_vsync_irq)(void)
+{
+	dma_hw->ints1 = 1u<<vsync_dma;
+	uint32_t words = capture_write_words();
+	dma_channel_abort(capture_dma);
+
+	pio_sm_set_enabled(capture_pio, capture_sm_index, false);
+	pio_sm_clear_fifos(capture_pio, capture_sm_index);
+	pio_sm_restart(capture_pio, capture_sm_index);
+
+	uint32_t save = spin_lock_blocking(capture_lock);
+	if(vsync_hook)
+		vsync_hook(manager);
+	int target = capture_vsync(manager, words);
+	spin_unlock(capture_lock, save);
+
+	pio_sm_exec(capture_pio, capture_sm_index, pio_encode_jmp(capture_entry));
+	capture_target(target);
+	pio_sm_set_enabled(capture_pio, capture_sm_index, true);
+	dma_channel_set_write_addr(vsync_dma, &vsync_dummy, true);
+}
+
+// The buffers have to be set up with capture_init() first. capture_offset is where lcd_capture is loaded, and both
+// state machines have to be configured (but not running.)
+void capture_start(struct capture_manager_t *m, uint32_t pio_index, uint32_t capture_sm, uint32_t capture_offset,
+	uint32_t vsync_sm, uint32_t capture_chan, uint32_t vsync_chan)
+{
+	manager = m;
+	capture_pio = pio_index ? pio1 : pio0;
+	capture_sm_index = capture_sm;
+	capture_entry = capture_offset;
+	capture_dma = capture_chan;
+	vsync_dma = vsync_chan;
+	capture_lock = spin_lock_init(spin_lock_claim_unused(true));
+
+	capture_incr = dma_channel_get_default_config(capture_chan);
+	channel_config_set_transfer_data_size(&capture_incr, DMA_SIZE_32);
+	channel_config_set_read_increment(&capture_incr, false);
+	channel_config_set_write_increment(&capture_incr, true);
+	channel_config_set_dreq(&capture_incr, pio_get_dreq(capture_pio, capture_sm, false));
+	capture_fixed = capture_incr;
+	channel_config_set_write_increment(&capture_fixed, false);
+
+	dma_channel_config c = dma_channel_get_default_config(vsync_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_dreq(&c, pio_get_dreq(capture_pio, vsync_sm, false));
+	dma_channel_configure(vsync_chan, &c, &vsync_dummy, &capture_pio->rxf[vsync_sm], 1, false);
+	dma_channel_set_irq1_enabled(vsync_chan, true);
+	irq_set_exclusive_handler(DMA_IRQ_1, capture_vsync_irq);
+	irq_set_enabled(DMA_IRQ_1, true);
+
+	capture_target(m->target);
+	dma_channel_start(vsync_chan);
+	pio_sm_set_enabled(capture_pio, vsync_sm, true);
+	pio_sm_set_enabled(capture_pio, capture_sm, true);
+}
+
+// Called from the vsync IRQ before the frame that just ended is counted, with the manager's spin lock held.
+void capture_set_vsync_hook(void (*hook)(struct capture_manager_t *m))
+{
+	vsync_hook = hook;
+}
+
+// Only from the vsync hook, while the state machine is stopped: the capture starts again at offset. The new program has
+// to take the same pin and shift settings as the one capture_start() got.
+void __not_in_flash_func(capture_select_program)(uint32_t offset, uint32_t wrap_target, uint32_t wrap)
+{
+	capture_entry = offset;
+	pio_sm_set_wrap(capture_pio, capture_sm_index, wrap_target, wrap);
+}
+
+// format is set to the format of the frame (CAPTURE_FORMAT_NONE before the first one.)
+const uint32_t *__not_in_flash_func(capture_frame_begin)(struct capture_manager_t *m, int *format)
+{
+	uint32_t save = spin_lock_blocking(capture_lock);
+	int b = capture_display_begin(m);
+	*format = m->buffer_format[b];
+	spin_unlock(capture_lock, save);
+	return m->buffer[b];
+}
+
+void __not_in_flash_func(capture_frame_line)(struct capture_manager_t *m, int line)
+{
+	uint32_t save = spin_lock_blocking(capture_lock);
+	capture_display_line(m, line, capture_write_words());
+	spin_unlock(capture_lock, save);
+}
+
+void __not_in_flash_func(capture_frame_end)(struct capture_manager_t *m)
+{
+	uint32_t save = spin_lock_blocking(capture_lock);
+	capture_display_end(m);
+	spin_unlock(capture_lock, save);
+}
@@ -0,0 +1,243 @@
+/*
+	capture_manager.h
+
+	Decides which framebuffer the LCD capture writes into, and which one the encoder reads, so that the output only ever
+	shows whole frames. Channel 8 moves the words of lcd_capture into the capture buffer, and vsync_interruptor pushes a
+	word at every vsync, which channel 9 moves so that its completion IRQ can resync channel 8 (capture_manager.c.)
+
+	At every vsync, the number of words channel 8 moved since the last one says what the frame was:
+	-complete: exactly frame_words (CAPTURE_FRAME_WORDS unless the format changed), it becomes the ready frame
+	-short: fewer (power on, reset, or pixel clocks lost to a glitch)
+	-long: more (a vsync went missing, or spurious pixel clocks)
+	Short and long frames are dropped and their buffer is reused. The encoder takes the ready frame at the start of its own
+	frame (capture_display_begin()) and holds it until it's done with the last line, so the flip is a single index change
+	with both sides looking at the same state, never halfway through an output frame. Without a new frame, it shows the
+	last one again.
+
+	The capture writes into a buffer that's neither held by the encoder nor ready, and with no ready frame, nor the one
+	that's shown again. With 2 buffers there is sometimes none: the encoder holds one and the other was just completed.
+	The capture may then go into the held buffer if the encoder is far enough in (CAPTURE_SAFE_LINES) that the capture,
+	which writes lines faster than the encoder reads them, can't catch up with it. Otherwise the incoming frame goes to a
+	sink word (DMA write increment off) and is dropped.
+	A frame the encoder reads while the capture is writing into it is torn if the capture gets to a line before the encoder
+	does; capture_display_line() checks that for every line, so the safe line count is checked too, not just assumed.
+
+	The frame size and the format (which capture program it comes from) can change at a vsync (capture_set_format(), for
+	the model detection in model_detect.h.) Every buffer keeps the format of the frame that was completed in it, so the
+	encoder always reads a frame the way it was captured, including the old one it shows again while the first frame of
+	the new format comes in. A frame the right size can still be the wrong format (a DMG frame is the size of a GBC one),
+	so whoever changes the format can also reject the frame that just ended (capture_reject().)
+
+	Only one side changes the state at a time: the vsync IRQ on one side, and the encoder on the other, both under a
+	spin lock in capture_manager.c.
+*/
+
+#ifndef CAPTURE_MANAGER_H
+#define CAPTURE_MANAGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define CAPTURE_WIDTH 240
+#define CAPTURE_HEIGHT 160
+// lcd_capture pushes 2 pixels per word, lcd_capture_lut (lcd_cap_lut.pio) 4 pixels per 3 words
+#ifdef CAPTURE_LUT_BYTES
+#define CAPTURE_LINE_WORDS (CAPTURE_WIDTH*3/4)
+#else
+#define CAPTURE_LINE_WORDS (CAPTURE_WIDTH/2)
+#endif
+#define CAPTURE_FRAME_WORDS (CAPTURE_LINE_WORDS*CAPTURE_HEIGHT)
+// Channel 8 is allowed one line more than a frame, so a long frame is still counted and doesn't run off the buffer.
+#define CAPTURE_SLACK_WORDS CAPTURE_LINE_WORDS
+#define CAPTURE_DMA_WORDS (CAPTURE_FRAME_WORDS+CAPTURE_SLACK_WORDS)
+#define CAPTURE_MAX_BUFFERS 3
+// GBA: 160 of 228 lines are captured at 59.73Hz; the encoder reads its 160 lines over 480 of 539 lines at 59.81Hz.
+// Starting at line 0 when the encoder is at line r, the capture catches up at line r*228/(228-179.7), which is past
+// the last line for r>=34. Rounded up for the difference in frame start and the time to restart channel 8.
+#define CAPTURE_SAFE_LINES 40
+#define CAPTURE_SINK (-1)
+// Format of a buffer that hasn't had a complete frame yet
+#define CAPTURE_FORMAT_NONE (-1)
+
+enum capture_result_t
+{
+	CAPTURE_COMPLETE,
+	CAPTURE_SHORT,
+	CAPTURE_LONG,
+	CAPTURE_DROPPED, // went into the sink
+	CAPTURE_REJECTED // capture_reject()
+};
+
+struct capture_manager_t
+{
+	uint32_t *buffer[CAPTURE_MAX_BUFFERS];
+	int buffers;
+	int safe_lines;
+	int target; // buffer channel 8 writes into, or CAPTURE_SINK
+	int ready; // newest complete frame the encoder hasn't taken yet, or -1
+	int held; // buffer the encoder is reading, or -1 between its frames
+	int shown; // last buffer the encoder took
+	// Size and format of the frames being captured, and the format of the frame in every buffer
+	uint32_t line_words, frame_words;
+	int format;
+	int buffer_format[CAPTURE_MAX_BUFFERS];
+	bool reject; // drop the frame that ends at the next vsync
+	bool torn_frame; // the frame the encoder holds has been torn
+	int encoder_line; // last line of the held buffer the encoder got to (capture_display_line())
+	uint32_t last_words;
+	enum capture_result_t last_result;
+	// Statistics
+	uint32_t vsyncs;
+	uint32_t complete, short_frames, long_frames, dropped, rejected;
+	uint32_t skipped; // complete frames replaced by a newer one before the encoder took them
+	uint32_t shared; // captures into the held buffer
+	uint32_t displayed, repeated, torn;
+};
+
+// buffers holds count (2 or 3) framebuffers of CAPTURE_DMA_WORDS words. The capture starts in the sink, since the
+// first vsync ends a frame that started before anything was running. The encoder shows buffer 0 until there's a frame
+// (with format CAPTURE_FORMAT_NONE.) Frames are CAPTURE_LINE_WORDS x CAPTURE_HEIGHT in format 0 to begin with.
+static inline void capture_init(struct capture_manager_t *m, uint32_t *const *buffers, int count)
+{
+	memset(m, 0, sizeof(struct capture_manager_t));
+	if(count>CAPTURE_MAX_BUFFERS)
+		count = CAPTURE_MAX_BUFFERS;
+	for(int i=0; i<count; i++)
+		m->buffer[i] = buffers[i];
+	m->buffers = count;
+	m->safe_lines = CAPTURE_SAFE_LINES;
+	m->target = CAPTURE_SINK;
+	m->ready = -1;
+	m->held = -1;
+	m->shown = 0;
+	m->line_words = CAPTURE_LINE_WORDS;
+	m->frame_words = CAPTURE_FRAME_WORDS;
+	m->format = 0;
+	for(int i=0; i<CAPTURE_MAX_BUFFERS; i++)
+		m->buffer_format[i] = CAPTURE_FORMAT_NONE;
+}
+
+// Frames are line_words x lines words (at most CAPTURE_FRAME_WORDS) in format, from the frame that ends at the next
+// vsync on. Called at a vsync (the vsync hook in capture_manager.c), so that frame is the one that starts now; if it's
+// called before capture_vsync(), the frame that's ending would be counted in the new format, so it has to be rejected.
+static inline void capture_set_format(struct capture_manager_t *m, int format, uint32_t line_words, uint32_t lines)
+{
+	m->format = format;
+	m->line_words = line_words;
+	m->frame_words = line_words*lines;
+}
+
+// The frame that ends at the next capture_vsync() isn't shown, whatever its size.
+static inline void capture_reject(struct capture_manager_t *m)
+{
+	m->reject = true;
+}
+
+static inline bool capture_buffer_free(const struct capture_manager_t *m, int b)
+{
+	return b!=m->ready && b!=m->held && !(m->ready<0 && b==m->shown);
+}
+
+// Vsync: words is how many words channel 8 moved since the last vsync. The encoder is at encoder_line of the buffer
+// it holds, as far as it said (capture_display_line()). Returns the buffer for the next frame, or CAPTURE_SINK.
+static inline int capture_vsync(struct capture_manager_t *m, uint32_t words)
+{
+	m->vsyncs++;
+	m->last_words = words;
+	if(m->target==CAPTURE_SINK)
+	{
+		m->last_result = CAPTURE_DROPPED;
+		m->dropped++;
+	}
+	else if(m->reject)
+	{
+		m->last_result = CAPTURE_REJECTED;
+		m->rejected++;
+	}
+	else if(words<m->frame_words)
+	{
+		m->last_result = CAPTURE_SHORT;
+		m->short_frames++;
+	}
+	else if(words>m->frame_words)
+	{
+		m->last_result = CAPTURE_LONG;
+		m->long_frames++;
+	}
+	else
+	{
+		m->last_result = CAPTURE_COMPLETE;
+		m->complete++;
+		if(m->ready>=0)
+			m->skipped++;
+		m->ready = m->target;
+		m->buffer_format[m->target] = m->format;
+	}
+
+	m->reject = false;
+	int next = CAPTURE_SINK;
+	for(int b=0; b<m->buffers; b++)
+	{
+		if(capture_buffer_free(m, b))
+		{
+			next = b;
+			break;
+		}
+	}
+	// Only with a ready frame: the encoder takes that one next, so the held buffer isn't shown again.
+	if(next==CAPTURE_SINK && m->held>=0 && m->ready>=0 && m->encoder_line>=m->safe_lines)
+	{
+		next = m->held;
+		m->shared++;
+	}
+	m->target = next;
+	return next;
+}
+
+// Start of an encoder frame: takes the ready frame if there is one. Returns the buffer to read.
+static inline int capture_display_begin(struct capture_manager_t *m)
+{
+	if(m->ready>=0)
+	{
+		m->shown = m->ready;
+		m->ready = -1;
+	}
+	else
+		m->repeated++;
+	m->held = m->shown;
+	m->torn_frame = false;
+	m->encoder_line = 0;
+	m->displayed++;
+	return m->held;
+}
+
+// Before the encoder reads line (of the captured frame.) write_words is where channel 8 is in its current frame: if it's writing into the held
+// buffer and already past this line, the line is from the next frame. This is also the only way the capture learns
+// how far the encoder is, so every encoder has to call it (capture_frame_line()) for every line it reads, or the
+// held buffer is never shared and torn frames aren't counted.
+static inline void capture_display_line(struct capture_manager_t *m, int line, uint32_t write_words)
+{
+	m->encoder_line = line;
+	if(m->held>=0 && m->target==m->held && !m->torn_frame && write_words>(uint32_t)line*m->line_words)
+	{
+		m->torn_frame = true;
+		m->torn++;
+	}
+}
+
+static inline void capture_display_end(struct capture_manager_t *m)
+{
+	m->held = -1;
+}
+
+// Firmware side (capture_manager.c)
+void capture_start(struct capture_manager_t *m, uint32_t pio_index, uint32_t capture_sm, uint32_t capture_offset,
+	uint32_t vsync_sm, uint32_t capture_chan, uint32_t vsync_chan);
+const uint32_t *capture_frame_begin(struct capture_manager_t *m, int *format);
+void capture_set_vsync_hook(void (*hook)(struct capture_manager_t *m));
+void capture_select_program(uint32_t offset, uint32_t wrap_target, uint32_t wrap);
+void capture_frame_line(struct capture_manager_t *m, int line);
+void capture_frame_end(struct capture_manager_t *m);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+	data_island.h
+
+	HDMI data island packets: building them, the BCH ECC, and TERC4 encoding.
+
+	A packet is a 3 byte header and 4 subpackets of 7 bytes. The header gets a BCH(32,24) ECC byte and each subpacket
+	a BCH(64,56) one, both with the generator x^8+x^7+x^6+1, bits in LSB first.
+	Over the 32 pixel clocks of a packet, pixel i carries:
+	-channel 0: bit 0 hsync, bit 1 vsync, bit 2 header bit i, bit 3 zero on the first pixel of the data island and one
+	 after, so a packet that follows another one in the same island has it set on its pixel 0 too
+	-channel 1: bit n is bit 2i of subpacket n
+	-channel 2: bit n is bit 2i+1 of subpacket n
+	data_island_encode() does the BCH part once and keeps the 4-bit values without the sync bits and bit 3, since the
+	same packet can go out with different sync levels and at any position in the island. data_island_frame_words() adds
+	them when it builds the island words of a line.
+
+	InfoFrames (AVI, SPD, Audio) have the checksum in byte 0 of the payload, and payload byte n goes into subpacket n/7,
+	byte n%7. The checksum makes the header and all payload bytes add up to 0.
+*/
+
+#ifndef DATA_ISLAND_H
+#define DATA_ISLAND_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define DATA_ISLAND_PIXELS 32
+// Data island guard band on channels 1 and 2 (channel 0 sends TERC4 0xc with the sync bits)
+#define DATA_ISLAND_GUARD 0x133
+// Channel 0 bit 3, set on every island pixel but the first
+#define DATA_ISLAND_NOT_FIRST 0x8
+
+#define PACKET_NULL 0x00
+#define PACKET_ACR 0x01
+#define PACKET_AUDIO_SAMPLE 0x02
+#define PACKET_INFOFRAME_AVI 0x82
+#define PACKET_INFOFRAME_SPD 0x83
+#define PACKET_INFOFRAME_AUDIO 0x84
+
+// Samples per audio sample packet (2 channel layout)
+#define AUDIO_PACKET_SAMPLES 4
+// IEC 60958 channel status block length, in frames (stereo samples)
+#define AUDIO_STATUS_FRAMES 192
+
+static const uint16_t data_island_terc4[16] =
+{
+	0b1010011100, 0b1001100011, 0b1011100100, 0b1011100010,
+	0b0101110001, 0b0100011110, 0b0110001110, 0b0100111100,
+	0b1011001100, 0b0100111001, 0b0110011100, 0b1011000110,
+	0b1010001110, 0b1001110001, 0b0101100011, 0b1011000011
+};
+
+struct data_packet_t
+{
+	uint8_t header[3];
+	uint8_t subpacket[4][7];
+};
+
+// A packet after BCH: the 4-bit values of each channel, channel 0 without the sync bits and bit 3.
+struct data_island_t
+{
+	uint8_t nibble[3][DATA_ISLAND_PIXELS];
+};
+
+static inline uint8_t data_island_ecc(const uint8_t *data, int length)
+{
+	uint8_t ecc = 0;
+	for(int i=0; i<length; i++)
+	{
+		for(int b=0; b<8; b++)
+		{
+			int feedback = (ecc^(data[i]>>b))&1;
+			ecc = (uint8_t)((ecc>>1)^(feedback ? 0x83 : 0));
+		}
+	}
+	return ecc;
+}
+
+static inline void data_island_encode(const struct data_packet_t *packet, struct data_island_t *island)
+{
+	uint8_t header[4], sub[4][8];
+	memcpy(header, packet->header, 3);
+	header[3] = data_island_ecc(header, 3);
+	for(int n=0; n<4; n++)
+	{
+		memcpy(sub[n], packet->subpacket[n], 7);
+		sub[n][7] = data_island_ecc(sub[n], 7);
+	}
+	for(int i=0; i<DATA_ISLAND_PIXELS; i++)
+	{
+		uint8_t ch1 = 0, ch2 = 0;
+		for(int n=0; n<4; n++)
+		{
+			ch1 |= (uint8_t)(((sub[n][(2*i)>>3]>>((2*i)&7))&1)<<n);
+			ch2 |= (uint8_t)(((sub[n][(2*i+1)>>3]>>((2*i+1)&7))&1)<<n);
+		}
+		island->nibble[0][i] = (uint8_t)(((header[i>>3]>>(i&7))&1)<<2);
+		island->nibble[1][i] = ch1;
+		island->nibble[2][i] = ch2;
+	}
+}
+
+static inline void data_packet_null(struct data_packet_t *packet)
+{
+	memset(packet, 0, sizeof(struct data_packet_t));
+}
+
+static inline void data_packet_infoframe(struct data_packet_t *packet, uint8_t type, uint8_t version, uint8_t length,
+	const uint8_t *payload)
+{
+	uint8_t bytes[28] = {0};
+	uint8_t sum = (uint8_t)(type+version+length);
+	for(int i=1; i<=length && i<28; i++)
+	{
+		bytes[i] = payload[i-1];
+		sum = (uint8_t)(sum+bytes[i]);
+	}
+	bytes[0] = (uint8_t)(0x100-sum);
+	packet->header[0] = type;
+	packet->header[1] = version;
+	packet->header[2] = length;
+	for(int n=0; n<4; n++)
+		memcpy(packet->subpacket[n], bytes+7*n, 7);
+}
+
+// RGB, 4:3 picture and active format, no pixel repetition.
+static inline void data_packet_avi(struct data_packet_t *packet, uint8_t vic)
+{
+	uint8_t payload[13] = {0};
+	payload[1] = 0x18;
+	payload[3] = vic;
+	data_packet_infoframe(packet, PACKET_INFOFRAME_AVI, 2, 13, payload);
+}
+
+// Source Product Description: vendor (8 characters), product (16 characters), source type (0x08 is game console.)
+static inline void data_packet_spd(struct data_packet_t *packet, const char *vendor, const char *product, uint8_t source)
+{
+	uint8_t payload[25] = {0};
+	for(int i=0; i<8 && vendor[i]; i++)
+		payload[i] = (uint8_t)vendor[i];
+	for(int i=0; i<16 && product[i]; i++)
+		payload[8+i] = (uint8_t)product[i];
+	payload[24] = source;
+	data_packet_infoframe(packet, PACKET_INFOFRAME_SPD, 1, 25, payload);
+}
+
+// 2 channel LPCM, with sample rate and size taken from the stream.
+static inline void data_packet_audio_infoframe(struct data_packet_t *packet)
+{
+	uint8_t payload[10] = {0};
+	payload[0] = 0x01;
+	data_packet_infoframe(packet, PACKET_INFOFRAME_AUDIO, 1, 10, payload);
+}
+
+// Audio Clock Regeneration: 128*fs = f_tmds*N/CTS, where f_tmds is the TMDS character rate (the pixel clock.)
+static inline void data_packet_acr(struct data_packet_t *packet, uint32_t n, uint32_t cts)
+{
+	memset(packet, 0, sizeof(struct data_packet_t));
+	packet->header[0] = PACKET_ACR;
+	for(int i=0; i<4; i++)
+	{
+		packet->subpacket[i][1] = (uint8_t)((cts>>16)&0x0f);
+		packet->subpacket[i][2] = (uint8_t)(cts>>8);
+		packet->subpacket[i][3] = (uint8_t)cts;
+		packet->subpacket[i][4] = (uint8_t)((n>>16)&0x0f);
+		packet->subpacket[i][5] = (uint8_t)(n>>8);
+		packet->subpacket[i][6] = (uint8_t)n;
+	}
+}
+
+// Recommended N for the common sample rates, and the CTS that goes with it for a pixel clock.
+static inline uint32_t audio_acr_n(uint32_t sample_rate)
+{
+	switch(sample_rate)
+	{
+		case 32000: return 4096;
+		case 44100: return 6272;
+		default: return 128*sample_rate/1000;
+	}
+}
+
+static inline uint32_t audio_acr_cts(uint32_t pixel_hz, uint32_t sample_rate, uint32_t n)
+{
+	return (uint32_t)(((uint64_t)pixel_hz*n+64ull*sample_rate)/(128ull*sample_rate));
+}
+
+// IEC 60958 sample frequency code for channel status byte 3.
+static inline uint8_t audio_status_rate_code(uint32_t sample_rate)
+{
+	switch(sample_rate)
+	{
+		case 44100: return 0x0;
+		case 32000: return 0x3;
+		default: return 0x2; // 48kHz
+	}
+}
+
+// Audio sample packet with count (1-4) stereo samples, starting at frame (position in the 192 frame channel status block.)
+// The 16-bit samples go into the top of the 24-bit subframes. Channel status: consumer, PCM, no copyright, and the
+// sample rate in byte 3; the rest is zero.
+static inline void data_packet_audio(struct data_packet_t *packet, const int16_t *samples, int count, uint32_t frame,
+	uint8_t rate_code)
+{
+	memset(packet, 0, sizeof(struct data_packet_t));
+	packet->header[0] = PACKET_AUDIO_SAMPLE;
+	for(int i=0; i<count && i<AUDIO_PACKET_SAMPLES; i++)
+	{
+		uint32_t f = (frame+i)%AUDIO_STATUS_FRAMES;
+		// Channel status bit f: bit 2 of byte 0 is "no copyright", bits 24-27 are the sample rate.
+		int status = f==2 || (f>=24 && f<28 && ((rate_code>>(f-24))&1));
+		uint8_t flags = 0;
+		packet->header[1] |= (uint8_t)(1<<i);
+		if(!f)
+			packet->header[2] |= (uint8_t)(0x10<<i);
+		for(int ch=0; ch<2; ch++)
+		{
+			uint32_t sub = ((uint32_t)(uint16_t)samples[2*i+ch])<<8;
+			uint8_t *b = packet->subpacket[i]+3*ch;
+			b[0] = (uint8_t)sub;
+			b[1] = (uint8_t)(sub>>8);
+			b[2] = (uint8_t)(sub>>16);
+			// Even parity over the sample and the V, U and C bits
+			uint32_t p = sub^(uint32_t)status;
+			p ^= p>>16;
+			p ^= p>>8;
+			p ^= p>>4;
+			p ^= p>>2;
+			p ^= p>>1;
+			flags |= (uint8_t)(((status<<2)|((p&1)<<3))<<(4*ch));
+		}
+		packet->subpacket[i][6] = flags;
+	}
+}
+
+// Island words of one lane of a line in 30-bit framing (3 symbols per word, see blank_spans.h): words front/3 to
+// (front+32*count+2)/3 of the blanking region. The symbols in those words that aren't island pixels are the guard
+// bands around it. hsync is low from front to front+pulse, vsync is vsync_before before front and vsync_after from there.
+// Returns the number of words (none without packets.)
+static inline int data_island_frame_words(const struct data_island_t *const *islands, int count, int lane, int front, int pulse,
+	int vsync_before, int vsync_after, uint32_t *out)
+{
+	if(count<=0)
+		return 0;
+	int first = front/3, end = (front+DATA_ISLAND_PIXELS*count+2)/3;
+	int island_end = front+DATA_ISLAND_PIXELS*count;
+	for(int w=first; w<end; w++)
+	{
+		uint32_t word = 0;
+		for(int k=0; k<3; k++)
+		{
+			int p = 3*w+k;
+			int hsync = (p>=front && p<front+pulse) ? 0 : 1;
+			int sync = ((p<front ? vsync_before : vsync_after)<<1)|hsync;
+			uint32_t sym;
+			if(p<front || p>=island_end)
+				sym = lane ? DATA_ISLAND_GUARD : data_island_terc4[0xc|sync];
+			else
+			{
+				const struct data_island_t *island = islands[(p-front)/DATA_ISLAND_PIXELS];
+				int i = (p-front)%DATA_ISLAND_PIXELS;
+				int flags = lane ? 0 : sync|(p==front ? 0 : DATA_ISLAND_NOT_FIRST);
+				sym = data_island_terc4[island->nibble[lane][i]|flags];
+			}
+			word |= sym<<(10*k);
+		}
+		*out++ = word;
+	}
+	return end-first;
+}
+
+#endif
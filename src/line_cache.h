@@ -0,0 +1,184 @@
+/*
+	line_cache.h
+
+	Skips the encode of lines that were already encoded: every framebuffer line is hashed, and if a cache entry holds
+	the encoded output of a line with the same hash, the line DMA sends that entry instead of a freshly encoded line.
+	That covers lines that didn't change since the last frame, and lines that are the same as another line (borders,
+	plain backgrounds, vertical scrolling.)
+
+	Keeping all 160 encoded lines would take 3*TMDS_LINE_WORDS words each, 432KB, so there are only a few entries, and
+	they're given out so that a static screen keeps the same lines cached instead of going round and round: a line that
+	misses only takes an entry that wasn't used in the last frame, or the one its own line had before. If there is none,
+	it's encoded into one of the 2 plain line buffers and not kept. The entry of the line before is never taken, since
+	DMA is still sending it.
+
+	The hash is 2 multiply/xor chains over the 120 framebuffer words (the multiplier is single cycle on the RP2040), so
+	about 8 cycles a word, against around 15000 for the encode of a line. A wrong hit needs both 32-bit halves to
+	collide.
+*/
+
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tmds_channel_encode.h"
+
+#ifndef LINE_CACHE_ENTRIES
+#define LINE_CACHE_ENTRIES 16
+#endif
+#define LINE_CACHE_MAX_LINES 160
+#define LINE_CACHE_NONE (-1)
+
+struct line_cache_key_t
+{
+	uint32_t a, b;
+};
+
+struct line_cache_entry_t
+{
+	struct line_cache_key_t key;
+	uint32_t *lane[3];
+	int32_t stamp; // frame it was last used in, -2 if empty
+	int16_t line; // line it was last encoded for
+};
+
+struct line_cache_t
+{
+	struct line_cache_entry_t entry[LINE_CACHE_ENTRIES];
+	int entries;
+	uint32_t *scratch[2][3]; // the plain line buffers
+	// Per framebuffer line: the hash last frame and the entry it had
+	struct line_cache_key_t line_key[LINE_CACHE_MAX_LINES];
+	int16_t line_entry[LINE_CACHE_MAX_LINES];
+	int lines;
+	int32_t frame;
+	int pinned; // entry of the line before, LINE_CACHE_NONE if that was a scratch buffer
+	// Statistics: lines that changed since the last frame, hits, lines that were encoded and kept, and encoded and not kept
+	uint32_t frame_dirty, frame_hits;
+	uint32_t dirty, hits, kept, uncached, frames, static_frames;
+};
+
+static inline struct line_cache_key_t line_cache_hash(const uint32_t *fb_line)
+{
+	struct line_cache_key_t key = {0x811c9dc5u, 0x01000193u};
+	for(int i=0; i<TMDS_FB_LINE_WORDS; i++)
+	{
+		key.a = (key.a^fb_line[i])*0x9e3779b1u;
+		key.b = (key.b+fb_line[i])*0x85ebca77u;
+		key.b ^= key.b>>15;
+	}
+	return key;
+}
+
+static inline bool line_cache_key_equal(struct line_cache_key_t x, struct line_cache_key_t y)
+{
+	return x.a==y.a && x.b==y.b;
+}
+
+// lanes has count*3 buffers of TMDS_LINE_WORDS words for the entries (lane n of entry e at lanes[3*e+n]), and
+// scratch the 2 line buffers the encoder already has.
+static inline void line_cache_init(struct line_cache_t *c, uint32_t *const *lanes, int count, uint32_t *const scratch[2][3],
+	int lines)
+{
+	memset(c, 0, sizeof(struct line_cache_t));
+	if(count>LINE_CACHE_ENTRIES)
+		count = LINE_CACHE_ENTRIES;
+	if(lines>LINE_CACHE_MAX_LINES)
+		lines = LINE_CACHE_MAX_LINES;
+	c->entries = count;
+	c->lines = lines;
+	for(int e=0; e<count; e++)
+	{
+		for(int n=0; n<3; n++)
+			c->entry[e].lane[n] = lanes[3*e+n];
+		c->entry[e].stamp = -2;
+		c->entry[e].line = -1;
+	}
+	for(int b=0; b<2; b++)
+	{
+		for(int n=0; n<3; n++)
+			c->scratch[b][n] = scratch[b][n];
+	}
+	for(int l=0; l<lines; l++)
+		c->line_entry[l] = LINE_CACHE_NONE;
+	c->pinned = LINE_CACHE_NONE;
+	c->frame = -1;
+}
+
+// Picks where line (framebuffer line, seq is the running line count for the scratch buffers) comes from.
+// Fills lanes with the 3 lane buffers and returns true if they already hold the line (nothing to encode.)
+static inline bool line_cache_lookup(struct line_cache_t *c, int line, uint32_t seq, struct line_cache_key_t key,
+	uint32_t **lanes)
+{
+	if(line==0)
+	{
+		if(c->frame>=0)
+		{
+			c->frames++;
+			if(!c->frame_dirty)
+				c->static_frames++;
+		}
+		c->frame++;
+		c->frame_dirty = c->frame_hits = 0;
+	}
+	if(c->frame==0 || !line_cache_key_equal(key, c->line_key[line]))
+	{
+		c->frame_dirty++;
+		c->dirty++;
+	}
+	c->line_key[line] = key;
+
+	int found = LINE_CACHE_NONE, victim = LINE_CACHE_NONE;
+	int32_t oldest = c->frame-1;
+	for(int e=0; e<c->entries; e++)
+	{
+		struct line_cache_entry_t *entry = &c->entry[e];
+		if(entry->stamp>=0 && line_cache_key_equal(entry->key, key))
+		{
+			found = e;
+			break;
+		}
+		if(e!=c->pinned && entry->stamp<oldest)
+		{
+			oldest = entry->stamp;
+			victim = e;
+		}
+	}
+	if(found==LINE_CACHE_NONE && victim==LINE_CACHE_NONE)
+	{
+		int own = c->line_entry[line];
+		if(own!=LINE_CACHE_NONE && own!=c->pinned && c->entry[own].line==line && c->entry[own].stamp<c->frame)
+			victim = own;
+	}
+
+	int use = found!=LINE_CACHE_NONE ? found : victim;
+	if(use==LINE_CACHE_NONE)
+	{
+		for(int n=0; n<3; n++)
+			lanes[n] = c->scratch[seq&1][n];
+		c->line_entry[line] = LINE_CACHE_NONE;
+		c->pinned = LINE_CACHE_NONE;
+		c->uncached++;
+		return false;
+	}
+	struct line_cache_entry_t *entry = &c->entry[use];
+	for(int n=0; n<3; n++)
+		lanes[n] = entry->lane[n];
+	entry->stamp = c->frame;
+	c->line_entry[line] = (int16_t)use;
+	c->pinned = use;
+	if(found!=LINE_CACHE_NONE)
+	{
+		c->hits++;
+		c->frame_hits++;
+		return true;
+	}
+	entry->key = key;
+	entry->line = (int16_t)line;
+	c->kept++;
+	return false;
+}
+
+#endif
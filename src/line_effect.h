@@ -0,0 +1,75 @@
+/*
+	line_effect.h
+
+	Scanline and LCD grid looks, for free. Every input line already goes out SPLIT_LINE_REPEAT times and every pixel is
+	3 symbols from one LUT entry, so:
+	-scanlines: the last repeat of each line isn't the line buffer but a dark line, encoded once by line_effect_init().
+	 Only the read address of the line's active block changes (line_effect_source()), so the encode is the same.
+	-LCD grid: the same scanlines, plus a LUT where the third symbol of every entry is dimmed (grid_lut.bin from
+	 create_tmds_lut_grid() in tmds_util.c), so every third column is darker too. It's only another LUT pointer.
+	A dimmed copy of the line for the last repeat would look softer, but it's one more encode per line, so it's not
+	offered here.
+
+	With a line that isn't sent from its buffer on the last repeat, nothing else changes: the line buffer is still
+	released after SPLIT_LINE_REPEAT lines, and blank_spans_build() gets line_effect_source() as active, with
+	line_words words and read increment on. With model_detect.h, the grid LUT goes in place of the RGB555 one.
+*/
+
+#ifndef LINE_EFFECT_H
+#define LINE_EFFECT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "tmds_channel_encode.h"
+#include "tmds_encode_split.h"
+
+enum line_effect_mode_t
+{
+	LINE_EFFECT_NONE,
+	LINE_EFFECT_SCANLINES,
+	LINE_EFFECT_GRID,
+	LINE_EFFECT_MODES
+};
+
+// What a repeat of an input line sends
+#define LINE_EFFECT_IMAGE 0
+#define LINE_EFFECT_DARK 1
+
+struct line_effect_t
+{
+	int mode;
+	const uint32_t *tmds_lut; // the encoder has to use this LUT
+	uint8_t pattern[SPLIT_LINE_REPEAT];
+	int line_words; // TMDS_LINE_WORDS, or TMDS_LINE_PIXELS for lanes with a pull threshold of 30
+	uint32_t dark_line[3][TMDS_LINE_PIXELS];
+};
+
+// lut is the normal LUT and grid_lut the dimmed one (only needed for LINE_EFFECT_GRID.) dark is the 15-bit pixel of
+// the dark lines.
+static inline void line_effect_init(struct line_effect_t *e, int mode, const uint32_t *lut, const uint32_t *grid_lut,
+	uint32_t dark, int line_words)
+{
+	uint8_t values[TMDS_LINE_PIXELS];
+	e->mode = mode;
+	e->tmds_lut = mode==LINE_EFFECT_GRID ? grid_lut : lut;
+	e->line_words = line_words;
+	for(int r=0; r<SPLIT_LINE_REPEAT; r++)
+		e->pattern[r] = (mode!=LINE_EFFECT_NONE && r==SPLIT_LINE_REPEAT-1) ? LINE_EFFECT_DARK : LINE_EFFECT_IMAGE;
+	for(int lane=0; lane<3; lane++)
+	{
+		memset(values, (int)((dark>>tmds_channel_shift(lane))&0x1f), sizeof(values));
+		// Dark lines are whole lines of their own, so they start from the reset disparity like any other line
+		if(line_words==TMDS_LINE_PIXELS)
+			tmds_encode_channel_30(lut, values, e->dark_line[lane], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+		else
+			tmds_encode_channel(lut, values, e->dark_line[lane], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+	}
+}
+
+// Where lane reads from on repeat (0 to SPLIT_LINE_REPEAT-1) of the input line in line_buf.
+static inline const uint32_t *line_effect_source(const struct line_effect_t *e, int repeat, int lane, uint32_t *const line_buf[3])
+{
+	return e->pattern[repeat]==LINE_EFFECT_DARK ? e->dark_line[lane] : line_buf[lane];
+}
+
+#endif
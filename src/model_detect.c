@@ -0,0 +1,107 @@
+/*
+	model_detect.c
+
+	Firmware side of the model detection (see model_detect.h.)
+	lcd_timing runs on a free state machine of its own PIO, and a DMA channel moves every line count it pushes into
+	timing_line, so at a vsync timing_line has the pixel clocks of the last line and the drop in the transfer count of
+	the channel is the number of lines. The vsync hook of the capture manager reads both, restarts the channel, rejects
+	the frame if it isn't from the model the capture is set up for, and switches the capture program and format if the
+	model changed. That is all done while the capture is stopped for the vsync anyway; the output PIO and DMA never
+	notice.
+
+	model_next_frame() is the next_frame callback of the split encoder: it hands the frame it's done with back to the
+	capture manager, takes the newest one, and picks the LUT for its format. model_frame_line() is its frame_line
+	callback, which tells the capture manager the line the encoder reads, for the torn frame check and the early reuse
+	of the held buffer.
+*/
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/gpio.h"
+#include "model_detect.h"
+
+// More lines than a frame ever has, so the channel never runs out between 2 vsyncs
+#define TIMING_DMA_LINES 0x10000u
+
+static struct model_detect_t *detect;
+static struct capture_manager_t *detect_manager;
+static uint32_t program[MODEL_CAPTURES][3];
+static const uint32_t *model_luts[MODEL_LUTS];
+static uint timing_dma, strap;
+static uint32_t timing_line, last_vsync_us;
+static bool frame_held;
+
+static void __not_in_flash_func(model_vsync_hook)(struct capture_manager_t *m)
+{
+	struct lcd_measure_t ms;
+	uint32_t now = time_us_32();
+	ms.lines = TIMING_DMA_LINES-dma_channel_hw_addr(timing_dma)->transfer_count;
+	ms.line_pixels = timing_line;
+	ms.frame_us = now-last_vsync_us;
+	ms.strap = gpio_get(strap);
+	last_vsync_us = now;
+	// It's the vertical blank, no line count is on its way
+	dma_channel_abort(timing_dma);
+	dma_channel_set_trans_count(timing_dma, TIMING_DMA_LINES, true);
+
+	if(!model_detect_vsync(detect, m, &ms))
+		return;
+	const struct lcd_model_info_t *info = &lcd_models[detect->model];
+	capture_select_program(program[info->capture][0], program[info->capture][1], program[info->capture][2]);
+}
+
+// Has to be called before capture_start(), which gets the offset of lcd_capture. offsets has the offset, wrap target
+// and wrap of every capture program (all loaded on the capture PIO), and luts the LUT of every pipeline. The lcd_timing
+// state machine has to be configured (but not running.) The capture starts as a GBA.
+void model_detect_start(struct model_detect_t *d, struct capture_manager_t *m, const uint32_t offsets[MODEL_CAPTURES][3],
+	const uint32_t *const luts[MODEL_LUTS], uint32_t timing_pio, uint32_t timing_sm, uint32_t timing_chan,
+	uint32_t strap_pin)
+{
+	detect = d;
+	detect_manager = m;
+	for(int i=0; i<MODEL_CAPTURES; i++)
+	{
+		for(int n=0; n<3; n++)
+			program[i][n] = offsets[i][n];
+	}
+	for(int i=0; i<MODEL_LUTS; i++)
+		model_luts[i] = luts[i];
+	model_detect_init(d, LCD_MODEL_GBA);
+	model_capture_format(m, LCD_MODEL_GBA);
+	frame_held = false;
+
+	strap = strap_pin;
+	gpio_init(strap_pin);
+	gpio_set_dir(strap_pin, GPIO_IN);
+
+	PIO pio = timing_pio ? pio1 : pio0;
+	timing_dma = timing_chan;
+	dma_channel_config c = dma_channel_get_default_config(timing_chan);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_dreq(&c, pio_get_dreq(pio, timing_sm, false));
+	dma_channel_configure(timing_chan, &c, &timing_line, &pio->rxf[timing_sm], TIMING_DMA_LINES, true);
+
+	last_vsync_us = time_us_32();
+	capture_set_vsync_hook(model_vsync_hook);
+	pio_sm_set_enabled(pio, timing_sm, true);
+}
+
+void __not_in_flash_func(model_next_frame)(struct split_encode_t *enc, struct split_frame_t *frame)
+{
+	(void)enc;
+	int format;
+	if(frame_held)
+		capture_frame_end(detect_manager);
+	const uint32_t *pixels = capture_frame_begin(detect_manager, &format);
+	frame_held = true;
+	model_frame(frame, format, pixels, model_luts);
+}
+
+void __not_in_flash_func(model_frame_line)(struct split_encode_t *enc, int line)
+{
+	(void)enc;
+	capture_frame_line(detect_manager, line);
+}
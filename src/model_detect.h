@@ -0,0 +1,205 @@
+/*
+	model_detect.h
+
+	Works out which Gameboy the LCD signals come from, so one firmware runs all of them. lcd_timing (lcd_timing.pio)
+	pushes the pixel clocks of every line, and at every vsync model_detect.c has the pixel clocks of the last line, the
+	number of lines since the last vsync and the time between them, plus the level of GP28:
+	-240x160: GBA
+	-160x144: DMG if GP28 is high, GBC if it's low (the timing is the same, only the data lines differ)
+	Anything else, or a frame rate nowhere near 59.73Hz, is a glitch, a console that's off or resetting, or an LCD that
+	isn't there, and doesn't count. A model has to be measured MODEL_DETECT_FRAMES times in a row before the pipeline
+	changes, so a glitch can't switch it. A frame that wasn't measured as the model the pipeline is set up for is
+	rejected (capture_reject()) whatever its size, so the frames a DMG sends to the GBC pipeline (same size) before the
+	switch never show.
+
+	A pipeline is a capture program and a LUT. The GBC and the GBA both use lcd_capture, the DMG uses lcd_capture_dmg and
+	its own LUT (palette colors, see create_tmds_lut_dmg() in tmds_util.c.) All the capture programs are loaded when the
+	firmware starts, so a switch is a jump to another program at a vsync, while the capture is stopped anyway
+	(capture_select_program()), and the frames that were captured before it still show with their own pipeline, since
+	every capture buffer keeps its format (capture_manager.h.) The output side never stops, so there's no HDMI relink.
+
+	The framebuffer is 240x160 for all of them. A 160x144 frame is captured as it is (80 words a line) and the encoder
+	puts it in the middle, with border pixels around it (split_frame_t in tmds_encode_split.h.)
+*/
+
+#ifndef MODEL_DETECT_H
+#define MODEL_DETECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "capture_manager.h"
+#include "tmds_encode_split.h"
+
+enum lcd_model_t
+{
+	LCD_MODEL_DMG,
+	LCD_MODEL_GBC,
+	LCD_MODEL_GBA,
+	LCD_MODEL_COUNT
+};
+#define LCD_MODEL_NONE (-1)
+
+// Capture programs, in the order model_detect_start() gets them
+enum model_capture_t
+{
+	MODEL_CAPTURE_15BPP, // lcd_capture
+	MODEL_CAPTURE_DMG, // lcd_capture_dmg
+	MODEL_CAPTURES
+};
+
+enum model_lut_t
+{
+	MODEL_LUT_RGB555,
+	MODEL_LUT_DMG,
+	MODEL_LUTS
+};
+
+// Channel codes lcd_capture_dmg pushes for shade s (0 is the lightest)
+#define DMG_CODE_BLUE(s) (0x1c|(s))
+#define DMG_CODE_GREEN(s) ((s)<<3)
+#define DMG_CODE_RED(s) (0x04|(s))
+#define DMG_PIXEL(s) ((DMG_CODE_BLUE(s)<<10)|(DMG_CODE_GREEN(s)<<5)|DMG_CODE_RED(s))
+
+#define MODEL_STRAP_ANY (-1)
+#define MODEL_DETECT_FRAMES 3
+// 59.73Hz for all of them; outside this it's not a frame
+#define MODEL_FRAME_US_MIN 15000
+#define MODEL_FRAME_US_MAX 18500
+
+struct lcd_model_info_t
+{
+	const char *name;
+	int width, height;
+	int strap; // GP28 level, or MODEL_STRAP_ANY
+	int capture, lut;
+	uint32_t border; // pixel pair around a smaller frame
+};
+
+static const struct lcd_model_info_t lcd_models[LCD_MODEL_COUNT] =
+{
+	// The DMG border is the lightest shade, like the screen with the LCD off
+	{"DMG", 160, 144, 1, MODEL_CAPTURE_DMG, MODEL_LUT_DMG, ((uint32_t)DMG_PIXEL(0)<<16)|DMG_PIXEL(0)},
+	{"GBC", 160, 144, 0, MODEL_CAPTURE_15BPP, MODEL_LUT_RGB555, 0},
+	{"GBA", 240, 160, MODEL_STRAP_ANY, MODEL_CAPTURE_15BPP, MODEL_LUT_RGB555, 0},
+};
+
+// What was measured between 2 vsyncs
+struct lcd_measure_t
+{
+	uint32_t line_pixels; // pixel clocks in the last line
+	uint32_t lines; // lines with pixel clocks since the last vsync
+	uint32_t frame_us;
+	bool strap; // GP28
+};
+
+struct model_detect_t
+{
+	int model; // pipeline the capture is set up for
+	int candidate, streak;
+	bool frame_ok; // the last frame measured was from model
+	// Statistics
+	uint32_t frames, unknown, switches;
+};
+
+// model is the pipeline the capture starts with.
+static inline void model_detect_init(struct model_detect_t *d, int model)
+{
+	memset(d, 0, sizeof(struct model_detect_t));
+	d->model = model;
+	d->candidate = LCD_MODEL_NONE;
+}
+
+// The model a measurement fits, or LCD_MODEL_NONE.
+static inline int model_classify(const struct lcd_measure_t *ms)
+{
+	if(ms->frame_us<MODEL_FRAME_US_MIN || ms->frame_us>MODEL_FRAME_US_MAX)
+		return LCD_MODEL_NONE;
+	for(int i=0; i<LCD_MODEL_COUNT; i++)
+	{
+		const struct lcd_model_info_t *info = &lcd_models[i];
+		if(ms->line_pixels==(uint32_t)info->width && ms->lines==(uint32_t)info->height &&
+			(info->strap==MODEL_STRAP_ANY || info->strap==(ms->strap ? 1 : 0)))
+			return i;
+	}
+	return LCD_MODEL_NONE;
+}
+
+// At every vsync. Returns true if the pipeline has to change to d->model.
+static inline bool model_detect_frame(struct model_detect_t *d, const struct lcd_measure_t *ms)
+{
+	d->frames++;
+	int model = model_classify(ms);
+	d->frame_ok = model==d->model;
+	if(model==LCD_MODEL_NONE)
+	{
+		d->unknown++;
+		d->streak = 0;
+		return false;
+	}
+	if(model==d->model)
+	{
+		d->streak = 0;
+		return false;
+	}
+	if(model!=d->candidate)
+	{
+		d->candidate = model;
+		d->streak = 0;
+	}
+	if(++d->streak<MODEL_DETECT_FRAMES)
+		return false;
+	d->model = model;
+	d->streak = 0;
+	d->switches++;
+	return true;
+}
+
+// Capture format for a model (the format is the model number.)
+static inline void model_capture_format(struct capture_manager_t *m, int model)
+{
+	const struct lcd_model_info_t *info = &lcd_models[model];
+	capture_set_format(m, model, (uint32_t)info->width/2, (uint32_t)info->height);
+}
+
+// The vsync hook, before the frame that just ended is counted. Returns true if the capture has to go on with the
+// program of d->model (the format has been changed already.)
+static inline bool model_detect_vsync(struct model_detect_t *d, struct capture_manager_t *m, const struct lcd_measure_t *ms)
+{
+	bool changed = model_detect_frame(d, ms);
+	if(!d->frame_ok)
+		capture_reject(m);
+	if(changed)
+		model_capture_format(m, d->model);
+	return changed;
+}
+
+// Frame source for the encoder: pixels is a frame captured in format (CAPTURE_FORMAT_NONE shows all border.)
+static inline void model_frame(struct split_frame_t *frame, int format, const uint32_t *pixels,
+	const uint32_t *const luts[MODEL_LUTS])
+{
+	if(format==CAPTURE_FORMAT_NONE)
+	{
+		frame->tmds_lut = luts[MODEL_LUT_RGB555];
+		frame->pixels = NULL;
+		frame->border = 0;
+		return;
+	}
+	const struct lcd_model_info_t *info = &lcd_models[format];
+	frame->tmds_lut = luts[info->lut];
+	frame->pixels = pixels;
+	frame->line_words = info->width/2;
+	frame->height = info->height;
+	frame->x_words = (TMDS_FB_LINE_WORDS-frame->line_words)/2;
+	frame->y = (CAPTURE_HEIGHT-info->height)/2;
+	frame->border = info->border;
+}
+
+// Firmware side (model_detect.c)
+void model_detect_start(struct model_detect_t *d, struct capture_manager_t *m, const uint32_t offsets[MODEL_CAPTURES][3],
+	const uint32_t *const luts[MODEL_LUTS], uint32_t timing_pio, uint32_t timing_sm, uint32_t timing_chan,
+	uint32_t strap_pin);
+void model_next_frame(struct split_encode_t *enc, struct split_frame_t *frame);
+void model_frame_line(struct split_encode_t *enc, int line);
+
+#endif
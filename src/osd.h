@@ -0,0 +1,384 @@
+/*
+	osd.h
+
+	On-screen display for the settings (palette, color correction, scaling, audio volume): a box of text, drawn into
+	lines that are already encoded, without encoding them again. Input (the SNES controller port) isn't here; this
+	only draws what it's given.
+
+	The box is a whole number of 16 pixel groups wide, so in the packed lanes it starts and ends on a word boundary.
+	Its lines are rows of glyphs from osd_font.h, with a 4 pixel margin on both sides. Every line of the box comes
+	down to one 4 bit pattern per 4 pixels (osd_render()), and every pattern is encoded ahead of time for each of the
+	4 places a group of 4 pixels can be in a packed group of 16 (osd_set_colors()), so the box goes in with 18 loads
+	and 15 stores per group, with no separating, no lookups and no packing.
+
+	That only works because the OSD colors don't care about the disparity: their 8-bit values (depth_convert() of the
+	5-bit value) have 4 ones in q_m, so the DVI encoder sends the same symbol whatever the running disparity is, and
+	leaves it as it was. That's 2, 7, 9, 11, 20, 22, 24 and 29 of the 32 values, for every channel; osd_set_colors()
+	turns anything else down.
+	The box still changes the disparity at its right edge: the pixels right of it were encoded starting from whatever
+	the original pixels under the box left behind. So the last 2 pixels of the box are fix-up pixels, which take the
+	disparity from what it is at the left edge to what it was at the right edge. Both come from the words themselves:
+	the running disparity is the ones minus the zeros of everything that was sent since the start of the line (where
+	it's 0), so it's a popcount. The fix-up colors are picked once per lane for every pair of disparities, as close
+	to the background as they can be (osd_set_colors()). Every disparity a line can get to from 0 can get to every other
+	one in 2 pixels, so with lines from create_tmds_lut() the whole line stays exactly what the encoder would have sent
+	for the pixels it shows; anything else that can't be reached gets as close as it can, and is counted in inexact.
+
+	The popcount up to the right edge of the box is most of the cost (scripts/osd_check.c has the numbers): a box on
+	the left of the line costs about a third of encoding the lane again, and one on the right three quarters.
+
+	Lines under the box change, so with a line cache the key of those lines has to change too (osd_line_key()). Then a
+	patched line stays in the cache like any other, and a static screen with the OSD up costs nothing per line.
+*/
+
+#ifndef OSD_H
+#define OSD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tmds_channel_encode.h"
+#include "osd_font.h"
+
+#define OSD_CELL_PIXELS 8
+#define OSD_MARGIN 4 // pixels left of the first column, and right of the last one
+// 1 blank line, the 8 lines of the glyphs, 1 blank line
+#define OSD_ROW_LINES (OSD_FONT_HEIGHT+2)
+#define OSD_MAX_ROWS 4
+#define OSD_MAX_LINES (OSD_MAX_ROWS*OSD_ROW_LINES)
+#define OSD_MAX_GROUPS (TMDS_LINE_PIXELS/TMDS_PACK_GROUP)
+#define OSD_MAX_COLS (OSD_MAX_GROUPS*TMDS_PACK_GROUP/OSD_CELL_PIXELS-1)
+#define OSD_PATTERN_PIXELS 4
+#define OSD_PATTERNS (OSD_MAX_GROUPS*TMDS_PACK_GROUP/OSD_PATTERN_PIXELS)
+// 4 tripled pixels are 120 bits, and can start anywhere in a word but its top 2 bits
+#define OSD_RUN_WORDS 5
+#define OSD_FIXUP_PIXELS 2
+#define OSD_FIXUP_INEXACT 0x8000
+// LUT disparity states (see lut_disparity() in tmds_util.c)
+#define OSD_DISP_STATES 16
+
+struct osd_t
+{
+	const uint32_t *tmds_lut; // the RGB555 LUT (create_tmds_lut()), whatever LUT the lines came from
+	int line_words; // TMDS_LINE_WORDS, or TMDS_LINE_PIXELS for lanes with a pull threshold of 30
+	bool visible;
+	int x_groups, groups; // box position and width, in 16 pixel groups
+	int y, rows; // first framebuffer line, and rows of text
+	uint32_t fg, bg; // 15-bit pixels
+	char text[OSD_MAX_ROWS][OSD_MAX_COLS+1];
+	uint32_t generation; // goes up with every change
+	// From osd_render(): pattern of every 4 pixels of every line of the box (bit 3 is the leftmost pixel, 1 is fg)
+	uint8_t pattern[OSD_MAX_LINES][OSD_PATTERNS];
+	uint32_t line_key[OSD_MAX_LINES];
+	// From osd_set_colors(), per lane: the tripled symbols of bg and fg, every pattern at every place in a packed
+	// group, and the 2 fix-up colors (c1|c2<<5) for every disparity at the left and right edge of the box
+	uint32_t symbols[3][2];
+	uint32_t run[3][TMDS_PACK_GROUP/OSD_PATTERN_PIXELS][16][OSD_RUN_WORDS];
+	uint16_t fixup[3][OSD_DISP_STATES][OSD_DISP_STATES];
+	// Statistics, per lane so that each core only writes its own: fix-ups that didn't get to the disparity they had to
+	uint32_t inexact[3];
+};
+
+static inline const uint32_t *osd_lut_entry(const uint32_t *lut, uint32_t color, uint32_t disp)
+{
+	return lut+((color<<1)|disp);
+}
+
+// True if the 5-bit value is sent the same way from every disparity, and leaves the disparity alone.
+static inline bool osd_balanced(const uint32_t *lut, uint32_t value)
+{
+	uint32_t symbols = osd_lut_entry(lut, value, TMDS_DISP_RESET)[0];
+	for(uint32_t d=0; d<OSD_DISP_STATES; d++)
+	{
+		const uint32_t *entry = osd_lut_entry(lut, value, d<<6);
+		if(entry[0]!=symbols || entry[1]!=(d<<6))
+			return false;
+	}
+	return true;
+}
+
+static inline uint32_t osd_channel(uint32_t pixel, int lane)
+{
+	return (pixel>>tmds_channel_shift(lane))&0x1f;
+}
+
+// LUT disparity state of a running disparity, false if it's out of range
+static inline bool osd_disp_state(int disparity, uint32_t *state)
+{
+	int s = disparity/2+8;
+	*state = (uint32_t)(s<0 ? 0 : s>=OSD_DISP_STATES ? OSD_DISP_STATES-1 : s);
+	return s>=0 && s<OSD_DISP_STATES;
+}
+
+static inline void osd_init(struct osd_t *osd, const uint32_t *lut, int line_words)
+{
+	memset(osd, 0, sizeof(struct osd_t));
+	osd->tmds_lut = lut;
+	osd->line_words = line_words;
+	osd->groups = 1;
+	osd->rows = 1;
+}
+
+// Builds the runs and the fix-up tables for fg and bg. Returns false (and changes nothing) if a channel of either
+// isn't one of the balanced values (osd_balanced().)
+static inline bool osd_set_colors(struct osd_t *osd, uint32_t fg, uint32_t bg)
+{
+	const uint32_t *lut = osd->tmds_lut;
+	for(int lane=0; lane<3; lane++)
+	{
+		if(!osd_balanced(lut, osd_channel(fg, lane)) || !osd_balanced(lut, osd_channel(bg, lane)))
+			return false;
+	}
+	osd->fg = fg;
+	osd->bg = bg;
+	for(int lane=0; lane<3; lane++)
+	{
+		uint32_t back = osd_channel(bg, lane);
+		osd->symbols[lane][0] = osd_lut_entry(lut, back, TMDS_DISP_RESET)[0];
+		osd->symbols[lane][1] = osd_lut_entry(lut, osd_channel(fg, lane), TMDS_DISP_RESET)[0];
+
+		// Pattern k of a group starts at bit 120*k, which is bit 0, 24, 16 or 8 of its first word
+		for(int k=0; k<TMDS_PACK_GROUP/OSD_PATTERN_PIXELS; k++)
+		{
+			int offset = (k*OSD_PATTERN_PIXELS*30)&31;
+			for(int p=0; p<16; p++)
+			{
+				uint32_t *run = osd->run[lane][k][p];
+				memset(run, 0, OSD_RUN_WORDS*sizeof(uint32_t));
+				for(int i=0; i<OSD_PATTERN_PIXELS; i++)
+				{
+					uint32_t s = osd->symbols[lane][(p>>(OSD_PATTERN_PIXELS-1-i))&1];
+					int bit = offset+30*i;
+					run[bit>>5] |= s<<(bit&31);
+					if((bit&31)>2)
+						run[(bit>>5)+1] |= s>>(32-(bit&31));
+				}
+			}
+		}
+
+		// Fix-ups: every pair of colors from every disparity, the cheapest for every disparity it gets to
+		uint8_t cost[OSD_DISP_STATES][OSD_DISP_STATES];
+		memset(cost, 0xff, sizeof(cost));
+		for(uint32_t s=0; s<OSD_DISP_STATES; s++)
+		{
+			for(uint32_t c1=0; c1<32; c1++)
+			{
+				uint32_t d1 = osd_lut_entry(lut, c1, s<<6)[1];
+				for(uint32_t c2=0; c2<32; c2++)
+				{
+					uint32_t t = osd_lut_entry(lut, c2, d1)[1]>>6;
+					int c = (c1>back ? c1-back : back-c1)+(c2>back ? c2-back : back-c2);
+					if(c<cost[s][t])
+					{
+						cost[s][t] = (uint8_t)c;
+						osd->fixup[lane][s][t] = (uint16_t)(c1|(c2<<5));
+					}
+				}
+			}
+			// The ones it can't get to take the closest one it can
+			for(int t=0; t<OSD_DISP_STATES; t++)
+			{
+				if(cost[s][t]!=0xff)
+					continue;
+				int best = -1;
+				for(int u=0; u<OSD_DISP_STATES; u++)
+				{
+					if(cost[s][u]!=0xff && (best<0 || (u>t ? u-t : t-u)<(best>t ? best-t : t-best)))
+						best = u;
+				}
+				osd->fixup[lane][s][t] = osd->fixup[lane][s][best]|OSD_FIXUP_INEXACT;
+			}
+		}
+	}
+	osd->generation++;
+	return true;
+}
+
+// Box at x_groups*16 pixels from the left, groups*16 pixels wide (2*groups-1 columns), and rows rows from line y.
+static inline void osd_set_box(struct osd_t *osd, int x_groups, int groups, int y, int rows)
+{
+	if(groups<1)
+		groups = 1;
+	if(groups>OSD_MAX_GROUPS)
+		groups = OSD_MAX_GROUPS;
+	if(x_groups<0)
+		x_groups = 0;
+	if(x_groups>OSD_MAX_GROUPS-groups)
+		x_groups = OSD_MAX_GROUPS-groups;
+	if(rows<1)
+		rows = 1;
+	if(rows>OSD_MAX_ROWS)
+		rows = OSD_MAX_ROWS;
+	osd->x_groups = x_groups;
+	osd->groups = groups;
+	osd->y = y;
+	osd->rows = rows;
+	osd->generation++;
+}
+
+static inline int osd_cols(const struct osd_t *osd)
+{
+	return osd->groups*TMDS_PACK_GROUP/OSD_CELL_PIXELS-1;
+}
+
+// Text of a row, cut at the width of the box. Shows up with the next osd_render().
+static inline void osd_print(struct osd_t *osd, int row, const char *text)
+{
+	if(row<0 || row>=OSD_MAX_ROWS)
+		return;
+	strncpy(osd->text[row], text, OSD_MAX_COLS);
+	osd->text[row][OSD_MAX_COLS] = 0;
+}
+
+// Turns the text into the patterns of every line of the box, and gives every line its cache key.
+static inline void osd_render(struct osd_t *osd)
+{
+	int cols = osd_cols(osd);
+	osd->generation++;
+	for(int l=0; l<osd->rows*OSD_ROW_LINES; l++)
+	{
+		const char *text = osd->text[l/OSD_ROW_LINES];
+		int glyph_line = l%OSD_ROW_LINES-1;
+		uint8_t *pattern = osd->pattern[l];
+		int len = (int)strlen(text);
+		// The margins are half a glyph each, so every glyph is 2 whole patterns
+		memset(pattern, 0, OSD_PATTERNS);
+		for(int c=0; c<cols && c<len && glyph_line>=0 && glyph_line<OSD_FONT_HEIGHT; c++)
+		{
+			uint8_t bits = osd_font_glyph(text[c])[glyph_line];
+			pattern[1+2*c] = bits>>4;
+			pattern[2+2*c] = bits&0x0f;
+		}
+		uint32_t key = 0x811c9dc5u^osd->generation;
+		for(int i=0; i<osd->groups*(TMDS_PACK_GROUP/OSD_PATTERN_PIXELS); i++)
+			key = (key^pattern[i])*0x01000193u;
+		osd->line_key[l] = key;
+	}
+}
+
+// What goes into the line cache key of a framebuffer line (0 outside the box, or with the OSD off.)
+static inline uint32_t osd_line_key(const struct osd_t *osd, int line)
+{
+	int l = line-osd->y;
+	if(!osd->visible || l<0 || l>=osd->rows*OSD_ROW_LINES)
+		return 0;
+	return osd->line_key[l]^osd->generation;
+}
+
+// Number of ones in count words.
+static inline uint32_t osd_popcount(const uint32_t *words, int count)
+{
+	uint32_t total = 0;
+	while(count>0)
+	{
+		// Byte counts of up to 31 words still fit into a byte
+		int n = count<31 ? count : 31;
+		uint32_t bytes = 0;
+		for(int i=0; i<n; i++)
+		{
+			uint32_t v = words[i];
+			v -= (v>>1)&0x55555555u;
+			v = (v&0x33333333u)+((v>>2)&0x33333333u);
+			bytes += (v+(v>>4))&0x0f0f0f0fu;
+		}
+		bytes = (bytes&0x00ff00ffu)+((bytes>>8)&0x00ff00ffu);
+		total += (bytes+(bytes>>16))&0xffff;
+		words += n;
+		count -= n;
+	}
+	return total;
+}
+
+// Puts the tripled symbols of one pixel into a packed lane.
+static inline void osd_put_packed(uint32_t *lane, int pixel, uint32_t symbols)
+{
+	int bit = pixel*30;
+	uint32_t *w = lane+(bit>>5);
+	int shift = bit&31;
+	w[0] = (w[0]&~(0x3fffffffu<<shift))|(symbols<<shift);
+	if(shift>2)
+		w[1] = (w[1]&~(0x3fffffffu>>(32-shift)))|(symbols>>(32-shift));
+}
+
+// Draws line (framebuffer line) of the box into one lane of an encoded line: lane words from tmds_encode_channel()
+// or tmds_encode_channel_30(), as osd->line_words says. Does nothing for lines outside the box.
+static inline void osd_patch_lane(struct osd_t *osd, int line, int lane, uint32_t *buf)
+{
+	int l = line-osd->y;
+	if(!osd->visible || l<0 || l>=osd->rows*OSD_ROW_LINES)
+		return;
+	const uint8_t *pattern = osd->pattern[l];
+	int first = osd->x_groups*TMDS_PACK_GROUP, pixels = osd->groups*TMDS_PACK_GROUP;
+	uint32_t before, inside;
+	if(osd->line_words==TMDS_LINE_WORDS)
+	{
+		uint32_t *w = buf+osd->x_groups*TMDS_PACK_WORDS;
+		before = osd_popcount(buf, osd->x_groups*TMDS_PACK_WORDS);
+		inside = osd_popcount(w, osd->groups*TMDS_PACK_WORDS);
+		const uint32_t (*run)[16][OSD_RUN_WORDS] = osd->run[lane];
+		for(int g=0; g<osd->groups; g++)
+		{
+			const uint32_t *r0 = run[0][pattern[0]], *r1 = run[1][pattern[1]];
+			const uint32_t *r2 = run[2][pattern[2]], *r3 = run[3][pattern[3]];
+			w[0] = r0[0];
+			w[1] = r0[1];
+			w[2] = r0[2];
+			w[3] = r0[3]|r1[0];
+			w[4] = r1[1];
+			w[5] = r1[2];
+			w[6] = r1[3];
+			w[7] = r1[4]|r2[0];
+			w[8] = r2[1];
+			w[9] = r2[2];
+			w[10] = r2[3];
+			w[11] = r2[4]|r3[0];
+			w[12] = r3[1];
+			w[13] = r3[2];
+			w[14] = r3[3];
+			w += TMDS_PACK_WORDS;
+			pattern += TMDS_PACK_GROUP/OSD_PATTERN_PIXELS;
+		}
+	}
+	else
+	{
+		uint32_t *w = buf+first;
+		const uint32_t *symbols = osd->symbols[lane];
+		before = osd_popcount(buf, first);
+		inside = osd_popcount(w, pixels);
+		for(int i=0; i<pixels/OSD_PATTERN_PIXELS; i++)
+		{
+			uint32_t p = pattern[i];
+			w[0] = symbols[(p>>3)&1];
+			w[1] = symbols[(p>>2)&1];
+			w[2] = symbols[(p>>1)&1];
+			w[3] = symbols[p&1];
+			w += OSD_PATTERN_PIXELS;
+		}
+	}
+
+	// The runs left the disparity where it was at the left edge, and the fix-up pixels take it to where it was at
+	// the right edge
+	int left = 2*(int)before-30*first;
+	int right = left+2*(int)inside-30*pixels;
+	uint32_t s, t;
+	bool exact = osd_disp_state(left, &s);
+	exact = osd_disp_state(right, &t) && exact;
+	uint32_t f = osd->fixup[lane][s][t];
+	const uint32_t *e1 = osd_lut_entry(osd->tmds_lut, f&0x1f, s<<6);
+	const uint32_t *e2 = osd_lut_entry(osd->tmds_lut, (f>>5)&0x1f, e1[1]);
+	if(!exact || (f&OSD_FIXUP_INEXACT))
+		osd->inexact[lane]++;
+	int fix = first+pixels-OSD_FIXUP_PIXELS;
+	if(osd->line_words==TMDS_LINE_WORDS)
+	{
+		osd_put_packed(buf, fix, e1[0]);
+		osd_put_packed(buf, fix+1, e2[0]);
+	}
+	else
+	{
+		buf[fix] = e1[0];
+		buf[fix+1] = e2[0];
+	}
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+	osd_font.h
+
+	8x8 font for the on-screen display (osd.h): ASCII 0x20-0x5f, so digits, upper case and punctuation. Lower case is
+	drawn with the upper case glyphs. Each glyph is 5x7 in columns 1-5 and rows 0-6, one byte per row with bit 7 as the
+	leftmost pixel, which leaves 3 pixels between characters and row 7 for the space between lines.
+*/
+
+#ifndef OSD_FONT_H
+#define OSD_FONT_H
+
+#include <stdint.h>
+
+#define OSD_FONT_FIRST 0x20
+#define OSD_FONT_GLYPHS 64
+#define OSD_FONT_HEIGHT 8
+
+static const uint8_t osd_font[OSD_FONT_GLYPHS*OSD_FONT_HEIGHT] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ' '
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x10, 0x00, // '!'
+	0x28, 0x28, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, // '"'
+	0x28, 0x28, 0x7c, 0x28, 0x7c, 0x28, 0x28, 0x00, // '#'
+	0x10, 0x3c, 0x50, 0x38, 0x14, 0x78, 0x10, 0x00, // '$'
+	0x60, 0x64, 0x08, 0x10, 0x20, 0x4c, 0x0c, 0x00, // '%'
+	0x30, 0x48, 0x50, 0x20, 0x54, 0x48, 0x34, 0x00, // '&'
+	0x10, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, // '''
+	0x08, 0x10, 0x20, 0x20, 0x20, 0x10, 0x08, 0x00, // '('
+	0x20, 0x10, 0x08, 0x08, 0x08, 0x10, 0x20, 0x00, // ')'
+	0x00, 0x10, 0x54, 0x38, 0x54, 0x10, 0x00, 0x00, // '*'
+	0x00, 0x10, 0x10, 0x7c, 0x10, 0x10, 0x00, 0x00, // '+'
+	0x00, 0x00, 0x00, 0x00, 0x30, 0x10, 0x20, 0x00, // ','
+	0x00, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x00, 0x00, // '-'
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, // '.'
+	0x00, 0x04, 0x08, 0x10, 0x20, 0x40, 0x00, 0x00, // '/'
+	0x38, 0x44, 0x4c, 0x54, 0x64, 0x44, 0x38, 0x00, // '0'
+	0x10, 0x30, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00, // '1'
+	0x38, 0x44, 0x04, 0x08, 0x10, 0x20, 0x7c, 0x00, // '2'
+	0x7c, 0x08, 0x10, 0x08, 0x04, 0x44, 0x38, 0x00, // '3'
+	0x08, 0x18, 0x28, 0x48, 0x7c, 0x08, 0x08, 0x00, // '4'
+	0x7c, 0x40, 0x78, 0x04, 0x04, 0x44, 0x38, 0x00, // '5'
+	0x18, 0x20, 0x40, 0x78, 0x44, 0x44, 0x38, 0x00, // '6'
+	0x7c, 0x04, 0x08, 0x10, 0x20, 0x20, 0x20, 0x00, // '7'
+	0x38, 0x44, 0x44, 0x38, 0x44, 0x44, 0x38, 0x00, // '8'
+	0x38, 0x44, 0x44, 0x3c, 0x04, 0x08, 0x30, 0x00, // '9'
+	0x00, 0x30, 0x30, 0x00, 0x30, 0x30, 0x00, 0x00, // ':'
+	0x00, 0x30, 0x30, 0x00, 0x30, 0x10, 0x20, 0x00, // ';'
+	0x08, 0x10, 0x20, 0x40, 0x20, 0x10, 0x08, 0x00, // '<'
+	0x00, 0x00, 0x7c, 0x00, 0x7c, 0x00, 0x00, 0x00, // '='
+	0x20, 0x10, 0x08, 0x04, 0x08, 0x10, 0x20, 0x00, // '>'
+	0x38, 0x44, 0x04, 0x08, 0x10, 0x00, 0x10, 0x00, // '?'
+	0x38, 0x44, 0x04, 0x34, 0x54, 0x54, 0x38, 0x00, // '@'
+	0x38, 0x44, 0x44, 0x7c, 0x44, 0x44, 0x44, 0x00, // 'A'
+	0x78, 0x44, 0x44, 0x78, 0x44, 0x44, 0x78, 0x00, // 'B'
+	0x38, 0x44, 0x40, 0x40, 0x40, 0x44, 0x38, 0x00, // 'C'
+	0x70, 0x48, 0x44, 0x44, 0x44, 0x48, 0x70, 0x00, // 'D'
+	0x7c, 0x40, 0x40, 0x78, 0x40, 0x40, 0x7c, 0x00, // 'E'
+	0x7c, 0x40, 0x40, 0x78, 0x40, 0x40, 0x40, 0x00, // 'F'
+	0x38, 0x44, 0x40, 0x5c, 0x44, 0x44, 0x3c, 0x00, // 'G'
+	0x44, 0x44, 0x44, 0x7c, 0x44, 0x44, 0x44, 0x00, // 'H'
+	0x38, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00, // 'I'
+	0x1c, 0x08, 0x08, 0x08, 0x08, 0x48, 0x30, 0x00, // 'J'
+	0x44, 0x48, 0x50, 0x60, 0x50, 0x48, 0x44, 0x00, // 'K'
+	0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x7c, 0x00, // 'L'
+	0x44, 0x6c, 0x54, 0x54, 0x44, 0x44, 0x44, 0x00, // 'M'
+	0x44, 0x44, 0x64, 0x54, 0x4c, 0x44, 0x44, 0x00, // 'N'
+	0x38, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00, // 'O'
+	0x78, 0x44, 0x44, 0x78, 0x40, 0x40, 0x40, 0x00, // 'P'
+	0x38, 0x44, 0x44, 0x44, 0x54, 0x48, 0x34, 0x00, // 'Q'
+	0x78, 0x44, 0x44, 0x78, 0x50, 0x48, 0x44, 0x00, // 'R'
+	0x3c, 0x40, 0x40, 0x38, 0x04, 0x04, 0x78, 0x00, // 'S'
+	0x7c, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, // 'T'
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00, // 'U'
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x28, 0x10, 0x00, // 'V'
+	0x44, 0x44, 0x44, 0x54, 0x54, 0x54, 0x28, 0x00, // 'W'
+	0x44, 0x44, 0x28, 0x10, 0x28, 0x44, 0x44, 0x00, // 'X'
+	0x44, 0x44, 0x28, 0x10, 0x10, 0x10, 0x10, 0x00, // 'Y'
+	0x7c, 0x04, 0x08, 0x10, 0x20, 0x40, 0x7c, 0x00, // 'Z'
+	0x38, 0x20, 0x20, 0x20, 0x20, 0x20, 0x38, 0x00, // '['
+	0x00, 0x40, 0x20, 0x10, 0x08, 0x04, 0x00, 0x00, // backslash
+	0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x38, 0x00, // ']'
+	0x10, 0x28, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, // '^'
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x00, // '_'
+};
+
+// Glyph rows of character c, unknown characters as '?'
+static inline const uint8_t *osd_font_glyph(char c)
+{
+	if(c>='a' && c<='z')
+		c = (char)(c-'a'+'A');
+	if(c<OSD_FONT_FIRST || c>=OSD_FONT_FIRST+OSD_FONT_GLYPHS)
+		c = '?';
+	return osd_font+(c-OSD_FONT_FIRST)*OSD_FONT_HEIGHT;
+}
+
+#endif
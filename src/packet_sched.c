@@ -0,0 +1,27 @@
+/*
+	packet_sched.c
+
+	Firmware side of the packet scheduler (see packet_sched.h.)
+	The line IRQ asks for the island buffers of the next line before it builds that line's control blocks: the packets
+	are picked, and framed into the island words of each lane, which blank_spans_build() points the island span at.
+	There are 2 lines of island buffers, same as the line buffers: one being sent, one being built.
+*/
+
+#include "pico/stdlib.h"
+#include "packet_sched.h"
+
+static uint32_t island_words[2][3][PACKET_ISLAND_WORDS];
+static uint32_t *island_lanes[2][3];
+
+// Returns the island words of each lane for line.
+uint32_t *const *__not_in_flash_func(packet_sched_prepare)(struct packet_sched_t *s, int line)
+{
+	const struct data_island_t *islands[PACKET_SCHED_MAX_SLOTS];
+	int count = packet_sched_line(s, line, islands, NULL);
+	for(int lane=0; lane<3; lane++)
+	{
+		island_lanes[line&1][lane] = island_words[line&1][lane];
+		packet_sched_frame_words(s, line, islands, count, lane, island_lanes[line&1][lane]);
+	}
+	return island_lanes[line&1];
+}
@@ -0,0 +1,285 @@
+/*
+	packet_sched.h
+
+	Gives out the data island slots of every line to the packets that need them.
+	Demand:
+	-ACR (audio clock regeneration) every acr_lines lines
+	-audio sample packets, whenever the audio FIFO has audio_packet_samples stereo samples (up to 4 per packet)
+	-AVI InfoFrame every avi_frames frames, Audio InfoFrame every aif_frames, SPD every spd_frames (0 turns one off)
+	Slots are filled in that order: ACR, audio, then the InfoFrames, and null packets in whatever is left. The InfoFrames
+	become due at the start of vblank, where there are more slots per line, and have until the next vblank to go out.
+	Audio arrives from the audio side through packet_sched_push_audio() (one producer, one consumer.)
+
+	The constant packets are encoded once (data_island.h); only audio packets are encoded per line.
+	Anything that doesn't fit is counted: dropped samples and periodic packets that were still pending when the next one
+	came due. Lines where every slot went to audio and there was still a full packet waiting are counted too, but that's
+	normal for a while after a block of samples comes in. packet_sched_demand() does the same check
+	on average rates, before anything runs.
+
+	The scheduling is all in here; packet_sched.c is the firmware side that turns a line's packets into island buffers
+	for blank_spans_build().
+*/
+
+#ifndef PACKET_SCHED_H
+#define PACKET_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "data_island.h"
+
+#define PACKET_SCHED_MAX_SLOTS 4
+// Island words per lane with all slots used, including the guard bands that share the first and last word
+#define PACKET_ISLAND_WORDS ((DATA_ISLAND_PIXELS*PACKET_SCHED_MAX_SLOTS+4)/3+1)
+// Stereo samples, power of 2
+#define PACKET_AUDIO_FIFO 256
+
+enum packet_kind_t
+{
+	PKT_NULL = 0,
+	PKT_ACR = 1,
+	PKT_AUDIO = 2,
+	PKT_AVI = 3,
+	PKT_AIF = 4,
+	PKT_SPD = 5,
+	PKT_KINDS = 6
+};
+
+struct packet_sched_config_t
+{
+	uint32_t pixel_hz;
+	int h_front, h_pulse, h_total;
+	int v_active, v_front, v_pulse, v_total;
+	int slots_active, slots_vblank; // packets per line
+	uint32_t sample_rate; // 0 for no audio
+	int audio_packet_samples; // 1-4
+	int acr_lines;
+	int avi_frames, aif_frames, spd_frames;
+};
+
+struct packet_sched_t
+{
+	struct packet_sched_config_t cfg;
+	int16_t audio_fifo[2*PACKET_AUDIO_FIFO];
+	volatile uint32_t audio_head; // written by the audio side
+	volatile uint32_t audio_tail; // written by the scheduler
+	uint32_t audio_frame; // position in the channel status block
+	uint8_t rate_code;
+	struct data_island_t null_island, acr_island, avi_island, aif_island, spd_island;
+	struct data_island_t audio_island[PACKET_SCHED_MAX_SLOTS];
+	int acr_countdown;
+	uint32_t frame;
+	bool acr_due, avi_due, aif_due, spd_due;
+	// Statistics
+	uint32_t sent[PKT_KINDS];
+	uint32_t audio_dropped; // samples that didn't fit into the FIFO
+	uint32_t audio_late; // lines where audio still had a full packet waiting after the last slot
+	uint32_t missed; // periodic packets that were still waiting when the next one came due
+};
+
+// 720x480 with the blanking in DOCUMENTATION.md, 48kHz audio.
+static inline void packet_sched_default_config(struct packet_sched_config_t *cfg)
+{
+	cfg->pixel_hz = 29400000;
+	cfg->h_front = 32;
+	cfg->h_pulse = 64;
+	cfg->h_total = 912;
+	cfg->v_active = 480;
+	cfg->v_front = 13;
+	cfg->v_pulse = 8;
+	cfg->v_total = 539;
+	cfg->slots_active = 2;
+	cfg->slots_vblank = 2;
+	cfg->sample_rate = 48000;
+	cfg->audio_packet_samples = AUDIO_PACKET_SAMPLES;
+	cfg->acr_lines = 32;
+	cfg->avi_frames = 1;
+	cfg->aif_frames = 1;
+	cfg->spd_frames = 0;
+}
+
+static inline int packet_sched_slots(const struct packet_sched_config_t *cfg, int line)
+{
+	return line<cfg->v_active ? cfg->slots_active : cfg->slots_vblank;
+}
+
+// Vsync level (active low) before and after the start of the hsync pulse, same lines as span_compiler.c.
+static inline void packet_sched_vsync(const struct packet_sched_config_t *cfg, int line, int *before, int *after)
+{
+	int pulse_start = cfg->v_active+cfg->v_front;
+	*before = !(line>pulse_start && line<=pulse_start+cfg->v_pulse);
+	*after = !(line>=pulse_start && line<pulse_start+cfg->v_pulse);
+}
+
+// Average packets per frame asked for, against the slots there are. Returns true if it fits.
+// Audio counts as full packets: with a lower audio_packet_samples more packets go out while there are free slots,
+// but they fill up again as soon as slots get scarce.
+static inline bool packet_sched_demand(const struct packet_sched_config_t *cfg, double *demand, int *capacity)
+{
+	double frame_time = (double)cfg->h_total*cfg->v_total/cfg->pixel_hz;
+	double d = 0;
+	if(cfg->sample_rate)
+	{
+		d += cfg->sample_rate*frame_time/AUDIO_PACKET_SAMPLES;
+		d += (double)cfg->v_total/cfg->acr_lines;
+	}
+	if(cfg->avi_frames)
+		d += 1.0/cfg->avi_frames;
+	if(cfg->aif_frames && cfg->sample_rate)
+		d += 1.0/cfg->aif_frames;
+	if(cfg->spd_frames)
+		d += 1.0/cfg->spd_frames;
+	*demand = d;
+	*capacity = cfg->v_active*cfg->slots_active+(cfg->v_total-cfg->v_active)*cfg->slots_vblank;
+	return d<=*capacity;
+}
+
+static inline void packet_sched_init(struct packet_sched_t *s, const struct packet_sched_config_t *cfg)
+{
+	struct data_packet_t packet;
+	memset(s, 0, sizeof(struct packet_sched_t));
+	s->cfg = *cfg;
+	if(s->cfg.audio_packet_samples<1 || s->cfg.audio_packet_samples>AUDIO_PACKET_SAMPLES)
+		s->cfg.audio_packet_samples = AUDIO_PACKET_SAMPLES;
+	if(s->cfg.slots_active>PACKET_SCHED_MAX_SLOTS)
+		s->cfg.slots_active = PACKET_SCHED_MAX_SLOTS;
+	if(s->cfg.slots_vblank>PACKET_SCHED_MAX_SLOTS)
+		s->cfg.slots_vblank = PACKET_SCHED_MAX_SLOTS;
+	s->rate_code = audio_status_rate_code(cfg->sample_rate);
+	data_packet_null(&packet);
+	data_island_encode(&packet, &s->null_island);
+	if(cfg->sample_rate)
+	{
+		uint32_t n = audio_acr_n(cfg->sample_rate);
+		data_packet_acr(&packet, n, audio_acr_cts(cfg->pixel_hz, cfg->sample_rate, n));
+		data_island_encode(&packet, &s->acr_island);
+	}
+	data_packet_avi(&packet, 2);
+	data_island_encode(&packet, &s->avi_island);
+	data_packet_audio_infoframe(&packet);
+	data_island_encode(&packet, &s->aif_island);
+	data_packet_spd(&packet, "GBHDMI", "Gameboy", 0x08);
+	data_island_encode(&packet, &s->spd_island);
+	s->acr_countdown = 1;
+}
+
+static inline uint32_t packet_sched_audio_level(const struct packet_sched_t *s)
+{
+	return s->audio_head-s->audio_tail;
+}
+
+// Adds count stereo samples (L, R interleaved). Returns how many fit.
+static inline int packet_sched_push_audio(struct packet_sched_t *s, const int16_t *samples, int count)
+{
+	uint32_t head = s->audio_head;
+	int free_frames = PACKET_AUDIO_FIFO-(int)(head-s->audio_tail);
+	int n = count<free_frames ? count : free_frames;
+	for(int i=0; i<n; i++)
+	{
+		uint32_t pos = (head+i)&(PACKET_AUDIO_FIFO-1);
+		s->audio_fifo[2*pos] = samples[2*i];
+		s->audio_fifo[2*pos+1] = samples[2*i+1];
+	}
+	s->audio_head = head+n;
+	s->audio_dropped += count-n;
+	return n;
+}
+
+static inline const struct data_island_t *packet_sched_audio(struct packet_sched_t *s, int slot)
+{
+	int16_t samples[2*AUDIO_PACKET_SAMPLES];
+	uint32_t level = packet_sched_audio_level(s);
+	int count = level<AUDIO_PACKET_SAMPLES ? (int)level : AUDIO_PACKET_SAMPLES;
+	struct data_packet_t packet;
+	for(int i=0; i<count; i++)
+	{
+		uint32_t pos = (s->audio_tail+i)&(PACKET_AUDIO_FIFO-1);
+		samples[2*i] = s->audio_fifo[2*pos];
+		samples[2*i+1] = s->audio_fifo[2*pos+1];
+	}
+	s->audio_tail += count;
+	data_packet_audio(&packet, samples, count, s->audio_frame, s->rate_code);
+	s->audio_frame = (s->audio_frame+count)%AUDIO_STATUS_FRAMES;
+	data_island_encode(&packet, &s->audio_island[slot]);
+	return &s->audio_island[slot];
+}
+
+// Picks the packets for line (0 is the first active line.) Fills islands (and kinds, if not NULL) for every slot of
+// the line and returns the number of slots.
+static inline int packet_sched_line(struct packet_sched_t *s, int line, const struct data_island_t **islands, uint8_t *kinds)
+{
+	const struct packet_sched_config_t *cfg = &s->cfg;
+	int slots = packet_sched_slots(cfg, line);
+	bool audio = cfg->sample_rate!=0;
+	if(line==cfg->v_active)
+	{
+		if((cfg->avi_frames && s->avi_due) || (audio && cfg->aif_frames && s->aif_due) || (cfg->spd_frames && s->spd_due))
+			s->missed++;
+		s->avi_due = cfg->avi_frames && !(s->frame%cfg->avi_frames);
+		s->aif_due = audio && cfg->aif_frames && !(s->frame%cfg->aif_frames);
+		s->spd_due = cfg->spd_frames && !(s->frame%cfg->spd_frames);
+		s->frame++;
+	}
+	if(audio && !--s->acr_countdown)
+	{
+		if(s->acr_due)
+			s->missed++;
+		s->acr_due = true;
+		s->acr_countdown = cfg->acr_lines;
+	}
+
+	for(int slot=0; slot<slots; slot++)
+	{
+		enum packet_kind_t kind = PKT_NULL;
+		const struct data_island_t *island = &s->null_island;
+		if(s->acr_due)
+		{
+			kind = PKT_ACR;
+			island = &s->acr_island;
+			s->acr_due = false;
+		}
+		else if(audio && packet_sched_audio_level(s)>=(uint32_t)cfg->audio_packet_samples)
+		{
+			kind = PKT_AUDIO;
+			island = packet_sched_audio(s, slot);
+		}
+		else if(s->avi_due)
+		{
+			kind = PKT_AVI;
+			island = &s->avi_island;
+			s->avi_due = false;
+		}
+		else if(s->aif_due)
+		{
+			kind = PKT_AIF;
+			island = &s->aif_island;
+			s->aif_due = false;
+		}
+		else if(s->spd_due)
+		{
+			kind = PKT_SPD;
+			island = &s->spd_island;
+			s->spd_due = false;
+		}
+		islands[slot] = island;
+		if(kinds)
+			kinds[slot] = (uint8_t)kind;
+		s->sent[kind]++;
+	}
+	if(audio && packet_sched_audio_level(s)>=(uint32_t)cfg->audio_packet_samples)
+		s->audio_late++;
+	return slots;
+}
+
+// Island words of one lane for a line's packets (see data_island_frame_words().)
+static inline int packet_sched_frame_words(const struct packet_sched_t *s, int line, const struct data_island_t *const *islands,
+	int count, int lane, uint32_t *out)
+{
+	int before, after;
+	packet_sched_vsync(&s->cfg, line, &before, &after);
+	return data_island_frame_words(islands, count, lane, s->cfg.h_front, s->cfg.h_pulse, before, after, out);
+}
+
+// Firmware side (packet_sched.c)
+uint32_t *const *packet_sched_prepare(struct packet_sched_t *s, int line);
+
+#endif
@@ -1,16 +1,32 @@
 /*
 	An example I made for the RPi Pico PLL.
 	Non-functional, but just to provide some context.
+
+	The clock, PLL dividers and core voltage come from clock_config.h, which is generated by
+	scripts/clock_planner.c for the video mode and features in use. Without it, this falls back to
+	the original 294MHz at 1.15V.
 */
 
 #include <stdio.h>
 #include "pico/stdlib.h"
+#include "hardware/vreg.h"
+
+#if __has_include("clock_config.h")
+#include "clock_config.h"
+#else
+#define SYS_CLOCK_KHZ 294000
+#define SYS_VREG_VOLTAGE VREG_VOLTAGE_1_15
+#endif
 
 int main()
 {
 	stdio_init_all();
 
-	uint32_t sys_clock_khz = 294000;
+	// Voltage has to go up before the clock does.
+	vreg_set_voltage(SYS_VREG_VOLTAGE);
+	sleep_ms(10);
+
+	uint32_t sys_clock_khz = SYS_CLOCK_KHZ;
 
 	uint vco_freq_out, post_div1_out, post_div2_out;
 
@@ -31,4 +47,4 @@ int main()
 	{
 		do_nothing();
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,60 @@
+/*
+	scale_plan.c
+
+	Firmware side of the scale plan (see scale_plan.h.)
+	The active part of each line goes out as up to SCALE_ACTIVE_BLOCKS control blocks per lane instead of the single
+	line buffer block: border word, image words from the line buffer, border word. They go where blank_spans_build()
+	put its line buffer block (its last one), so a line is built with
+
+		n = blank_spans_build(dma, lane, blocks, line, island, NULL, 0, 0)-1;
+		n += scale_plan_blocks(plan, dma, lane, blocks+n, image);
+
+	and the blocks of each lane need room for BLANK_SPAN_MAX+SCALE_ACTIVE_BLOCKS entries. build_line takes the input
+	line of every output line from line_src (NULL image for SCALE_BORDER.) For the line buffers to be released after
+	the last output line of each run, instead of after every SPLIT_LINE_REPEAT lines, the split encoder gets vrun and
+	runs (split_encode_line_sent()), and in_height as its lines.
+*/
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "scale_plan.h"
+
+// Builds the active blocks of one lane. image is the line buffer of the lane (image_words words), or NULL for a
+// border line. Returns the number of blocks; only the last one raises the IRQ.
+int __not_in_flash_func(scale_plan_blocks)(const struct scale_plan_t *p, const struct blank_dma_t *dma, int lane,
+	struct dma_ctrl_block_t *blocks, const uint32_t *image)
+{
+	uint32_t last_fixed = dma->ctrl_last[lane]&~DMA_CH0_CTRL_TRIG_INCR_READ_BITS;
+	struct dma_ctrl_block_t *block = blocks;
+	if(!image)
+	{
+		block->read_addr = &p->border_word[lane];
+		block->write_addr = dma->txf[lane];
+		block->transfer_count = (uint32_t)(p->left_words+p->image_words+p->right_words);
+		block->ctrl = last_fixed;
+		return 1;
+	}
+	if(p->left_words)
+	{
+		block->read_addr = &p->border_word[lane];
+		block->write_addr = dma->txf[lane];
+		block->transfer_count = (uint32_t)p->left_words;
+		block->ctrl = dma->ctrl_fixed[lane];
+		block++;
+	}
+	block->read_addr = image;
+	block->write_addr = dma->txf[lane];
+	block->transfer_count = (uint32_t)p->image_words;
+	block->ctrl = p->right_words ? dma->ctrl_incr[lane] : dma->ctrl_last[lane];
+	block++;
+	if(p->right_words)
+	{
+		block->read_addr = &p->border_word[lane];
+		block->write_addr = dma->txf[lane];
+		block->transfer_count = (uint32_t)p->right_words;
+		block->ctrl = last_fixed;
+		block++;
+	}
+
+	return (int)(block-blocks);
+}
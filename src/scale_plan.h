@@ -0,0 +1,231 @@
+/*
+	scale_plan.h
+
+	Scaling from any input geometry to the active area of a modeline, worked out once into tables:
+	-hrep: how many output pixels (TMDS symbols) each input pixel of a line becomes
+	-vrun: which input line (or border) each run of output lines shows, and line_src with the same for every output line
+	-the border: one LUT word per lane that is the same 3 symbols at any disparity, so a border line is one DMA block
+	 that sends that word out_w/3 times, and the borders left and right of the image are 2 more
+	The ratio is num/den output pixels per input pixel, the same both ways (square pixels): 2, 3 and 4 are plain
+	repeats, and something like 10/3 (160x144 into 480 lines) is nearest neighbour, with input pixel i covering output
+	pixels floor(i*num/den) to floor((i+1)*num/den)-1 of the image, so the repeats go 3, 3, 4, 3, 3, 4...
+
+	Like blank_spans.h, the lanes run with a pull threshold of 30, so every word is 3 whole symbols. The left border is a
+	whole number of words, the image is image_words words with the last one padded with border symbols, and the right
+	border is what's left. The image part is encoded by scale_encode_channel(), which takes the repeats straight from
+	hrep and needs a LUT for 1, 2 and 3 symbols per entry (create_tmds_lut_symbols() in tmds_util.c; the 3 symbol one
+	is the normal LUT.) When every repeat is 3 that is tmds_encode_channel_30(), same as without a plan.
+
+	Border colors have to be disparity neutral, because the image after them starts from the reset disparity and the
+	LUT word has to fit any disparity the image before them ends at. Only a few 5-bit values are (scale_check lists
+	them; 2 is the darkest with the default LUT), so scale_plan_init() takes the nearest one per lane.
+
+	The DMA blocks are built by scale_plan.c.
+*/
+
+#ifndef SCALE_PLAN_H
+#define SCALE_PLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tmds_channel_encode.h"
+#include "blank_spans.h"
+
+#define SCALE_MAX_IN_WIDTH 240
+#define SCALE_MAX_IN_HEIGHT 240
+#define SCALE_MAX_OUT_HEIGHT 576
+#define SCALE_MAX_REPEAT 8
+// Top border, every input line, bottom border
+#define SCALE_MAX_RUNS (SCALE_MAX_IN_HEIGHT+2)
+#define SCALE_BORDER (-1)
+// Blocks scale_plan_blocks() puts in place of the line buffer block of blank_spans_build()
+#define SCALE_ACTIVE_BLOCKS 3
+
+struct scale_run_t
+{
+	int16_t line; // input line, or SCALE_BORDER
+	uint16_t count; // output lines
+};
+
+struct scale_plan_t
+{
+	int in_width, in_height, out_width, out_height;
+	int num, den;
+	int image_width, image_height; // output pixels and lines the image covers
+	int left, top; // output pixels and lines before the image
+	int left_words, image_words, right_words; // per lane and line
+	int uniform; // the repeat of every input pixel if they're all the same, otherwise 0
+	uint8_t hrep[SCALE_MAX_IN_WIDTH];
+	struct scale_run_t vrun[SCALE_MAX_RUNS];
+	int runs;
+	int16_t line_src[SCALE_MAX_OUT_HEIGHT]; // vrun for every output line
+	uint8_t border[3]; // 5-bit value per lane
+	uint32_t border_word[3];
+};
+
+static inline int scale_gcd(int a, int b)
+{
+	while(b)
+	{
+		int t = a%b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+// Largest ratio at which in_width x in_height fits into out_width x out_height.
+static inline void scale_fit(int in_width, int in_height, int out_width, int out_height, int *num, int *den)
+{
+	// out_height/in_height <= out_width/in_width
+	if(out_height*in_width<=out_width*in_height)
+	{
+		*num = out_height;
+		*den = in_height;
+	}
+	else
+	{
+		*num = out_width;
+		*den = in_width;
+	}
+	int g = scale_gcd(*num, *den);
+	*num /= g;
+	*den /= g;
+}
+
+// Output pixels input pixel i becomes.
+static inline int scale_repeat(int i, int num, int den)
+{
+	return ((i+1)*num)/den-(i*num)/den;
+}
+
+// A LUT entry that sends the same symbol 3 times and leaves the disparity as it was, for every disparity.
+static inline bool scale_value_neutral(const uint32_t *tmds_lut, int value)
+{
+	uint32_t word = tmds_lut[value<<1]&0x3fffffff;
+	uint32_t symbol = word&0x3ff;
+	if(word!=(symbol|(symbol<<10)|(symbol<<20)))
+		return false;
+	for(uint32_t disp=0; disp<16; disp++)
+	{
+		const uint32_t *entry = tmds_lut+((uint32_t)(value<<1)|(disp<<6));
+		if((entry[0]&0x3fffffff)!=word || entry[1]!=(disp<<6))
+			return false;
+	}
+	return true;
+}
+
+// The disparity neutral value closest to value, or -1 if the LUT has none.
+static inline int scale_nearest_neutral(const uint32_t *tmds_lut, int value)
+{
+	for(int d=0; d<32; d++)
+	{
+		if(value-d>=0 && scale_value_neutral(tmds_lut, value-d))
+			return value-d;
+		if(value+d<32 && scale_value_neutral(tmds_lut, value+d))
+			return value+d;
+	}
+	return -1;
+}
+
+// Works out the plan for num/den (num>=den), with the border as close to the 15-bit pixel border as tmds_lut (the 3
+// symbol LUT) allows. Returns false if the image doesn't fit, a repeat is over SCALE_MAX_REPEAT, out_width isn't a
+// multiple of 3, or there's no border color.
+static inline bool scale_plan_init(struct scale_plan_t *p, int in_width, int in_height, int out_width, int out_height,
+	int num, int den, const uint32_t *tmds_lut, uint32_t border)
+{
+	memset(p, 0, sizeof(struct scale_plan_t));
+	if(in_width<1 || in_width>SCALE_MAX_IN_WIDTH || in_height<1 || in_height>SCALE_MAX_IN_HEIGHT ||
+		out_height>SCALE_MAX_OUT_HEIGHT || out_width%BLANK_SYMBOLS_PER_WORD || num<den || den<1 ||
+		(num+den-1)/den>SCALE_MAX_REPEAT)
+		return false;
+	p->in_width = in_width;
+	p->in_height = in_height;
+	p->out_width = out_width;
+	p->out_height = out_height;
+	p->num = num;
+	p->den = den;
+	p->image_width = (in_width*num)/den;
+	p->image_height = (in_height*num)/den;
+	if(p->image_width>out_width || p->image_height>out_height)
+		return false;
+
+	for(int ch=0; ch<3; ch++)
+	{
+		int value = scale_nearest_neutral(tmds_lut, (int)((border>>tmds_channel_shift(ch))&0x1f));
+		if(value<0)
+			return false;
+		p->border[ch] = (uint8_t)value;
+		p->border_word[ch] = tmds_lut[value<<1]&0x3fffffff;
+	}
+
+	p->uniform = scale_repeat(0, num, den);
+	for(int i=0; i<in_width; i++)
+	{
+		p->hrep[i] = (uint8_t)scale_repeat(i, num, den);
+		if(p->hrep[i]!=p->uniform)
+			p->uniform = 0;
+	}
+	int line_words = out_width/BLANK_SYMBOLS_PER_WORD;
+	p->left_words = ((out_width-p->image_width)/2)/BLANK_SYMBOLS_PER_WORD;
+	p->left = p->left_words*BLANK_SYMBOLS_PER_WORD;
+	p->image_words = (p->image_width+BLANK_SYMBOLS_PER_WORD-1)/BLANK_SYMBOLS_PER_WORD;
+	p->right_words = line_words-p->left_words-p->image_words;
+
+	p->top = (out_height-p->image_height)/2;
+	int bottom = out_height-p->top-p->image_height;
+	if(p->top)
+		p->vrun[p->runs++] = (struct scale_run_t){SCALE_BORDER, (uint16_t)p->top};
+	for(int l=0; l<in_height; l++)
+		p->vrun[p->runs++] = (struct scale_run_t){(int16_t)l, (uint16_t)scale_repeat(l, num, den)};
+	if(bottom)
+		p->vrun[p->runs++] = (struct scale_run_t){SCALE_BORDER, (uint16_t)bottom};
+	int line = 0;
+	for(int r=0; r<p->runs; r++)
+	{
+		for(int n=0; n<p->vrun[r].count; n++)
+			p->line_src[line++] = p->vrun[r].line;
+	}
+	return true;
+}
+
+// Encodes one channel of an input line (in_width values) into image_words words, starting at LUT disparity disp.
+// luts[n] is the LUT with n symbols per entry (luts[0] isn't used.) pad is the border word of the lane, for the
+// symbols after the image in the last word. Returns the disparity after the last pixel.
+static inline uint32_t scale_encode_channel(const uint32_t *const luts[4], const struct scale_plan_t *p,
+	const uint8_t *values, uint32_t *out, uint32_t pad, uint32_t disp)
+{
+	if(p->uniform==BLANK_SYMBOLS_PER_WORD)
+		return tmds_encode_channel_30(luts[3], values, out, p->in_width, disp);
+	uint64_t acc = 0;
+	int fill = 0;
+	for(int i=0; i<p->in_width; i++)
+	{
+		uint32_t value = ((uint32_t)values[i])<<1;
+		for(int rep=p->hrep[i]; rep>0; )
+		{
+			int n = rep>3 ? 3 : rep;
+			const uint32_t *entry = luts[n]+(value|disp);
+			acc |= ((uint64_t)entry[0])<<fill;
+			disp = entry[1];
+			fill += 10*n;
+			rep -= n;
+			if(fill>=30)
+			{
+				*out++ = (uint32_t)acc&0x3fffffff;
+				acc >>= 30;
+				fill -= 30;
+			}
+		}
+	}
+	if(fill)
+		*out = (uint32_t)(acc|(((uint64_t)pad)<<fill))&0x3fffffff;
+	return disp;
+}
+
+// Firmware side (scale_plan.c)
+int scale_plan_blocks(const struct scale_plan_t *p, const struct blank_dma_t *dma, int lane, struct dma_ctrl_block_t *blocks,
+	const uint32_t *image);
+
+#endif
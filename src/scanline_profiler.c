@@ -0,0 +1,166 @@
+/*
+	scanline_profiler.c
+
+	See scanline_profiler.h. The functions in here are only called through the PROFILE_EVENT macros,
+	so none of this costs anything unless SCANLINE_PROFILER is defined.
+	Each event costs a PWM counter read and a ring buffer store (around 15 cycles); the release event in the
+	DMA IRQ also updates the histograms (around 60 cycles, 3 times per input line.)
+*/
+
+#include <stdio.h>
+#include <limits.h>
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "scanline_profiler.h"
+
+static struct profiler_t prof;
+
+static inline uint32_t profiler_time(void)
+{
+	return pwm_hw->slice[PROFILER_PWM_SLICE].ctr;
+}
+
+static inline void ring_put(struct profiler_ring_t *ring, uint32_t word)
+{
+	if(ring->pos==ring->stop_at)
+		return;
+	ring->events[(ring->pos++)&(PROFILER_RING_SIZE-1)] = word;
+}
+
+// Line numbers are kept in 16 bits, so they're compared like this.
+static inline int line_reached(uint32_t end_word, uint32_t line)
+{
+	return (int16_t)((uint16_t)(end_word>>16)-(uint16_t)line)>=0;
+}
+
+void profiler_init(int lines_per_frame, uint32_t clock_khz)
+{
+	for(int i=0; i<3; i++)
+	{
+		prof.ring[i].pos = 0;
+		prof.ring[i].stop_at = UINT_MAX;
+	}
+	for(int i=0; i<PROFILER_BINS; i++)
+	{
+		prof.line_hist[i] = 0;
+		prof.late_hist[0][i] = 0;
+		prof.late_hist[1][i] = 0;
+		prof.frame_hist[i] = 0;
+	}
+	for(int i=0; i<PROFILER_MAX_LINES; i++)
+	{
+		prof.line_worst[i] = INT16_MAX;
+		prof.line_misses[i] = 0;
+	}
+	prof.last_end[0] = 0xffffu<<16;
+	prof.last_end[1] = 0xffffu<<16;
+	prof.released = 0;
+	prof.frame_worst = INT32_MAX;
+	prof.frames = 0;
+	prof.lines = 0;
+	prof.misses = 0;
+	prof.lines_per_frame = lines_per_frame>PROFILER_MAX_LINES ? PROFILER_MAX_LINES : lines_per_frame;
+	prof.clock_khz = clock_khz;
+
+	// Free-running 16-bit counter at the system clock.
+	pwm_config config = pwm_get_default_config();
+	pwm_config_set_clkdiv_int(&config, 1);
+	pwm_config_set_wrap(&config, 0xffff);
+	pwm_init(PROFILER_PWM_SLICE, &config, true);
+}
+
+void __not_in_flash_func(profiler_event)(enum profiler_event_type_t type, uint32_t line)
+{
+	uint32_t t = profiler_time();
+	uint core = get_core_num();
+	ring_put(&prof.ring[core], PROFILER_EVENT_WORD(t, type, line));
+	if(type!=PROF_ENC_END)
+		return;
+
+	prof.last_end[core] = ((line&0xffff)<<16)|t;
+	// If DMA already wanted this line and the other core is done with it too, this core finished it last,
+	// so it records how late it was.
+	if((int16_t)((uint16_t)prof.released-(uint16_t)line)>0 && line_reached(prof.last_end[core^1], line))
+	{
+		int32_t slack = -(int32_t)(uint16_t)(t-prof.release_time[line&1]);
+		prof.late_hist[core][profiler_bin(slack)]++;
+	}
+}
+
+void __not_in_flash_func(profiler_irq_event)(enum profiler_event_type_t type, uint32_t line)
+{
+	uint32_t t = profiler_time();
+	ring_put(&prof.ring[PROF_SRC_IRQ], PROFILER_EVENT_WORD(t, type, line));
+	if(type!=PROF_RELEASE)
+		return;
+
+	prof.release_time[line&1] = t;
+	prof.released = line;
+	prof.lines++;
+
+	uint32_t end0 = prof.last_end[0], end1 = prof.last_end[1];
+	int32_t slack;
+	if(line_reached(end0, line) && line_reached(end1, line))
+	{
+		int32_t slack0 = (int16_t)(uint16_t)(t-end0), slack1 = (int16_t)(uint16_t)(t-end1);
+		slack = slack0<slack1 ? slack0 : slack1;
+		prof.line_hist[profiler_bin(slack)]++;
+	}
+	else
+	{
+		// The cores record by how much in late_hist when they get there.
+		slack = -1;
+		if(prof.misses++==0)
+		{
+			for(int i=0; i<3; i++)
+				prof.ring[i].stop_at = prof.ring[i].pos+PROFILER_POST_MISS;
+		}
+	}
+
+	int scanline = line%prof.lines_per_frame;
+	if(slack<prof.line_worst[scanline])
+		prof.line_worst[scanline] = (int16_t)slack;
+	if(slack<0)
+		prof.line_misses[scanline]++;
+	if(slack<prof.frame_worst)
+		prof.frame_worst = slack;
+	if(scanline==prof.lines_per_frame-1)
+	{
+		prof.frame_hist[profiler_bin(prof.frame_worst)]++;
+		prof.frames++;
+		prof.frame_worst = INT32_MAX;
+	}
+}
+
+static void dump_hist(const char *name, const uint32_t *hist)
+{
+	for(int i=0; i<PROFILER_BINS; i++)
+	{
+		if(hist[i])
+			printf("%s %d %lu\n", name, i, (unsigned long)hist[i]);
+	}
+}
+
+// Text dump for scripts/profile_decode.c. Safe to call while the profiler is running;
+// the numbers might just be a line apart from each other.
+void profiler_dump(void)
+{
+	printf("PROF BEGIN 1 %d %d %d %lu\n", PROFILER_BINS, PROFILER_BIN_SHIFT, prof.lines_per_frame, (unsigned long)prof.clock_khz);
+	printf("TOTAL %lu %lu %lu\n", (unsigned long)prof.lines, (unsigned long)prof.frames, (unsigned long)prof.misses);
+	dump_hist("HIST", prof.line_hist);
+	dump_hist("LATE", prof.late_hist[0]);
+	dump_hist("LATE", prof.late_hist[1]);
+	dump_hist("FRAME", prof.frame_hist);
+	for(int i=0; i<prof.lines_per_frame; i++)
+		printf("LINE %d %d %lu\n", i, prof.line_worst[i], (unsigned long)prof.line_misses[i]);
+	for(int src=0; src<3; src++)
+	{
+		struct profiler_ring_t *ring = &prof.ring[src];
+		uint32_t end = ring->pos;
+		uint32_t start = end>PROFILER_RING_SIZE ? end-PROFILER_RING_SIZE : 0;
+		for(uint32_t i=start; i<end; i++)
+			printf("EVT %d %08lx\n", src, (unsigned long)ring->events[i&(PROFILER_RING_SIZE-1)]);
+	}
+	printf("PROF END\n");
+}
@@ -0,0 +1,102 @@
+/*
+	scanline_profiler.h
+
+	Lightweight per-line timing instrumentation for the line encode.
+	Compiled out completely unless SCANLINE_PROFILER is defined.
+
+	Timestamps come from a free-running PWM counter clocked at the system clock, so both cores and the IRQ handler
+	share the same time base. It's only 16 bits, but everything that gets compared (a line's encode vs. its DMA
+	deadline) is less than 32768 cycles apart, so signed 16-bit differences are enough.
+
+	What gets recorded:
+	-A ring buffer of raw events per source (core 0, core 1, DMA IRQ) for looking at what happened around a miss.
+	 The rings stop PROFILER_POST_MISS events after the first miss so that the miss stays in them.
+	-A histogram of slack for every line: the time between both cores finishing a line and DMA starting to send it.
+	 Late lines go into the bins below PROFILER_BINS/2.
+	-A histogram of the worst slack of every frame.
+	-Worst slack and number of misses for every scanline of the input frame.
+
+	profiler_dump() prints all of that as text over stdio; scripts/profile_decode.c turns it into something readable.
+*/
+
+#ifndef SCANLINE_PROFILER_H
+#define SCANLINE_PROFILER_H
+
+#include <stdint.h>
+
+#define PROFILER_RING_SIZE 512 // per source, power of 2
+#define PROFILER_BINS 64
+#define PROFILER_BIN_SHIFT 10 // 1024 cycles per bin, so the histogram covers -32768 to 32767
+#define PROFILER_MAX_LINES 160
+#define PROFILER_POST_MISS (PROFILER_RING_SIZE/2)
+#define PROFILER_PWM_SLICE 7
+
+enum profiler_event_type_t
+{
+	PROF_ENC_START = 0,
+	PROF_ENC_END = 1,
+	PROF_DMA_DONE = 2, // one output line sent by the line DMA
+	PROF_RELEASE = 3, // line buffer released; the line number is the next line to be sent
+	PROF_FRAME = 4
+};
+
+enum profiler_source_t
+{
+	PROF_SRC_CORE0 = 0,
+	PROF_SRC_CORE1 = 1,
+	PROF_SRC_IRQ = 2
+};
+
+// Event word: timestamp in the lower 16 bits, then line number (12 bits) and type (4 bits).
+#define PROFILER_EVENT_WORD(t, type, line) (((uint32_t)(t)&0xffff)|(((uint32_t)(line)&0xfff)<<16)|(((uint32_t)(type))<<28))
+
+struct profiler_ring_t
+{
+	uint32_t pos;
+	uint32_t stop_at; // ring stops when pos reaches this
+	uint32_t events[PROFILER_RING_SIZE];
+};
+
+struct profiler_t
+{
+	struct profiler_ring_t ring[3];
+	uint32_t line_hist[PROFILER_BINS]; // written by the IRQ
+	uint32_t late_hist[2][PROFILER_BINS]; // written by the core that finished a late line last
+	uint32_t frame_hist[PROFILER_BINS];
+	int16_t line_worst[PROFILER_MAX_LINES];
+	uint32_t line_misses[PROFILER_MAX_LINES];
+	volatile uint32_t last_end[2]; // per core: line<<16 | timestamp of the last ENC_END
+	volatile uint32_t released; // next line to be sent
+	uint32_t release_time[2]; // timestamp of the release of the last 2 lines, indexed by line&1
+	int32_t frame_worst;
+	uint32_t frames;
+	uint32_t lines;
+	uint32_t misses;
+	int lines_per_frame;
+	uint32_t clock_khz;
+};
+
+#ifdef SCANLINE_PROFILER
+#define PROFILE_EVENT(type, line) profiler_event(type, line)
+#define PROFILE_IRQ_EVENT(type, line) profiler_irq_event(type, line)
+#else
+#define PROFILE_EVENT(type, line) ((void)0)
+#define PROFILE_IRQ_EVENT(type, line) ((void)0)
+#endif
+
+// Maps slack in cycles to a histogram bin.
+static inline int profiler_bin(int32_t slack)
+{
+	if(slack<-32768)
+		slack = -32768;
+	if(slack>32767)
+		slack = 32767;
+	return (slack+32768)>>PROFILER_BIN_SHIFT;
+}
+
+void profiler_init(int lines_per_frame, uint32_t clock_khz);
+void profiler_event(enum profiler_event_type_t type, uint32_t line);
+void profiler_irq_event(enum profiler_event_type_t type, uint32_t line);
+void profiler_dump(void);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+	sram_layout.c
+
+	Firmware side of the SRAM layouts (see sram_layout.h.)
+	The line buffers and, in SRAM_LAYOUT_BANKED, the LUT copies live here. The bank sections are NOLOAD in
+	memmap_banks.ld, so the LUTs are copied in at run time rather than at boot.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "sram_layout.h"
+#include "tmds_encode_split.h"
+
+#if SRAM_LAYOUT==SRAM_LAYOUT_BANKED
+// The LUT copies come first in their banks (memmap_banks.ld), so both are at the same offset.
+static uint32_t __sram_bank(3, "tmds_lut") core0_luts[SRAM_LUT_SLOTS][SRAM_LUT_WORDS];
+static uint32_t __sram_bank(2, "tmds_lut") core1_luts[SRAM_LUT_SLOTS][SRAM_LUT_WORDS];
+// Lanes 0 and 2 share bank 0: both are read by the same DMA master, which can't stall on itself.
+static uint32_t __sram_bank(0, "line_buf") lane0_buf[2][TMDS_LINE_WORDS];
+static uint32_t __sram_bank(1, "line_buf") lane1_buf[2][TMDS_LINE_WORDS];
+static uint32_t __sram_bank(0, "line_buf") lane2_buf[2][TMDS_LINE_WORDS];
+#else
+static uint32_t lane0_buf[2][TMDS_LINE_WORDS];
+static uint32_t lane1_buf[2][TMDS_LINE_WORDS];
+static uint32_t lane2_buf[2][TMDS_LINE_WORDS];
+#endif
+
+void sram_layout_line_buffers(struct split_encode_t *enc)
+{
+	for(int b=0; b<2; b++)
+	{
+		enc->line_buf[b][0] = lane0_buf[b];
+		enc->line_buf[b][1] = lane1_buf[b];
+		enc->line_buf[b][2] = lane2_buf[b];
+	}
+}
+
+const uint32_t *sram_layout_lut(int slot, const uint32_t *lut)
+{
+#if SRAM_LAYOUT==SRAM_LAYOUT_BANKED
+	// A linker script that put something else first would break core 1's lookups without a sound.
+	hard_assert((uintptr_t)core0_luts[0]+SRAM_CORE1_LUT_WORDS*4==(uintptr_t)core1_luts[0]);
+	if(slot<0 || slot>=SRAM_LUT_SLOTS)
+		return NULL;
+	memcpy(core0_luts[slot], lut, sizeof(core0_luts[slot]));
+	memcpy(core1_luts[slot], lut, sizeof(core1_luts[slot]));
+	return core0_luts[slot];
+#else
+	(void)slot;
+	return lut;
+#endif
+}
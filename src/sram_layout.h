@@ -0,0 +1,85 @@
+/*
+	sram_layout.h
+
+	Where the split encode (tmds_encode_split.h) and its buffers go in SRAM. The 4 main banks are striped (word n of
+	0x20000000 is in bank n&3) and scratch X and Y are banks of their own; each bank serves one access per cycle, so
+	2 cores and the DMA wait on each other whenever they want the same one. scripts/sram_layout_sim.c models every
+	layout below and a few others, and prints the stall cycles per line of each.
+	-SRAM_LAYOUT_STRIPED (default): the SDK default with PICO_COPY_TO_RAM. Both encode loops run from the striped
+	 range, so the instruction fetches of the 2 cores keep running into each other, their LUT lookups and the DMA:
+	 about 6% of the core accesses stall, and the DMA waits 85 cycles per line.
+	-SRAM_LAYOUT_CORE_SCRATCH (not measured, see below): the encode loop and the separated values of each core go in the scratch bank that
+	 also has its stack (core 0 in Y, core 1 in X), so most of what a core fetches and loads is in a bank the
+	 other core never touches. 0.4% of the accesses stall and the DMA waits 25 cycles per line.
+	-SRAM_LAYOUT_BANKED (not measured either): on top of that, every core gets its own copy of the LUTs, at the same place in bank 3 (core 0)
+	 and bank 2 (core 1), and the line buffers of lanes 0 and 2 go in bank 0 and lane 1 in bank 1, through the
+	 non-striped aliases of the banks. 0.3% of the core accesses stall and the DMA waits 15 cycles per line. This needs
+	 memmap_banks.ld, which takes the top SRAM_BANK_BYTES of every bank out of the striped range (so 32KB less for
+	 the framebuffers and everything else; the line cache only fits with 8 entries or fewer), and the LUTs have to be
+	 loaded with sram_layout_lut().
+	Either way, the encode is far from its deadline (under 30% of it), so this is about the line DMA and the time
+	left for everything else more than about the encode itself.
+
+	The 2 scratch layouts aren't recommended: nobody has measured whether they fit. The scratch banks are 4KB, and the
+	SDK puts a 2KB stack at the top of each, which leaves 2KB per core for the encode loop with everything inlined
+	into it (line cache, frame sources, OSD) and its values (240 bytes.) The size of that loop has never been taken
+	from a firmware build, so the stall numbers above only hold if it fits. Before switching, measure .scratch_x and
+	.scratch_y (arm-none-eabi-size -A) and give the bigger one to sram_layout_sim -k, which otherwise doesn't pick
+	these layouts. Link scratch_check.ld with SRAM_LAYOUT_CORE_SCRATCH (memmap_banks.ld has the same checks) so a
+	loop that doesn't fit fails the link instead of overwriting the stack.
+
+	The core 1 copy of a LUT is exactly one bank below the core 0 copy, so core 1 finds it by adding
+	SRAM_CORE1_LUT_WORDS to the LUT pointer it is given (split_frame_line().) That's 0 in the other layouts.
+*/
+
+#ifndef SRAM_LAYOUT_H
+#define SRAM_LAYOUT_H
+
+#include <stdint.h>
+
+#define SRAM_LAYOUT_STRIPED 0
+#define SRAM_LAYOUT_CORE_SCRATCH 1
+#define SRAM_LAYOUT_BANKED 2
+
+#ifndef SRAM_LAYOUT
+#define SRAM_LAYOUT SRAM_LAYOUT_STRIPED
+#endif
+
+// Non-striped top of every bank that memmap_banks.ld keeps for SRAM_LAYOUT_BANKED
+#define SRAM_BANK_BYTES (8*1024)
+// LUTs that sram_layout_lut() can hold (RGB555 and DMG, model_detect.h)
+#define SRAM_LUT_SLOTS 2
+#define SRAM_LUT_WORDS 1024
+
+#if SRAM_LAYOUT==SRAM_LAYOUT_BANKED
+// Bank 2 is 64KB below bank 3 in the non-striped aliases
+#define SRAM_CORE1_LUT_WORDS (-(0x10000/4))
+#else
+#define SRAM_CORE1_LUT_WORDS 0
+#endif
+
+// Data in the non-striped top of bank n (memmap_banks.ld)
+#define __sram_bank(n, group) __attribute__((section(".sram_bank" #n "." group)))
+
+// Code and data of the encode loop of each core (tmds_encode_split.c)
+#if SRAM_LAYOUT==SRAM_LAYOUT_STRIPED
+#define __core0_encode_func(name) __not_in_flash_func(name)
+#define __core1_encode_func(name) __not_in_flash_func(name)
+#define __core0_encode_data(group) __scratch_x(group)
+#define __core1_encode_data(group) __scratch_y(group)
+#else
+#define __core0_encode_func(name) __scratch_y(#name) name
+#define __core1_encode_func(name) __scratch_x(#name) name
+#define __core0_encode_data(group) __scratch_y(group)
+#define __core1_encode_data(group) __scratch_x(group)
+#endif
+
+struct split_encode_t;
+
+// Firmware side (sram_layout.c)
+// Points the 2 line buffers of every lane at their place in this layout.
+void sram_layout_line_buffers(struct split_encode_t *enc);
+// The LUT to give the encoder for lut: in SRAM_LAYOUT_BANKED, lut copied into slot for both cores, lut itself otherwise.
+const uint32_t *sram_layout_lut(int slot, const uint32_t *lut);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+	tmds_channel_encode.h
+
+	Plain C version of the per-channel line encoder sketched in tmds_encode.S (SeparatePixel, GetTMDSDisparity and PackTMDS.)
+	There are no SDK dependencies in here on purpose, so the host tools in the scripts folder can include this header
+	and run the exact same loops that the firmware runs.
+
+	Framebuffer format: 2 pixels per word, as pushed by lcd_capture (the older pixel is in the upper half-word.)
+	Pixel format (same as SeparatePixel): bits 0-4 red, bits 5-9 green, bits 10-14 blue.
+	TMDS channel 0 is blue, channel 1 is green and channel 2 is red.
+
+	LUT format (see tmds_pixel_repeat() in tmds_util.c): entry address is (color<<1)|disparity, where disparity is
+	already shifted left by 6. Word 0 of the entry is the 3 tripled TMDS words, word 1 is the next disparity.
+
+	Pair LUT format (see create_tmds_lut_pairs() in tmds_util.c): entry address is ((color0<<5)|color1)<<1 for 2
+	neighbouring pixels, word 0 is the 3 tripled TMDS words of the first one and word 1 of the second. There's no
+	disparity: the 6 symbols of every entry add up to 0 (tmds_encode_channel_pairs().)
+
+	LUT byte format, as pushed by lcd_capture_lut (lcd_cap_lut.pio): 3 bytes per pixel, one per TMDS channel in channel
+	order, each holding color<<1, so there's nothing to separate (tmds_encode_channel_bytes().)
+*/
+
+#ifndef TMDS_CHANNEL_ENCODE_H
+#define TMDS_CHANNEL_ENCODE_H
+
+#include <stdint.h>
+
+#define TMDS_LINE_PIXELS 240
+#define TMDS_FB_LINE_WORDS (TMDS_LINE_PIXELS/2)
+#define TMDS_FB_LINE_BYTES_LUT (TMDS_LINE_PIXELS*3)
+// 16 tripled pixels (480 bits) fit into 15 32-bit words
+#define TMDS_PACK_GROUP 16
+#define TMDS_PACK_WORDS 15
+#define TMDS_LINE_WORDS ((TMDS_LINE_PIXELS/TMDS_PACK_GROUP)*TMDS_PACK_WORDS)
+
+// Disparity is reset to zero at the start of every line, which is entry (0+8)<<6 of the LUT.
+#define TMDS_DISP_RESET (8<<6)
+
+// Separates a single channel of count pixels into one value per byte.
+// shift is 0 for red (channel 2), 5 for green (channel 1) and 10 for blue (channel 0).
+// first has to be even, because pixels come in pairs.
+static inline void tmds_separate_channel(const uint32_t *fb_line, uint8_t *values, int first, int count, int shift)
+{
+	const uint32_t *pix = fb_line+(first>>1);
+	for(int i=0; i<count; i+=2)
+	{
+		uint32_t pair = *pix++;
+		values[i] = (uint8_t)((pair>>(16+shift))&0x1f);
+		values[i+1] = (uint8_t)((pair>>shift)&0x1f);
+	}
+}
+
+// Shift amount for the color of a TMDS channel.
+static inline int tmds_channel_shift(int channel)
+{
+	return 10-(channel*5);
+}
+
+// Encodes count values (a multiple of TMDS_PACK_GROUP) of one channel, starting at LUT disparity disp.
+// Writes (count/16)*15 packed words to out, and returns the disparity after the last pixel so that
+// another core can pick up the rest of the line.
+static inline uint32_t tmds_encode_channel(const uint32_t *tmds_lut, const uint8_t *values, uint32_t *out, int count, uint32_t disp)
+{
+	for(int i=0; i<count; i+=TMDS_PACK_GROUP)
+	{
+		uint32_t acc = 0;
+		int fill = 0;
+		for(int j=0; j<TMDS_PACK_GROUP; j++)
+		{
+			const uint32_t *entry = tmds_lut+((((uint32_t)values[i+j])<<1)|disp);
+			uint32_t tripled = entry[0];
+			disp = entry[1];
+			// Same idea as PackTMDS: the 30 new bits go on top of what's left, and whatever doesn't fit goes to the next word.
+			acc |= tripled<<fill;
+			fill += 30;
+			if(fill>=32)
+			{
+				*out++ = acc;
+				fill -= 32;
+				acc = fill ? (tripled>>(30-fill)) : 0;
+			}
+		}
+	}
+	return disp;
+}
+
+// Same as tmds_encode_channel(), for lanes that run with a pull threshold of 30 (see blank_spans.h.)
+// Word 0 of the LUT entry is already one output word, so there's nothing to pack: writes count words.
+static inline uint32_t tmds_encode_channel_30(const uint32_t *tmds_lut, const uint8_t *values, uint32_t *out, int count, uint32_t disp)
+{
+	for(int i=0; i<count; i++)
+	{
+		const uint32_t *entry = tmds_lut+((((uint32_t)values[i])<<1)|disp);
+		out[i] = entry[0];
+		disp = entry[1];
+	}
+	return disp;
+}
+
+// Same as tmds_encode_channel(), straight from a line in the LUT byte format: the byte already is the LUT offset of
+// the color, so there's only the load, the OR with the disparity, and the lookup.
+// line points at the first pixel to encode, which doesn't have to be even.
+static inline uint32_t tmds_encode_channel_bytes(const uint32_t *tmds_lut, const uint8_t *line, int channel, uint32_t *out,
+	int count, uint32_t disp)
+{
+	const uint8_t *pix = line+channel;
+	for(int i=0; i<count; i+=TMDS_PACK_GROUP)
+	{
+		uint32_t acc = 0;
+		int fill = 0;
+		for(int j=0; j<TMDS_PACK_GROUP; j++)
+		{
+			const uint32_t *entry = tmds_lut+(((uint32_t)*pix)|disp);
+			pix += 3;
+			uint32_t tripled = entry[0];
+			disp = entry[1];
+			acc |= tripled<<fill;
+			fill += 30;
+			if(fill>=32)
+			{
+				*out++ = acc;
+				fill -= 32;
+				acc = fill ? (tripled>>(30-fill)) : 0;
+			}
+		}
+	}
+	return disp;
+}
+
+// Stateless encode with a pair LUT: the symbols of every 2 pixels add up to a disparity of 0, so there's no disparity
+// to carry from one pair to the next, or from one call to the next. Any group of 16 pixels gives the same words on its
+// own as in a whole line, so the groups of a line can be encoded in any order, on either core. A pixel pair of the
+// framebuffer is one entry, so there's no separate pass either: a load, 2 shifts and 2 ANDs for the address of 2 pixels.
+// pixels points at the framebuffer word of the first 2 pixels, shift is tmds_channel_shift(), and count is a multiple
+// of TMDS_PACK_GROUP.
+static inline void tmds_encode_channel_pairs(const uint32_t *pair_lut, const uint32_t *pixels, int shift, uint32_t *out,
+	int count)
+{
+	for(int i=0; i<count; i+=TMDS_PACK_GROUP)
+	{
+		uint32_t acc = 0;
+		int fill = 0;
+		for(int j=0; j<TMDS_PACK_GROUP/2; j++)
+		{
+			uint32_t pair = *pixels++;
+			// The older pixel (upper half-word) is color0
+			const uint32_t *entry = pair_lut+((((pair>>(16+shift))&0x1f)<<6)|(((pair>>shift)&0x1f)<<1));
+			for(int k=0; k<2; k++)
+			{
+				uint32_t tripled = entry[k];
+				acc |= tripled<<fill;
+				fill += 30;
+				if(fill>=32)
+				{
+					*out++ = acc;
+					fill -= 32;
+					acc = fill ? (tripled>>(30-fill)) : 0;
+				}
+			}
+		}
+	}
+}
+
+// Same as tmds_encode_channel_pairs(), for lanes with a pull threshold of 30: the entry is already 2 output words, so
+// count only has to be even.
+static inline void tmds_encode_channel_pairs_30(const uint32_t *pair_lut, const uint32_t *pixels, int shift, uint32_t *out,
+	int count)
+{
+	for(int i=0; i<count; i+=2)
+	{
+		uint32_t pair = *pixels++;
+		const uint32_t *entry = pair_lut+((((pair>>(16+shift))&0x1f)<<6)|(((pair>>shift)&0x1f)<<1));
+		out[i] = entry[0];
+		out[i+1] = entry[1];
+	}
+}
+
+// Converts count pixels from the framebuffer format to the LUT byte format (what lcd_capture_lut would have pushed
+// for the same pixels.) For the host tools.
+static inline void tmds_pixels_to_bytes(const uint32_t *fb_line, uint8_t *line, int count)
+{
+	for(int i=0; i<count; i++)
+	{
+		uint32_t pixel = (fb_line[i>>1]>>((i&1) ? 0 : 16))&0x7fff;
+		for(int ch=0; ch<3; ch++)
+			line[3*i+ch] = (uint8_t)(((pixel>>tmds_channel_shift(ch))&0x1f)<<1);
+	}
+}
+
+// Reference single-core encode of a whole line into 3 lane buffers of TMDS_LINE_WORDS each.
+static inline void tmds_encode_line(const uint32_t *tmds_lut, const uint32_t *fb_line, uint32_t *lane[3], uint8_t *values)
+{
+	for(int ch=0; ch<3; ch++)
+	{
+		tmds_separate_channel(fb_line, values, 0, TMDS_LINE_PIXELS, tmds_channel_shift(ch));
+		tmds_encode_channel(tmds_lut, values, lane[ch], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+	}
+}
+
+// Same for a line in the LUT byte format.
+static inline void tmds_encode_line_bytes(const uint32_t *tmds_lut, const uint8_t *line, uint32_t *lane[3])
+{
+	for(int ch=0; ch<3; ch++)
+		tmds_encode_channel_bytes(tmds_lut, line, ch, lane[ch], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+}
+
+#endif
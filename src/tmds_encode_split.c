@@ -0,0 +1,112 @@
+/*
+	tmds_encode_split.c
+
+	Firmware side of the split channel encode (see tmds_encode_split.h for how the work is divided.)
+	Both cores run the same loop: wait until the line buffer for the next input line has been released by DMA,
+	encode their half of the line, and mark it as done.
+
+	The line-completion barrier is the DMA completion flag of the channel 0 line DMA (channel 0 in out_dma_manager.S.)
+	Every completion means one output line has been sent; every SPLIT_LINE_REPEAT of them (or the runs of vrun, with
+	a scale plan) means one input line and its line buffer are free again. The IRQ handler runs on core 0 and wakes core 1 up with SEV.
+	When the output has its own handler on DMA_IRQ_0 (blank_spans.c), that one calls split_encode_line_done() instead,
+	since acknowledging the channel in one handler would clear it for the other.
+*/
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "tmds_encode_split.h"
+#include "sram_layout.h"
+#include "scanline_profiler.h"
+
+static struct split_encode_t *split_enc;
+static uint32_t split_dma_channel;
+
+// Separated channel values for each core, 1 byte per pixel. Where they go, and the encode loops, is up to the
+// SRAM layout (sram_layout.h.)
+static uint8_t __core0_encode_data("split_values") core0_values[TMDS_LINE_PIXELS];
+static uint8_t __core1_encode_data("split_values") core1_values[TMDS_LINE_PIXELS];
+
+// One active output line has been sent.
+void __not_in_flash_func(split_encode_line_done)(void)
+{
+	PROFILE_IRQ_EVENT(PROF_DMA_DONE, split_enc->line_release);
+	if(!split_encode_line_sent(split_enc))
+		return;
+	PROFILE_IRQ_EVENT(PROF_RELEASE, split_enc->line_release);
+	__sev();
+}
+
+static void __not_in_flash_func(split_dma_irq)(void)
+{
+	dma_hw->ints0 = 1u<<split_dma_channel;
+	split_encode_line_done();
+}
+
+static void __not_in_flash_func(wait_handoff)(void)
+{
+	tight_loop_contents();
+}
+
+// Line n goes into buffer n&1, which was last used by line n-2.
+static inline void wait_line_buffer(struct split_encode_t *enc, uint32_t line)
+{
+	while(enc->line_release+1<line)
+		__wfe();
+}
+
+static void __core1_encode_func(core1_encode_loop)(void)
+{
+	struct split_encode_t *enc = split_enc;
+	uint32_t line = 0;
+	while(1)
+	{
+		wait_line_buffer(enc, line);
+		PROFILE_EVENT(PROF_ENC_START, line);
+		split_encode_core1(enc, line, core1_values, wait_handoff);
+		PROFILE_EVENT(PROF_ENC_END, line);
+		enc->core_done[1] = ++line;
+	}
+}
+
+void split_encode_init(struct split_encode_t *enc, uint32_t dma_line_channel)
+{
+	split_enc = enc;
+	split_dma_channel = dma_line_channel;
+	enc->line_release = 0;
+	enc->dma_count = 0;
+	enc->run = 0;
+	enc->ch1_handoff = 0xffffu<<16;
+	enc->cache_handoff = 0xffffu<<16;
+	enc->frame_handoff = 0;
+	enc->core_done[0] = 0;
+	enc->core_done[1] = 0;
+	enc->late_lines = 0;
+
+	if(dma_line_channel==SPLIT_NO_DMA_IRQ)
+		return;
+	dma_channel_set_irq0_enabled(dma_line_channel, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, split_dma_irq);
+	irq_set_enabled(DMA_IRQ_0, true);
+}
+
+void split_encode_launch(struct split_encode_t *enc)
+{
+	(void)enc;
+	multicore_launch_core1(core1_encode_loop);
+}
+
+void __core0_encode_func(split_encode_core0_loop)(struct split_encode_t *enc)
+{
+	uint32_t line = 0;
+	while(1)
+	{
+		wait_line_buffer(enc, line);
+		PROFILE_EVENT(PROF_ENC_START, line);
+		split_encode_core0(enc, line, core0_values, wait_handoff);
+		PROFILE_EVENT(PROF_ENC_END, line);
+		enc->core_done[0] = ++line;
+	}
+}
@@ -0,0 +1,271 @@
+/*
+	tmds_encode_split.h
+
+	Splits the 3 TMDS channel encodes of a line between both cores.
+	Core 0: first part of channel 1 (green), then all of channel 0 (blue.)
+	Core 1: all of channel 2 (red), then the rest of channel 1, starting from the disparity core 0 hands over.
+	Core 1 only needs the handoff after a whole channel of its own work, so it (almost) never waits for it.
+	The handoffs hold one line each, and nothing else keeps core 0 from getting a line ahead (lines 0 and 1 are both
+	free at the start, and core 1 can run late), so core 0 waits for core 1 to finish a line before it publishes the
+	handoffs of the next one. Otherwise it would overwrite a handoff core 1 hasn't read yet, and core 1 would wait for
+	it forever.
+
+	With a line cache (line_cache.h), core 0 hashes the line first and hands the result to core 1 the same way, and
+	both skip the line if it's a hit. The line buffer pointers of the line then point at the cache entry, so whatever
+	sets up the line DMA has to take them from line_buf for every line.
+
+	With next_frame set, core 0 asks for a new frame source (frame, LUT and where it goes) at the start of every frame,
+	and core 1 waits for it before the first line of that frame. With frame_line set too, core 0 says which line of the
+	source it's about to read, for every line that comes from its pixels (model_frame_line(), so the capture manager
+	knows how far the encoder is.) The sources alternate between 2 slots, so core 1 can
+	still be on the last line of the old frame. A frame smaller than the framebuffer (160x144 Gameboy frames) gets
+	copied into the middle of a line of border pixels by each core, into its own line_copy.
+
+	With osd set, each core draws the on-screen display (osd.h) into its lanes once they're encoded: core 0 into
+	channel 0, core 1 into channels 2 and 1. With a line cache, the OSD goes into the key, so a hit already has it.
+	The OSD is shared by both cores, so it only changes between frames (from next_frame), and its box must not take
+	the last line of the frame, which core 1 can still be on.
+
+	Line buffers are released from the output line IRQ, DMA_IRQ_0. With out_dma_manager.S nothing else uses it, so
+	split_encode_init() takes it for the completion of the line channel. The other outputs have their own handler on
+	it (blank_spans.c), so there split_encode_init() gets SPLIT_NO_DMA_IRQ and that handler calls
+	split_encode_line_done() after every active line instead.
+
+	The split point has to be a multiple of 16 pixels so each half of channel 1 starts on a word boundary.
+	112 gives core 0 352 pixels and core 1 368 pixels of work per line, since core 0 also takes the DMA IRQs
+	(encode_split_sim puts the difference at about 2% that way, vs. 6% the other way around with 128.)
+*/
+
+#ifndef TMDS_ENCODE_SPLIT_H
+#define TMDS_ENCODE_SPLIT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "tmds_channel_encode.h"
+#include "line_cache.h"
+#include "sram_layout.h"
+#include "osd.h"
+#include "scale_plan.h"
+
+#ifndef SPLIT_CH1_PIXELS
+#define SPLIT_CH1_PIXELS 112
+#endif
+
+#if (SPLIT_CH1_PIXELS%TMDS_PACK_GROUP)!=0 || SPLIT_CH1_PIXELS<=0 || SPLIT_CH1_PIXELS>=TMDS_LINE_PIXELS
+#error "SPLIT_CH1_PIXELS has to be a multiple of 16 between 16 and 224"
+#endif
+
+#define SPLIT_CH1_WORDS ((SPLIT_CH1_PIXELS/TMDS_PACK_GROUP)*TMDS_PACK_WORDS)
+
+// Each input line is shown this many times, so this many DMA line completions release one line buffer (without vrun.)
+#define SPLIT_LINE_REPEAT 3
+// dma_line_channel of split_encode_init() when the output's line IRQ calls split_encode_line_done()
+#define SPLIT_NO_DMA_IRQ 0xffffffffu
+
+// Where the lines of a frame come from, when next_frame is used.
+struct split_frame_t
+{
+	const uint32_t *tmds_lut;
+	const uint32_t *pixels; // line_words words per line, NULL for a frame that's all border
+	int line_words, height;
+	int x_words, y; // where the frame goes
+	uint32_t border; // pixel pair
+};
+
+struct split_encode_t
+{
+	const uint32_t *tmds_lut; // from sram_layout_lut() in SRAM_LAYOUT_BANKED, like the LUTs of next_frame
+	const uint32_t *framebuffer; // TMDS_FB_LINE_WORDS words per line
+	uint32_t *line_buf[2][3]; // double line buffer, TMDS_LINE_WORDS words per lane
+	int lines; // number of input lines per frame
+	struct line_cache_t *cache; // NULL to encode every line
+	// Called by core 0 at the start of every frame to fill in its source, NULL to always use framebuffer and tmds_lut.
+	void (*next_frame)(struct split_encode_t *enc, struct split_frame_t *frame);
+	// Called by core 0 before it reads line (0 to height-1) of the frame source's pixels, NULL for nothing.
+	void (*frame_line)(struct split_encode_t *enc, int line);
+	struct split_frame_t frame[2]; // by frame number parity
+	uint32_t line_copy[2][TMDS_FB_LINE_WORDS]; // per core
+	struct osd_t *osd; // NULL for no OSD, line_words has to be TMDS_LINE_WORDS
+	// Vertical schedule of a scale plan (vrun and runs of scale_plan_t) the line buffers are released by, NULL for
+	// SPLIT_LINE_REPEAT output lines per input line. Its runs have to add up to the active lines of the output.
+	const struct scale_run_t *vrun;
+	int runs;
+
+	// Written by the DMA completion IRQ: number of input lines whose line buffer has been fully sent.
+	volatile uint32_t line_release;
+	// Output lines sent of the input line (or vrun entry) being shown, and that entry (split_encode_line_sent())
+	uint32_t dma_count;
+	int run;
+	// Core 0 -> core 1 handoff of the channel 1 disparity at SPLIT_CH1_PIXELS.
+	// The line number goes in the top half so core 1 can't pick up a stale value.
+	volatile uint32_t ch1_handoff;
+	// Core 0 -> core 1: line number in the top half, 1 if the line is a cache hit.
+	volatile uint32_t cache_handoff;
+	// Core 0 -> core 1: number of frame sources core 0 has filled in.
+	volatile uint32_t frame_handoff;
+	// Number of lines each core has finished.
+	volatile uint32_t core_done[2];
+	// Lines where the encode wasn't finished when DMA needed the buffer.
+	volatile uint32_t late_lines;
+};
+
+// Framebuffer line and LUT for line, for core. Core 1 reads its own copy of the LUT in SRAM_LAYOUT_BANKED.
+static inline const uint32_t *split_frame_line(struct split_encode_t *enc, uint32_t line, int core, const uint32_t **lut)
+{
+	int lut_offset = core ? SRAM_CORE1_LUT_WORDS : 0;
+	if(!enc->next_frame)
+	{
+		*lut = enc->tmds_lut+lut_offset;
+		return enc->framebuffer+(line%enc->lines)*TMDS_FB_LINE_WORDS;
+	}
+	const struct split_frame_t *f = &enc->frame[(line/enc->lines)&1];
+	int l = (int)(line%enc->lines)-f->y;
+	bool inside = f->pixels && l>=0 && l<f->height;
+	*lut = f->tmds_lut+lut_offset;
+	if(inside && f->line_words==TMDS_FB_LINE_WORDS)
+		return f->pixels+l*TMDS_FB_LINE_WORDS;
+	uint32_t *copy = enc->line_copy[core];
+	for(int i=0; i<TMDS_FB_LINE_WORDS; i++)
+		copy[i] = f->border;
+	if(inside)
+		memcpy(copy+f->x_words, f->pixels+l*f->line_words, (size_t)f->line_words*sizeof(uint32_t));
+	return copy;
+}
+
+// One active output line has been sent. Every SPLIT_LINE_REPEAT of them release the line buffer of an input line, or
+// with vrun the last output line of each run of an input line does (border runs release nothing, so a plan like
+// 3, 3, 4 works); returns true when one was. split_encode_line_done() on the board, and the host sims directly.
+static inline bool split_encode_line_sent(struct split_encode_t *enc)
+{
+	uint32_t repeat = SPLIT_LINE_REPEAT;
+	bool border = false;
+	if(enc->vrun)
+	{
+		repeat = enc->vrun[enc->run].count;
+		border = enc->vrun[enc->run].line==SCALE_BORDER;
+	}
+	if(++enc->dma_count<repeat)
+		return false;
+	enc->dma_count = 0;
+	if(enc->vrun && ++enc->run==enc->runs)
+		enc->run = 0;
+	if(border)
+		return false;
+	uint32_t released = enc->line_release+1;
+	// The next buffer to be sent belongs to line 'released', which should already be encoded by both cores.
+	if(enc->core_done[0]<=released || enc->core_done[1]<=released)
+		enc->late_lines++;
+	enc->line_release = released;
+	return true;
+}
+
+// Waits until core 1 is done with the line before line, and so with the handoffs of that line
+static inline void split_wait_core1(struct split_encode_t *enc, uint32_t line, void (*wait_handoff)(void))
+{
+	while(enc->core_done[1]<line)
+	{
+		wait_handoff();
+	}
+	__asm__ volatile("" ::: "memory");
+}
+
+// Per-core halves of the line encode. They are also called directly by the host simulations, which have to keep
+// core_done[1] up to date. wait_handoff is called while the other core isn't there yet.
+static inline void split_encode_core0(struct split_encode_t *enc, uint32_t line, uint8_t *values, void (*wait_handoff)(void))
+{
+	uint32_t **lane = enc->line_buf[line&1];
+	const uint32_t *lut;
+	uint32_t disp;
+
+	if(enc->next_frame && line%enc->lines==0)
+	{
+		enc->next_frame(enc, &enc->frame[(line/enc->lines)&1]);
+		__asm__ volatile("" ::: "memory");
+		enc->frame_handoff = line/enc->lines+1;
+	}
+	const uint32_t *fb_line = split_frame_line(enc, line, 0, &lut);
+	if(enc->next_frame && enc->frame_line)
+	{
+		const struct split_frame_t *f = &enc->frame[(line/enc->lines)&1];
+		int l = (int)(line%enc->lines)-f->y;
+		if(f->pixels && l>=0 && l<f->height)
+			enc->frame_line(enc, l);
+	}
+
+	if(enc->cache)
+	{
+		// The same pixels give other TMDS words with another LUT
+		struct line_cache_key_t key = line_cache_hash(fb_line);
+		key.b ^= (uint32_t)(uintptr_t)lut;
+		if(enc->osd)
+			key.a ^= osd_line_key(enc->osd, (int)(line%enc->lines));
+		bool hit = line_cache_lookup(enc->cache, (int)(line%enc->lines), line, key, lane);
+		split_wait_core1(enc, line, wait_handoff);
+		enc->cache_handoff = (line<<16)|(hit ? 1 : 0);
+		if(hit)
+			return;
+	}
+
+	tmds_separate_channel(fb_line, values, 0, SPLIT_CH1_PIXELS, tmds_channel_shift(1));
+	disp = tmds_encode_channel(lut, values, lane[1], SPLIT_CH1_PIXELS, TMDS_DISP_RESET);
+	if(!enc->cache)
+		split_wait_core1(enc, line, wait_handoff);
+	enc->ch1_handoff = (line<<16)|disp;
+
+	tmds_separate_channel(fb_line, values, 0, TMDS_LINE_PIXELS, tmds_channel_shift(0));
+	tmds_encode_channel(lut, values, lane[0], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+	if(enc->osd)
+		osd_patch_lane(enc->osd, (int)(line%enc->lines), 0, lane[0]);
+}
+
+static inline void split_encode_core1(struct split_encode_t *enc, uint32_t line, uint8_t *values, void (*wait_handoff)(void))
+{
+	uint32_t **lane = enc->line_buf[line&1];
+	const uint32_t *lut;
+	uint32_t handoff;
+
+	if(enc->next_frame && line%enc->lines==0)
+	{
+		while(enc->frame_handoff<line/enc->lines+1)
+		{
+			wait_handoff();
+		}
+		__asm__ volatile("" ::: "memory");
+	}
+	const uint32_t *fb_line = split_frame_line(enc, line, 1, &lut);
+
+	if(enc->cache)
+	{
+		while(((handoff = enc->cache_handoff)>>16)!=(line&0xffff))
+		{
+			wait_handoff();
+		}
+		if(handoff&1)
+			return;
+		// lane was just changed by core 0
+		__asm__ volatile("" ::: "memory");
+	}
+
+	tmds_separate_channel(fb_line, values, 0, TMDS_LINE_PIXELS, tmds_channel_shift(2));
+	tmds_encode_channel(lut, values, lane[2], TMDS_LINE_PIXELS, TMDS_DISP_RESET);
+
+	tmds_separate_channel(fb_line, values, SPLIT_CH1_PIXELS, TMDS_LINE_PIXELS-SPLIT_CH1_PIXELS, tmds_channel_shift(1));
+	while(((handoff = enc->ch1_handoff)>>16)!=(line&0xffff))
+	{
+		wait_handoff();
+	}
+	tmds_encode_channel(lut, values, lane[1]+SPLIT_CH1_WORDS, TMDS_LINE_PIXELS-SPLIT_CH1_PIXELS, handoff&0xffff);
+	if(enc->osd)
+	{
+		osd_patch_lane(enc->osd, (int)(line%enc->lines), 2, lane[2]);
+		osd_patch_lane(enc->osd, (int)(line%enc->lines), 1, lane[1]);
+	}
+}
+
+// Firmware side (tmds_encode_split.c)
+void split_encode_init(struct split_encode_t *enc, uint32_t dma_line_channel);
+void split_encode_line_done(void);
+void split_encode_launch(struct split_encode_t *enc);
+void split_encode_core0_loop(struct split_encode_t *enc);
+
+#endif
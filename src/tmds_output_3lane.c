@@ -0,0 +1,223 @@
+/*
+	tmds_output_3lane.c
+
+	Firmware side of the single state machine output (see tmds_output_3lane.h.)
+	All 3 lanes come from one DMA data channel into one TX FIFO, and one control channel loads it with 2 blocks per
+	line: the blanking of the line (one of the 4 buffers of tmds_util -3, read in order), then the active part, which
+	is a line buffer for the active lines or the 2 control symbol words of the vblank line from an 8 byte read ring.
+	So the video takes 2 DMA channels instead of the 6 of blank_spans.c or out_dma_manager.S.
+
+	The joined FIFO only holds 8 words, 40 bit-times, which is far too short for an IRQ to restart the DMA at the end
+	of a line like vga_output.c does. So nothing ever stops: every block chains to the control channel. The blanking
+	block raises DMA_IRQ_0 when it's done (while the control channel loads the active block), and the IRQ handler
+	writes the next line's blocks and points the control channel at them without triggering it. It has the whole
+	active part of the line (7200 cycles) to do that.
+
+	Each framebuffer line is 3 output lines from the same line buffer, and the encode (about 70 cycles per pixel on
+	the M0+, more than a line) is too long for the IRQ handler, so the handler only asks for it and tmds_3lane_task(),
+	called from the loop of the core that owns the output, does it into the buffer that isn't being sent. It has 3
+	lines for that.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "capture_manager.h"
+#include "blank_spans.h"
+#include "tmds_output_3lane.h"
+#include "tmds_output_3lane.pio.h"
+
+#if __has_include("clock_config.h")
+#include "clock_config.h"
+#else
+// The modeline of tmds_util.h
+#define MODE_H_ACTIVE 720
+#define MODE_H_FRONT 32
+#define MODE_H_PULSE 64
+#define MODE_H_BACK 96
+#define MODE_V_ACTIVE 480
+#define MODE_V_FRONT 13
+#define MODE_V_PULSE 8
+#define MODE_V_BACK 38
+#endif
+
+#define T3_LINE_REPEAT 3
+#define T3_V_TOTAL (MODE_V_ACTIVE+MODE_V_FRONT+MODE_V_PULSE+MODE_V_BACK)
+#define T3_BLANK_WORDS TMDS_3LANE_WORDS(MODE_H_FRONT+MODE_H_PULSE+MODE_H_BACK)
+
+#if MODE_H_ACTIVE!=TMDS_LINE_PIXELS*3 || MODE_V_ACTIVE!=CAPTURE_HEIGHT*T3_LINE_REPEAT
+#error "The 3-lane output needs the active area to be the framebuffer at 3x"
+#endif
+#if CAPTURE_LINE_WORDS!=TMDS_FB_LINE_WORDS
+#error "The 3-lane output needs 2 RGB555 pixels per framebuffer word"
+#endif
+
+// Blanking variants, in the order of the buffers given to tmds_3lane_start() (same as enum blank_variant_t)
+#define T3_HBLANK 0
+#define T3_VBLANK_EN 1
+#define T3_VBLANK_SYN 2
+#define T3_VBLANK_EX 3
+
+static uint32_t t3_line_buf[2][TMDS_3LANE_LINE_WORDS];
+// Control symbols of a vblank line's active part, vsync high then low. Ring reads need the alignment.
+static uint32_t t3_ctl[2][TMDS_3LANE_SYMBOL_WORDS] __attribute__((aligned(8)));
+static struct dma_ctrl_block_t t3_blocks[2][2];
+static const uint32_t *t3_blank[4];
+static const uint32_t *t3_lut;
+static struct capture_manager_t *t3_capture;
+static const uint32_t *t3_frame;
+static int t3_frame_format;
+static uint32_t t3_ctrl_blank, t3_ctrl_active, t3_ctrl_ring;
+static uint t3_data_chan, t3_ctrl_chan;
+static int t3_line; // output line being sent, 0 is the first active line
+static volatile int t3_encode_line = -1; // framebuffer line tmds_3lane_task() has to encode, or -1
+
+// Vsync edges happen at the start of the hsync pulse, like in span_compiler.c.
+static int t3_variant(int line)
+{
+	int pulse_start = MODE_V_ACTIVE+MODE_V_FRONT;
+	if(line==pulse_start)
+		return T3_VBLANK_EN;
+	if(line>pulse_start && line<pulse_start+MODE_V_PULSE)
+		return T3_VBLANK_SYN;
+	if(line==pulse_start+MODE_V_PULSE)
+		return T3_VBLANK_EX;
+	return T3_HBLANK;
+}
+
+static void __not_in_flash_func(t3_build_line)(struct dma_ctrl_block_t *blocks, int line)
+{
+	int variant = t3_variant(line);
+	blocks[0].read_addr = t3_blank[variant];
+	blocks[0].transfer_count = T3_BLANK_WORDS;
+	blocks[0].ctrl = t3_ctrl_blank;
+	blocks[1].transfer_count = TMDS_3LANE_WORDS(MODE_H_ACTIVE);
+	if(line<MODE_V_ACTIVE)
+	{
+		blocks[1].read_addr = t3_line_buf[(line/T3_LINE_REPEAT)&1];
+		blocks[1].ctrl = t3_ctrl_active;
+	}
+	else
+	{
+		// vsync is low after the start of the pulse on the EN and SYN lines
+		blocks[1].read_addr = t3_ctl[variant==T3_VBLANK_EN || variant==T3_VBLANK_SYN];
+		blocks[1].ctrl = t3_ctrl_ring;
+	}
+}
+
+static void __not_in_flash_func(t3_line_irq)(void)
+{
+	dma_hw->ints0 = 1u<<t3_data_chan;
+	// The control channel was started by the same chain that raised the IRQ; it's 4 transfers, so it's done by now.
+	while(dma_channel_is_busy(t3_ctrl_chan))
+		tight_loop_contents();
+	int line = t3_line;
+	if(++t3_line==T3_V_TOTAL)
+		t3_line = 0;
+	t3_build_line(t3_blocks[t3_line&1], t3_line);
+	dma_channel_set_read_addr(t3_ctrl_chan, t3_blocks[t3_line&1], false);
+
+	// The line buffer of line is being sent: the other one gets the next framebuffer line.
+	if(line<MODE_V_ACTIVE && line%T3_LINE_REPEAT==0 && line/T3_LINE_REPEAT+1<CAPTURE_HEIGHT)
+		t3_encode_line = line/T3_LINE_REPEAT+1;
+	else if(line==MODE_V_ACTIVE)
+		t3_encode_line = 0;
+}
+
+static void __not_in_flash_func(t3_encode)(int fb_line)
+{
+	if(fb_line==0)
+		t3_frame = capture_frame_begin(t3_capture, &t3_frame_format);
+	capture_frame_line(t3_capture, fb_line);
+	uint32_t *out = t3_line_buf[fb_line&1];
+	if(t3_frame_format==CAPTURE_FORMAT_NONE)
+	{
+		static const uint32_t black[TMDS_FB_LINE_WORDS];
+		tmds_3lane_encode_line(t3_lut, black, out);
+	}
+	else
+		tmds_3lane_encode_line(t3_lut, t3_frame+fb_line*CAPTURE_LINE_WORDS, out);
+	if(fb_line==CAPTURE_HEIGHT-1)
+		capture_frame_end(t3_capture);
+}
+
+// Encodes the next framebuffer line if the output is waiting for one. Has to be called at least once every 3 lines.
+void __not_in_flash_func(tmds_3lane_task)(void)
+{
+	int fb_line = t3_encode_line;
+	if(fb_line<0)
+		return;
+	t3_encode_line = -1;
+	t3_encode(fb_line);
+}
+
+// Starts the output on GP14-19 with state machine sm, frames from capture (set up with capture_init(), RGB555.)
+// lut is a TMDS_3LANE_LUT_WORDS LUT, blank the 4 blanking buffers of one set (hblank, vblank_en, vblank_syn, vblank_ex)
+// and ctl_active the 4 words of 3l_ctl_active.bin, all from tmds_util -3.
+void tmds_3lane_start(uint32_t pio_index, uint32_t sm, uint32_t data_chan, uint32_t ctrl_chan, const uint32_t *lut,
+	const uint32_t *const blank[4], const uint32_t ctl_active[4], struct capture_manager_t *capture)
+{
+	PIO pio = pio_index ? pio1 : pio0;
+	t3_lut = lut;
+	for(int v=0; v<4; v++)
+		t3_blank[v] = blank[v];
+	memcpy(t3_ctl, ctl_active, sizeof(t3_ctl));
+	t3_capture = capture;
+	t3_data_chan = data_chan;
+	t3_ctrl_chan = ctrl_chan;
+
+	for(uint pin=TMDS_3LANE_PIN; pin<TMDS_3LANE_PIN+TMDS_3LANE_PINS; pin++)
+		pio_gpio_init(pio, pin);
+	uint offset = pio_add_program(pio, &tmds_output_3lane_program);
+	pio_sm_config c = tmds_output_3lane_program_get_default_config(offset);
+	sm_config_set_out_pins(&c, TMDS_3LANE_PIN, TMDS_3LANE_PINS);
+	sm_config_set_out_shift(&c, true, true, TMDS_3LANE_BITS_PER_WORD*TMDS_3LANE_PINS);
+	sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+	sm_config_set_clkdiv_int_frac(&c, 1, 0);
+	pio_sm_init(pio, sm, offset, &c);
+	pio_sm_set_consecutive_pindirs(pio, sm, TMDS_3LANE_PIN, TMDS_3LANE_PINS, true);
+
+	// Data channel: all of its settings come from the control blocks, and it always chains to the control channel.
+	dma_channel_config d = dma_channel_get_default_config(data_chan);
+	channel_config_set_transfer_data_size(&d, DMA_SIZE_32);
+	channel_config_set_read_increment(&d, true);
+	channel_config_set_write_increment(&d, false);
+	channel_config_set_dreq(&d, pio_get_dreq(pio, sm, true));
+	channel_config_set_chain_to(&d, ctrl_chan);
+	channel_config_set_irq_quiet(&d, true);
+	t3_ctrl_active = channel_config_get_ctrl_value(&d);
+	channel_config_set_ring(&d, false, 3);
+	t3_ctrl_ring = channel_config_get_ctrl_value(&d);
+	channel_config_set_ring(&d, false, 0);
+	channel_config_set_irq_quiet(&d, false);
+	t3_ctrl_blank = channel_config_get_ctrl_value(&d);
+	for(int b=0; b<2; b++)
+	{
+		t3_blocks[b][0].write_addr = &pio->txf[sm];
+		t3_blocks[b][1].write_addr = &pio->txf[sm];
+	}
+
+	// Control channel: 4 words per block into READ_ADDR, WRITE_ADDR, TRANS_COUNT and CTRL_TRIG of the data channel
+	d = dma_channel_get_default_config(ctrl_chan);
+	channel_config_set_transfer_data_size(&d, DMA_SIZE_32);
+	channel_config_set_read_increment(&d, true);
+	channel_config_set_write_increment(&d, true);
+	channel_config_set_ring(&d, true, 4);
+	dma_channel_configure(ctrl_chan, &d, &dma_hw->ch[data_chan].read_addr, NULL, 4, false);
+	dma_channel_set_irq0_enabled(data_chan, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, t3_line_irq);
+	irq_set_enabled(DMA_IRQ_0, true);
+
+	// Framebuffer line 1 is asked for by the first IRQ
+	t3_encode(0);
+	t3_encode_line = -1;
+	t3_line = 0;
+	t3_build_line(t3_blocks[0], 0);
+	// The FIFO fills up before the state machine starts, and the frame starts with the first active line.
+	dma_channel_set_read_addr(ctrl_chan, t3_blocks[0], true);
+	pio_sm_set_enabled(pio, sm, true);
+
+	return;
+}
@@ -0,0 +1,93 @@
+/*
+	tmds_output_3lane.h
+
+	Word layout and line encoder for tmds_output_3lane.pio, where one state machine drives all 3 TMDS lanes with
+	'out pins, 6' from a single interleaved stream.
+
+	Every bit-time is 6 bits: bit 2*lane is the P leg and bit 2*lane+1 the N leg of that lane (lane 0 is TMDS channel
+	0, blue.) With a pull threshold of 30, a word is 5 bit-times and a symbol of all 3 lanes is exactly 2 words, so
+	anything that repeats every symbol (the control symbols of a vblank line) repeats every 2 words and can be sent
+	from an 8 byte DMA read ring.
+
+	LUT format (create_tmds_lut_3lane() in tmds_util.c, "3l_tmds_lut.bin" from tmds_util -3): entries of
+	TMDS_3LANE_LUT_ENTRY words at (color<<3)|disparity, where disparity is the LUT disparity of lut_disparity() shifted
+	left by 2 more (bits 8-11.) Words 0-5 are the 3 symbols on lane 0 (bits 0-1 of every bit-time), word 6 is the next
+	disparity and word 7 is unused. The other lanes are the same words shifted left by 2 and 4, so one LUT does all 3
+	lanes, and the encoder ORs the 3 lanes of each word together.
+
+	The DMA and the state machine are set up by tmds_output_3lane.c.
+*/
+
+#ifndef TMDS_OUTPUT_3LANE_H
+#define TMDS_OUTPUT_3LANE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tmds_channel_encode.h"
+
+#define TMDS_3LANE_PIN 14
+#define TMDS_3LANE_PINS 6
+#define TMDS_3LANE_BITS_PER_WORD 5
+#define TMDS_3LANE_SYMBOL_WORDS 2
+// Words for a number of symbols on all 3 lanes
+#define TMDS_3LANE_WORDS(symbols) ((symbols)*TMDS_3LANE_SYMBOL_WORDS)
+
+// 32 colors * 16 disparities * 8 words
+#define TMDS_3LANE_LUT_ENTRY 8
+#define TMDS_3LANE_LUT_WORDS (32*16*TMDS_3LANE_LUT_ENTRY)
+#define TMDS_3LANE_DISP_RESET (8<<8)
+
+// 240 pixels, 3 symbols each
+#define TMDS_3LANE_LINE_WORDS TMDS_3LANE_WORDS(TMDS_LINE_PIXELS*3)
+
+// ORs symbol into the 2 words at out, on lane (0-2.)
+static inline void tmds_3lane_put_symbol(uint32_t *out, uint32_t symbol, int lane)
+{
+	for(int b=0; b<10; b++)
+	{
+		uint32_t bit = (symbol>>b)&0x01;
+		out[b/TMDS_3LANE_BITS_PER_WORD] |= (bit|((bit^0x01)<<1))<<(6*(b%TMDS_3LANE_BITS_PER_WORD)+2*lane);
+	}
+}
+
+// Packs count symbols of each lane into TMDS_3LANE_WORDS(count) words.
+static inline void tmds_3lane_pack(const uint16_t *ch0, const uint16_t *ch1, const uint16_t *ch2, uint32_t *out, int count)
+{
+	for(int i=0; i<count; i++)
+	{
+		uint32_t *words = out+TMDS_3LANE_WORDS(i);
+		words[0] = 0;
+		words[1] = 0;
+		tmds_3lane_put_symbol(words, ch0[i], 0);
+		tmds_3lane_put_symbol(words, ch1[i], 1);
+		tmds_3lane_put_symbol(words, ch2[i], 2);
+	}
+}
+
+// Encodes a framebuffer line (TMDS_FB_LINE_WORDS) into TMDS_3LANE_LINE_WORDS words, with the disparity of every lane
+// starting from TMDS_3LANE_DISP_RESET.
+static inline void tmds_3lane_encode_line(const uint32_t *lut, const uint32_t *fb_line, uint32_t *out)
+{
+	uint32_t d0 = TMDS_3LANE_DISP_RESET, d1 = TMDS_3LANE_DISP_RESET, d2 = TMDS_3LANE_DISP_RESET;
+	for(int i=0; i<TMDS_LINE_PIXELS; i++)
+	{
+		uint32_t pixel = fb_line[i>>1]>>((i&1) ? 0 : 16);
+		const uint32_t *b = lut+((((pixel>>10)&0x1f)<<3)|d0);
+		const uint32_t *g = lut+((((pixel>>5)&0x1f)<<3)|d1);
+		const uint32_t *r = lut+(((pixel&0x1f)<<3)|d2);
+		for(int k=0; k<6; k++)
+			out[k] = b[k]|(g[k]<<2)|(r[k]<<4);
+		d0 = b[6];
+		d1 = g[6];
+		d2 = r[6];
+		out += 6;
+	}
+}
+
+// Firmware side (tmds_output_3lane.c)
+struct capture_manager_t;
+void tmds_3lane_start(uint32_t pio_index, uint32_t sm, uint32_t data_chan, uint32_t ctrl_chan, const uint32_t *lut,
+	const uint32_t *const blank[4], const uint32_t ctl_active[4], struct capture_manager_t *capture);
+void tmds_3lane_task(void);
+
+#endif
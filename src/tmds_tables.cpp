@@ -0,0 +1,54 @@
+/*
+	tmds_tables.cpp
+
+	Instantiates tmds_tables.hpp for the modeline of clock_config.h into tmds_tables (tmds_tables.h), all at compile
+	time: the static_asserts stop the build if the modeline doesn't fit or a table isn't DC balanced, and the object is
+	constant initialized, so there's no code that runs for it.
+*/
+
+#include "tmds_tables.h"
+#include "tmds_tables.hpp"
+
+namespace
+{
+
+struct clock_config_mode
+{
+	static constexpr int h_active = MODE_H_ACTIVE, h_front = MODE_H_FRONT, h_pulse = MODE_H_PULSE, h_back = MODE_H_BACK;
+	static constexpr int v_active = MODE_V_ACTIVE, v_front = MODE_V_FRONT, v_pulse = MODE_V_PULSE, v_back = MODE_V_BACK;
+};
+
+using blank = tmds::blank_t<clock_config_mode>;
+
+constexpr tmds::lut_t lut = tmds::make_lut<TMDS_TABLES_REPEAT>();
+constexpr blank blank_nm = tmds::make_blank<clock_config_mode, TMDS_TABLES_ISLANDS>();
+constexpr blank blank_nd = tmds::make_blank<clock_config_mode, 0>();
+
+static_assert(blank::words==TMDS_TABLES_BLANK_WORDS, "blanking line size");
+static_assert(tmds::LUT_WORDS==TMDS_TABLES_LUT_WORDS, "LUT size");
+static_assert(tmds::blank_fits<clock_config_mode, TMDS_TABLES_ISLANDS>(), "the islands don't fit the blanking");
+static_assert(tmds::lut_balanced<TMDS_TABLES_REPEAT>(lut), "a LUT entry's disparity isn't its symbols' balance");
+static_assert(tmds::blank_balanced(blank_nm) && tmds::blank_balanced(blank_nd),
+	"a blanking line has a bad symbol or isn't DC balanced on channels 1 and 2");
+
+constexpr tmds_tables_t make_tables()
+{
+	tmds_tables_t t{};
+	for(int i=0; i<TMDS_TABLES_LUT_WORDS; i++)
+		t.lut[i] = lut.words[i];
+	for(int v=0; v<4; v++)
+	{
+		for(int ch=0; ch<3; ch++)
+		{
+			tmds::pack(blank_nm.symbol[v][ch], t.blank_nm[v][ch], blank::symbols);
+			tmds::pack(blank_nd.symbol[v][ch], t.blank_nd[v][ch], blank::symbols);
+		}
+	}
+	return t;
+}
+
+}
+
+// constinit in all but name: the initializer is a constant expression, so it's filled in by the compiler.
+constexpr tmds_tables_t tmds_tables_init = make_tables();
+struct tmds_tables_t tmds_tables = tmds_tables_init;
@@ -0,0 +1,55 @@
+/*
+	tmds_tables.h
+
+	C view of the tables tmds_tables.cpp has the compiler work out (see tmds_tables.hpp): the TMDS LUT and both sets of
+	blanking lines for the modeline of clock_config.h, in the same formats as tmds_lut.bin and the hblank/vblank_*
+	files of tmds_util.c, without the .bin files or a generator run.
+	They're initialized data, so they're in RAM from boot on like everything else the DMA reads.
+*/
+
+#ifndef TMDS_TABLES_H
+#define TMDS_TABLES_H
+
+#include <stdint.h>
+
+#if __has_include("clock_config.h")
+#include "clock_config.h"
+#else
+// The modeline of tmds_util.h
+#define MODE_H_ACTIVE 720
+#define MODE_H_FRONT 32
+#define MODE_H_PULSE 64
+#define MODE_H_BACK 96
+#define MODE_V_ACTIVE 480
+#define MODE_V_FRONT 13
+#define MODE_V_PULSE 8
+#define MODE_V_BACK 38
+#endif
+
+// Symbols per LUT entry (pixel repeat), and data islands on the lines of the "nm" set
+#define TMDS_TABLES_REPEAT 3
+#define TMDS_TABLES_ISLANDS 2
+
+#define TMDS_TABLES_LUT_WORDS 1024
+#define TMDS_TABLES_BLANK_SYMBOLS (MODE_H_FRONT+MODE_H_PULSE+MODE_H_BACK)
+#define TMDS_TABLES_BLANK_WORDS ((TMDS_TABLES_BLANK_SYMBOLS*10)/32)
+
+struct tmds_tables_t
+{
+	uint32_t lut[TMDS_TABLES_LUT_WORDS];
+	// [variant][channel], variants in the order of enum blank_variant_t (hblank, vblank_en, vblank_syn, vblank_ex)
+	uint32_t blank_nm[4][3][TMDS_TABLES_BLANK_WORDS]; // with TMDS_TABLES_ISLANDS null packets
+	uint32_t blank_nd[4][3][TMDS_TABLES_BLANK_WORDS]; // no data islands
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct tmds_tables_t tmds_tables;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
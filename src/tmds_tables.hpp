@@ -0,0 +1,341 @@
+/*
+	tmds_tables.hpp
+
+	The TMDS LUT and the blanking lines of tmds_util.c, worked out by the compiler (C++17 constexpr) instead of by running
+	the generator and importing its .bin files, so they can't fall out of step with the modeline. Header only, and
+	nothing but <stdint.h>: tmds_tables.cpp instantiates it for the modeline of clock_config.h into the C view of
+	tmds_tables.h, and scripts/tmds_tables_check.c compares that with what tmds_util.c generates.
+
+	Everything is written from the specs, not ported from the generator:
+	-encode(): the 8b/10b flow chart of DVI 1.0 (3.3.3) with its running disparity
+	-the control, guard band and TERC4 symbols as the tables list them (same values as tmds_util.c)
+	-null packet data islands with the BCH ECC of data_island.h (x^8+x^7+x^6+1, LSB first)
+	The results are in the formats of tmds_util.c: LUT entries of 2 words at (color<<1)|lut_disparity() with Repeat
+	symbols in word 0, and lines packed 10 bits per symbol, LSB first, into 32-bit words (pack_buffer_single().)
+
+	A mode is any type with the static constexpr ints of mode_720x480 below. The check functions (lut_balanced(),
+	blank_balanced(), blank_fits()) are there for static_assert.
+*/
+
+#ifndef TMDS_TABLES_HPP
+#define TMDS_TABLES_HPP
+
+#include <stdint.h>
+
+namespace tmds
+{
+
+// The modeline of tmds_util.h
+struct mode_720x480
+{
+	static constexpr int h_active = 720, h_front = 32, h_pulse = 64, h_back = 96;
+	static constexpr int v_active = 480, v_front = 13, v_pulse = 8, v_back = 38;
+};
+
+constexpr int LUT_WORDS = 1024;
+constexpr int ISLAND_PIXELS = 32;
+
+// Blanking line variants, same order as enum blank_variant_t in tmds_util.h
+enum variant_t
+{
+	HBLANK = 0,
+	VBLANK_EN = 1,
+	VBLANK_SYN = 2,
+	VBLANK_EX = 3
+};
+
+// C1C0 = 00, 01, 10, 11
+constexpr uint16_t ctl_symbol[4] = {0x354, 0x0ab, 0x154, 0x2ab};
+// Video guard band is guard[0] on channels 0 and 2, guard[1] on channel 1; island guard band is guard[1]
+constexpr uint16_t guard_symbol[2] = {0x2cc, 0x133};
+constexpr uint16_t terc4_symbol[16] =
+{
+	0x29c, 0x263, 0x2e4, 0x2e2, 0x171, 0x11e, 0x18e, 0x13c,
+	0x2cc, 0x139, 0x19c, 0x2c6, 0x28e, 0x271, 0x163, 0x2c3
+};
+
+constexpr int ones(uint32_t v, int bits)
+{
+	int n = 0;
+	for(int b=0; b<bits; b++)
+		n += (v>>b)&1;
+	return n;
+}
+
+// Ones minus zeros of a symbol
+constexpr int balance(uint16_t symbol)
+{
+	return 2*ones(symbol, 10)-10;
+}
+
+// 5-bit channel value to 8 bits. 0x00 and 0xff get their LSB flipped, which keeps the running disparity of a line
+// within -8..8 so the LUT can keep half of it in 4 bits.
+constexpr uint8_t depth_convert(int c)
+{
+	uint8_t out = (uint8_t)((c<<3)|((c&0x1c)>>2));
+	return (out==0xff || out==0x00) ? (uint8_t)(out^0x01) : out;
+}
+
+// LUT disparity bits (6-9 of the entry address) of a running disparity, like lut_disparity() in tmds_util.c
+constexpr uint32_t lut_disparity(int disparity)
+{
+	return ((uint32_t)(disparity/2+8)&0x0f)<<6;
+}
+
+struct encoded_t
+{
+	uint16_t symbol;
+	int disparity;
+};
+
+// DVI 1.0 3.3.3: data byte d with running disparity cnt to a symbol and the new cnt
+constexpr encoded_t encode(uint8_t d, int cnt)
+{
+	int n1 = ones(d, 8);
+	bool use_xnor = n1>4 || (n1==4 && !(d&1));
+	uint32_t q_m = d&1;
+	for(int i=1; i<8; i++)
+	{
+		uint32_t bit = ((q_m>>(i-1))^(d>>i))&1;
+		q_m |= (use_xnor ? bit^1 : bit)<<i;
+	}
+	if(!use_xnor)
+		q_m |= 0x100;
+	int n1_qm = ones(q_m, 8), n0_qm = 8-n1_qm;
+	bool bit8 = (q_m>>8)&1;
+	uint32_t q_out = 0;
+	if(cnt==0 || n1_qm==n0_qm)
+	{
+		q_out = bit8 ? q_m : ((q_m^0xff)|0x200);
+		cnt += bit8 ? n1_qm-n0_qm : n0_qm-n1_qm;
+	}
+	else if((cnt>0 && n1_qm>n0_qm) || (cnt<0 && n0_qm>n1_qm))
+	{
+		q_out = (q_m^0xff)|0x200;
+		cnt += 2*bit8+n0_qm-n1_qm;
+	}
+	else
+	{
+		q_out = q_m;
+		cnt += -2*!bit8+n1_qm-n0_qm;
+	}
+	return encoded_t{(uint16_t)q_out, cnt};
+}
+
+struct lut_t
+{
+	uint32_t words[LUT_WORDS];
+};
+
+// create_tmds_lut_symbols(): Repeat (1-3) symbols of each 5-bit value per entry, word 1 the disparity after them.
+// With 3 it's create_tmds_lut().
+template<int Repeat>
+constexpr lut_t make_lut()
+{
+	static_assert(Repeat>=1 && Repeat<=3, "an entry has 1 to 3 symbols");
+	lut_t lut{};
+	for(int color=0; color<32; color++)
+	{
+		for(int h=-8; h<8; h++)
+		{
+			uint32_t index = ((uint32_t)color<<1)|lut_disparity(2*h);
+			int cnt = 2*h;
+			for(int s=0; s<Repeat; s++)
+			{
+				encoded_t e = encode(depth_convert(color), cnt);
+				lut.words[index] |= (uint32_t)e.symbol<<(10*s);
+				cnt = e.disparity;
+			}
+			lut.words[index+1] = lut_disparity(cnt);
+		}
+	}
+	return lut;
+}
+
+// Every entry's disparity bits have to be what its symbols really add up to, from every disparity in range.
+template<int Repeat>
+constexpr bool lut_balanced(const lut_t &lut)
+{
+	for(int color=0; color<32; color++)
+	{
+		for(int h=0; h<16; h++)
+		{
+			uint32_t index = ((uint32_t)color<<1)|((uint32_t)h<<6);
+			int sum = 0;
+			for(int s=0; s<Repeat; s++)
+				sum += balance((uint16_t)((lut.words[index]>>(10*s))&0x3ff));
+			int next = (int)((lut.words[index+1]>>6)&0x0f);
+			if(2*(next-h)!=sum || (lut.words[index+1]&~0x3c0u))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Null packet island, channel 0 without the sync bits and bit 3 (data_island_encode() of data_packet_null())
+struct island_t
+{
+	uint8_t nibble[3][ISLAND_PIXELS];
+};
+
+constexpr uint8_t bch_ecc(const uint8_t *data, int length)
+{
+	uint8_t ecc = 0;
+	for(int i=0; i<length; i++)
+	{
+		for(int b=0; b<8; b++)
+		{
+			int feedback = (ecc^(data[i]>>b))&1;
+			ecc = (uint8_t)((ecc>>1)^(feedback ? 0x83 : 0));
+		}
+	}
+	return ecc;
+}
+
+constexpr island_t null_island()
+{
+	uint8_t header[4] = {0, 0, 0, 0}, sub[4][8] = {};
+	header[3] = bch_ecc(header, 3);
+	for(int n=0; n<4; n++)
+		sub[n][7] = bch_ecc(sub[n], 7);
+	island_t island{};
+	for(int i=0; i<ISLAND_PIXELS; i++)
+	{
+		for(int n=0; n<4; n++)
+		{
+			island.nibble[1][i] |= (uint8_t)(((sub[n][(2*i)>>3]>>((2*i)&7))&1)<<n);
+			island.nibble[2][i] |= (uint8_t)(((sub[n][(2*i+1)>>3]>>((2*i+1)&7))&1)<<n);
+		}
+		island.nibble[0][i] = (uint8_t)(((header[i>>3]>>(i&7))&1)<<2);
+	}
+	return island;
+}
+
+template<class Mode>
+struct blank_t
+{
+	static constexpr int symbols = Mode::h_front+Mode::h_pulse+Mode::h_back;
+	static constexpr int words = symbols*10/32;
+	uint16_t symbol[4][3][symbols];
+};
+
+// fill_blank_line() for all 4 variants: control period with sync, Islands null packets at the start of the hsync
+// pulse with their preamble and guard bands, and the video preamble and guard band at the end.
+template<class Mode, int Islands>
+constexpr blank_t<Mode> make_blank()
+{
+	constexpr int blank = blank_t<Mode>::symbols;
+	constexpr int island_start = Mode::h_front, island_end = Mode::h_front+ISLAND_PIXELS*Islands;
+	// vsync level (active low) before and after the start of the hsync pulse
+	constexpr int vsync_before[4] = {1, 1, 0, 0}, vsync_after[4] = {1, 0, 0, 1};
+	island_t island = null_island();
+	blank_t<Mode> out{};
+	for(int v=0; v<4; v++)
+	{
+		for(int i=0; i<blank; i++)
+		{
+			int hsync = (i>=Mode::h_front && i<Mode::h_front+Mode::h_pulse) ? 0 : 1;
+			int vsync = i<Mode::h_front ? vsync_before[v] : vsync_after[v];
+			int sync = (vsync<<1)|hsync;
+			uint16_t ch0 = ctl_symbol[sync], ch1 = ctl_symbol[0], ch2 = ctl_symbol[0];
+			if(i>=blank-2)
+			{
+				ch0 = guard_symbol[0];
+				ch1 = guard_symbol[1];
+				ch2 = guard_symbol[0];
+			}
+			else if(i>=blank-10)
+				ch1 = ctl_symbol[1];
+			else if(Islands && i>=island_start-10 && i<island_start-2)
+			{
+				ch1 = ctl_symbol[1];
+				ch2 = ctl_symbol[1];
+			}
+			else if(Islands && ((i>=island_start-2 && i<island_start) || (i>=island_end && i<island_end+2)))
+			{
+				ch0 = terc4_symbol[0x0c|sync];
+				ch1 = guard_symbol[1];
+				ch2 = guard_symbol[1];
+			}
+			else if(i>=island_start && i<island_end)
+			{
+				int pixel = (i-island_start)%ISLAND_PIXELS;
+				ch0 = terc4_symbol[island.nibble[0][pixel]|sync|(i==island_start ? 0 : 0x8)];
+				ch1 = terc4_symbol[island.nibble[1][pixel]];
+				ch2 = terc4_symbol[island.nibble[2][pixel]];
+			}
+			out.symbol[v][0][i] = ch0;
+			out.symbol[v][1][i] = ch1;
+			out.symbol[v][2][i] = ch2;
+		}
+	}
+	return out;
+}
+
+// The islands and their preambles and guard bands fit between the front porch and the video preamble, and the line
+// packs into whole words.
+template<class Mode, int Islands>
+constexpr bool blank_fits()
+{
+	constexpr int blank = blank_t<Mode>::symbols;
+	return blank%16==0 && Islands>=0 && (!Islands ||
+		(Mode::h_front>=10 && Mode::h_front+ISLAND_PIXELS*Islands+2<=blank-10));
+}
+
+// A code of the control period or a data island: control, guard band or TERC4 symbol
+constexpr bool blank_symbol(uint16_t symbol)
+{
+	for(int i=0; i<4; i++)
+	{
+		if(symbol==ctl_symbol[i])
+			return true;
+	}
+	for(int i=0; i<16; i++)
+	{
+		if(symbol==terc4_symbol[i])
+			return true;
+	}
+	return symbol==guard_symbol[0] || symbol==guard_symbol[1];
+}
+
+// Every symbol of a blanking line is one of the codes above, and channels 1 and 2 add nothing to the DC offset (all
+// their codes have 5 ones.) Channel 0 can't: the control symbols with vsync high (0x154, 0x2ab) are -2 and +2, so its
+// balance follows the sync and is left to the coupling capacitors like on any other source.
+template<class Mode>
+constexpr bool blank_balanced(const blank_t<Mode> &b)
+{
+	for(int v=0; v<4; v++)
+	{
+		for(int ch=0; ch<3; ch++)
+		{
+			int sum = 0;
+			for(int i=0; i<blank_t<Mode>::symbols; i++)
+			{
+				if(!blank_symbol(b.symbol[v][ch][i]))
+					return false;
+				sum += balance(b.symbol[v][ch][i]);
+			}
+			if(ch && sum)
+				return false;
+		}
+	}
+	return true;
+}
+
+// pack_buffer_single(): count symbols (a multiple of 16), 10 bits each, LSB first
+constexpr void pack(const uint16_t *symbols, uint32_t *out, int count)
+{
+	for(int i=0; i<count*10/32; i++)
+		out[i] = 0;
+	for(int i=0; i<count; i++)
+	{
+		int bit = 10*i;
+		out[bit/32] |= (uint32_t)symbols[i]<<(bit%32);
+		if(bit%32>22)
+			out[bit/32+1] |= (uint32_t)symbols[i]>>(32-bit%32);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*
+	vga_output.c
+
+	Firmware side of the VGA output (see vga_output.h.)
+	The 3 state machines are SM 0-2 of the PIO the TMDS lanes would be on, and get their counts with pio_sm_exec()
+	before they all start together. GP13 can't be the optional clock output with VGA on.
+
+	There are 2 line buffers, and each has VGA_LINE_REPEAT control blocks that all send it to the TX FIFO of
+	vga_out_9bpp. Like in blank_spans.c, the control channel writes them into the data channel one by one, and the last
+	one doesn't chain and raises DMA_IRQ_0 instead. The IRQ handler points the control channel at the blocks of the
+	other buffer, which has the next line already, and then converts the line after that into the buffer that was just
+	sent. Only the restart has a deadline: the FIFO and the blanking give it vga_sim's IRQ slack (1379 cycles.)
+	The conversion has all the time the other buffer takes to go out, 3 lines.
+
+	Frames come from the capture manager like for the TMDS encoder, so the output only shows whole frames. It has to be
+	the GBA's 240x160 in one of the vga_output.h formats; DMG frames (lcd_capture_dmg) aren't converted.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/irq.h"
+#include "capture_manager.h"
+#include "vga_output.h"
+#include "vga_output_9bpp.pio.h"
+
+#if __has_include("clock_config.h")
+#include "clock_config.h"
+#else
+// The modeline of tmds_util.h
+#define MODE_H_ACTIVE 720
+#define MODE_H_FRONT 32
+#define MODE_H_PULSE 64
+#define MODE_H_BACK 96
+#define MODE_V_ACTIVE 480
+#define MODE_V_FRONT 13
+#define MODE_V_PULSE 8
+#define MODE_V_BACK 38
+#endif
+
+#if CAPTURE_LINE_WORDS!=VGA_LINE_PIXELS/2
+#error "The VGA output needs 2 pixels per framebuffer word"
+#endif
+
+#define VGA_SM_HSYNC 0
+#define VGA_SM_VSYNC 1
+#define VGA_SM_PIXELS 2
+
+static struct vga_palette_t vga_palette;
+static uint32_t vga_line_buf[2][VGA_LINE_WORDS];
+static struct dma_ctrl_block_t vga_blocks[2][VGA_LINE_REPEAT];
+static struct capture_manager_t *vga_capture;
+static const uint32_t *vga_frame;
+static int vga_frame_format, vga_source;
+static int vga_sending; // line buffer the DMA is on
+static int vga_next_line; // next framebuffer line to convert
+static uint vga_data_chan, vga_ctrl_chan;
+
+// Converts the next framebuffer line into line buffer b.
+static void __not_in_flash_func(vga_convert_next)(int b)
+{
+	if(vga_next_line==0)
+		vga_frame = capture_frame_begin(vga_capture, &vga_frame_format);
+	capture_frame_line(vga_capture, vga_next_line);
+	const uint32_t *line = vga_frame+vga_next_line*CAPTURE_LINE_WORDS;
+	if(vga_frame_format==CAPTURE_FORMAT_NONE)
+		memset(vga_line_buf[b], 0, sizeof(vga_line_buf[b]));
+	else if(vga_source==VGA_SOURCE_10BPP)
+		vga_convert_line_10(line, vga_line_buf[b]);
+	else
+		vga_convert_line(&vga_palette, line, vga_line_buf[b]);
+	if(++vga_next_line==CAPTURE_HEIGHT)
+	{
+		capture_frame_end(vga_capture);
+		vga_next_line = 0;
+	}
+}
+
+static void __not_in_flash_func(vga_line_irq)(void)
+{
+	dma_hw->ints0 = 1u<<vga_data_chan;
+	vga_sending ^= 1;
+	dma_channel_set_read_addr(vga_ctrl_chan, vga_blocks[vga_sending], true);
+	vga_convert_next(vga_sending^1);
+}
+
+// Puts value into dest (ISR, OSR or Y) of a stopped state machine, through its TX FIFO and the OSR.
+static void vga_sm_set(PIO pio, uint sm, uint32_t value, enum pio_src_dest dest)
+{
+	pio_sm_put_blocking(pio, sm, value);
+	pio_sm_exec(pio, sm, pio_encode_pull(false, true));
+	if(dest!=pio_osr)
+		pio_sm_exec(pio, sm, pio_encode_mov(dest, pio_osr));
+}
+
+// Starts the output, with frames from capture (set up with capture_init()) in format source. The system clock has
+// to be VGA_SYS_CLOCK_KHZ. Returns false if the modeline doesn't work with the programs.
+bool vga_output_start(uint32_t pio_index, uint32_t data_chan, uint32_t ctrl_chan, struct capture_manager_t *capture,
+	int source)
+{
+	static const struct vga_mode_t mode = {MODE_H_ACTIVE, MODE_H_FRONT, MODE_H_PULSE, MODE_H_BACK,
+		MODE_V_ACTIVE, MODE_V_FRONT, MODE_V_PULSE, MODE_V_BACK};
+	struct vga_timing_t t;
+	if(!vga_timing_init(&t, &mode))
+		return false;
+	PIO pio = pio_index ? pio1 : pio0;
+	vga_capture = capture;
+	vga_source = source;
+	vga_data_chan = data_chan;
+	vga_ctrl_chan = ctrl_chan;
+	vga_palette_init(&vga_palette);
+
+	for(uint pin=VGA_DATA_PIN; pin<=VGA_VSYNC_PIN; pin++)
+		pio_gpio_init(pio, pin);
+
+	// Syncs are idle high before anything starts, data is black.
+	uint offset = pio_add_program(pio, &vga_hsync_program);
+	pio_sm_config c = vga_hsync_program_get_default_config(offset);
+	sm_config_set_sideset_pins(&c, VGA_HSYNC_PIN);
+	sm_config_set_clkdiv_int_frac(&c, VGA_CYCLES_PER_DOT, 0);
+	pio_sm_init(pio, VGA_SM_HSYNC, offset, &c);
+	pio_sm_set_pins_with_mask(pio, VGA_SM_HSYNC, 1u<<VGA_HSYNC_PIN, 1u<<VGA_HSYNC_PIN);
+	pio_sm_set_consecutive_pindirs(pio, VGA_SM_HSYNC, VGA_HSYNC_PIN, 1, true);
+	vga_sm_set(pio, VGA_SM_HSYNC, t.hsync_isr, pio_isr);
+	vga_sm_set(pio, VGA_SM_HSYNC, t.hsync_osr, pio_osr);
+
+	offset = pio_add_program(pio, &vga_vsync_program);
+	c = vga_vsync_program_get_default_config(offset);
+	sm_config_set_sideset_pins(&c, VGA_VSYNC_PIN);
+	sm_config_set_clkdiv_int_frac(&c, VGA_CYCLES_PER_DOT, 0);
+	pio_sm_init(pio, VGA_SM_VSYNC, offset, &c);
+	pio_sm_set_pins_with_mask(pio, VGA_SM_VSYNC, 1u<<VGA_VSYNC_PIN, 1u<<VGA_VSYNC_PIN);
+	pio_sm_set_consecutive_pindirs(pio, VGA_SM_VSYNC, VGA_VSYNC_PIN, 1, true);
+	vga_sm_set(pio, VGA_SM_VSYNC, t.vsync_isr, pio_isr);
+	vga_sm_set(pio, VGA_SM_VSYNC, t.vsync_y, pio_y);
+
+	offset = pio_add_program(pio, &vga_out_9bpp_program);
+	c = vga_out_9bpp_program_get_default_config(offset);
+	sm_config_set_out_pins(&c, VGA_DATA_PIN, VGA_DATA_BITS);
+	sm_config_set_out_shift(&c, true, true, VGA_PIXELS_PER_WORD*VGA_DATA_BITS);
+	sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+	sm_config_set_clkdiv_int_frac(&c, VGA_CYCLES_PER_DOT, 0);
+	pio_sm_init(pio, VGA_SM_PIXELS, offset, &c);
+	pio_sm_set_pins_with_mask(pio, VGA_SM_PIXELS, 0, ((1u<<VGA_DATA_BITS)-1)<<VGA_DATA_PIN);
+	pio_sm_set_consecutive_pindirs(pio, VGA_SM_PIXELS, VGA_DATA_PIN, VGA_DATA_BITS, true);
+	vga_sm_set(pio, VGA_SM_PIXELS, t.pixel_isr, pio_isr);
+	vga_sm_set(pio, VGA_SM_PIXELS, t.pixel_y, pio_y);
+	// Empties the OSR, so the first OUT pulls the first pixels
+	pio_sm_exec(pio, VGA_SM_PIXELS, pio_encode_out(pio_null, 32));
+
+	// Data channel: all of its settings come from the control blocks
+	dma_channel_config d = dma_channel_get_default_config(data_chan);
+	channel_config_set_transfer_data_size(&d, DMA_SIZE_32);
+	channel_config_set_read_increment(&d, true);
+	channel_config_set_write_increment(&d, false);
+	channel_config_set_dreq(&d, pio_get_dreq(pio, VGA_SM_PIXELS, true));
+	channel_config_set_chain_to(&d, ctrl_chan);
+	channel_config_set_irq_quiet(&d, true);
+	uint32_t ctrl_chain = channel_config_get_ctrl_value(&d);
+	// Chaining to itself means no chain
+	channel_config_set_chain_to(&d, data_chan);
+	channel_config_set_irq_quiet(&d, false);
+	uint32_t ctrl_last = channel_config_get_ctrl_value(&d);
+	for(int b=0; b<2; b++)
+	{
+		for(int r=0; r<VGA_LINE_REPEAT; r++)
+		{
+			struct dma_ctrl_block_t *block = &vga_blocks[b][r];
+			block->read_addr = vga_line_buf[b];
+			block->write_addr = &pio->txf[VGA_SM_PIXELS];
+			block->transfer_count = VGA_LINE_WORDS;
+			block->ctrl = r==VGA_LINE_REPEAT-1 ? ctrl_last : ctrl_chain;
+		}
+	}
+
+	// Control channel: 4 words per block into READ_ADDR, WRITE_ADDR, TRANS_COUNT and CTRL_TRIG of the data channel
+	d = dma_channel_get_default_config(ctrl_chan);
+	channel_config_set_transfer_data_size(&d, DMA_SIZE_32);
+	channel_config_set_read_increment(&d, true);
+	channel_config_set_write_increment(&d, true);
+	channel_config_set_ring(&d, true, 4);
+	dma_channel_configure(ctrl_chan, &d, &dma_hw->ch[data_chan].read_addr, NULL, 4, false);
+	dma_channel_set_irq0_enabled(data_chan, true);
+	irq_set_exclusive_handler(DMA_IRQ_0, vga_line_irq);
+	irq_set_enabled(DMA_IRQ_0, true);
+
+	vga_next_line = 0;
+	vga_convert_next(0);
+	vga_convert_next(1);
+	vga_sending = 0;
+	// The FIFO fills up before the state machines start, and the frame starts with the first active line.
+	dma_channel_set_read_addr(ctrl_chan, vga_blocks[0], true);
+	pio_enable_sm_mask_in_sync(pio, (1u<<VGA_SM_HSYNC)|(1u<<VGA_SM_VSYNC)|(1u<<VGA_SM_PIXELS));
+
+	return true;
+}
@@ -0,0 +1,149 @@
+/*
+	vga_output.h
+
+	VGA output, for CRTs and scalers, as a fallback to HDMI that runs at half the clock. It's the same modeline as the
+	HDMI output (MODE_* from clock_config.h), but a dot is VGA_CYCLES_PER_DOT system clocks instead of 10, so 147MHz
+	instead of 294MHz, which needs no more than the default core voltage (1.10V, see clock_planner.c.)
+
+	vga_output_9bpp.pio has 3 state machines: vga_hsync makes the lines and raises an IRQ at every hsync leading edge,
+	vga_vsync counts them, drives vsync and passes the IRQ on for the active lines only, and vga_out_9bpp sends the
+	pixels of an active line from its TX FIFO and is black the rest of the time. All the timing is in the PIO, so the
+	DMA only has to keep the FIFO from running dry: every output line is VGA_LINE_WORDS words of 3 pixels (10 bits each,
+	bits 0-2 red, 3-6 green, 7-9 blue), and each input line goes out VGA_LINE_REPEAT times from the same line buffer.
+
+	The pixels come from a framebuffer in one of 2 formats, both 2 pixels per word with the older one in the upper
+	half-word:
+	-RGB555 (lcd_capture): every pixel goes through the palette table, which takes each 5-bit channel to the nearest
+	 of the 8 or 16 levels the resistor DAC has. A table for all 32768 colors would be 64KB, so it's split: red and
+	 green by the low 10 bits, blue by the top 5 (2112 bytes.)
+	-10 bits (lcd_cap_9bpp): the capture's GP0-GP9 are wired in the same order as the output, so it's only repacked.
+
+	The DMA and the state machines are set up by vga_output.c.
+*/
+
+#ifndef VGA_OUTPUT_H
+#define VGA_OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "blank_spans.h"
+
+#define VGA_DATA_PIN 13
+#define VGA_DATA_BITS 10
+#define VGA_HSYNC_PIN 23
+#define VGA_VSYNC_PIN 24
+#define VGA_CYCLES_PER_DOT 5
+#define VGA_SYS_CLOCK_KHZ 147000
+
+#define VGA_LINE_PIXELS 240
+#define VGA_PIXELS_PER_WORD 3
+#define VGA_LINE_WORDS (VGA_LINE_PIXELS/VGA_PIXELS_PER_WORD)
+#define VGA_LINE_REPEAT 3
+#define VGA_LINE_DOTS (VGA_LINE_PIXELS*VGA_LINE_REPEAT)
+
+// Bits per channel of the output, and where they go
+#define VGA_RED_BITS 3
+#define VGA_GREEN_BITS 4
+#define VGA_BLUE_BITS 3
+#define VGA_RED_SHIFT 0
+#define VGA_GREEN_SHIFT 3
+#define VGA_BLUE_SHIFT 7
+
+// Framebuffer formats
+enum vga_source_t
+{
+	VGA_SOURCE_RGB555,
+	VGA_SOURCE_10BPP
+};
+
+struct vga_mode_t
+{
+	int h_active, h_front, h_pulse, h_back;
+	int v_active, v_front, v_pulse, v_back;
+};
+
+// Register values of the 3 state machines (see vga_output_9bpp.pio)
+struct vga_timing_t
+{
+	uint32_t hsync_isr, hsync_osr;
+	uint32_t vsync_isr, vsync_y;
+	uint32_t pixel_isr, pixel_y;
+	int h_total, v_total;
+	int first_dot; // dots from the hsync leading edge to the first pixel
+};
+
+struct vga_palette_t
+{
+	uint16_t rg[1024]; // red and green, by bits 0-9 of the RGB555 pixel
+	uint16_t b[32]; // blue, by bits 10-14
+};
+
+// Works out the register values for mode. Returns false if the active area isn't VGA_LINE_DOTS wide, or a count is
+// too short or long for the programs.
+static inline bool vga_timing_init(struct vga_timing_t *t, const struct vga_mode_t *m)
+{
+	if(m->h_active!=VGA_LINE_DOTS || m->h_pulse<3 || m->h_pulse+m->h_back<8 || m->v_active<1 || m->v_front<1 ||
+		m->v_pulse<1 || m->v_back<1 || m->v_active>0x10000 || m->v_front>0x10000 || m->v_pulse>0x10000 || m->v_back>0x10000)
+		return false;
+	t->h_total = m->h_active+m->h_front+m->h_pulse+m->h_back;
+	t->v_total = m->v_active+m->v_front+m->v_pulse+m->v_back;
+	// The line is laid out pulse, back porch, active, front porch
+	t->hsync_isr = (uint32_t)(m->h_pulse-3);
+	t->hsync_osr = (uint32_t)(t->h_total-m->h_pulse-2);
+	t->vsync_isr = (uint32_t)(m->v_active-1)|((uint32_t)(m->v_front-1)<<16);
+	t->vsync_y = (uint32_t)(m->v_pulse-1)|((uint32_t)(m->v_back-1)<<16);
+	t->first_dot = m->h_pulse+m->h_back;
+	t->pixel_isr = (uint32_t)(t->first_dot-8);
+	t->pixel_y = VGA_LINE_PIXELS-1;
+	return true;
+}
+
+// Nearest of the levels of a channel with bits bits, for a 5-bit value.
+static inline uint16_t vga_level(int value, int bits)
+{
+	return (uint16_t)((value*((1<<bits)-1)+15)/31);
+}
+
+static inline void vga_palette_init(struct vga_palette_t *p)
+{
+	for(int i=0; i<1024; i++)
+		p->rg[i] = (uint16_t)((vga_level(i&0x1f, VGA_RED_BITS)<<VGA_RED_SHIFT)|(vga_level(i>>5, VGA_GREEN_BITS)<<VGA_GREEN_SHIFT));
+	for(int i=0; i<32; i++)
+		p->b[i] = (uint16_t)(vga_level(i, VGA_BLUE_BITS)<<VGA_BLUE_SHIFT);
+}
+
+static inline uint32_t vga_pixel(const struct vga_palette_t *p, uint32_t pixel)
+{
+	return (uint32_t)p->rg[pixel&0x3ff]|p->b[(pixel>>10)&0x1f];
+}
+
+// One RGB555 framebuffer line (VGA_LINE_PIXELS/2 words) to VGA_LINE_WORDS words: 3 framebuffer words are 2 output words.
+static inline void vga_convert_line(const struct vga_palette_t *p, const uint32_t *fb_line, uint32_t *out)
+{
+	for(int i=0; i<VGA_LINE_WORDS; i+=2)
+	{
+		uint32_t a = fb_line[0], b = fb_line[1], c = fb_line[2];
+		fb_line += 3;
+		out[i] = vga_pixel(p, a>>16)|(vga_pixel(p, a)<<10)|(vga_pixel(p, b>>16)<<20);
+		out[i+1] = vga_pixel(p, b)|(vga_pixel(p, c>>16)<<10)|(vga_pixel(p, c)<<20);
+	}
+}
+
+// Same for a line of lcd_cap_9bpp, which already is 10 bits per pixel.
+static inline void vga_convert_line_10(const uint32_t *fb_line, uint32_t *out)
+{
+	for(int i=0; i<VGA_LINE_WORDS; i+=2)
+	{
+		uint32_t a = fb_line[0], b = fb_line[1], c = fb_line[2];
+		fb_line += 3;
+		out[i] = ((a>>16)&0x3ff)|((a&0x3ff)<<10)|(((b>>16)&0x3ff)<<20);
+		out[i+1] = (b&0x3ff)|(((c>>16)&0x3ff)<<10)|((c&0x3ff)<<20);
+	}
+}
+
+// Firmware side (vga_output.c)
+struct capture_manager_t;
+bool vga_output_start(uint32_t pio_index, uint32_t data_chan, uint32_t ctrl_chan, struct capture_manager_t *capture,
+	int source);
+
+#endif